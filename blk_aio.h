@@ -0,0 +1,592 @@
+/*
+
+    Asynchronous block target: a disk or file written with several
+    requests in flight.
+
+    Windows queues overlapped writes on one handle. Elsewhere a thread
+    per slot issues pwrite, which keeps the same number of requests at
+    the device without a kernel AIO dependency. Either way the caller
+    takes the next free slot, fills its buffer and submits it; slots are
+    reused in turn, so a sequential writer never waits for more than the
+    oldest request.
+
+    Ranges that should read as zero can be unmapped instead of written:
+    TRIM on a disk, a punched hole in a file.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#endif
+
+#include "blk_io.h"
+
+namespace wde2
+{
+    namespace blk
+    {
+        //-----------------------------------------------------------------------------
+        class AsyncTarget
+        {
+        public:
+            struct Slot
+            {
+                AlignedBuffer buffer;
+                uint64_t offset = 0;
+                size_t length = 0;
+                bool busy = false;
+                bool ok = true;
+#ifdef _WIN32
+                OVERLAPPED ov{ 0 };
+#endif
+                explicit Slot(size_t size) : buffer(size) {}
+            };
+
+        private:
+            std::vector<std::unique_ptr<Slot>> m_slots;
+            size_t m_next = 0;
+            uint64_t m_size = 0;
+            DWORD m_sectorSize = 512;
+            bool m_device = false;
+            bool m_created = false;
+            std::atomic<bool> m_failed{ false };
+#ifdef _WIN32
+            HANDLE m_handle = INVALID_HANDLE_VALUE;
+            // of a disk, from IOCTL_STORAGE_GET_DEVICE_NUMBER
+            DWORD m_deviceNumber = (DWORD)-1;
+            // locked and dismounted by lockVolumes(), released by close()
+            std::vector<HANDLE> m_volumes;
+
+            // true if any extent of the volume is on 'disk'
+            static bool onDisk(HANDLE volume, DWORD disk)
+            {
+                // a volume spanning more disks than this is not worth the bother
+                BYTE buffer[sizeof(VOLUME_DISK_EXTENTS) + 31 * sizeof(DISK_EXTENT)];
+                DWORD n = 0;
+                if (!::DeviceIoControl(volume, IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS, NULL, 0, buffer, sizeof(buffer), &n, NULL)) {
+                    return false;
+                }
+                const VOLUME_DISK_EXTENTS* extents = (const VOLUME_DISK_EXTENTS*)buffer;
+                for (DWORD i = 0; i < extents->NumberOfDiskExtents && i < 32; i++)
+                {
+                    if (extents->Extents[i].DiskNumber == disk) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // \\?\Volume{...}\ to a handle on the volume, not its root directory
+            static HANDLE openVolume(std::wstring name, DWORD access)
+            {
+                if (!name.empty() && name.back() == L'\\') {
+                    name.pop_back();
+                }
+                return ::CreateFileW(name.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+            }
+
+            // DeviceIoControl on an overlapped handle
+            bool control(DWORD code, void* in, DWORD inLength, void* out, DWORD outLength)
+            {
+                OVERLAPPED ov{ 0 };
+                ov.hEvent = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+                DWORD n = 0;
+                BOOL ok = ::DeviceIoControl(m_handle, code, in, inLength, out, outLength, &n, &ov);
+                if (!ok && ::GetLastError() == ERROR_IO_PENDING) {
+                    ok = ::GetOverlappedResult(m_handle, &ov, &n, TRUE);
+                }
+                ::CloseHandle(ov.hEvent);
+                return ok != FALSE;
+            }
+#else
+            int m_fd = -1;
+            std::filesystem::path m_path;
+            // O_EXCL on a block device fails while anything on it is mounted
+            int m_exclusive = -1;
+            std::mutex m_lock;
+            std::condition_variable m_changed;
+            std::deque<Slot*> m_queue;
+            std::vector<std::thread> m_threads;
+            bool m_stop = false;
+
+            void work()
+            {
+                std::unique_lock<std::mutex> g(m_lock);
+                while (true)
+                {
+                    m_changed.wait(g, [&] { return m_stop || !m_queue.empty(); });
+                    if (m_queue.empty()) {
+                        return;
+                    }
+                    Slot* s = m_queue.front();
+                    m_queue.pop_front();
+                    g.unlock();
+                    const BYTE* p = s->buffer.data();
+                    uint64_t offset = s->offset;
+                    size_t length = s->length;
+                    bool ok = true;
+                    while (length)
+                    {
+                        ssize_t n = ::pwrite(m_fd, p, length, (off_t)offset);
+                        if (n < 0 && errno == EINTR) {
+                            continue;
+                        }
+                        if (n <= 0)
+                        {
+                            ok = false;
+                            break;
+                        }
+                        p += n;
+                        offset += (uint64_t)n;
+                        length -= (size_t)n;
+                    }
+                    g.lock();
+                    s->ok = ok;
+                    s->busy = false;
+                    m_changed.notify_all();
+                }
+            }
+#endif
+
+            // until the slot's request, if any, has completed
+            bool wait(Slot& s)
+            {
+#ifdef _WIN32
+                if (s.busy)
+                {
+                    DWORD n = 0;
+                    s.ok = ::GetOverlappedResult(m_handle, &s.ov, &n, TRUE) && n == s.length;
+                    s.busy = false;
+                }
+#else
+                std::unique_lock<std::mutex> g(m_lock);
+                m_changed.wait(g, [&] { return !s.busy; });
+#endif
+                if (!s.ok) {
+                    m_failed = true;
+                }
+                return s.ok;
+            }
+
+        public:
+            // 'depth' requests of up to 'blockSize' bytes each
+            AsyncTarget(size_t blockSize, size_t depth = 8)
+            {
+                for (size_t i = 0; i < (std::max)(depth, (size_t)1); i++)
+                {
+                    m_slots.emplace_back(new Slot(blockSize));
+#ifdef _WIN32
+                    m_slots.back()->ov.hEvent = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+#endif
+                }
+            }
+
+            ~AsyncTarget()
+            {
+                close();
+#ifdef _WIN32
+                for (auto& s : m_slots) {
+                    ::CloseHandle(s->ov.hEvent);
+                }
+#endif
+            }
+
+            AsyncTarget(const AsyncTarget&) = delete;
+            AsyncTarget& operator=(const AsyncTarget&) = delete;
+
+            // an existing disk, or a file that is created or resized to 'fileSize'
+            bool open(const std::filesystem::path& path, uint64_t fileSize = 0)
+            {
+#ifdef _WIN32
+                m_device = path.wstring().rfind(L"\\\\.\\", 0) == 0;
+                m_handle = ::CreateFileW(path.c_str(),
+                                        GENERIC_READ | GENERIC_WRITE,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                        NULL,
+                                        m_device ? OPEN_EXISTING : OPEN_ALWAYS,
+                                        FILE_FLAG_OVERLAPPED,
+                                        NULL);
+                if (m_handle == INVALID_HANDLE_VALUE) {
+                    return false;
+                }
+                if (m_device)
+                {
+                    GET_LENGTH_INFORMATION gli{ 0 };
+                    DISK_GEOMETRY_EX geom{ 0 };
+                    STORAGE_DEVICE_NUMBER number{};
+                    if (control(IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &gli, sizeof(gli))) {
+                        m_size = (uint64_t)gli.Length.QuadPart;
+                    }
+                    if (control(IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0, &geom, sizeof(geom))) {
+                        m_sectorSize = geom.Geometry.BytesPerSector;
+                    }
+                    if (control(IOCTL_STORAGE_GET_DEVICE_NUMBER, NULL, 0, &number, sizeof(number))) {
+                        m_deviceNumber = number.DeviceNumber;
+                    }
+                    return m_size != 0;
+                }
+                m_created = ::GetLastError() != ERROR_ALREADY_EXISTS;
+                // so that unmapped ranges take no space
+                if (m_created) {
+                    control(FSCTL_SET_SPARSE, NULL, 0, NULL, 0);
+                }
+                FILE_END_OF_FILE_INFO eof;
+                eof.EndOfFile.QuadPart = (LONGLONG)fileSize;
+                if (!::SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &eof, sizeof(eof))) {
+                    return false;
+                }
+                m_size = fileSize;
+                return true;
+#else
+                // a mistyped device name must not turn into a file under /dev
+                bool file = path.native().rfind("/dev/", 0) != 0;
+                m_created = file && !std::filesystem::exists(path);
+                m_path = path;
+                m_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (file ? O_CREAT : 0), 0644);
+                if (m_fd < 0) {
+                    return false;
+                }
+                struct stat st;
+                m_device = ::fstat(m_fd, &st) == 0 && S_ISBLK(st.st_mode);
+                if (m_device)
+                {
+                    unsigned long long bytes = 0;
+                    int ssz = 0;
+                    if (::ioctl(m_fd, BLKGETSIZE64, &bytes) == 0) {
+                        m_size = bytes;
+                    }
+                    if (::ioctl(m_fd, BLKSSZGET, &ssz) == 0 && ssz >= 512) {
+                        m_sectorSize = (DWORD)ssz;
+                    }
+                }
+                else
+                {
+                    if (::ftruncate(m_fd, (off_t)fileSize) != 0) {
+                        return false;
+                    }
+                    m_size = fileSize;
+                }
+                for (size_t i = 0; i < m_slots.size(); i++) {
+                    m_threads.emplace_back([this]() { work(); });
+                }
+                return m_size != 0;
+#endif
+            }
+
+            // a disk Windows boots or runs from: disk 0, as w32_sig.h assumes, or
+            // the disk holding the Windows directory. Elsewhere a mounted root
+            // fails lockVolumes() instead
+            bool holdsSystem() const
+            {
+#ifdef _WIN32
+                if (!m_device) {
+                    return false;
+                }
+                if (m_deviceNumber == 0 || m_deviceNumber == (DWORD)-1) {
+                    return true;
+                }
+                wchar_t directory[MAX_PATH] = { 0 };
+                wchar_t mount[MAX_PATH] = { 0 };
+                wchar_t volume[MAX_PATH] = { 0 };
+                if (!::GetSystemWindowsDirectoryW(directory, MAX_PATH)
+                    || !::GetVolumePathNameW(directory, mount, MAX_PATH)
+                    || !::GetVolumeNameForVolumeMountPointW(mount, volume, MAX_PATH)) {
+                    // can't tell, so assume the worst
+                    return true;
+                }
+                HANDLE h = openVolume(volume, 0);
+                if (h == INVALID_HANDLE_VALUE) {
+                    return true;
+                }
+                bool system = onDisk(h, m_deviceNumber);
+                ::CloseHandle(h);
+                return system;
+#else
+                return false;
+#endif
+            }
+
+            // before the first write to a disk: every volume on it locked and
+            // dismounted, so no file system writes behind us or refuses our
+            // writes halfway through. held until close(). false if any volume
+            // is in use
+            bool lockVolumes()
+            {
+                if (!m_device) {
+                    return true;
+                }
+#ifdef _WIN32
+                wchar_t name[MAX_PATH] = { 0 };
+                HANDLE find = ::FindFirstVolumeW(name, MAX_PATH);
+                if (find == INVALID_HANDLE_VALUE) {
+                    return false;
+                }
+                bool ok = true;
+                do
+                {
+                    HANDLE h = openVolume(name, GENERIC_READ | GENERIC_WRITE);
+                    // i.e. a card reader with no card
+                    if (h == INVALID_HANDLE_VALUE) {
+                        continue;
+                    }
+                    if (!onDisk(h, m_deviceNumber))
+                    {
+                        ::CloseHandle(h);
+                        continue;
+                    }
+                    DWORD n = 0;
+                    if (!::DeviceIoControl(h, FSCTL_LOCK_VOLUME, NULL, 0, NULL, 0, &n, NULL)
+                        || !::DeviceIoControl(h, FSCTL_DISMOUNT_VOLUME, NULL, 0, NULL, 0, &n, NULL))
+                    {
+                        ::CloseHandle(h);
+                        ok = false;
+                        break;
+                    }
+                    m_volumes.push_back(h);
+                } while (::FindNextVolumeW(find, name, MAX_PATH));
+                ::FindVolumeClose(find);
+                return ok;
+#else
+                if (m_exclusive < 0) {
+                    m_exclusive = ::open(m_path.c_str(), O_RDONLY | O_EXCL | O_CLOEXEC);
+                }
+                return m_exclusive >= 0;
+#endif
+            }
+
+            explicit operator bool() const
+            {
+#ifdef _WIN32
+                return m_handle != INVALID_HANDLE_VALUE;
+#else
+                return m_fd >= 0;
+#endif
+            }
+
+            uint64_t size() const { return m_size; }
+            DWORD sectorSize() const { return m_sectorSize; }
+            bool isDevice() const { return m_device; }
+            // a new file reads as zero throughout
+            bool created() const { return m_created; }
+            size_t blockSize() const { return m_slots[0]->buffer.size(); }
+            // false once any write has failed
+            bool ok() const { return !m_failed; }
+            // true if an unmapped range is guaranteed to read back as zero.
+            // Windows gives no such promise for TRIM
+            bool unmapReadsZero() const
+            {
+#ifdef _WIN32
+                return !m_device;
+#else
+                return true;
+#endif
+            }
+
+            // the next slot, once its previous request has completed
+            Slot& next()
+            {
+                Slot& s = *m_slots[m_next];
+                m_next = (m_next + 1) % m_slots.size();
+                wait(s);
+                return s;
+            }
+
+            // write the first 'length' bytes of the slot's buffer at 'offset'
+            bool submit(Slot& s, uint64_t offset, size_t length)
+            {
+                s.offset = offset;
+                s.length = length;
+                s.ok = true;
+                s.busy = true;
+#ifdef _WIN32
+                HANDLE event = s.ov.hEvent;
+                s.ov = OVERLAPPED{ 0 };
+                s.ov.hEvent = event;
+                s.ov.Offset = (DWORD)offset;
+                s.ov.OffsetHigh = (DWORD)(offset >> 32);
+                if (!::WriteFile(m_handle, s.buffer.data(), (DWORD)length, NULL, &s.ov) && ::GetLastError() != ERROR_IO_PENDING)
+                {
+                    s.busy = false;
+                    s.ok = false;
+                    m_failed = true;
+                }
+#else
+                std::lock_guard<std::mutex> g(m_lock);
+                m_queue.push_back(&s);
+                m_changed.notify_all();
+#endif
+                return !m_failed;
+            }
+
+            // synchronous. 'buffer' aligned as for unbuffered I/O
+            bool read(uint64_t offset, void* buffer, size_t length)
+            {
+#ifdef _WIN32
+                OVERLAPPED ov{ 0 };
+                ov.hEvent = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+                ov.Offset = (DWORD)offset;
+                ov.OffsetHigh = (DWORD)(offset >> 32);
+                DWORD n = 0;
+                BOOL ok = ::ReadFile(m_handle, buffer, (DWORD)length, NULL, &ov);
+                if (ok || ::GetLastError() == ERROR_IO_PENDING) {
+                    ok = ::GetOverlappedResult(m_handle, &ov, &n, TRUE);
+                }
+                ::CloseHandle(ov.hEvent);
+                return ok && n == length;
+#else
+                BYTE* p = (BYTE*)buffer;
+                while (length)
+                {
+                    ssize_t n = ::pread(m_fd, p, length, (off_t)offset);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        return false;
+                    }
+                    p += n;
+                    offset += (uint64_t)n;
+                    length -= (size_t)n;
+                }
+                return true;
+#endif
+            }
+
+            // TRIM a disk range, punch a hole in a file. false if the target
+            // cannot, in which case the caller writes zeros. sector aligned
+            bool unmap(uint64_t offset, uint64_t length)
+            {
+#ifdef _WIN32
+                if (m_device)
+                {
+                    struct
+                    {
+                        DEVICE_MANAGE_DATA_SET_ATTRIBUTES attributes;
+                        DEVICE_DATA_SET_RANGE range;
+                    } dsm;
+                    memset(&dsm, 0, sizeof(dsm));
+                    dsm.attributes.Size = sizeof(dsm.attributes);
+                    dsm.attributes.Action = DeviceDsmAction_Trim;
+                    dsm.attributes.DataSetRangesOffset = (DWORD)((BYTE*)&dsm.range - (BYTE*)&dsm);
+                    dsm.attributes.DataSetRangesLength = sizeof(dsm.range);
+                    dsm.range.StartingOffset = (LONGLONG)offset;
+                    dsm.range.LengthInBytes = length;
+                    return control(IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES, &dsm, sizeof(dsm), NULL, 0);
+                }
+                FILE_ZERO_DATA_INFORMATION zero;
+                zero.FileOffset.QuadPart = (LONGLONG)offset;
+                zero.BeyondFinalZero.QuadPart = (LONGLONG)(offset + length);
+                return control(FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), NULL, 0);
+#else
+                if (m_device)
+                {
+                    // zeroes the range, unmapping where the device can do so
+                    uint64_t range[2] = { offset, length };
+                    return ::ioctl(m_fd, BLKZEROOUT, range) == 0;
+                }
+                return ::fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)length) == 0;
+#endif
+            }
+
+            // every request complete and on stable storage
+            bool flush()
+            {
+                for (auto& s : m_slots) {
+                    wait(*s);
+                }
+#ifdef _WIN32
+                return ok() && ::FlushFileBuffers(m_handle) != FALSE;
+#else
+                return ok() && ::fsync(m_fd) == 0;
+#endif
+            }
+
+            void close()
+            {
+                if (!*this) {
+                    return;
+                }
+                for (auto& s : m_slots) {
+                    wait(*s);
+                }
+#ifdef _WIN32
+                // have Windows read the new partition table before the volumes come back
+                if (!m_volumes.empty()) {
+                    control(IOCTL_DISK_UPDATE_PROPERTIES, NULL, 0, NULL, 0);
+                }
+                for (HANDLE h : m_volumes) {
+                    ::CloseHandle(h);
+                }
+                m_volumes.clear();
+                ::CloseHandle(m_handle);
+                m_handle = INVALID_HANDLE_VALUE;
+#else
+                {
+                    std::lock_guard<std::mutex> g(m_lock);
+                    m_stop = true;
+                    m_changed.notify_all();
+                }
+                for (auto& t : m_threads) {
+                    t.join();
+                }
+                m_threads.clear();
+                if (m_exclusive >= 0)
+                {
+                    ::close(m_exclusive);
+                    m_exclusive = -1;
+                    // the new partition table, as the Windows side does
+                    ::ioctl(m_fd, BLKRRPART);
+                }
+                ::close(m_fd);
+                m_fd = -1;
+#endif
+            }
+        };
+    }
+}
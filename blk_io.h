@@ -0,0 +1,485 @@
+/*
+
+    Block sources: anything that can be read at a byte offset.
+
+    The partition table parser and image tooling read through this
+    interface so the same code runs against a physical drive, an
+    image file, a slice of either, or a buffer in memory.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#endif
+
+#include "structs.h"
+
+namespace wde2
+{
+    namespace blk
+    {
+        //-----------------------------------------------------------------------------
+        class BlockSource
+        {
+        public:
+            virtual ~BlockSource() {}
+            // bytes
+            virtual uint64_t size() const = 0;
+            // logical sector size if the source knows it, otherwise 512
+            virtual DWORD sectorSize() const { return 512; }
+            // exactly 'length' bytes at 'offset'. false on error or short read
+            virtual bool read(uint64_t offset, void* buffer, size_t length) = 0;
+        };
+
+        //-----------------------------------------------------------------------------
+        // caller owns the memory. 'size' may exceed 'length' to stand in
+        // for a disk of which only the leading bytes are at hand; reads past
+        // 'length' then fail.
+        class MemorySource : public BlockSource
+        {
+            const BYTE* m_data;
+            size_t m_length;
+            uint64_t m_size;
+            DWORD m_sectorSize;
+
+        public:
+            MemorySource(const void* data, size_t length, DWORD sectorSize = 512, uint64_t size = 0)
+                : m_data((const BYTE*)data), m_length(length),
+                  m_size(size ? size : length), m_sectorSize(sectorSize)
+            {
+            }
+            uint64_t size() const override { return m_size; }
+            DWORD sectorSize() const override { return m_sectorSize; }
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > m_length || length > m_length - offset) {
+                    return false;
+                }
+                memcpy(buffer, m_data + offset, length);
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // only the sectors written exist, the rest reads as zero. large
+        // synthetic disks at the cost of their metadata.
+        class SparseSource : public BlockSource
+        {
+            uint64_t m_size;
+            DWORD m_sectorSize;
+            // offset => sector
+            std::map<uint64_t, std::vector<BYTE>> m_sectors;
+
+        public:
+            SparseSource(uint64_t size, DWORD sectorSize = 512) : m_size(size), m_sectorSize(sectorSize) {}
+            uint64_t size() const override { return m_size; }
+            DWORD sectorSize() const override { return m_sectorSize; }
+
+            // whole sectors only, 'offset' sector aligned
+            void write(uint64_t offset, const void* data, size_t length)
+            {
+                const BYTE* p = (const BYTE*)data;
+                for (size_t done = 0; done < length; done += m_sectorSize)
+                {
+                    std::vector<BYTE>& s = m_sectors[offset + done];
+                    s.assign(m_sectorSize, 0);
+                    memcpy(s.data(), p + done, (std::min)((size_t)m_sectorSize, length - done));
+                }
+            }
+
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                BYTE* p = (BYTE*)buffer;
+                memset(p, 0, length);
+                uint64_t first = offset - (offset % m_sectorSize);
+                for (auto it = m_sectors.lower_bound(first); it != m_sectors.end() && it->first < offset + length; ++it)
+                {
+                    uint64_t s = (std::max)(it->first, offset);
+                    uint64_t e = (std::min)(it->first + m_sectorSize, offset + length);
+                    memcpy(p + (s - offset), it->second.data() + (s - it->first), (size_t)(e - s));
+                }
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // [offset, offset + length) of another source, i.e. a fixed VHD
+        // without its footer or a single partition
+        class SliceSource : public BlockSource
+        {
+            BlockSource& m_source;
+            uint64_t m_offset;
+            uint64_t m_length;
+
+        public:
+            SliceSource(BlockSource& source, uint64_t offset, uint64_t length)
+                : m_source(source), m_offset(offset), m_length(length)
+            {
+            }
+            uint64_t size() const override { return m_length; }
+            DWORD sectorSize() const override { return m_source.sectorSize(); }
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > m_length || length > m_length - offset) {
+                    return false;
+                }
+                return m_source.read(m_offset + offset, buffer, length);
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // another source with ranges of it read from elsewhere, i.e. a disk with
+        // its volumes read from their shadow copies. offset 0 of an overlay's
+        // source is 'start' of this one
+        class OverlaySource : public BlockSource
+        {
+            struct Overlay
+            {
+                uint64_t start = 0;
+                uint64_t length = 0;
+                BlockSource* source = nullptr;
+            };
+            BlockSource& m_base;
+            // by start, none overlapping
+            std::vector<Overlay> m_overlays;
+
+        public:
+            explicit OverlaySource(BlockSource& base) : m_base(base) {}
+            uint64_t size() const override { return m_base.size(); }
+            DWORD sectorSize() const override { return m_base.sectorSize(); }
+
+            // false if the range overlaps one added before or runs off the end
+            bool add(uint64_t start, uint64_t length, BlockSource& source)
+            {
+                if (start > size() || length > size() - start) {
+                    return false;
+                }
+                auto it = m_overlays.begin();
+                while (it != m_overlays.end() && it->start < start) {
+                    ++it;
+                }
+                if ((it != m_overlays.end() && start + length > it->start)
+                    || (it != m_overlays.begin() && (it - 1)->start + (it - 1)->length > start)) {
+                    return false;
+                }
+                Overlay o;
+                o.start = start;
+                o.length = length;
+                o.source = &source;
+                m_overlays.insert(it, o);
+                return true;
+            }
+
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > size() || length > size() - offset) {
+                    return false;
+                }
+                BYTE* p = (BYTE*)buffer;
+                while (length)
+                {
+                    // the overlay under 'offset', or where the next one starts
+                    const Overlay* in = nullptr;
+                    uint64_t end = size();
+                    for (const Overlay& o : m_overlays)
+                    {
+                        if (offset >= o.start && offset < o.start + o.length)
+                        {
+                            in = &o;
+                            end = o.start + o.length;
+                            break;
+                        }
+                        if (o.start > offset)
+                        {
+                            end = o.start;
+                            break;
+                        }
+                    }
+                    size_t n = (size_t)(std::min)((uint64_t)length, end - offset);
+                    if (!(in ? in->source->read(offset - in->start, p, n) : m_base.read(offset, p, n))) {
+                        return false;
+                    }
+                    p += n;
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // counts I/Os. for benchmarks and to keep parsers honest.
+        class CountingSource : public BlockSource
+        {
+            BlockSource& m_source;
+
+        public:
+            uint64_t reads = 0;
+            uint64_t bytes = 0;
+
+            explicit CountingSource(BlockSource& source) : m_source(source) {}
+            uint64_t size() const override { return m_source.size(); }
+            DWORD sectorSize() const override { return m_source.sectorSize(); }
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                reads++;
+                bytes += length;
+                return m_source.read(offset, buffer, length);
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // fails reads touching chosen sectors, i.e. to test error handling without
+        // an ageing disk. a sector fails its first 'failures' reads then reads
+        // normally, so both hard and intermittent errors can be staged.
+        class FaultySource : public BlockSource
+        {
+            BlockSource& m_source;
+            // sector offset => reads left to fail
+            std::map<uint64_t, uint32_t> m_faults;
+
+        public:
+            uint64_t reads = 0;
+            uint64_t failed = 0;
+
+            explicit FaultySource(BlockSource& source) : m_source(source) {}
+            uint64_t size() const override { return m_source.size(); }
+            DWORD sectorSize() const override { return m_source.sectorSize(); }
+
+            void fail(uint64_t offset, uint64_t length, uint32_t failures = 0xFFFFFFFF)
+            {
+                DWORD ss = m_source.sectorSize();
+                for (uint64_t s = offset - offset % ss; s < offset + length; s += ss) {
+                    m_faults[s] = failures;
+                }
+            }
+
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                reads++;
+                bool ok = true;
+                DWORD ss = m_source.sectorSize();
+                for (auto it = m_faults.lower_bound(offset - offset % ss); it != m_faults.end() && it->first < offset + length; ++it)
+                {
+                    if (it->second)
+                    {
+                        if (it->second != 0xFFFFFFFF) {
+                            it->second--;
+                        }
+                        ok = false;
+                    }
+                }
+                if (!ok) {
+                    failed++;
+                    return false;
+                }
+                return m_source.read(offset, buffer, length);
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // for unbuffered I/O: the memory, offsets and lengths must be sector aligned
+        class AlignedBuffer
+        {
+            BYTE* m_data = nullptr;
+            size_t m_size = 0;
+
+        public:
+            explicit AlignedBuffer(size_t size, size_t alignment = 4096) : m_size(size)
+            {
+#ifdef _WIN32
+                m_data = (BYTE*)::_aligned_malloc(size, alignment);
+#else
+                void* p = nullptr;
+                m_data = (::posix_memalign(&p, alignment, size) == 0) ? (BYTE*)p : nullptr;
+#endif
+                nv2::throw_if(!m_data, nv2::acc("Unable to allocate ") << size << " bytes");
+            }
+            ~AlignedBuffer()
+            {
+#ifdef _WIN32
+                ::_aligned_free(m_data);
+#else
+                ::free(m_data);
+#endif
+            }
+            AlignedBuffer(const AlignedBuffer&) = delete;
+            AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+            BYTE* data() { return m_data; }
+            const BYTE* data() const { return m_data; }
+            size_t size() const { return m_size; }
+        };
+
+        //-----------------------------------------------------------------------------
+        // read only file or device, i.e. an image or \\.\PhysicalDrive3 or /dev/sdb.
+        // Device reads must be sector aligned; callers read whole sectors.
+        class FileSource : public BlockSource
+        {
+            uint64_t m_size = 0;
+            DWORD m_sectorSize = 512;
+#ifdef _WIN32
+            HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+            int m_fd = -1;
+#endif
+
+        public:
+            explicit FileSource(const std::filesystem::path& path)
+            {
+#ifdef _WIN32
+                m_handle = ::CreateFileW(path.c_str(),
+                                        GENERIC_READ,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                        NULL,
+                                        OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL,
+                                        NULL);
+                if (m_handle == INVALID_HANDLE_VALUE) {
+                    return;
+                }
+                LARGE_INTEGER li{ 0 };
+                if (::GetFileSizeEx(m_handle, &li) && li.QuadPart) {
+                    m_size = (uint64_t)li.QuadPart;
+                }
+                else
+                {
+                    // devices report zero. ask the disk driver
+                    GET_LENGTH_INFORMATION gli{ 0 };
+                    DWORD bytesReturned = 0;
+                    if (DeviceIoControl(m_handle, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0,
+                                        &gli, sizeof(gli), &bytesReturned, NULL)) {
+                        m_size = (uint64_t)gli.Length.QuadPart;
+                    }
+                    DISK_GEOMETRY_EX geom{};
+                    if (DeviceIoControl(m_handle, IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0,
+                                        &geom, sizeof(geom), &bytesReturned, NULL)) {
+                        m_sectorSize = geom.Geometry.BytesPerSector;
+                    }
+                }
+#else
+                m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (m_fd < 0) {
+                    return;
+                }
+                struct stat st;
+                if (::fstat(m_fd, &st) == 0 && S_ISBLK(st.st_mode))
+                {
+                    unsigned long long bytes = 0;
+                    if (::ioctl(m_fd, BLKGETSIZE64, &bytes) == 0) {
+                        m_size = bytes;
+                    }
+                    int ssz = 0;
+                    if (::ioctl(m_fd, BLKSSZGET, &ssz) == 0 && ssz >= 512) {
+                        m_sectorSize = (DWORD)ssz;
+                    }
+                }
+                else if (::fstat(m_fd, &st) == 0) {
+                    m_size = (uint64_t)st.st_size;
+                }
+#endif
+            }
+
+            ~FileSource()
+            {
+#ifdef _WIN32
+                if (m_handle != INVALID_HANDLE_VALUE) {
+                    ::CloseHandle(m_handle);
+                }
+#else
+                if (m_fd >= 0) {
+                    ::close(m_fd);
+                }
+#endif
+            }
+
+            FileSource(const FileSource&) = delete;
+            FileSource& operator=(const FileSource&) = delete;
+
+            explicit operator bool() const
+            {
+#ifdef _WIN32
+                return m_handle != INVALID_HANDLE_VALUE;
+#else
+                return m_fd >= 0;
+#endif
+            }
+
+            uint64_t size() const override { return m_size; }
+            DWORD sectorSize() const override { return m_sectorSize; }
+
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                BYTE* p = (BYTE*)buffer;
+                while (length)
+                {
+#ifdef _WIN32
+                    OVERLAPPED ov{};
+                    ov.Offset = (DWORD)offset;
+                    ov.OffsetHigh = (DWORD)(offset >> 32);
+                    DWORD chunk = (DWORD)(std::min)(length, (size_t)(1u << 30));
+                    DWORD n = 0;
+                    if (!::ReadFile(m_handle, p, chunk, &n, &ov) || n == 0) {
+                        return false;
+                    }
+#else
+                    ssize_t n = ::pread(m_fd, p, length, (off_t)offset);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        return false;
+                    }
+#endif
+                    p += n;
+                    offset += (uint64_t)n;
+                    length -= (size_t)n;
+                }
+                return true;
+            }
+        };
+    }
+}
@@ -0,0 +1,945 @@
+/*
+
+    Differencing chains: merge a child into its parent, or flatten a chain.
+
+    A differencing VHD or VHDX holds only the blocks written since it was
+    created from its parent and reads the rest through it. Each level
+    here is read through its own BAT: a block is the parent's, zero, in
+    this file, or, in a differencing file, in this file sector by sector
+    as its bitmap says. The chain is walked newest first, one window of
+    the disk at a time, and stops as soon as every sector of the window
+    has an owner, so only the newest copy of a sector is ever read.
+
+    Only the BAT entries of the window are held, per level, with one
+    owner entry per 512 bytes of the window, so memory stays small
+    however deep the chain.
+
+    flatten() writes the chain as a new standalone image of any format
+    img::create() writes, front to back in one pass.
+
+    merge() writes the sectors the child holds into its parent in place,
+    again front to back. The parent may be a raw image, a fixed, dynamic
+    or differencing VHD, or a dynamic or differencing VHDX; blocks it
+    lacks are appended. The child is not changed, and reads the same
+    throughout, so an interrupted merge is simply run again. Once a VHDX
+    parent is complete its data write GUID is renewed, as the format
+    asks, so older children of it no longer open in Hyper-V.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "blk_io.h"
+#include "img_io.h"
+#include "img_write.h"
+
+namespace wde2
+{
+    namespace chain
+    {
+        // owners are tracked per 512 bytes, whatever the sector size
+        static const uint32_t _unit = 512;
+        static const uint16_t _unresolved = 0xFFFF;
+        static const uint16_t _zero = 0xFFFE;
+        static const size_t _maxDepth = 4096;
+        // BAT entries read at once for a block outside the window
+        static const uint64_t _ahead = 256;
+        // VHD parent locator platform codes: UTF-16 relative and absolute paths
+        static const uint32_t _vhdRelative = 0x57327275;   // 'W2ru'
+        static const uint32_t _vhdAbsolute = 0x57326B75;   // 'W2ku'
+
+        // a block as one level holds it
+        enum class State
+        {
+            Parent,
+            Zero,
+            Present,
+            // differencing: the sectors its bitmap sets
+            Partial,
+        };
+
+        static std::wstring utf16(const BYTE* p, size_t bytes, bool bigEndian)
+        {
+            std::wstring s;
+            for (size_t i = 0; i + 1 < bytes; i += 2)
+            {
+                wchar_t c = bigEndian ? (wchar_t)((p[i] << 8) | p[i + 1]) : (wchar_t)(p[i] | (p[i + 1] << 8));
+                if (!c) {
+                    break;
+                }
+                s += c;
+            }
+            return s;
+        }
+
+        // as the VHDX parent_linkage value has it: {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}
+        static std::wstring guidString(const BYTE* p)
+        {
+            wchar_t s[40];
+            swprintf(s, sizeof(s) / sizeof(s[0]), L"{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+                     img::le32(p), img::le16(p + 4), img::le16(p + 6), p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+            return s;
+        }
+
+        // a locator path, relative to the child's folder unless absolute
+        static std::filesystem::path locate(const std::filesystem::path& child, std::wstring name)
+        {
+#ifndef _WIN32
+            std::replace(name.begin(), name.end(), L'\\', L'/');
+#endif
+            std::filesystem::path p(name);
+            return (p.is_absolute() ? p : child.parent_path() / p).lexically_normal();
+        }
+
+        //-----------------------------------------------------------------------------
+        // one image of a chain, its BAT read a window at a time
+        class Level
+        {
+            std::filesystem::path m_path;
+            std::unique_ptr<blk::FileSource> m_file;
+            img::Kind m_kind = img::Kind::Raw;
+            uint64_t m_size = 0;
+            uint32_t m_sectorSize = 512;
+            // 0 for a raw image or fixed VHD: the file is the disk
+            uint32_t m_blockSize = 0;
+            bool m_differencing = false;
+            img::VhdLayout m_vhd;
+            img::VhdxLayout m_vhdx;
+            uint64_t m_chunkRatio = 0;
+            std::wstring m_parentLinkage;
+            // where to look for the parent, best first
+            std::vector<std::filesystem::path> m_parents;
+            // entries for blocks [m_first, m_first + m_bat.size()): VHD sectors or VHDX entries
+            uint64_t m_first = 0;
+            std::vector<uint64_t> m_bat;
+            // merge target only
+            img::OutputFile m_out;
+            bool m_writable = false;
+            // where the next block goes
+            uint64_t m_end = 0;
+            bool m_modified = false;
+
+            bool vhdx() const { return m_kind == img::Kind::Vhdx || m_kind == img::Kind::DifferencingVhdx; }
+
+            void findVhdParents()
+            {
+                std::vector<std::filesystem::path> absolute;
+                for (int i = 0; i < 8; i++)
+                {
+                    const BYTE* e = m_vhd.header + 576 + i * 24;
+                    uint32_t code = img::be32(e);
+                    uint32_t length = img::be32(e + 8);
+                    if ((code != _vhdRelative && code != _vhdAbsolute) || length == 0 || length > 64 * 1024) {
+                        continue;
+                    }
+                    std::vector<BYTE> data(length);
+                    if (m_file->read(img::be64(e + 16), data.data(), data.size()))
+                    {
+                        std::filesystem::path p = locate(m_path, utf16(data.data(), data.size(), false));
+                        (code == _vhdRelative ? m_parents : absolute).push_back(p);
+                    }
+                }
+                m_parents.insert(m_parents.end(), absolute.begin(), absolute.end());
+                // the parent's file name, tried beside the child last
+                std::wstring name = utf16(m_vhd.header + 64, 512, true);
+                if (name.size()) {
+                    m_parents.push_back(locate(m_path, std::filesystem::path(name).filename().wstring()));
+                }
+            }
+
+            void findVhdxParents()
+            {
+                const std::vector<BYTE>& v = m_vhdx.parentLocator;
+                std::filesystem::path relative, absolute, volume;
+                uint16_t count = v.size() >= 20 ? img::le16(v.data() + 18) : 0;
+                for (uint16_t i = 0; i < count && 20u + (i + 1) * 12u <= v.size(); i++)
+                {
+                    const BYTE* e = v.data() + 20 + i * 12;
+                    uint32_t keyOffset = img::le32(e);
+                    uint32_t valueOffset = img::le32(e + 4);
+                    uint16_t keyLength = img::le16(e + 8);
+                    uint16_t valueLength = img::le16(e + 10);
+                    if ((uint64_t)keyOffset + keyLength > v.size() || (uint64_t)valueOffset + valueLength > v.size()) {
+                        continue;
+                    }
+                    std::wstring key = utf16(v.data() + keyOffset, keyLength, false);
+                    std::wstring value = utf16(v.data() + valueOffset, valueLength, false);
+                    if (key == L"parent_linkage") {
+                        m_parentLinkage = value;
+                    }
+                    else if (key == L"relative_path") {
+                        relative = locate(m_path, value);
+                    }
+                    else if (key == L"absolute_win32_path") {
+                        absolute = locate(m_path, value);
+                    }
+                    else if (key == L"volume_path") {
+                        volume = locate(m_path, value);
+                    }
+                }
+                for (const std::filesystem::path& p : { relative, absolute, volume })
+                {
+                    if (!p.empty()) {
+                        m_parents.push_back(p);
+                    }
+                }
+            }
+
+            // BAT entries for blocks [first, first + count), unless already held
+            bool load(uint64_t first, uint64_t count)
+            {
+                if (first >= m_first && first + count <= m_first + m_bat.size()) {
+                    return true;
+                }
+                uint64_t blocks = (m_size + m_blockSize - 1) / m_blockSize;
+                count = (std::min)(count, blocks - first);
+                m_first = first;
+                m_bat.assign((size_t)count, 0);
+                if (!vhdx())
+                {
+                    std::vector<BYTE> raw((size_t)count * 4);
+                    if (!m_file->read(m_vhd.tableOffset + first * 4, raw.data(), raw.size())) {
+                        return false;
+                    }
+                    for (size_t i = 0; i < m_bat.size(); i++) {
+                        m_bat[i] = img::be32(raw.data() + i * 4);
+                    }
+                    return true;
+                }
+                // payload entries, with the sector bitmap entries between them
+                uint64_t last = first + count - 1;
+                uint64_t from = first + first / m_chunkRatio;
+                std::vector<BYTE> raw((size_t)(last + last / m_chunkRatio - from + 1) * 8);
+                if (!m_file->read(m_vhdx.batOffset + from * 8, raw.data(), raw.size())) {
+                    return false;
+                }
+                for (uint64_t b = first; b <= last; b++) {
+                    m_bat[(size_t)(b - first)] = img::le64(raw.data() + (b + b / m_chunkRatio - from) * 8);
+                }
+                return true;
+            }
+
+            uint64_t& entry(uint64_t block) { return m_bat[(size_t)(block - m_first)]; }
+
+            // and where its data starts in the file
+            State state(uint64_t entry, uint64_t& fileOffset) const
+            {
+                if (!vhdx())
+                {
+                    if (entry == img::_vhdUnallocated) {
+                        return m_differencing ? State::Parent : State::Zero;
+                    }
+                    fileOffset = entry * 512 + m_vhd.bitmapBytes;
+                    return m_differencing ? State::Partial : State::Present;
+                }
+                fileOffset = (entry >> 20) * img::_vhdxMB;
+                uint64_t s = entry & 7;
+                if (s == img::_vhdxFullyPresent) {
+                    return State::Present;
+                }
+                if (!m_differencing) {
+                    return State::Zero;
+                }
+                if (s == img::_vhdxPartiallyPresent) {
+                    return State::Partial;
+                }
+                return (s == img::_vhdxZero || s == img::_vhdxUnmapped) ? State::Zero : State::Parent;
+            }
+
+            bool writeEntry(uint64_t block, uint64_t value)
+            {
+                BYTE raw[8];
+                if (!vhdx())
+                {
+                    img::putBe32(raw, (uint32_t)value);
+                    return m_out.write(m_vhd.tableOffset + block * 4, raw, 4);
+                }
+                img::putLe64(raw, value);
+                return m_out.write(m_vhdx.batOffset + (block + block / m_chunkRatio) * 8, raw, 8);
+            }
+
+            // the file offset of a block's sector bitmap, and of its first bit.
+            // VHDX: 0 if the bitmap block is absent and 'allocate' is not set
+            bool bitmap(uint64_t block, uint64_t fileOffset, bool allocate, uint64_t& at, uint64_t& firstBit)
+            {
+                if (!vhdx())
+                {
+                    at = fileOffset - m_vhd.bitmapBytes;
+                    firstBit = 0;
+                    return true;
+                }
+                uint64_t chunk = block / m_chunkRatio;
+                uint64_t index = chunk * (m_chunkRatio + 1) + m_chunkRatio;
+                BYTE raw[8];
+                if (!m_file->read(m_vhdx.batOffset + index * 8, raw, sizeof(raw))) {
+                    return false;
+                }
+                uint64_t e = img::le64(raw);
+                firstBit = (block % m_chunkRatio) * (m_blockSize / m_sectorSize);
+                if ((e & 7) == img::_vhdxFullyPresent)
+                {
+                    at = (e >> 20) * img::_vhdxMB;
+                    return true;
+                }
+                at = 0;
+                if (!allocate) {
+                    return true;
+                }
+                // a new bitmap block, all clear
+                at = m_end;
+                m_end += img::_vhdxMB;
+                img::putLe64(raw, ((at / img::_vhdxMB) << 20) | img::_vhdxFullyPresent);
+                return m_out.resize(m_end) && m_out.write(m_vhdx.batOffset + index * 8, raw, sizeof(raw));
+            }
+
+            // sectors [first, first + count) of a block as its bitmap has them
+            bool present(uint64_t block, uint64_t fileOffset, uint64_t first, uint64_t count, std::vector<bool>& out)
+            {
+                out.assign((size_t)count, false);
+                uint64_t at = 0, base = 0;
+                if (!bitmap(block, fileOffset, false, at, base)) {
+                    return false;
+                }
+                if (!at) {
+                    return true;
+                }
+                uint64_t byte0 = (base + first) / 8;
+                std::vector<BYTE> bits((size_t)((base + first + count + 7) / 8 - byte0));
+                if (!m_file->read(at + byte0, bits.data(), bits.size())) {
+                    return false;
+                }
+                for (uint64_t s = 0; s < count; s++)
+                {
+                    uint64_t bit = base + first + s - byte0 * 8;
+                    // VHD bitmaps run from the top bit, VHDX from the bottom
+                    BYTE mask = vhdx() ? (BYTE)(1 << (bit % 8)) : (BYTE)(0x80 >> (bit % 8));
+                    out[(size_t)s] = (bits[(size_t)(bit / 8)] & mask) != 0;
+                }
+                return true;
+            }
+
+            // sets sectors [first, end) of a block in its bitmap. 'fresh' clears the
+            // rest of the block's bits: they were never this file's
+            bool mark(uint64_t block, uint64_t fileOffset, uint64_t first, uint64_t end, bool fresh)
+            {
+                uint64_t at = 0, base = 0;
+                if (!bitmap(block, fileOffset, true, at, base)) {
+                    return false;
+                }
+                uint64_t lo = fresh ? 0 : first;
+                uint64_t hi = fresh ? m_blockSize / sectorSize() : end;
+                uint64_t byte0 = (base + lo) / 8;
+                std::vector<BYTE> bits((size_t)((base + hi + 7) / 8 - byte0));
+                if (!m_out.read(at + byte0, bits.data(), bits.size())) {
+                    return false;
+                }
+                for (uint64_t s = lo; s < hi; s++)
+                {
+                    uint64_t bit = base + s - byte0 * 8;
+                    BYTE mask = vhdx() ? (BYTE)(1 << (bit % 8)) : (BYTE)(0x80 >> (bit % 8));
+                    if (s >= first && s < end) {
+                        bits[(size_t)(bit / 8)] |= mask;
+                    }
+                    else {
+                        bits[(size_t)(bit / 8)] &= (BYTE)~mask;
+                    }
+                }
+                return m_out.write(at + byte0, bits.data(), bits.size());
+            }
+
+        public:
+            const std::filesystem::path& path() const { return m_path; }
+            img::Kind kind() const { return m_kind; }
+            uint64_t size() const { return m_size; }
+            // of the bitmap: 512 for a VHD
+            uint32_t sectorSize() const { return vhdx() ? m_sectorSize : 512; }
+            bool differencing() const { return m_differencing; }
+            const std::vector<std::filesystem::path>& parents() const { return m_parents; }
+
+            // false unless a raw image, VHD or VHDX
+            bool open(const std::filesystem::path& path)
+            {
+                m_path = path;
+                m_file.reset(new blk::FileSource(path));
+                if (!*m_file || m_file->size() == 0) {
+                    return false;
+                }
+                BYTE head[8] = { 0 };
+                BYTE footer[8] = { 0 };
+                m_file->read(0, head, sizeof(head));
+                if (m_file->size() >= 1024) {
+                    m_file->read(m_file->size() - 512, footer, sizeof(footer));
+                }
+                if (memcmp(head, "vhdxfile", 8) == 0)
+                {
+                    if (!m_vhdx.read(*m_file) || !m_vhdx.valid()) {
+                        return false;
+                    }
+                    m_size = m_vhdx.size;
+                    m_blockSize = m_vhdx.blockSize;
+                    m_sectorSize = m_vhdx.sectorSize;
+                    m_chunkRatio = m_vhdx.chunkRatio();
+                    m_differencing = m_vhdx.hasParent;
+                    m_kind = m_differencing ? img::Kind::DifferencingVhdx : img::Kind::Vhdx;
+                    if (m_differencing) {
+                        findVhdxParents();
+                    }
+                    return true;
+                }
+                if (memcmp(head, "wde2arch", 8) == 0) {
+                    return false;
+                }
+                if (memcmp(footer, "conectix", 8) == 0)
+                {
+                    if (!m_vhd.read(*m_file)) {
+                        return false;
+                    }
+                    m_size = m_vhd.size;
+                    if (m_vhd.diskType == img::_vhdFixed)
+                    {
+                        m_kind = img::Kind::FixedVhd;
+                        return m_size <= m_file->size() - 512;
+                    }
+                    if (m_vhd.diskType != img::_vhdDynamic && m_vhd.diskType != img::_vhdDifferencing) {
+                        return false;
+                    }
+                    m_blockSize = m_vhd.blockSize;
+                    m_differencing = (m_vhd.diskType == img::_vhdDifferencing);
+                    m_kind = m_differencing ? img::Kind::DifferencingVhd : img::Kind::DynamicVhd;
+                    if (m_differencing) {
+                        findVhdParents();
+                    }
+                    return true;
+                }
+                m_size = m_file->size();
+                m_sectorSize = m_file->sectorSize();
+                return true;
+            }
+
+            // 'parent' is the image this one was created from, unchanged since
+            bool linked(const Level& parent) const
+            {
+                if (m_kind == img::Kind::DifferencingVhd)
+                {
+                    return !parent.vhdx() && parent.m_kind != img::Kind::Raw
+                        && memcmp(m_vhd.header + 40, parent.m_vhd.footer + 68, 16) == 0;
+                }
+                if (m_kind == img::Kind::DifferencingVhdx && parent.vhdx())
+                {
+                    std::wstring a = m_parentLinkage, b = guidString(parent.m_vhdx.header + 32);
+                    std::transform(a.begin(), a.end(), a.begin(), [](wchar_t c) { return (wchar_t)towupper(c); });
+                    return a == b;
+                }
+                return false;
+            }
+
+            // units of [offset, offset + length) still _unresolved in 'owner' become
+            // 'self' where this level holds them, or _zero where it reads as zero
+            bool resolve(uint64_t offset, size_t length, uint16_t self, uint16_t* owner)
+            {
+                auto set = [&](size_t u0, size_t u1, uint16_t value) {
+                    for (size_t u = u0; u < u1; u++)
+                    {
+                        if (owner[u] == _unresolved) {
+                            owner[u] = value;
+                        }
+                    }
+                };
+                if (!m_blockSize)
+                {
+                    set(0, length / _unit, self);
+                    return true;
+                }
+                uint64_t first = offset / m_blockSize;
+                uint64_t last = (offset + length - 1) / m_blockSize;
+                if (!load(first, last - first + 1)) {
+                    return false;
+                }
+                std::vector<bool> bits;
+                for (uint64_t b = first; b <= last; b++)
+                {
+                    uint64_t start = (std::max)(offset, b * m_blockSize);
+                    uint64_t end = (std::min)(offset + length, (b + 1) * m_blockSize);
+                    size_t u0 = (size_t)((start - offset) / _unit);
+                    size_t u1 = (size_t)((end - offset) / _unit);
+                    uint64_t fileOffset = 0;
+                    switch (state(entry(b), fileOffset))
+                    {
+                    case State::Parent:
+                        break;
+                    case State::Zero:
+                        set(u0, u1, _zero);
+                        break;
+                    case State::Present:
+                        set(u0, u1, self);
+                        break;
+                    case State::Partial:
+                    {
+                        uint64_t s0 = (start - b * m_blockSize) / sectorSize();
+                        uint64_t s1 = (end - b * m_blockSize + sectorSize() - 1) / sectorSize();
+                        if (!present(b, fileOffset, s0, s1 - s0, bits)) {
+                            return false;
+                        }
+                        for (size_t u = u0; u < u1; u++)
+                        {
+                            uint64_t s = (offset + u * _unit - b * m_blockSize) / sectorSize();
+                            if (bits[(size_t)(s - s0)] && owner[u] == _unresolved) {
+                                owner[u] = self;
+                            }
+                        }
+                        break;
+                    }
+                    }
+                }
+                return true;
+            }
+
+            // this level's own data for [offset, offset + length), zero where it has none
+            bool read(uint64_t offset, BYTE* p, size_t length)
+            {
+                if (!m_blockSize) {
+                    return m_file->read(offset, p, length);
+                }
+                while (length)
+                {
+                    uint64_t b = offset / m_blockSize;
+                    uint64_t within = offset % m_blockSize;
+                    size_t n = (size_t)(std::min)((uint64_t)length, m_blockSize - within);
+                    uint64_t fileOffset = 0;
+                    if (!load(b, _ahead)) {
+                        return false;
+                    }
+                    State s = state(entry(b), fileOffset);
+                    if (s == State::Present || s == State::Partial)
+                    {
+                        if (!m_file->read(fileOffset + within, p, n)) {
+                            return false;
+                        }
+                    }
+                    else {
+                        memset(p, 0, n);
+                    }
+                    p += n;
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+
+            //-----------------------------------------------------------------------------
+            // merge target: opens the file for writing as well
+            bool writable()
+            {
+                if (!m_out.open(m_path, true)) {
+                    return false;
+                }
+                m_writable = true;
+                uint64_t fileSize = m_out.size();
+                if (vhdx()) {
+                    m_end = (fileSize + img::_vhdxMB - 1) / img::_vhdxMB * img::_vhdxMB;
+                }
+                else if (m_blockSize) {
+                    // over the footer copy, which moves to the new end
+                    m_end = (fileSize - 512 + 511) & ~511ull;
+                }
+                return true;
+            }
+
+            // [offset, offset + length) of the disk, appending blocks as needed.
+            // a differencing level marks the sectors as its own
+            bool write(uint64_t offset, const BYTE* p, size_t length)
+            {
+                if (!m_writable) {
+                    return false;
+                }
+                m_modified = true;
+                if (!m_blockSize) {
+                    return m_out.write(offset, p, length);
+                }
+                while (length)
+                {
+                    uint64_t b = offset / m_blockSize;
+                    uint64_t within = offset % m_blockSize;
+                    size_t n = (size_t)(std::min)((uint64_t)length, m_blockSize - within);
+                    if (!load(b, _ahead)) {
+                        return false;
+                    }
+                    uint64_t fileOffset = 0;
+                    State s = state(entry(b), fileOffset);
+                    uint64_t s0 = within / sectorSize();
+                    uint64_t s1 = (within + n + sectorSize() - 1) / sectorSize();
+                    if (s == State::Present || s == State::Partial)
+                    {
+                        if (!m_out.write(fileOffset + within, p, n) || (s == State::Partial && !mark(b, fileOffset, s0, s1, false))) {
+                            return false;
+                        }
+                    }
+                    else if (!vhdx())
+                    {
+                        // bitmap and block over the old footer copy, the footer after them
+                        uint64_t at = m_end;
+                        m_end += m_vhd.bitmapBytes + m_blockSize;
+                        fileOffset = at + m_vhd.bitmapBytes;
+                        if (!m_out.write(m_end, m_vhd.footer, sizeof(m_vhd.footer)) || !m_out.write(fileOffset + within, p, n)) {
+                            return false;
+                        }
+                        // a dynamic block is whole, its unwritten sectors zero
+                        std::vector<BYTE> bits((size_t)m_vhd.bitmapBytes, m_differencing ? 0 : 0xFF);
+                        if (!m_out.write(at, bits.data(), bits.size())
+                            || (m_differencing && !mark(b, fileOffset, s0, s1, true))) {
+                            return false;
+                        }
+                        entry(b) = at / 512;
+                        if (!writeEntry(b, entry(b))) {
+                            return false;
+                        }
+                    }
+                    else
+                    {
+                        fileOffset = m_end;
+                        m_end += m_blockSize;
+                        if (!m_out.resize(m_end) || !m_out.write(fileOffset + within, p, n)) {
+                            return false;
+                        }
+                        // the rest of the block is the parent's, unless it was zero
+                        bool partial = (s == State::Parent) && n < m_blockSize;
+                        if (partial && !mark(b, fileOffset, s0, s1, true)) {
+                            return false;
+                        }
+                        entry(b) = ((fileOffset / img::_vhdxMB) << 20) | (partial ? img::_vhdxPartiallyPresent : img::_vhdxFullyPresent);
+                        if (!writeEntry(b, entry(b))) {
+                            return false;
+                        }
+                    }
+                    p += n;
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+
+            // [offset, offset + length) reads as zero after. a whole VHDX block
+            // is set to the zero state rather than written
+            bool zero(uint64_t offset, size_t length)
+            {
+                if (!m_writable) {
+                    return false;
+                }
+                std::vector<BYTE> zeros((size_t)(std::min)((uint64_t)length, (uint64_t)img::_vhdxMB), 0);
+                while (length)
+                {
+                    size_t n = (size_t)(std::min)((uint64_t)length, (uint64_t)zeros.size());
+                    uint64_t fileOffset = 0;
+                    if (m_blockSize)
+                    {
+                        uint64_t b = offset / m_blockSize;
+                        uint64_t within = offset % m_blockSize;
+                        n = (size_t)(std::min)((uint64_t)length, m_blockSize - within);
+                        if (!load(b, _ahead)) {
+                            return false;
+                        }
+                        if (state(entry(b), fileOffset) == State::Zero)
+                        {
+                            offset += n;
+                            length -= n;
+                            continue;
+                        }
+                        if (vhdx() && n == m_blockSize)
+                        {
+                            m_modified = true;
+                            entry(b) = img::_vhdxZero;
+                            if (!writeEntry(b, entry(b))) {
+                                return false;
+                            }
+                            offset += n;
+                            length -= n;
+                            continue;
+                        }
+                    }
+                    for (size_t done = 0; done < n; )
+                    {
+                        size_t k = (std::min)(n - done, zeros.size());
+                        if (!write(offset + done, zeros.data(), k)) {
+                            return false;
+                        }
+                        done += k;
+                    }
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+
+            // flushes, then renews a modified VHDX's write GUIDs in its other header
+            bool commit()
+            {
+                if (!m_writable || !m_out.flush()) {
+                    return false;
+                }
+                if (!m_modified || !vhdx()) {
+                    return true;
+                }
+                BYTE h[4096];
+                memcpy(h, m_vhdx.header, sizeof(h));
+                img::putLe64(h + 8, img::le64(h + 8) + 1);
+                img::randomGuid(h + 16);
+                img::randomGuid(h + 32);
+                memset(h + 4, 0, 4);
+                img::putLe32(h + 4, hash::crc32c(h, sizeof(h)));
+                int slot = m_vhdx.slot ^ 1;
+                if (!m_out.write(slot ? img::_vhdxHeader2 : img::_vhdxHeader1, h, sizeof(h)) || !m_out.flush()) {
+                    return false;
+                }
+                memcpy(m_vhdx.header, h, sizeof(h));
+                m_vhdx.slot = slot;
+                m_modified = false;
+                return true;
+            }
+        };
+
+        typedef std::vector<std::unique_ptr<Level>> Chain;
+
+        //-----------------------------------------------------------------------------
+        // 'path' and up to 'depth' - 1 of its ancestors, newest first. throws if
+        // a parent cannot be found or has changed since its child was created
+        static Chain open(const std::filesystem::path& path, size_t depth = _maxDepth)
+        {
+            Chain chain;
+            std::set<std::filesystem::path> seen;
+            std::filesystem::path next = path;
+            while (chain.size() < depth)
+            {
+                nv2::throw_if(chain.size() == _maxDepth, nv2::acc("Chain of ") << path.wstring() << " is deeper than " << _maxDepth);
+                std::unique_ptr<Level> level(new Level());
+                nv2::throw_if(!level->open(next), nv2::acc("Not a raw image, VHD or VHDX: ") << next.wstring());
+                std::error_code ec;
+                nv2::throw_if(!seen.insert(std::filesystem::weakly_canonical(next, ec)).second,
+                              nv2::acc("Chain of ") << path.wstring() << " loops at " << next.wstring());
+                if (chain.size())
+                {
+                    nv2::throw_if(!chain.back()->linked(*level),
+                                  nv2::acc("Parent ") << next.wstring() << " has changed since " << chain.back()->path().wstring() << " was created");
+                    nv2::throw_if(level->size() != chain.front()->size(),
+                                  nv2::acc("Parent ") << next.wstring() << " is " << level->size() << " bytes, not " << chain.front()->size());
+                }
+                nv2::throw_if(level->size() % _unit, nv2::acc("Size of ") << next.wstring() << " is not whole sectors");
+                bool differencing = level->differencing();
+                std::vector<std::filesystem::path> parents = level->parents();
+                chain.push_back(std::move(level));
+                if (!differencing) {
+                    break;
+                }
+                next.clear();
+                for (const std::filesystem::path& p : parents)
+                {
+                    if (std::filesystem::exists(p, ec))
+                    {
+                        next = p;
+                        break;
+                    }
+                }
+                nv2::throw_if(next.empty(), nv2::acc("Unable to find the parent of ") << chain.back()->path().wstring());
+            }
+            return chain;
+        }
+
+        //-----------------------------------------------------------------------------
+        struct Options
+        {
+            // of the disk, resolved at a time
+            uint32_t window = 32 * 1024 * 1024;
+        };
+
+        struct Report
+        {
+            size_t levels = 0;
+            // merge(): the parent written
+            std::filesystem::path parent;
+            uint64_t size = 0;
+            uint64_t bytesRead = 0;
+            uint64_t bytesWritten = 0;
+            // zero in the chain, not read
+            uint64_t bytesZero = 0;
+            // read from each level, newest first
+            std::vector<uint64_t> bytesFrom;
+            double seconds = 0;
+        };
+
+        // the owner of each unit of [offset, offset + length): the newest level
+        // holding it, or _zero. the walk stops once every unit has one
+        static void resolve(Chain& chain, size_t levels, uint64_t offset, size_t length, std::vector<uint16_t>& owner)
+        {
+            size_t units = length / _unit;
+            std::fill(owner.begin(), owner.begin() + units, _unresolved);
+            for (size_t i = 0; i < levels; i++)
+            {
+                nv2::throw_if(!chain[i]->resolve(offset, length, (uint16_t)i, owner.data()),
+                              nv2::acc("Unable to read the BAT of ") << chain[i]->path().wstring());
+                if (std::find(owner.begin(), owner.begin() + units, _unresolved) == owner.begin() + units) {
+                    break;
+                }
+            }
+        }
+
+        // calls 'each(level or _zero or _unresolved, first unit, units)' per run of one owner
+        template <typename F>
+        static void runs(const std::vector<uint16_t>& owner, size_t units, F each)
+        {
+            for (size_t u = 0; u < units; )
+            {
+                size_t e = u;
+                while (e < units && owner[e] == owner[u]) {
+                    e++;
+                }
+                each(owner[u], u, e - u);
+                u = e;
+            }
+        }
+
+        //-----------------------------------------------------------------------------
+        // the chain of 'top' as a new standalone image, in the format kindFor() gives 'output'
+        static Report flatten(const std::filesystem::path& top, const std::filesystem::path& output,
+                              const Options& options = Options(),
+                              const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            auto started = std::chrono::steady_clock::now();
+            Chain chain = open(top);
+            std::error_code ec;
+            for (const auto& level : chain)
+            {
+                nv2::throw_if(std::filesystem::weakly_canonical(level->path(), ec) == std::filesystem::weakly_canonical(output, ec),
+                              nv2::acc("Output ") << output.wstring() << " is part of the chain");
+            }
+            Report report;
+            report.levels = chain.size();
+            report.size = chain.front()->size();
+            report.bytesFrom.assign(chain.size(), 0);
+            std::unique_ptr<img::ImageWriter> image = img::create(output, report.size, false, chain.front()->sectorSize());
+            nv2::throw_if(!image, nv2::acc("Unable to create ") << output.wstring());
+            // an archive is written strictly in order, so zero windows are written too
+            bool sequential = (image->kind() == img::Kind::Archive);
+
+            blk::AlignedBuffer buffer(options.window);
+            std::vector<uint16_t> owner(options.window / _unit);
+            for (uint64_t offset = 0; offset < report.size; offset += options.window)
+            {
+                size_t length = (size_t)(std::min)((uint64_t)options.window, report.size - offset);
+                resolve(chain, chain.size(), offset, length, owner);
+                memset(buffer.data(), 0, length);
+                bool data = false;
+                runs(owner, length / _unit, [&](uint16_t level, size_t u, size_t n) {
+                    if (level == _zero || level == _unresolved)
+                    {
+                        report.bytesZero += n * _unit;
+                        return;
+                    }
+                    nv2::throw_if(!chain[level]->read(offset + u * _unit, buffer.data() + u * _unit, n * _unit),
+                                  nv2::acc("Unable to read ") << chain[level]->path().wstring() << " at offset " << offset + u * _unit);
+                    report.bytesRead += n * _unit;
+                    report.bytesFrom[level] += n * _unit;
+                    data = true;
+                });
+                if (data || sequential)
+                {
+                    nv2::throw_if(!image->write(offset, buffer.data(), length),
+                                  nv2::acc("Unable to write ") << output.wstring() << " at offset " << offset);
+                    report.bytesWritten += length;
+                }
+                if (progress) {
+                    progress(offset + length, report.size);
+                }
+            }
+            nv2::throw_if(!image->finish(), nv2::acc("Unable to complete ") << output.wstring());
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            return report;
+        }
+
+        //-----------------------------------------------------------------------------
+        // what the differencing image 'child' holds, written into its parent in place
+        static Report merge(const std::filesystem::path& child, const Options& options = Options(),
+                            const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            auto started = std::chrono::steady_clock::now();
+            Chain chain = open(child, 2);
+            nv2::throw_if(chain.size() < 2, nv2::acc("Not a differencing image: ") << child.wstring());
+            Level& top = *chain[0];
+            Level& parent = *chain[1];
+            nv2::throw_if(!parent.writable(), nv2::acc("Unable to open ") << parent.path().wstring() << " for writing");
+            Report report;
+            report.levels = 2;
+            report.parent = parent.path();
+            report.size = top.size();
+            report.bytesFrom.assign(2, 0);
+
+            blk::AlignedBuffer buffer(options.window);
+            std::vector<uint16_t> owner(options.window / _unit);
+            for (uint64_t offset = 0; offset < report.size; offset += options.window)
+            {
+                size_t length = (size_t)(std::min)((uint64_t)options.window, report.size - offset);
+                resolve(chain, 1, offset, length, owner);
+                runs(owner, length / _unit, [&](uint16_t level, size_t u, size_t n) {
+                    uint64_t at = offset + u * _unit;
+                    if (level == _unresolved) {
+                        return;
+                    }
+                    if (level == _zero)
+                    {
+                        nv2::throw_if(!parent.zero(at, n * _unit), nv2::acc("Unable to write ") << parent.path().wstring() << " at offset " << at);
+                        report.bytesZero += n * _unit;
+                        return;
+                    }
+                    nv2::throw_if(!top.read(at, buffer.data(), n * _unit), nv2::acc("Unable to read ") << top.path().wstring() << " at offset " << at);
+                    nv2::throw_if(!parent.write(at, buffer.data(), n * _unit), nv2::acc("Unable to write ") << parent.path().wstring() << " at offset " << at);
+                    report.bytesRead += n * _unit;
+                    report.bytesFrom[0] += n * _unit;
+                    report.bytesWritten += n * _unit;
+                });
+                if (progress) {
+                    progress(offset + length, report.size);
+                }
+            }
+            nv2::throw_if(!parent.commit(), nv2::acc("Unable to flush ") << parent.path().wstring());
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            return report;
+        }
+    }
+}
@@ -0,0 +1,1344 @@
+/*
+
+    Clone a block source into an image, tolerating read errors.
+
+    CreateVirtualDisk gives up on the first unreadable sector. This
+    engine reads the source itself and works like a two-phase rescue:
+
+    1. large reads front to back. a failed read marks its chunk and
+       skips ahead, doubling the skip while errors continue, so a
+       damaged area costs a few slow reads rather than thousands.
+       the skipped areas are then read without skipping.
+    2. the failed chunks are split in halves down to single sectors,
+       and the sectors that still fail are retried.
+
+    What can not be read is zero-filled in the image and reported.
+    Progress is kept in a map file so an interrupted run resumes
+    where it stopped. A healthy disk takes phase 1 only: one pass of
+    large reads, overlapped with the writes.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blk_io.h"
+#include "enum_cache.h"
+#include "img_write.h"
+#include "log_ex.h"
+#include "metrics_ex.h"
+#include "trace_ex.h"
+
+namespace wde2
+{
+    namespace clone
+    {
+        static const uint32_t _mapMagic = 0x4D524457;   // 'WDRM'
+        static const uint32_t _mapVersion = 1;
+
+        enum class State : uint8_t
+        {
+            Untried = 0,
+            Good = 1,
+            // a large read failed somewhere in here
+            Failed = 2,
+            // single sectors that did not read
+            Bad = 3,
+        };
+
+        static const char* stateName(State state)
+        {
+            switch (state)
+            {
+            case State::Untried: return "untried";
+            case State::Good: return "good";
+            case State::Failed: return "failed";
+            case State::Bad: return "bad";
+            }
+            return "?";
+        }
+
+        struct Range
+        {
+            uint64_t start = 0;
+            uint64_t end = 0;
+            State state = State::Untried;
+        };
+
+        //-----------------------------------------------------------------------------
+        // the state of every byte of the source as adjacent ranges. a healthy
+        // disk is a single range however large it is.
+        class RangeMap
+        {
+            uint64_t m_size = 0;
+            // start => range
+            std::map<uint64_t, Range> m_ranges;
+
+            // make 'offset' the start of a range
+            void split(uint64_t offset)
+            {
+                if (offset >= m_size) {
+                    return;
+                }
+                auto it = m_ranges.upper_bound(offset);
+                --it;
+                if (it->first == offset) {
+                    return;
+                }
+                Range tail = it->second;
+                tail.start = offset;
+                it->second.end = offset;
+                m_ranges[offset] = tail;
+            }
+
+        public:
+            explicit RangeMap(uint64_t size = 0) { reset(size); }
+
+            void reset(uint64_t size)
+            {
+                m_size = size;
+                m_ranges.clear();
+                if (size) {
+                    m_ranges[0] = Range{ 0, size, State::Untried };
+                }
+            }
+
+            uint64_t size() const { return m_size; }
+            size_t count() const { return m_ranges.size(); }
+
+            void set(uint64_t start, uint64_t end, State state)
+            {
+                end = (std::min)(end, m_size);
+                if (start >= end) {
+                    return;
+                }
+                split(start);
+                split(end);
+                auto first = m_ranges.find(start);
+                auto last = m_ranges.lower_bound(end);
+                m_ranges.erase(first, last);
+                m_ranges[start] = Range{ start, end, state };
+                // merge with the neighbours
+                auto it = m_ranges.find(start);
+                if (it != m_ranges.begin())
+                {
+                    auto prev = std::prev(it);
+                    if (prev->second.state == state)
+                    {
+                        prev->second.end = it->second.end;
+                        m_ranges.erase(it);
+                        it = prev;
+                    }
+                }
+                auto next = std::next(it);
+                if (next != m_ranges.end() && next->second.state == state)
+                {
+                    it->second.end = next->second.end;
+                    m_ranges.erase(next);
+                }
+            }
+
+            // copies, so the caller may set() as it goes
+            std::vector<Range> ranges(State state) const
+            {
+                std::vector<Range> v;
+                for (auto& r : m_ranges)
+                {
+                    if (r.second.state == state) {
+                        v.push_back(r.second);
+                    }
+                }
+                return v;
+            }
+
+            uint64_t bytes(State state) const
+            {
+                uint64_t total = 0;
+                for (auto& r : m_ranges)
+                {
+                    if (r.second.state == state) {
+                        total += r.second.end - r.second.start;
+                    }
+                }
+                return total;
+            }
+
+            bool save(const std::filesystem::path& path) const
+            {
+                cache::ByteWriter w;
+                w.u32(_mapMagic);
+                w.u32(_mapVersion);
+                w.u64(m_size);
+                w.u64(m_ranges.size());
+                for (auto& r : m_ranges)
+                {
+                    w.u64(r.second.start);
+                    w.u64(r.second.end);
+                    w.u8((uint8_t)r.second.state);
+                }
+                return cache::saveAtomically(path, w.buffer());
+            }
+
+            // false if missing, damaged or for a source of another size
+            bool load(const std::filesystem::path& path, uint64_t size)
+            {
+                std::ifstream is(path, std::ios::binary);
+                if (!is) {
+                    return false;
+                }
+                std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+                cache::ByteReader r(data.data(), data.size());
+                if (r.u32() != _mapMagic || r.u32() != _mapVersion || r.u64() != size) {
+                    return false;
+                }
+                uint64_t count = r.u64();
+                std::map<uint64_t, Range> ranges;
+                uint64_t expected = 0;
+                for (uint64_t i = 0; i < count && r.ok(); i++)
+                {
+                    Range range;
+                    range.start = r.u64();
+                    range.end = r.u64();
+                    range.state = (State)r.u8();
+                    // contiguous and complete, or nothing
+                    if (range.start != expected || range.end <= range.start || range.state > State::Bad) {
+                        return false;
+                    }
+                    expected = range.end;
+                    ranges[range.start] = range;
+                }
+                if (!r.ok() || expected != size) {
+                    return false;
+                }
+                m_size = size;
+                m_ranges.swap(ranges);
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        static const uint32_t _manifestMagic = 0x4D424457;   // 'WDBM'
+        static const uint32_t _manifestVersion = 1;
+
+        // XXH64 of every block of an image, plus the size and time of the image
+        // file it was taken from. an image changed since (attached, booted) no
+        // longer matches and is hashed again rather than trusted.
+        class BlockManifest
+        {
+        public:
+            uint32_t blockSize = 0;
+            // of the virtual disk
+            uint64_t size = 0;
+            uint64_t imageSize = 0;
+            // file_time_type ticks
+            int64_t imageModified = 0;
+            std::vector<uint64_t> hashes;
+
+            BlockManifest() {}
+            BlockManifest(uint64_t size_, uint32_t blockSize_)
+                : blockSize(blockSize_), size(size_), hashes((size_t)((size_ + blockSize_ - 1) / blockSize_), 0)
+            {
+            }
+
+            size_t blocks() const { return hashes.size(); }
+
+            // once the image is closed, so the time is final
+            bool stamp(const std::filesystem::path& image)
+            {
+                std::error_code ec;
+                imageSize = std::filesystem::file_size(image, ec);
+                imageModified = (int64_t)std::filesystem::last_write_time(image, ec).time_since_epoch().count();
+                return !ec;
+            }
+
+            bool matches(const std::filesystem::path& image) const
+            {
+                std::error_code ec;
+                uint64_t fileSize = std::filesystem::file_size(image, ec);
+                int64_t modified = (int64_t)std::filesystem::last_write_time(image, ec).time_since_epoch().count();
+                return !ec && fileSize == imageSize && modified == imageModified;
+            }
+
+            bool save(const std::filesystem::path& path) const
+            {
+                cache::ByteWriter w;
+                w.u32(_manifestMagic);
+                w.u32(_manifestVersion);
+                w.u32(blockSize);
+                w.u64(size);
+                w.u64(imageSize);
+                w.u64((uint64_t)imageModified);
+                w.u64(hashes.size());
+                for (uint64_t h : hashes) {
+                    w.u64(h);
+                }
+                return cache::saveAtomically(path, w.buffer());
+            }
+
+            bool load(const std::filesystem::path& path)
+            {
+                std::ifstream is(path, std::ios::binary);
+                if (!is) {
+                    return false;
+                }
+                std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+                cache::ByteReader r(data.data(), data.size());
+                if (r.u32() != _manifestMagic || r.u32() != _manifestVersion) {
+                    return false;
+                }
+                blockSize = r.u32();
+                size = r.u64();
+                imageSize = r.u64();
+                imageModified = (int64_t)r.u64();
+                uint64_t count = r.u64();
+                if (!r.ok() || blockSize == 0 || count != (size + blockSize - 1) / blockSize || count > data.size() / 8) {
+                    return false;
+                }
+                hashes.resize((size_t)count);
+                for (uint64_t& h : hashes) {
+                    h = r.u64();
+                }
+                return r.ok();
+            }
+        };
+
+        // i.e. u:\images\host42.vhd.wdbm
+        static std::filesystem::path manifestPath(const std::filesystem::path& image)
+        {
+            std::filesystem::path p = image;
+            p += ".wdbm";
+            return p;
+        }
+
+        //-----------------------------------------------------------------------------
+        struct Options
+        {
+            // phase 1 read size
+            size_t chunkSize = 1024 * 1024;
+            // upper bound of the skip after consecutive errors
+            uint64_t maxSkip = 256ull * 1024 * 1024;
+            // extra passes over the bad sectors
+            unsigned retries = 2;
+            // seconds between map saves while the map changes
+            unsigned saveInterval = 10;
+            // block-hash sidecar to write for a later refresh(), if any
+            std::filesystem::path manifest;
+        };
+
+        struct Report
+        {
+            uint64_t size = 0;
+            uint64_t good = 0;
+            // zero-filled in the image
+            uint64_t bad = 0;
+            // bad in a pass, then read on a retry
+            uint64_t recovered = 0;
+            uint64_t reads = 0;
+            uint64_t readErrors = 0;
+            uint64_t bytesRead = 0;
+            // from an existing map
+            bool resumed = false;
+            std::vector<Range> badRanges;
+        };
+
+        //-----------------------------------------------------------------------------
+        class Rescue
+        {
+            blk::BlockSource& m_source;
+            img::ImageWriter& m_image;
+            std::filesystem::path m_mapPath;
+            Options m_options;
+            Report& m_report;
+            RangeMap m_map;
+            DWORD m_sectorSize = 512;
+            blk::AlignedBuffer m_buffers[2];
+            int m_current = 0;
+            // past the first pass: reads go over ground that failed before
+            bool m_retrying = false;
+            // one write-behind thread for the whole run, writing the other buffer
+            std::thread m_writer;
+            std::mutex m_writeLock;
+            std::condition_variable m_writeChanged;
+            uint64_t m_writeOffset = 0;
+            const BYTE* m_writeData = nullptr;
+            size_t m_writeLength = 0;
+            bool m_writeQueued = false;
+            bool m_writeFailed = false;
+            bool m_stopWriter = false;
+            std::chrono::steady_clock::time_point m_saved;
+            std::chrono::steady_clock::time_point m_reported;
+            std::function<void(uint64_t, uint64_t)> m_progress;
+            // block hashes of what was written, if asked for. blocks are the chunk size
+            BlockManifest* m_manifest = nullptr;
+            std::vector<uint8_t> m_hashed;
+
+            // a write that is not one whole block leaves its blocks to be hashed at the end
+            void hashed(uint64_t offset, const BYTE* data, size_t length)
+            {
+                if (!m_manifest) {
+                    return;
+                }
+                uint64_t block = m_manifest->blockSize;
+                size_t first = (size_t)(offset / block);
+                if (offset % block == 0 && (length == block || offset + length == m_manifest->size))
+                {
+                    m_manifest->hashes[first] = hash::xxh64(data, length);
+                    m_hashed[first] = 1;
+                    return;
+                }
+                for (uint64_t b = first; b * block < offset + length; b++) {
+                    m_hashed[(size_t)b] = 0;
+                }
+            }
+
+            bool read(uint64_t offset, BYTE* buffer, size_t length)
+            {
+                m_report.reads++;
+                trace::Stage stage("read", "offset", offset);
+                metrics::Timer timer(metrics::job().readLatency);
+                if (m_retrying) {
+                    metrics::job().retries.add();
+                }
+                if (!m_source.read(offset, buffer, length))
+                {
+                    m_report.readErrors++;
+                    metrics::job().readErrors.add();
+                    return false;
+                }
+                m_report.bytesRead += length;
+                metrics::job().bytesRead.add(length);
+                return true;
+            }
+
+            // hashing rides along with the write, off the read path
+            void writer()
+            {
+                trace::nameThread("rescue writer");
+                std::unique_lock<std::mutex> g(m_writeLock);
+                while (true)
+                {
+                    m_writeChanged.wait(g, [&] { return m_stopWriter || m_writeQueued; });
+                    if (!m_writeQueued) {
+                        return;
+                    }
+                    uint64_t offset = m_writeOffset;
+                    const BYTE* data = m_writeData;
+                    size_t length = m_writeLength;
+                    g.unlock();
+                    bool ok = false;
+                    {
+                        trace::Stage stage("write", "offset", offset);
+                        metrics::Timer timer(metrics::job().writeLatency);
+                        hashed(offset, data, length);
+                        ok = m_image.write(offset, data, length);
+                        if (ok) {
+                            metrics::job().bytesWritten.add(length);
+                        }
+                    }
+                    g.lock();
+                    m_writeFailed = m_writeFailed || !ok;
+                    m_writeQueued = false;
+                    m_writeChanged.notify_all();
+                }
+            }
+
+            void waitWrite()
+            {
+                std::unique_lock<std::mutex> g(m_writeLock);
+                m_writeChanged.wait(g, [&] { return !m_writeQueued; });
+                if (m_writeFailed)
+                {
+                    m_writeFailed = false;
+                    nv2::throw_if(true, nv2::acc("Image write failed"));
+                }
+            }
+
+            // the write overlaps the next read
+            void writeBehind(uint64_t offset, size_t length)
+            {
+                waitWrite();
+                {
+                    std::lock_guard<std::mutex> g(m_writeLock);
+                    m_writeOffset = offset;
+                    m_writeData = m_buffers[m_current].data();
+                    m_writeLength = length;
+                    m_writeQueued = true;
+                }
+                m_writeChanged.notify_all();
+                m_current ^= 1;
+            }
+
+            void writeNow(uint64_t offset, const BYTE* data, size_t length)
+            {
+                waitWrite();
+                trace::Stage stage("write", "offset", offset);
+                metrics::Timer timer(metrics::job().writeLatency);
+                hashed(offset, data, length);
+                nv2::throw_if(!m_image.write(offset, data, length), nv2::acc("Image write failed at ") << offset);
+                metrics::job().bytesWritten.add(length);
+            }
+
+            // saves the map now and then, and on 'force'
+            void changed(bool force = false)
+            {
+                auto now = std::chrono::steady_clock::now();
+                if (!m_mapPath.empty() && (force || now - m_saved >= std::chrono::seconds(m_options.saveInterval)))
+                {
+                    // a map must never claim what is not yet in the image
+                    waitWrite();
+                    nv2::throw_if(!m_map.save(m_mapPath), nv2::acc("Unable to write ") << m_mapPath.wstring());
+                    m_saved = now;
+                }
+                if (m_progress && (force || now - m_reported >= std::chrono::milliseconds(500)))
+                {
+                    m_progress(m_map.size() - m_map.bytes(State::Untried), m_map.size());
+                    m_reported = now;
+                }
+            }
+
+            // phase 1. 'skip' leaves areas after an error for a later sweep
+            void copy(const Range& range, bool skip)
+            {
+                size_t chunk = m_buffers[0].size();
+                uint64_t skipBytes = chunk;
+                uint64_t pos = range.start;
+                while (pos < range.end)
+                {
+                    size_t length = (size_t)(std::min)((uint64_t)chunk, range.end - pos);
+                    BYTE* buffer = m_buffers[m_current].data();
+                    if (read(pos, buffer, length))
+                    {
+                        writeBehind(pos, length);
+                        m_map.set(pos, pos + length, State::Good);
+                        pos += length;
+                        skipBytes = chunk;
+                        changed();
+                        continue;
+                    }
+                    m_map.set(pos, pos + length, State::Failed);
+                    pos += length;
+                    if (skip && pos < range.end)
+                    {
+                        uint64_t s = (std::min)(skipBytes, range.end - pos);
+                        s -= s % m_sectorSize;
+                        LOG_WARN("Read error at " << (pos - length) << ", skipping " << s << " bytes");
+                        pos += s;
+                        skipBytes = (std::min)(skipBytes * 2, (std::max)(m_options.maxSkip, (uint64_t)chunk));
+                    }
+                    changed();
+                }
+            }
+
+            // phase 2. halves until single sectors. 'known' the whole range failed already.
+            // failed chunks next to each other come as one range, so anything larger
+            // than a buffer is halved before it is read
+            void split(uint64_t start, uint64_t end, bool known)
+            {
+                BYTE* buffer = m_buffers[m_current].data();
+                size_t length = (size_t)(end - start);
+                if (length > m_buffers[0].size()) {
+                    known = true;
+                }
+                if (!known && read(start, buffer, length))
+                {
+                    writeNow(start, buffer, length);
+                    m_map.set(start, end, State::Good);
+                    m_report.recovered += length;
+                    changed();
+                    return;
+                }
+                if (length <= m_sectorSize)
+                {
+                    m_map.set(start, end, State::Bad);
+                    changed();
+                    return;
+                }
+                uint64_t sectors = (length + m_sectorSize - 1) / m_sectorSize;
+                uint64_t mid = start + (sectors / 2) * m_sectorSize;
+                split(start, mid, false);
+                split(mid, end, false);
+            }
+
+            // after the retries. the image must not keep stale data from an earlier run
+            void zeroFill(const Range& range)
+            {
+                BYTE* zeros = m_buffers[m_current].data();
+                size_t chunk = m_buffers[0].size();
+                memset(zeros, 0, chunk);
+                for (uint64_t pos = range.start; pos < range.end; pos += chunk) {
+                    writeNow(pos, zeros, (size_t)(std::min)((uint64_t)chunk, range.end - pos));
+                }
+            }
+
+        public:
+            Rescue(blk::BlockSource& source, img::ImageWriter& image, const std::filesystem::path& mapPath,
+                   Report& report, const Options& options = Options())
+                : m_source(source), m_image(image), m_mapPath(mapPath), m_options(options), m_report(report),
+                  m_map(source.size()),
+                  m_sectorSize((std::max)(source.sectorSize(), (DWORD)512)),
+                  m_buffers{ blk::AlignedBuffer((std::max)(options.chunkSize / m_sectorSize, (size_t)1) * m_sectorSize),
+                             blk::AlignedBuffer((std::max)(options.chunkSize / m_sectorSize, (size_t)1) * m_sectorSize) }
+            {
+                m_saved = m_reported = std::chrono::steady_clock::now();
+                m_writer = std::thread([this]() { writer(); });
+            }
+
+            // a write still queued is finished first
+            ~Rescue()
+            {
+                {
+                    std::lock_guard<std::mutex> g(m_writeLock);
+                    m_stopWriter = true;
+                }
+                m_writeChanged.notify_all();
+                m_writer.join();
+            }
+
+            Rescue(const Rescue&) = delete;
+            Rescue& operator=(const Rescue&) = delete;
+
+            // (done, total) bytes, now and then
+            void onProgress(const std::function<void(uint64_t, uint64_t)>& f) { m_progress = f; }
+
+            // resume from the map if it exists and matches the source
+            bool resume()
+            {
+                m_report.resumed = !m_mapPath.empty() && m_map.load(m_mapPath, m_source.size());
+                if (!m_report.resumed) {
+                    m_map.reset(m_source.size());
+                }
+                return m_report.resumed;
+            }
+
+            const RangeMap& map() const { return m_map; }
+
+            // fill 'manifest' with the hashes of the image, blocks of the chunk size
+            void hashBlocks(BlockManifest& manifest)
+            {
+                manifest = BlockManifest(m_image.size(), (uint32_t)m_buffers[0].size());
+                m_manifest = &manifest;
+                m_hashed.assign(manifest.blocks(), 0);
+            }
+
+            // throws if the image can not be written. read errors are only reported
+            void run()
+            {
+                m_report.size = m_source.size();
+                for (const Range& r : m_map.ranges(State::Untried)) {
+                    copy(r, true);
+                }
+                // the areas skipped over
+                for (const Range& r : m_map.ranges(State::Untried)) {
+                    copy(r, false);
+                }
+                waitWrite();
+                // every read from here is a second try
+                m_retrying = true;
+                for (const Range& r : m_map.ranges(State::Failed)) {
+                    split(r.start, r.end, true);
+                }
+                for (unsigned pass = 0; pass < m_options.retries; pass++)
+                {
+                    std::vector<Range> bad = m_map.ranges(State::Bad);
+                    if (bad.empty()) {
+                        break;
+                    }
+                    for (const Range& r : bad)
+                    {
+                        for (uint64_t pos = r.start; pos < r.end; pos += m_sectorSize)
+                        {
+                            size_t length = (size_t)(std::min)((uint64_t)m_sectorSize, r.end - pos);
+                            BYTE* buffer = m_buffers[m_current].data();
+                            if (read(pos, buffer, length))
+                            {
+                                writeNow(pos, buffer, length);
+                                m_map.set(pos, pos + length, State::Good);
+                                m_report.recovered += length;
+                                changed();
+                            }
+                        }
+                    }
+                }
+                m_report.badRanges = m_map.ranges(State::Bad);
+                for (const Range& r : m_report.badRanges) {
+                    zeroFill(r);
+                }
+                m_report.good = m_map.bytes(State::Good);
+                m_report.bad = m_map.bytes(State::Bad);
+                // blocks from an earlier run, split or zero-filled: read back from the image
+                for (size_t b = 0; m_manifest && b < m_hashed.size(); b++)
+                {
+                    if (m_hashed[b]) {
+                        continue;
+                    }
+                    uint64_t offset = (uint64_t)b * m_manifest->blockSize;
+                    size_t length = (size_t)(std::min)((uint64_t)m_manifest->blockSize, m_manifest->size - offset);
+                    nv2::throw_if(!m_image.read(offset, m_buffers[0].data(), length), nv2::acc("Unable to read back the image at ") << offset);
+                    m_manifest->hashes[b] = hash::xxh64(m_buffers[0].data(), length);
+                    m_hashed[b] = 1;
+                }
+                nv2::throw_if(!m_image.finish(), nv2::acc("Unable to complete the image"));
+                changed(true);
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // clone 'source' into 'imagePath' (.vhd for a fixed VHD, otherwise raw).
+        // with a map an interrupted run resumes, otherwise it starts again.
+        static Report rescue(blk::BlockSource& source, const std::filesystem::path& imagePath,
+                             const std::filesystem::path& mapPath, const Options& options = Options(),
+                             const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            // only a raw image or fixed VHD can be reopened to carry on from the map
+            img::Kind kind = img::kindFor(imagePath);
+            nv2::throw_if(!mapPath.empty() && kind != img::Kind::Raw && kind != img::Kind::FixedVhd,
+                          nv2::acc("A rescue map needs a raw image or fixed VHD to resume into: ") << imagePath.wstring());
+            Report report;
+            std::error_code ec;
+            RangeMap probe;
+            // only resume into the image the map was written for
+            bool keep = !mapPath.empty() && std::filesystem::exists(imagePath, ec) && probe.load(mapPath, source.size());
+            std::unique_ptr<img::ImageWriter> image = img::create(imagePath, source.size(), keep, source.sectorSize());
+            nv2::throw_if(!image, nv2::acc("Unable to create ") << imagePath.wstring());
+            // retries write behind the front, and the manifest reads back
+            nv2::throw_if(image->kind() == img::Kind::Archive, nv2::acc("An archive can not be written out of order: ") << imagePath.wstring());
+            bool flat = image->kind() == img::Kind::Raw || image->kind() == img::Kind::FixedVhd;
+            BlockManifest manifest;
+            {
+                Rescue r(source, *image, mapPath, report, options);
+                if (keep) {
+                    r.resume();
+                }
+                if (flat && !options.manifest.empty()) {
+                    r.hashBlocks(manifest);
+                }
+                r.onProgress(progress);
+                r.run();
+            }
+            image.reset();
+            if (flat && !options.manifest.empty())
+            {
+                nv2::throw_if(!manifest.stamp(imagePath) || !manifest.save(options.manifest),
+                              nv2::acc("Unable to write ") << options.manifest.wstring());
+            }
+            return report;
+        }
+
+        //-----------------------------------------------------------------------------
+        // fixed capacity, blocking. close() wakes everyone; pop() then drains and fails
+        template <typename T>
+        class BoundedQueue
+        {
+            std::mutex m_lock;
+            std::condition_variable m_changed;
+            std::deque<T> m_items;
+            size_t m_capacity;
+            bool m_closed = false;
+
+        public:
+            explicit BoundedQueue(size_t capacity) : m_capacity((std::max)(capacity, (size_t)1)) {}
+
+            // false once closed
+            bool push(T item)
+            {
+                std::unique_lock<std::mutex> g(m_lock);
+                m_changed.wait(g, [&] { return m_closed || m_items.size() < m_capacity; });
+                if (m_closed) {
+                    return false;
+                }
+                m_items.push_back(std::move(item));
+                m_changed.notify_all();
+                return true;
+            }
+
+            bool pop(T& item)
+            {
+                std::unique_lock<std::mutex> g(m_lock);
+                m_changed.wait(g, [&] { return m_closed || !m_items.empty(); });
+                if (m_items.empty()) {
+                    return false;
+                }
+                item = std::move(m_items.front());
+                m_items.pop_front();
+                m_changed.notify_all();
+                return true;
+            }
+
+            size_t size()
+            {
+                std::lock_guard<std::mutex> g(m_lock);
+                return m_items.size();
+            }
+
+            void close()
+            {
+                std::lock_guard<std::mutex> g(m_lock);
+                m_closed = true;
+                m_changed.notify_all();
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        struct RefreshReport
+        {
+            uint64_t size = 0;
+            uint64_t blocks = 0;
+            uint64_t changed = 0;
+            uint64_t bytesRead = 0;
+            uint64_t bytesWritten = 0;
+            // no usable manifest: the image was hashed first
+            bool rebuilt = false;
+            unsigned threads = 0;
+        };
+
+        // hash an image that has no usable manifest, blocks shared out between threads
+        static void hashImage(blk::BlockSource& image, BlockManifest& manifest, unsigned threads)
+        {
+            std::atomic<size_t> next{ 0 };
+            std::atomic<bool> failed{ false };
+            auto worker = [&]() {
+                blk::AlignedBuffer buffer(manifest.blockSize);
+                for (size_t b = next++; b < manifest.blocks() && !failed; b = next++)
+                {
+                    uint64_t offset = (uint64_t)b * manifest.blockSize;
+                    size_t length = (size_t)(std::min)((uint64_t)manifest.blockSize, manifest.size - offset);
+                    if (!image.read(offset, buffer.data(), length)) {
+                        failed = true;
+                        break;
+                    }
+                    manifest.hashes[b] = hash::xxh64(buffer.data(), length);
+                }
+            };
+            std::vector<std::thread> pool;
+            for (unsigned i = 1; i < threads; i++) {
+                pool.emplace_back(worker);
+            }
+            worker();
+            for (auto& t : pool) {
+                t.join();
+            }
+            nv2::throw_if(failed, nv2::acc("Unable to read the image to hash it"));
+        }
+
+        // stamp 'manifest' with the closed image and write it beside it
+        static void saveManifest(BlockManifest manifest, const std::filesystem::path& imagePath)
+        {
+            std::filesystem::path path = manifestPath(imagePath);
+            nv2::throw_if(!manifest.stamp(imagePath) || !manifest.save(path), nv2::acc("Unable to write ") << path.wstring());
+        }
+
+        // the manifest of an image written by something that could not hash it,
+        // i.e. the virtual disk API. false if the image is not raw or a fixed VHD
+        static bool writeManifest(const std::filesystem::path& imagePath, uint32_t blockSize = 1024 * 1024, unsigned threads = 0)
+        {
+            BlockManifest manifest;
+            {
+                img::Kind kind = img::Kind::Raw;
+                std::unique_ptr<blk::BlockSource> image = img::open(imagePath, &kind);
+                nv2::throw_if(!image, nv2::acc("Unable to read ") << imagePath.wstring());
+                if (kind != img::Kind::Raw && kind != img::Kind::FixedVhd) {
+                    return false;
+                }
+                manifest = BlockManifest(image->size(), blockSize);
+                hashImage(*image, manifest, threads ? threads : (std::max)(1u, std::thread::hardware_concurrency()));
+            }
+            saveManifest(manifest, imagePath);
+            return true;
+        }
+
+        //-----------------------------------------------------------------------------
+        // bring an existing raw image or fixed VHD of 'source' up to date in place.
+        // the source is read once; blocks are hashed in parallel and only those
+        // whose hash differs from the manifest are written. the new manifest
+        // replaces the old with a rename once the image is flushed, so a crash
+        // leaves a manifest that no longer matches the image and the next run
+        // hashes the image again. the source is read 'readSize' bytes at a time,
+        // by one thread per handle in 'stripes' as well when there are any: more
+        // handles on the same device, which keep a solid state disk busier than
+        // one reader can.
+        static RefreshReport refresh(blk::BlockSource& source, const std::filesystem::path& imagePath,
+                                     const std::filesystem::path& manifestFile, unsigned threads = 0,
+                                     uint32_t blockSize = 1024 * 1024, size_t readSize = 8 * 1024 * 1024,
+                                     const std::function<void(uint64_t, uint64_t)>& progress = nullptr,
+                                     const std::vector<blk::BlockSource*>& stripes = std::vector<blk::BlockSource*>())
+        {
+            RefreshReport report;
+            report.size = source.size();
+            report.threads = threads ? threads : (std::max)(1u, std::thread::hardware_concurrency());
+            uint64_t size = (source.size() + 511) & ~511ull;
+
+            BlockManifest old;
+            {
+                img::Kind kind = img::Kind::Raw;
+                std::unique_ptr<blk::BlockSource> image = img::open(imagePath, &kind);
+                nv2::throw_if(!image, nv2::acc("Unable to read ") << imagePath.wstring());
+                nv2::throw_if(kind != img::Kind::Raw && kind != img::Kind::FixedVhd,
+                              nv2::acc("Refresh needs a raw image or fixed VHD, not ") << img::kindName(kind));
+                nv2::throw_if(image->size() != size,
+                              nv2::acc("Image is ") << image->size() << " bytes, the source " << size);
+                if (!old.load(manifestFile) || !old.matches(imagePath) || old.size != size)
+                {
+                    old = BlockManifest(size, blockSize);
+                    hashImage(*image, old, report.threads);
+                    report.rebuilt = true;
+                }
+            }
+            blockSize = old.blockSize;
+            BlockManifest fresh(size, blockSize);
+            report.blocks = fresh.blocks();
+
+            std::unique_ptr<img::ImageWriter> image = img::create(imagePath, size, true);
+            nv2::throw_if(!image, nv2::acc("Unable to open ") << imagePath.wstring());
+
+            // a batch of whole blocks per read
+            struct Batch
+            {
+                blk::AlignedBuffer* buffer = nullptr;
+                uint64_t offset = 0;
+                size_t length = 0;
+            };
+            size_t perBatch = (std::max)((size_t)1, readSize / blockSize);
+            size_t batchBytes = perBatch * blockSize;
+            std::vector<std::unique_ptr<blk::AlignedBuffer>> buffers;
+            size_t inFlight = report.threads * 2 + stripes.size();
+            BoundedQueue<blk::AlignedBuffer*> idle(inFlight);
+            for (size_t i = 0; i < inFlight; i++)
+            {
+                buffers.emplace_back(new blk::AlignedBuffer(batchBytes));
+                idle.push(buffers.back().get());
+            }
+            BoundedQueue<Batch> work(report.threads * 2);
+            std::atomic<uint64_t> changed{ 0 };
+            std::atomic<uint64_t> written{ 0 };
+            std::atomic<bool> failed{ false };
+
+            auto hasher = [&]() {
+                trace::nameThread("refresh hasher");
+                Batch batch;
+                while (work.pop(batch))
+                {
+                    trace::Stage stage("hash", "offset", batch.offset);
+                    for (size_t done = 0; done < batch.length && !failed; done += blockSize)
+                    {
+                        size_t b = (size_t)((batch.offset + done) / blockSize);
+                        size_t length = (std::min)((size_t)blockSize, batch.length - done);
+                        const BYTE* data = batch.buffer->data() + done;
+                        fresh.hashes[b] = hash::xxh64(data, length);
+                        if (fresh.hashes[b] == old.hashes[b]) {
+                            metrics::job().identicalBlocks.add();
+                            continue;
+                        }
+                        // distinct offsets, so writers need no lock
+                        metrics::Timer timer(metrics::job().writeLatency);
+                        if (!image->write(batch.offset + done, data, length)) {
+                            failed = true;
+                        }
+                        timer.end();
+                        changed++;
+                        written += length;
+                        metrics::job().bytesWritten.add(length);
+                    }
+                    idle.push(batch.buffer);
+                    metrics::job().queueDepth.set((int64_t)work.size());
+                }
+            };
+            std::vector<std::thread> pool;
+            for (unsigned i = 0; i < report.threads; i++) {
+                pool.emplace_back(hasher);
+            }
+
+            // the source is read here, front to back. stripe readers take the
+            // next batch from the same cursor, so the device sees one sequential
+            // stream with several requests in flight
+            std::atomic<uint64_t> cursor{ 0 };
+            std::atomic<uint64_t> bytesRead{ 0 };
+            std::atomic<bool> readFailed{ false };
+            auto reader = [&](blk::BlockSource& handle, bool reports) {
+                auto reported = std::chrono::steady_clock::now();
+                for (uint64_t offset = cursor.fetch_add(batchBytes); offset < source.size() && !failed && !readFailed;
+                     offset = cursor.fetch_add(batchBytes))
+                {
+                    Batch batch;
+                    idle.pop(batch.buffer);
+                    batch.offset = offset;
+                    batch.length = (size_t)(std::min)((uint64_t)batchBytes, source.size() - offset);
+                    trace::Stage read("read", "offset", offset);
+                    metrics::Timer timer(metrics::job().readLatency);
+                    if (!handle.read(offset, batch.buffer->data(), batch.length))
+                    {
+                        readFailed = true;
+                        metrics::job().readErrors.add();
+                        idle.push(batch.buffer);
+                        break;
+                    }
+                    timer.end();
+                    read.end();
+                    bytesRead += batch.length;
+                    metrics::job().bytesRead.add(batch.length);
+                    work.push(batch);
+                    metrics::job().queueDepth.set((int64_t)work.size());
+                    if (reports && progress && std::chrono::steady_clock::now() - reported >= std::chrono::milliseconds(500))
+                    {
+                        progress(bytesRead, source.size());
+                        reported = std::chrono::steady_clock::now();
+                    }
+                }
+            };
+            std::vector<std::thread> readers;
+            for (blk::BlockSource* stripe : stripes)
+            {
+                readers.emplace_back([&, stripe]() {
+                    trace::nameThread("refresh reader");
+                    reader(*stripe, false);
+                });
+            }
+            reader(source, true);
+            for (auto& t : readers) {
+                t.join();
+            }
+            report.bytesRead = bytesRead;
+            work.close();
+            for (auto& t : pool) {
+                t.join();
+            }
+            // the old manifest stays. it no longer matches the image if anything was written
+            nv2::throw_if(readFailed, nv2::acc("Source read failed, use -cv with -rm for a failing disk"));
+            nv2::throw_if(failed, nv2::acc("Image write failed"));
+            nv2::throw_if(!image->finish(), nv2::acc("Unable to complete the image"));
+            image.reset();
+
+            report.changed = changed;
+            report.bytesWritten = written;
+            nv2::throw_if(!fresh.stamp(imagePath) || !fresh.save(manifestFile),
+                          nv2::acc("Unable to write ") << manifestFile.wstring());
+            if (progress) {
+                progress(source.size(), source.size());
+            }
+            return report;
+        }
+
+        //-----------------------------------------------------------------------------
+        // a clone of a disk in use that catches up with it, as a live migration
+        // does. the first pass copies everything; each pass after re-reads and
+        // hashes the whole disk and writes only the blocks that changed since the
+        // one before, so a pass costs a read at hashing speed plus the delta.
+        // live passes stop when one writes no more than 'threshold' bytes, writes
+        // no less than the one before, or after 'maxPasses'. a last pass then
+        // reads from a snapshot, which is held only for as long as that pass.
+        struct ConvergeOptions
+        {
+            // bytes a pass may write and be the last live pass
+            uint64_t threshold = 64 * 1024 * 1024;
+            // live passes after the first
+            unsigned maxPasses = 8;
+            uint32_t blockSize = 1024 * 1024;
+            size_t readSize = 8 * 1024 * 1024;
+            unsigned threads = 0;
+        };
+
+        struct PassReport
+        {
+            RefreshReport refresh;
+            double seconds = 0;
+            // read from the snapshot
+            bool snapshot = false;
+        };
+
+        struct ConvergeReport
+        {
+            std::vector<PassReport> passes;
+            // a live pass got under the threshold, rather than the passes giving up
+            bool converged = false;
+            // the last pass read from a snapshot
+            bool consistent = false;
+            double seconds = 0;
+        };
+
+        // takes a consistent view of the source, runs the pass on it and lets it
+        // go. false if there is nothing to take a view of
+        using Snapshot = std::function<bool(const std::function<void(blk::BlockSource&)>&)>;
+
+        // 'imagePath' is a raw image or fixed VHD, created if it does not exist.
+        // without a snapshot the image is as of the last live pass, which is not
+        // consistent. 'passed' is called as each pass ends
+        static ConvergeReport converge(blk::BlockSource& source, const std::filesystem::path& imagePath,
+                                       const ConvergeOptions& options, const Snapshot& snapshot,
+                                       const std::function<void(uint64_t, uint64_t)>& progress = nullptr,
+                                       const std::function<void(const PassReport&)>& passed = nullptr,
+                                       const std::vector<blk::BlockSource*>& stripes = std::vector<blk::BlockSource*>())
+        {
+            ConvergeReport report;
+            auto started = std::chrono::steady_clock::now();
+            img::Kind kind = img::kindFor(imagePath);
+            nv2::throw_if(kind != img::Kind::Raw && kind != img::Kind::FixedVhd,
+                          nv2::acc("A converging clone needs a raw image or fixed VHD, not ") << img::kindName(kind));
+            std::filesystem::path manifestFile = manifestPath(imagePath);
+            std::error_code ec;
+            if (!std::filesystem::exists(imagePath, ec))
+            {
+                uint64_t size = (source.size() + 511) & ~511ull;
+                std::unique_ptr<img::ImageWriter> image = img::create(imagePath, size, false, source.sectorSize());
+                nv2::throw_if(!image || !image->finish(), nv2::acc("Unable to create ") << imagePath.wstring());
+                image.reset();
+                // a new image is all zero, so its manifest needs no reading
+                BlockManifest zero(size, options.blockSize);
+                std::vector<BYTE> zeros(options.blockSize, 0);
+                for (size_t b = 0; b < zero.blocks(); b++) {
+                    zero.hashes[b] = hash::xxh64(zeros.data(), (size_t)(std::min)((uint64_t)options.blockSize, size - (uint64_t)b * options.blockSize));
+                }
+                nv2::throw_if(!zero.stamp(imagePath) || !zero.save(manifestFile),
+                              nv2::acc("Unable to write ") << manifestFile.wstring());
+            }
+
+            auto pass = [&](blk::BlockSource& from, const std::vector<blk::BlockSource*>& handles, bool snapshotted) {
+                auto begun = std::chrono::steady_clock::now();
+                PassReport p;
+                p.snapshot = snapshotted;
+                p.refresh = refresh(from, imagePath, manifestFile, options.threads, options.blockSize, options.readSize, progress, handles);
+                p.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begun).count();
+                report.passes.push_back(p);
+                if (passed) {
+                    passed(p);
+                }
+                return p.refresh.bytesWritten;
+            };
+
+            // the full pass, or a catch up if an earlier run left an image
+            uint64_t previous = pass(source, stripes, false);
+            for (unsigned i = 0; i < options.maxPasses; i++)
+            {
+                uint64_t written = pass(source, stripes, false);
+                if (written <= options.threshold)
+                {
+                    report.converged = true;
+                    break;
+                }
+                // the disk changes as fast as the passes catch up
+                if (written >= previous) {
+                    break;
+                }
+                previous = written;
+            }
+            if (snapshot)
+            {
+                report.consistent = snapshot([&](blk::BlockSource& view) {
+                    pass(view, std::vector<blk::BlockSource*>(), true);
+                });
+            }
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            return report;
+        }
+
+        //-----------------------------------------------------------------------------
+        // one source, several images. each chunk is read once into a buffer that
+        // all targets share; every target has its own writer thread and queue, so
+        // a slow one falls behind by up to 'maxLag' chunks before the reader, and
+        // with it every other target, waits for it.
+        struct FanOutOptions
+        {
+            size_t chunkSize = 4 * 1024 * 1024;
+            // chunks a target may fall behind
+            size_t maxLag = 32;
+            // fill FanOutReport::manifest as the source is read
+            bool hashBlocks = false;
+        };
+
+        struct TargetReport
+        {
+            img::Kind kind = img::Kind::Raw;
+            uint64_t bytesWritten = 0;
+            // times the reader waited for this target
+            uint64_t stalls = 0;
+            double seconds = 0;
+            // empty if the image is complete
+            std::string error;
+        };
+
+        struct FanOutReport
+        {
+            uint64_t size = 0;
+            uint64_t bytesRead = 0;
+            double seconds = 0;
+            std::vector<TargetReport> targets;
+            // of the source, for every raw or fixed VHD target
+            BlockManifest manifest;
+        };
+
+        static FanOutReport fanOut(blk::BlockSource& source, const std::vector<img::ImageWriter*>& images,
+                                   const FanOutOptions& options = FanOutOptions(),
+                                   const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            struct Chunk
+            {
+                blk::AlignedBuffer buffer;
+                uint64_t offset = 0;
+                size_t length = 0;
+                explicit Chunk(size_t size) : buffer(size) {}
+            };
+            using ChunkPtr = std::shared_ptr<const Chunk>;
+
+            FanOutReport report;
+            report.size = source.size();
+            report.targets.resize(images.size());
+            auto started = std::chrono::steady_clock::now();
+            DWORD ss = (std::max)(source.sectorSize(), (DWORD)512);
+            size_t chunkSize = (std::max)((size_t)ss, options.chunkSize / ss * ss);
+            if (options.hashBlocks)
+            {
+                // 1MB blocks as -rf uses, or whole chunks if they do not divide
+                uint32_t blockSize = (chunkSize % (1024 * 1024)) ? (uint32_t)chunkSize : 1024 * 1024;
+                report.manifest = BlockManifest((report.size + 511) & ~511ull, blockSize);
+            }
+
+            std::vector<std::unique_ptr<BoundedQueue<ChunkPtr>>> queues;
+            std::vector<std::atomic<bool>> failed(images.size());
+            std::vector<std::thread> writers;
+            for (size_t i = 0; i < images.size(); i++)
+            {
+                queues.emplace_back(new BoundedQueue<ChunkPtr>(options.maxLag));
+                failed[i] = false;
+                report.targets[i].kind = images[i]->kind();
+            }
+            for (size_t i = 0; i < images.size(); i++)
+            {
+                writers.emplace_back([&, i]() {
+                    trace::nameThread("fan-out writer");
+                    TargetReport& t = report.targets[i];
+                    ChunkPtr chunk;
+                    while (queues[i]->pop(chunk))
+                    {
+                        if (failed[i]) {
+                            continue;
+                        }
+                        trace::Stage stage("write", "offset", chunk->offset);
+                        metrics::Timer timer(metrics::job().writeLatency);
+                        if (!images[i]->write(chunk->offset, chunk->buffer.data(), chunk->length))
+                        {
+                            t.error = "write failed at " + std::to_string(chunk->offset);
+                            failed[i] = true;
+                            // the reader stops feeding us; let go of what is queued
+                            queues[i]->close();
+                            continue;
+                        }
+                        t.bytesWritten += chunk->length;
+                        metrics::job().bytesWritten.add(chunk->length);
+                        chunk.reset();
+                    }
+                    if (!failed[i] && t.bytesWritten == report.size && !images[i]->finish()) {
+                        t.error = "unable to complete the image";
+                    }
+                    t.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+                });
+            }
+
+            std::string readError;
+            auto reported = started;
+            for (uint64_t offset = 0; offset < report.size; offset += chunkSize)
+            {
+                std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>(chunkSize);
+                chunk->offset = offset;
+                chunk->length = (size_t)(std::min)((uint64_t)chunkSize, report.size - offset);
+                trace::Stage read("read", "offset", offset);
+                metrics::Timer timer(metrics::job().readLatency);
+                if (!source.read(offset, chunk->buffer.data(), chunk->length))
+                {
+                    readError = "Source read failed at " + std::to_string(offset) + ", use -cv with -rm for a failing disk";
+                    metrics::job().readErrors.add();
+                    break;
+                }
+                timer.end();
+                read.end();
+                report.bytesRead += chunk->length;
+                metrics::job().bytesRead.add(chunk->length);
+                for (size_t done = 0; options.hashBlocks && done < chunk->length; done += report.manifest.blockSize)
+                {
+                    size_t length = (std::min)((size_t)report.manifest.blockSize, chunk->length - done);
+                    report.manifest.hashes[(size_t)((offset + done) / report.manifest.blockSize)] = hash::xxh64(chunk->buffer.data() + done, length);
+                }
+                size_t live = 0;
+                size_t depth = 0;
+                for (size_t i = 0; i < images.size(); i++)
+                {
+                    if (failed[i]) {
+                        continue;
+                    }
+                    live++;
+                    if (queues[i]->size() >= options.maxLag) {
+                        report.targets[i].stalls++;
+                    }
+                    queues[i]->push(chunk);
+                    depth = (std::max)(depth, queues[i]->size());
+                }
+                // the deepest queue: the target furthest behind
+                metrics::job().queueDepth.set((int64_t)depth);
+                if (live == 0) {
+                    break;
+                }
+                if (progress && std::chrono::steady_clock::now() - reported >= std::chrono::milliseconds(500))
+                {
+                    progress(offset + chunk->length, report.size);
+                    reported = std::chrono::steady_clock::now();
+                }
+            }
+            for (auto& q : queues) {
+                q->close();
+            }
+            for (auto& t : writers) {
+                t.join();
+            }
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            nv2::throw_if(!readError.empty(), nv2::acc(readError.c_str()));
+            for (TargetReport& t : report.targets)
+            {
+                if (t.error.empty() && t.bytesWritten != report.size) {
+                    t.error = "incomplete";
+                }
+            }
+            if (progress) {
+                progress(report.bytesRead, report.size);
+            }
+            return report;
+        }
+    }
+}
@@ -0,0 +1,721 @@
+/*
+
+    Persistent cache for wde2::enumerate()
+
+    The enumerated DiskInfo map is stored in a compact binary file
+    keyed by device number/path along with a cheap ChangeToken
+    (size, layout hash, serial) per device. On the next run only
+    the tokens are re-read; devices whose token changed are
+    re-queried and everything else comes straight from the cache.
+    Any change in the set of devices forces a full enumeration.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <vector>
+#include <map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "structs.h"
+
+// must follow the platform backend. see enumerate() below
+#ifdef _WIN32
+// wde2.h
+#else
+#include "lnx_sysfs.h"
+#endif
+
+namespace wde2
+{
+    namespace cache
+    {
+        // 'WDEC' + version
+        static const uint32_t _magic = 0x43454457;
+        // 2: StorageClass
+        static const uint32_t _version = 2;
+
+        //-----------------------------------------------------------------------------
+        // FNV-1a. only needs to be cheap and stable across runs
+        static uint64_t fnv1a(uint64_t h, const void* data, size_t length)
+        {
+            const uint8_t* p = (const uint8_t*)data;
+            for (size_t i = 0; i < length; i++) {
+                h ^= p[i];
+                h *= 0x100000001b3ull;
+            }
+            return h;
+        }
+        static const uint64_t _fnvBasis = 0xcbf29ce484222325ull;
+
+        //-----------------------------------------------------------------------------
+        // hash of the fields that identify a layout. padding is never hashed.
+        static uint64_t layoutHash(DWORD style, const void* id, size_t idLength,
+                                   const PARTITION_INFORMATION_EX* entries, DWORD count)
+        {
+            uint64_t h = fnv1a(_fnvBasis, &style, sizeof(style));
+            h = fnv1a(h, id, idLength);
+            for (DWORD i = 0; i < count; i++)
+            {
+                const PARTITION_INFORMATION_EX& e = entries[i];
+                h = fnv1a(h, &e.StartingOffset.QuadPart, sizeof(LONGLONG));
+                h = fnv1a(h, &e.PartitionLength.QuadPart, sizeof(LONGLONG));
+                if (style == PARTITION_STYLE_MBR) {
+                    h = fnv1a(h, &e.Mbr.PartitionType, sizeof(e.Mbr.PartitionType));
+                }
+                else if (style == PARTITION_STYLE_GPT) {
+                    h = fnv1a(h, &e.Gpt.PartitionType, sizeof(GUID));
+                    h = fnv1a(h, &e.Gpt.PartitionId, sizeof(GUID));
+                }
+            }
+            return h;
+        }
+
+        static uint64_t layoutHash(const wde2::DiskInfo& di)
+        {
+            std::vector<PARTITION_INFORMATION_EX> entries;
+            for (auto& p : di.partitions) {
+                entries.push_back(p.second.piex);
+            }
+            const DRIVE_LAYOUT_INFORMATION_EX& dl = di.DriveLayout;
+            if (dl.PartitionStyle == PARTITION_STYLE_GPT) {
+                return layoutHash(dl.PartitionStyle, &dl.Gpt.DiskId, sizeof(GUID), entries.data(), (DWORD)entries.size());
+            }
+            return layoutHash(dl.PartitionStyle, &dl.Mbr.Signature, sizeof(DWORD), entries.data(), (DWORD)entries.size());
+        }
+
+        //-----------------------------------------------------------------------------
+        // little endian, fixed width. wide strings are stored as UTF-16 code
+        // units so a file written on Windows reads back on Linux and vice versa.
+        class ByteWriter
+        {
+            std::vector<uint8_t> m_buffer;
+        public:
+            void u8(uint8_t v) { m_buffer.push_back(v); }
+            void u16(uint16_t v) { u8((uint8_t)v); u8((uint8_t)(v >> 8)); }
+            void u32(uint32_t v) { u16((uint16_t)v); u16((uint16_t)(v >> 16)); }
+            void u64(uint64_t v) { u32((uint32_t)v); u32((uint32_t)(v >> 32)); }
+            void bytes(const void* p, size_t n) { m_buffer.insert(m_buffer.end(), (const uint8_t*)p, (const uint8_t*)p + n); }
+            void guid(const GUID& g) { u32(g.Data1); u16(g.Data2); u16(g.Data3); bytes(g.Data4, 8); }
+            void wstr(const std::wstring& s)
+            {
+                u32((uint32_t)s.size());
+                for (wchar_t c : s) {
+                    u16((uint16_t)c);
+                }
+            }
+            const std::vector<uint8_t>& buffer() const { return m_buffer; }
+        };
+
+        //-----------------------------------------------------------------------------
+        // rename a complete 'tmp' over 'path'. the data reaches the disk before
+        // the rename and the rename before we return, so a crash leaves the old
+        // file or the new one. 'tmp' is removed on failure.
+        static bool commitAtomically(const std::filesystem::path& tmp, const std::filesystem::path& path)
+        {
+            bool ok = false;
+#ifdef _WIN32
+            HANDLE h = ::CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (h != INVALID_HANDLE_VALUE)
+            {
+                ok = ::FlushFileBuffers(h) != FALSE;
+                ::CloseHandle(h);
+            }
+            ok = ok && ::MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+#else
+            int fd = ::open(tmp.c_str(), O_WRONLY | O_CLOEXEC);
+            if (fd >= 0)
+            {
+                ok = ::fsync(fd) == 0;
+                ::close(fd);
+            }
+            std::error_code ec;
+            if (ok)
+            {
+                std::filesystem::rename(tmp, path, ec);
+                ok = !ec;
+            }
+            if (ok)
+            {
+                std::filesystem::path parent = path.parent_path();
+                int dir = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                ok = dir >= 0 && ::fsync(dir) == 0;
+                if (dir >= 0) {
+                    ::close(dir);
+                }
+            }
+#endif
+            if (!ok)
+            {
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+            }
+            return ok;
+        }
+
+        // write 'path' through a temporary, see commitAtomically()
+        static bool saveAtomically(const std::filesystem::path& path, const void* data, size_t length)
+        {
+            std::filesystem::path tmp = path;
+            tmp += ".tmp";
+            bool ok = false;
+            {
+                std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+                os.write((const char*)data, (std::streamsize)length);
+                ok = !!os;
+            }
+            if (!ok)
+            {
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                return false;
+            }
+            return commitAtomically(tmp, path);
+        }
+
+        static bool saveAtomically(const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+        {
+            return saveAtomically(path, bytes.data(), bytes.size());
+        }
+
+        class ByteReader
+        {
+            const uint8_t* m_p = nullptr;
+            const uint8_t* m_end = nullptr;
+            bool m_ok = true;
+            bool need(size_t n)
+            {
+                if (!m_ok || (size_t)(m_end - m_p) < n) {
+                    m_ok = false;
+                }
+                return m_ok;
+            }
+        public:
+            ByteReader(const uint8_t* p, size_t n) : m_p(p), m_end(p + n) {}
+            bool ok() const { return m_ok; }
+            bool eof() const { return m_p >= m_end; }
+            uint8_t u8() { if (!need(1)) return 0; return *m_p++; }
+            uint16_t u16() { uint16_t lo = u8(); return (uint16_t)(lo | (u8() << 8)); }
+            uint32_t u32() { uint32_t lo = u16(); return lo | ((uint32_t)u16() << 16); }
+            uint64_t u64() { uint64_t lo = u32(); return lo | ((uint64_t)u32() << 32); }
+            void bytes(void* p, size_t n) { if (need(n)) { memcpy(p, m_p, n); m_p += n; } }
+            GUID guid() { GUID g; g.Data1 = u32(); g.Data2 = u16(); g.Data3 = u16(); bytes(g.Data4, 8); return g; }
+            std::wstring wstr()
+            {
+                std::wstring s;
+                uint32_t n = u32();
+                if (!need((size_t)n * 2)) {
+                    return s;
+                }
+                s.reserve(n);
+                for (uint32_t i = 0; i < n; i++) {
+                    s.push_back((wchar_t)u16());
+                }
+                return s;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        static void writePartition(ByteWriter& w, DWORD style, const PARTITION_INFORMATION_EX& piex)
+        {
+            w.u32(piex.PartitionStyle);
+            w.u64((uint64_t)piex.StartingOffset.QuadPart);
+            w.u64((uint64_t)piex.PartitionLength.QuadPart);
+            w.u32(piex.PartitionNumber);
+            w.u8(piex.RewritePartition);
+            w.u8(piex.IsServicePartition);
+            if (style == PARTITION_STYLE_GPT)
+            {
+                w.guid(piex.Gpt.PartitionType);
+                w.guid(piex.Gpt.PartitionId);
+                w.u64(piex.Gpt.Attributes);
+                for (int c = 0; c < 36; c++) {
+                    w.u16((uint16_t)piex.Gpt.Name[c]);
+                }
+            }
+            else
+            {
+                w.u8(piex.Mbr.PartitionType);
+                w.u8(piex.Mbr.BootIndicator);
+                w.u8(piex.Mbr.RecognizedPartition);
+                w.u32(piex.Mbr.HiddenSectors);
+                w.guid(piex.Mbr.PartitionId);
+            }
+        }
+
+        static PARTITION_INFORMATION_EX readPartition(ByteReader& r, DWORD style)
+        {
+            PARTITION_INFORMATION_EX piex;
+            memset(&piex, 0, sizeof(piex));
+            piex.PartitionStyle = (PARTITION_STYLE)r.u32();
+            piex.StartingOffset.QuadPart = (LONGLONG)r.u64();
+            piex.PartitionLength.QuadPart = (LONGLONG)r.u64();
+            piex.PartitionNumber = r.u32();
+            piex.RewritePartition = r.u8();
+            piex.IsServicePartition = r.u8();
+            if (style == PARTITION_STYLE_GPT)
+            {
+                piex.Gpt.PartitionType = r.guid();
+                piex.Gpt.PartitionId = r.guid();
+                piex.Gpt.Attributes = r.u64();
+                for (int c = 0; c < 36; c++) {
+                    piex.Gpt.Name[c] = (WCHAR)r.u16();
+                }
+            }
+            else
+            {
+                piex.Mbr.PartitionType = r.u8();
+                piex.Mbr.BootIndicator = r.u8();
+                piex.Mbr.RecognizedPartition = r.u8();
+                piex.Mbr.HiddenSectors = r.u32();
+                piex.Mbr.PartitionId = r.guid();
+            }
+            return piex;
+        }
+
+        //-----------------------------------------------------------------------------
+        static void writeDiskInfo(ByteWriter& w, const wde2::DiskInfo& di)
+        {
+            w.u32(di.StorageDeviceNumber.DeviceType);
+            w.u32(di.StorageDeviceNumber.DeviceNumber);
+            w.u32(di.StorageDeviceNumber.PartitionNumber);
+            w.wstr(di.DevicePath);
+            w.wstr(di.DeviceName);
+            w.wstr(di.SerialNumber);
+            w.wstr(di.VendorId);
+            w.wstr(di.ProductId);
+            w.wstr(di.ProductRevision);
+            w.u8(di.canBePartitioned);
+            w.u64((uint64_t)di.Geometry.Cylinders.QuadPart);
+            w.u32((uint32_t)di.Geometry.MediaType);
+            w.u32(di.Geometry.TracksPerCylinder);
+            w.u32(di.Geometry.SectorsPerTrack);
+            w.u32(di.Geometry.BytesPerSector);
+            w.u64((uint64_t)di.DiskSize.QuadPart);
+            w.u32((uint32_t)di.Storage.BusType);
+            w.u8(di.Storage.hasSeekPenalty);
+            w.u8(di.Storage.IncursSeekPenalty);
+            w.u8(di.Storage.hasTrim);
+            w.u8(di.Storage.TrimEnabled);
+            w.u64(di.Storage.MaxUnmapBytes);
+            w.u32(di.Storage.BytesPerPhysicalSector);
+            w.u32(di.Storage.BytesOffsetForSectorAlignment);
+            const DRIVE_LAYOUT_INFORMATION_EX& dl = di.DriveLayout;
+            w.u32(dl.PartitionStyle);
+            w.u32(dl.PartitionCount);
+            if (dl.PartitionStyle == PARTITION_STYLE_GPT)
+            {
+                w.guid(dl.Gpt.DiskId);
+                w.u64((uint64_t)dl.Gpt.StartingUsableOffset.QuadPart);
+                w.u64((uint64_t)dl.Gpt.UsableLength.QuadPart);
+                w.u32(dl.Gpt.MaxPartitionCount);
+            }
+            else
+            {
+                w.u32(dl.Mbr.Signature);
+                w.u32(dl.Mbr.CheckSum);
+            }
+            writePartition(w, dl.PartitionStyle, dl.PartitionEntry[0]);
+            w.u32((uint32_t)di.partitions.size());
+            for (auto& p : di.partitions)
+            {
+                w.u32(p.first);
+                w.wstr(p.second.volumeID);
+                writePartition(w, dl.PartitionStyle, p.second.piex);
+            }
+        }
+
+        static bool readDiskInfo(ByteReader& r, wde2::DiskInfo& di)
+        {
+            di.StorageDeviceNumber.DeviceType = r.u32();
+            di.StorageDeviceNumber.DeviceNumber = r.u32();
+            di.StorageDeviceNumber.PartitionNumber = r.u32();
+            di.DevicePath = r.wstr();
+            di.DeviceName = r.wstr();
+            di.SerialNumber = r.wstr();
+            di.VendorId = r.wstr();
+            di.ProductId = r.wstr();
+            di.ProductRevision = r.wstr();
+            di.canBePartitioned = r.u8() != 0;
+            di.Geometry.Cylinders.QuadPart = (LONGLONG)r.u64();
+            di.Geometry.MediaType = (MEDIA_TYPE)r.u32();
+            di.Geometry.TracksPerCylinder = r.u32();
+            di.Geometry.SectorsPerTrack = r.u32();
+            di.Geometry.BytesPerSector = r.u32();
+            di.DiskSize.QuadPart = (LONGLONG)r.u64();
+            di.Storage.BusType = (STORAGE_BUS_TYPE)r.u32();
+            di.Storage.hasSeekPenalty = r.u8() != 0;
+            di.Storage.IncursSeekPenalty = r.u8() != 0;
+            di.Storage.hasTrim = r.u8() != 0;
+            di.Storage.TrimEnabled = r.u8() != 0;
+            di.Storage.MaxUnmapBytes = r.u64();
+            di.Storage.BytesPerPhysicalSector = r.u32();
+            di.Storage.BytesOffsetForSectorAlignment = r.u32();
+            DRIVE_LAYOUT_INFORMATION_EX& dl = di.DriveLayout;
+            memset(&dl, 0, sizeof(dl));
+            dl.PartitionStyle = r.u32();
+            dl.PartitionCount = r.u32();
+            if (dl.PartitionStyle == PARTITION_STYLE_GPT)
+            {
+                dl.Gpt.DiskId = r.guid();
+                dl.Gpt.StartingUsableOffset.QuadPart = (LONGLONG)r.u64();
+                dl.Gpt.UsableLength.QuadPart = (LONGLONG)r.u64();
+                dl.Gpt.MaxPartitionCount = r.u32();
+            }
+            else
+            {
+                dl.Mbr.Signature = r.u32();
+                dl.Mbr.CheckSum = r.u32();
+            }
+            dl.PartitionEntry[0] = readPartition(r, dl.PartitionStyle);
+            di.partitions.clear();
+            uint32_t count = r.u32();
+            for (uint32_t i = 0; i < count && r.ok(); i++)
+            {
+                DWORD key = r.u32();
+                wde2::PartitionInfo partitionInfo;
+                partitionInfo.volumeID = r.wstr();
+                partitionInfo.piex = readPartition(r, dl.PartitionStyle);
+                di.partitions[key] = partitionInfo;
+            }
+            return r.ok();
+        }
+
+        //-----------------------------------------------------------------------------
+        struct Entry
+        {
+            wde2::ChangeToken token;
+            wde2::DiskInfo diskInfo;
+        };
+        using CacheMap = std::map<int, Entry>;
+
+        static void writeToken(ByteWriter& w, const wde2::ChangeToken& t)
+        {
+            w.u64(t.DiskSize);
+            w.u64(t.LayoutHash);
+            w.wstr(t.SerialNumber);
+        }
+
+        static wde2::ChangeToken readToken(ByteReader& r)
+        {
+            wde2::ChangeToken t;
+            t.DiskSize = r.u64();
+            t.LayoutHash = r.u64();
+            t.SerialNumber = r.wstr();
+            return t;
+        }
+
+        //-----------------------------------------------------------------------------
+        // whole file in one read. false if missing, truncated or wrong version.
+        static bool load(const std::filesystem::path& path, CacheMap& entries)
+        {
+            entries.clear();
+            std::ifstream is(path, std::ios::binary);
+            if (!is) {
+                return false;
+            }
+            std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+            ByteReader r(data.data(), data.size());
+            if (r.u32() != _magic || r.u32() != _version) {
+                return false;
+            }
+            uint32_t count = r.u32();
+            for (uint32_t i = 0; i < count && r.ok(); i++)
+            {
+                int key = (int)r.u32();
+                Entry e;
+                e.token = readToken(r);
+                if (!readDiskInfo(r, e.diskInfo)) {
+                    break;
+                }
+                entries[key] = e;
+            }
+            if (!r.ok()) {
+                entries.clear();
+            }
+            return r.ok();
+        }
+
+        static bool save(const std::filesystem::path& path, const CacheMap& entries)
+        {
+            ByteWriter w;
+            w.u32(_magic);
+            w.u32(_version);
+            w.u32((uint32_t)entries.size());
+            for (auto& e : entries)
+            {
+                w.u32((uint32_t)e.first);
+                writeToken(w, e.second.token);
+                writeDiskInfo(w, e.second.diskInfo);
+            }
+            return saveAtomically(path, w.buffer());
+        }
+
+#ifdef _WIN32
+        //-----------------------------------------------------------------------------
+        static HANDLE OpenPhysicalDrive(int deviceNumber)
+        {
+            nv2::acc name = L"\\\\.\\PhysicalDrive";
+            name << deviceNumber;
+            return CreateFile(name.wstr().c_str(),
+                GENERIC_READ,
+                FILE_SHARE_READ | FILE_SHARE_WRITE,
+                NULL,
+                OPEN_EXISTING,
+                0,
+                NULL);
+        }
+
+        //-----------------------------------------------------------------------------
+        // three IOCTLs, no SetupDi
+        static bool ReadChangeToken(int deviceNumber, wde2::ChangeToken& token)
+        {
+            HANDLE hDevice = OpenPhysicalDrive(deviceNumber);
+            if (hDevice == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            uw32::Handle wh(hDevice);
+            DWORD bytesReturned = 0;
+
+            GET_LENGTH_INFORMATION gli{ 0 };
+            BOOL ok = DeviceIoControl(hDevice, IOCTL_DISK_GET_LENGTH_INFO,
+                NULL, 0, &gli, sizeof(gli), &bytesReturned, NULL);
+            if (!ok) {
+                return false;
+            }
+            token.DiskSize = (uint64_t)gli.Length.QuadPart;
+
+            std::vector<BYTE> layout;
+            if (!GetDriveLayoutEx(hDevice, layout)) {
+                return false;
+            }
+            const DRIVE_LAYOUT_INFORMATION_EX* pdl = (const DRIVE_LAYOUT_INFORMATION_EX*)layout.data();
+            if (pdl->PartitionStyle == PARTITION_STYLE_GPT) {
+                token.LayoutHash = layoutHash(pdl->PartitionStyle, &pdl->Gpt.DiskId, sizeof(GUID), pdl->PartitionEntry, pdl->PartitionCount);
+            }
+            else {
+                token.LayoutHash = layoutHash(pdl->PartitionStyle, &pdl->Mbr.Signature, sizeof(DWORD), pdl->PartitionEntry, pdl->PartitionCount);
+            }
+
+            STORAGE_PROPERTY_QUERY query;
+            ZeroMemory(&query, sizeof(query));
+            query.PropertyId = StorageDeviceProperty;
+            query.QueryType = PropertyStandardQuery;
+            char propQueryOut[_8KB] = { 0 };
+            ok = DeviceIoControl(hDevice, IOCTL_STORAGE_QUERY_PROPERTY,
+                &query, sizeof(query), &propQueryOut, sizeof(propQueryOut), &bytesReturned, NULL);
+            STORAGE_DEVICE_DESCRIPTOR* pDevDesc = (STORAGE_DEVICE_DESCRIPTOR*)&propQueryOut[0];
+            token.SerialNumber.clear();
+            if (ok && pDevDesc->SerialNumberOffset) {
+                token.SerialNumber = nv2::n2w(&propQueryOut[pDevDesc->SerialNumberOffset]);
+            }
+            return true;
+        }
+
+        // device numbers are dense in practice. a disk appearing past the
+        // highest cached number means something was plugged in.
+        static bool DeviceSetChanged(const CacheMap& entries)
+        {
+            int highest = entries.empty() ? -1 : entries.rbegin()->first;
+            for (int n = highest + 1; n <= highest + 4; n++)
+            {
+                HANDLE hDevice = OpenPhysicalDrive(n);
+                if (hDevice != INVALID_HANDLE_VALUE) {
+                    CloseHandle(hDevice);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // re-query in place. DevicePath and StorageDeviceNumber carry over.
+        static bool Requery(int deviceNumber, wde2::DiskInfo& diskInfo)
+        {
+            HANDLE hDevice = OpenPhysicalDrive(deviceNumber);
+            if (hDevice == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            uw32::Handle wh(hDevice);
+            QueryDiskProperties(hDevice, diskInfo);
+            return true;
+        }
+#else
+        //-----------------------------------------------------------------------------
+        // sysfs size and serial plus one pread of the leading sectors
+        static bool ReadChangeToken(const wde2::DiskInfo& cached, wde2::ChangeToken& token)
+        {
+            // DevicePath is the resolved /sys/devices/.../block/<name> directory
+            std::string sysPath(cached.DevicePath.begin(), cached.DevicePath.end());
+            lnx::Fd dirfd(::open(sysPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            if (!dirfd) {
+                return false;
+            }
+            token.DiskSize = lnx::readAttrU64(dirfd.get(), "size") * 512;
+            {
+                lnx::Fd device(::openat(dirfd.get(), "device", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+                std::string serial = lnx::readAttr(device.get(), "serial");
+                if (serial.empty()) {
+                    serial = lnx::serialFromVpd80(lnx::readRaw(device.get(), "vpd_pg80"));
+                }
+                token.SerialNumber = lnx::widen(serial);
+            }
+            wde2::DiskInfo probe;
+            probe.Geometry = cached.Geometry;
+            probe.DiskSize.QuadPart = (LONGLONG)token.DiskSize;
+            std::string devicePath(cached.DeviceName.begin(), cached.DeviceName.end());
+            lnx::readLayout(devicePath, probe);
+            token.LayoutHash = layoutHash(probe);
+            return true;
+        }
+
+        static std::vector<std::string> deviceNames(const lnx::SysfsConfig& cfg)
+        {
+            std::vector<std::string> names;
+            std::string blockRoot = cfg.sysRoot + "/block";
+            if (DIR* dir = ::opendir(blockRoot.c_str()))
+            {
+                while (struct dirent* de = ::readdir(dir))
+                {
+                    if (lnx::isWholeDisk(de->d_name)) {
+                        names.push_back(de->d_name);
+                    }
+                }
+                ::closedir(dir);
+            }
+            std::sort(names.begin(), names.end(), lnx::deviceOrder);
+            return names;
+        }
+#endif
+
+        //-----------------------------------------------------------------------------
+        // Cached enumerate(). An empty path, or any failure to use the cache,
+        // falls back to a full enumeration.
+#ifdef _WIN32
+        std::map<int, wde2::DiskInfo> enumerate(const std::filesystem::path& path)
+#else
+        std::map<int, wde2::DiskInfo> enumerate(const std::filesystem::path& path,
+                                                const lnx::SysfsConfig& cfg = lnx::SysfsConfig())
+#endif
+        {
+#ifdef _WIN32
+            auto fullEnumerate = [&]() { return wde2::enumerate(); };
+            auto readToken = [&](int n, const wde2::DiskInfo&, wde2::ChangeToken& t) { return ReadChangeToken(n, t); };
+            auto requery = [&](int n, wde2::DiskInfo& di) { return Requery(n, di); };
+#else
+            auto fullEnumerate = [&]() { return wde2::enumerate(cfg); };
+            auto readToken = [&](int, const wde2::DiskInfo& di, wde2::ChangeToken& t) { return ReadChangeToken(di, t); };
+            auto requery = [&](int n, wde2::DiskInfo& di) {
+                std::string name(di.DeviceName.begin(), di.DeviceName.end());
+                name = name.substr(name.find_last_of('/') + 1);
+                di = lnx::queryDevice(cfg, name, n);
+                return true;
+            };
+#endif
+            if (path.empty()) {
+                return fullEnumerate();
+            }
+
+            CacheMap entries;
+            bool valid = load(path, entries) && !entries.empty();
+#ifdef _WIN32
+            valid = valid && !DeviceSetChanged(entries);
+#else
+            if (valid)
+            {
+                // device number is the index in sorted name order
+                std::vector<std::string> names = deviceNames(cfg);
+                valid = (names.size() == entries.size());
+                for (size_t i = 0; valid && i < names.size(); i++)
+                {
+                    auto it = entries.find((int)i);
+                    valid = (it != entries.end()
+                        && it->second.diskInfo.DeviceName == lnx::widen(cfg.devRoot + "/" + names[i]));
+                }
+            }
+#endif
+            bool dirty = !valid;
+            if (valid)
+            {
+                for (auto& e : entries)
+                {
+                    wde2::ChangeToken token;
+                    if (!readToken(e.first, e.second.diskInfo, token)) {
+                        // vanished
+                        valid = false;
+                        break;
+                    }
+                    if (token != e.second.token)
+                    {
+                        DBMSG2("cache: refreshing " << e.second.diskInfo.DeviceName);
+                        if (!requery(e.first, e.second.diskInfo)) {
+                            valid = false;
+                            break;
+                        }
+                        e.second.token = token;
+                        dirty = true;
+                    }
+                }
+            }
+
+            if (!valid)
+            {
+                DBMSG2("cache: full enumeration");
+                entries.clear();
+                std::map<int, wde2::DiskInfo> vdi = fullEnumerate();
+                for (auto& d : vdi)
+                {
+                    Entry e;
+                    e.diskInfo = d.second;
+                    readToken(d.first, d.second, e.token);
+                    entries[d.first] = e;
+                }
+                dirty = true;
+            }
+
+            if (dirty && !save(path, entries)) {
+                DBMSG("Unable to write enumeration cache " << path.wstring());
+            }
+
+            std::map<int, wde2::DiskInfo> vdi;
+            for (auto& e : entries) {
+                vdi[e.first] = e.second.diskInfo;
+            }
+            return vdi;
+        }
+    }
+}
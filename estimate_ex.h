@@ -0,0 +1,550 @@
+/*
+
+    Estimate what a clone will produce before running it.
+
+    A sample of 2MB blocks, the VHDX block size, is read at random from
+    each partition of the disk and from the space between them, on
+    several threads and at a limited rate so that a disk in use is not
+    swamped. Each block is checked for zeros and compressed as the .wda
+    writer would compress it. A NTFS volume's $Bitmap gives the share of
+    its clusters in use. Sequential reads at the start, middle and end
+    of the disk measure how fast a clone can read it.
+
+    From these the size of each image format and the time the clone
+    takes are predicted. The sizes are stratified estimates with normal
+    confidence bounds; the times span the slowest and fastest of the
+    three throughput probes, since a hard disk reads its inner tracks at
+    half the rate of the outer ones.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "blk_io.h"
+#include "img_io.h"
+#include "img_write.h"
+#include "lznt1.h"
+#include "ntfs_extract.h"
+#include "pt_raw.h"
+
+namespace wde2
+{
+    namespace estimate
+    {
+        // a VHDX block, two .wda blocks
+        static const size_t _sampleBlock = 2 * 1024 * 1024;
+        static const size_t _archiveBlock = 1024 * 1024;
+        // compressed again to time LZNT1
+        static const size_t _timedBlocks = 16;
+        // $Bitmap is MFT record 6
+        static const uint64_t _recordBitmap = 6;
+
+        //-----------------------------------------------------------------------------
+        struct Options
+        {
+            // blocks read in all, shared between the regions by size
+            uint32_t samples = 512;
+            // but no fewer than this from each region
+            uint32_t minimumSamples = 16;
+            unsigned threads = 4;
+            // sampling reads, bytes per second. 0 for no limit
+            uint64_t maxRate = 100 * 1024 * 1024;
+            // each of the three throughput probes
+            double probeSeconds = 2;
+            // normal quantile of the size bounds, 1.96 for 95%
+            double z = 1.96;
+            // 0 seeds from std::random_device
+            uint64_t seed = 0;
+        };
+
+        // a partition, or the space before, between or after them
+        struct Region
+        {
+            // 0 outside any partition
+            uint32_t partition = 0;
+            uint64_t offset = 0;
+            uint64_t length = 0;
+            // "NTFS" where the volume could be read
+            const char* fileSystem = "";
+            uint32_t samples = 0;
+            // of the sampled blocks
+            double zeroRatio = 0;
+            // compressed / original over the sampled blocks that were not zero
+            double compressRatio = 1;
+            // clusters in use per $Bitmap, -1 if not known
+            double allocated = -1;
+        };
+
+        struct Prediction
+        {
+            img::Kind kind = img::Kind::Raw;
+            uint64_t bytes = 0;
+            uint64_t bytesLow = 0;
+            uint64_t bytesHigh = 0;
+            double seconds = 0;
+            double secondsLow = 0;
+            double secondsHigh = 0;
+        };
+
+        struct Report
+        {
+            uint64_t size = 0;
+            DWORD sectorSize = 512;
+            std::vector<Region> regions;
+            uint64_t samples = 0;
+            uint64_t bytesSampled = 0;
+            double zeroRatio = 0;
+            double compressRatio = 1;
+            // sequential read, bytes per second: the mean and the range of the probes
+            double readRate = 0;
+            double readRateLow = 0;
+            double readRateHigh = 0;
+            // LZNT1 on all cores, bytes per second
+            double compressRate = 0;
+            // raw, fixed VHD, VHDX and .wda
+            std::vector<Prediction> predictions;
+            double seconds = 0;
+
+            const Prediction* find(img::Kind kind) const
+            {
+                for (const Prediction& p : predictions)
+                {
+                    if (p.kind == kind) {
+                        return &p;
+                    }
+                }
+                return nullptr;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // paces reads from several threads to an average rate
+        class Throttle
+        {
+            std::mutex m_lock;
+            std::chrono::steady_clock::time_point m_next = std::chrono::steady_clock::now();
+            uint64_t m_rate;
+
+        public:
+            explicit Throttle(uint64_t rate) : m_rate(rate) {}
+
+            void wait(size_t bytes)
+            {
+                if (m_rate == 0) {
+                    return;
+                }
+                std::chrono::steady_clock::time_point start;
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    start = (std::max)(m_next, std::chrono::steady_clock::now());
+                    m_next = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>((double)bytes / m_rate));
+                }
+                std::this_thread::sleep_until(start);
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // the partitions of the layout and the gaps around them, in disk order
+        static std::vector<Region> regions(blk::BlockSource& source)
+        {
+            std::vector<Region> parts;
+            wde2::DiskInfo di;
+            if (pt::parseAnySectorSize(source, di) && di.DriveLayout.PartitionStyle != PARTITION_STYLE_RAW)
+            {
+                for (auto& partition : di.partitions)
+                {
+                    const PARTITION_INFORMATION_EX& piex = partition.second.piex;
+                    if (piex.PartitionStyle == PARTITION_STYLE_MBR && pt::isExtendedMbrType(piex.Mbr.PartitionType)) {
+                        continue;
+                    }
+                    Region r;
+                    r.partition = piex.PartitionNumber;
+                    r.offset = (uint64_t)piex.StartingOffset.QuadPart;
+                    r.length = (std::min)((uint64_t)piex.PartitionLength.QuadPart, source.size() - (std::min)(source.size(), r.offset));
+                    if (r.length) {
+                        parts.push_back(r);
+                    }
+                }
+            }
+            std::sort(parts.begin(), parts.end(), [](const Region& a, const Region& b) { return a.offset < b.offset; });
+            std::vector<Region> all;
+            uint64_t end = 0;
+            for (const Region& r : parts)
+            {
+                if (r.offset > end)
+                {
+                    Region gap;
+                    gap.offset = end;
+                    gap.length = r.offset - end;
+                    all.push_back(gap);
+                }
+                if (r.offset + r.length > end)
+                {
+                    all.push_back(r);
+                    all.back().offset = (std::max)(r.offset, end);
+                    all.back().length = r.offset + r.length - all.back().offset;
+                    end = r.offset + r.length;
+                }
+            }
+            if (end < source.size())
+            {
+                Region gap;
+                gap.offset = end;
+                gap.length = source.size() - end;
+                all.push_back(gap);
+            }
+            return all;
+        }
+
+        // share of clusters in use, from $Bitmap. -1 if not NTFS or unreadable
+        static double allocated(blk::BlockSource& source, const Region& region)
+        {
+            ntfs::MftReader reader(source, region.offset, region.length);
+            ntfs::Record rec;
+            if (!reader.open() || !reader.readFile(_recordBitmap, rec)) {
+                return -1;
+            }
+            uint64_t clusters = region.length / reader.volume().clusterSize;
+            uint64_t used = 0, seen = 0;
+            ntfs::DataReader data(reader, rec);
+            bool ok = data.read([&](uint64_t, const BYTE* p, size_t n) {
+                for (size_t i = 0; i < n && seen < clusters; i++)
+                {
+                    BYTE b = p[i];
+                    if (clusters - seen < 8) {
+                        b &= (BYTE)((1u << (clusters - seen)) - 1);
+                    }
+                    for (; b; b &= (BYTE)(b - 1)) {
+                        used++;
+                    }
+                    seen += 8;
+                }
+                return true;
+            });
+            return (ok && seen) ? (double)used / clusters : -1;
+        }
+
+        //-----------------------------------------------------------------------------
+        // one sampled block: what each format stores for it
+        struct Sample
+        {
+            size_t region = 0;
+            uint64_t offset = 0;
+            size_t length = 0;
+            bool zero = true;
+            // .wda records, headers included
+            uint64_t archived = 0;
+            uint64_t compressedFrom = 0;
+            uint64_t compressedTo = 0;
+        };
+
+        // [0, n) in random order, the first k of them
+        static std::vector<uint64_t> pick(uint64_t n, uint64_t k, std::mt19937_64& random)
+        {
+            std::vector<uint64_t> picked;
+            if (k >= n)
+            {
+                for (uint64_t i = 0; i < n; i++) {
+                    picked.push_back(i);
+                }
+                return picked;
+            }
+            // Floyd's algorithm: k distinct values without an n sized table
+            for (uint64_t j = n - k; j < n; j++)
+            {
+                uint64_t t = std::uniform_int_distribution<uint64_t>(0, j)(random);
+                picked.push_back(std::find(picked.begin(), picked.end(), t) == picked.end() ? t : j);
+            }
+            std::sort(picked.begin(), picked.end());
+            return picked;
+        }
+
+        // sequential read at 'offset' for about 'seconds'. bytes per second
+        static double probe(blk::BlockSource& source, uint64_t offset, double seconds, blk::AlignedBuffer& buffer)
+        {
+            auto started = std::chrono::steady_clock::now();
+            uint64_t bytes = 0;
+            double elapsed = 0;
+            while (offset < source.size() && elapsed < seconds)
+            {
+                size_t n = (size_t)(std::min)((uint64_t)buffer.size(), source.size() - offset);
+                if (!source.read(offset, buffer.data(), n)) {
+                    break;
+                }
+                offset += n;
+                bytes += n;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            }
+            return elapsed > 0 ? bytes / elapsed : 0;
+        }
+
+        //-----------------------------------------------------------------------------
+        // 'source' must allow reads from several threads at once, as FileSource
+        // does. throws if nothing could be read
+        static Report run(blk::BlockSource& source, const Options& options = Options(),
+                          const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            Report report;
+            auto started = std::chrono::steady_clock::now();
+            report.size = source.size();
+            report.sectorSize = source.sectorSize();
+            nv2::throw_if(report.size == 0, nv2::acc("Nothing to estimate"));
+            report.regions = regions(source);
+            std::mt19937_64 random(options.seed ? options.seed : ((uint64_t)std::random_device()() << 32 | std::random_device()()));
+
+            // samples by size, then the blocks of each region at random
+            std::vector<Sample> samples;
+            for (size_t i = 0; i < report.regions.size(); i++)
+            {
+                Region& r = report.regions[i];
+                uint64_t blocks = (r.length + _sampleBlock - 1) / _sampleBlock;
+                uint64_t share = (uint64_t)std::ceil((double)options.samples * r.length / report.size);
+                r.samples = (uint32_t)(std::min)(blocks, (std::max)(share, (uint64_t)options.minimumSamples));
+                for (uint64_t b : pick(blocks, r.samples, random))
+                {
+                    Sample s;
+                    s.region = i;
+                    s.offset = r.offset + b * _sampleBlock;
+                    s.length = (size_t)(std::min)((uint64_t)_sampleBlock, r.offset + r.length - s.offset);
+                    samples.push_back(s);
+                }
+            }
+            std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.offset < b.offset; });
+
+            Throttle throttle(options.maxRate);
+            std::atomic<size_t> next(0), done(0), failed(0);
+            // a few blocks to time the compressor on, once the readers are done
+            std::mutex keepLock;
+            std::vector<std::vector<BYTE>> kept;
+            auto work = [&]() {
+                blk::AlignedBuffer buffer(_sampleBlock);
+                std::vector<BYTE> packed(ntfs::lznt1Bound(_archiveBlock));
+                for (size_t i = next++; i < samples.size(); i = next++)
+                {
+                    Sample& s = samples[i];
+                    throttle.wait(s.length);
+                    if (!source.read(s.offset, buffer.data(), s.length))
+                    {
+                        failed++;
+                        s.length = 0;
+                        continue;
+                    }
+                    for (size_t at = 0; at < s.length; at += _archiveBlock)
+                    {
+                        size_t n = (std::min)(_archiveBlock, s.length - at);
+                        s.archived += img::_archiveRecord + 8;
+                        if (img::isZero(buffer.data() + at, n)) {
+                            continue;
+                        }
+                        s.zero = false;
+                        size_t c = ntfs::lznt1Compress(buffer.data() + at, n, packed.data());
+                        {
+                            std::lock_guard<std::mutex> lock(keepLock);
+                            if (kept.size() < _timedBlocks) {
+                                kept.emplace_back(buffer.data() + at, buffer.data() + at + n);
+                            }
+                        }
+                        s.compressedFrom += n;
+                        s.compressedTo += (std::min)(c, n);
+                        s.archived += (std::min)(c, n);
+                    }
+                    size_t d = ++done;
+                    if (progress && d % 16 == 0) {
+                        progress(d, samples.size());
+                    }
+                }
+            };
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < (std::max)(1u, options.threads); t++) {
+                threads.emplace_back(work);
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+            nv2::throw_if(failed == samples.size(), nv2::acc("Unable to read any of ") << samples.size() << " sampled blocks");
+
+            for (Region& r : report.regions) {
+                r.allocated = allocated(source, r);
+                r.fileSystem = r.allocated >= 0 ? "NTFS" : "";
+            }
+
+            // whole disk reads for the duration
+            {
+                blk::AlignedBuffer buffer(_sampleBlock);
+                uint64_t span = (uint64_t)(options.probeSeconds * 1024 * 1024 * 1024);
+                uint64_t middle = report.size / 2 / _sampleBlock * _sampleBlock;
+                uint64_t last = report.size > span ? (report.size - span) / _sampleBlock * _sampleBlock : 0;
+                double sum = 0;
+                int probes = 0;
+                for (uint64_t offset : { (uint64_t)0, middle, last })
+                {
+                    double rate = probe(source, offset, options.probeSeconds, buffer);
+                    if (rate <= 0) {
+                        continue;
+                    }
+                    report.readRateLow = probes ? (std::min)(report.readRateLow, rate) : rate;
+                    report.readRateHigh = (std::max)(report.readRateHigh, rate);
+                    sum += rate;
+                    probes++;
+                }
+                report.readRate = probes ? sum / probes : 0;
+            }
+
+            // per region: the mean stored bytes of a block for each format, scaled
+            // up by the blocks in the region. the variance with the finite
+            // population correction, as the blocks are drawn without replacement
+            struct Stratum
+            {
+                double n = 0, zero = 0, from = 0, to = 0;
+                double sumV = 0, sumV2 = 0, sumA = 0, sumA2 = 0;
+            };
+            std::vector<Stratum> strata(report.regions.size());
+            for (const Sample& s : samples)
+            {
+                if (s.length == 0) {
+                    continue;
+                }
+                Stratum& st = strata[s.region];
+                double v = s.zero ? 0 : (double)s.length;
+                double a = (double)s.archived;
+                st.n++;
+                st.zero += s.zero ? 1 : 0;
+                st.from += (double)s.compressedFrom;
+                st.to += (double)s.compressedTo;
+                st.sumV += v;
+                st.sumV2 += v * v;
+                st.sumA += a;
+                st.sumA2 += a * a;
+                report.samples++;
+                report.bytesSampled += s.length;
+            }
+            double vhdx = 0, vhdxVar = 0, archive = 0, archiveVar = 0;
+            double zeroBlocks = 0, compressed = 0, nonZero = 0;
+            for (size_t i = 0; i < strata.size(); i++)
+            {
+                Stratum& st = strata[i];
+                Region& r = report.regions[i];
+                double blocks = std::ceil((double)r.length / _sampleBlock);
+                if (st.n == 0) {
+                    continue;
+                }
+                r.zeroRatio = st.zero / st.n;
+                r.compressRatio = st.from > 0 ? st.to / st.from : 1;
+                auto total = [&](double sum, double sum2, double& mean, double& var) {
+                    mean = sum / st.n;
+                    double s2 = st.n > 1 ? (sum2 - sum * mean) / (st.n - 1) : 0;
+                    var = blocks * blocks * (1 - st.n / blocks) * (std::max)(0.0, s2) / st.n;
+                    mean *= blocks;
+                };
+                double m, v;
+                total(st.sumV, st.sumV2, m, v);
+                vhdx += m;
+                vhdxVar += v;
+                total(st.sumA, st.sumA2, m, v);
+                archive += m;
+                archiveVar += v;
+                zeroBlocks += r.zeroRatio * blocks;
+                compressed += r.compressRatio * (1 - r.zeroRatio) * blocks;
+                nonZero += (1 - r.zeroRatio) * blocks;
+            }
+            double totalBlocks = std::ceil((double)report.size / _sampleBlock);
+            report.zeroRatio = zeroBlocks / totalBlocks;
+            report.compressRatio = nonZero > 0 ? compressed / nonZero : 1;
+            // one core alone: timing inside the readers counts the time they
+            // wait for each other when there are more threads than cores
+            if (!kept.empty())
+            {
+                std::vector<BYTE> packed(ntfs::lznt1Bound(_archiveBlock));
+                uint64_t bytes = 0;
+                auto t = std::chrono::steady_clock::now();
+                for (const std::vector<BYTE>& k : kept)
+                {
+                    ntfs::lznt1Compress(k.data(), k.size(), packed.data());
+                    bytes += k.size();
+                }
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+                report.compressRate = elapsed > 0 ? bytes / elapsed * (std::max)(1u, std::thread::hardware_concurrency()) : 0;
+            }
+
+            // the formats, headers and tables included
+            // as VhdxWriter lays them out
+            uint64_t chunkRatio = ((1ull << 23) * (report.sectorSize == 4096 ? 4096 : 512)) / _sampleBlock;
+            uint64_t entries = (uint64_t)totalBlocks + ((uint64_t)totalBlocks - 1) / chunkRatio;
+            uint64_t bat = (std::max)(img::_vhdxMB, (entries * 8 + img::_vhdxMB - 1) / img::_vhdxMB * img::_vhdxMB);
+            uint64_t vhdxFixed = 3 * img::_vhdxMB + bat;
+            uint64_t archiveFixed = img::_archiveHeader + img::_archiveTrailer;
+            auto predict = [&](img::Kind kind, double bytes, double variance, double fixed) {
+                Prediction p;
+                p.kind = kind;
+                double bound = options.z * std::sqrt(variance);
+                p.bytes = (uint64_t)(fixed + bytes);
+                p.bytesLow = (uint64_t)(fixed + (std::max)(0.0, bytes - bound));
+                p.bytesHigh = (uint64_t)(fixed + (std::min)((double)report.size * 1.01, bytes + bound));
+                // every format reads the whole disk
+                if (report.readRate > 0)
+                {
+                    p.seconds = report.size / report.readRate;
+                    p.secondsLow = report.size / report.readRateHigh;
+                    p.secondsHigh = report.size / report.readRateLow;
+                }
+                // and .wda is limited by the compressor too
+                if (kind == img::Kind::Archive && report.compressRate > 0)
+                {
+                    double compress = report.size * (1 - report.zeroRatio) / report.compressRate;
+                    p.seconds = (std::max)(p.seconds, compress);
+                    p.secondsLow = (std::max)(p.secondsLow, compress);
+                    p.secondsHigh = (std::max)(p.secondsHigh, compress);
+                }
+                report.predictions.push_back(p);
+            };
+            predict(img::Kind::Raw, (double)report.size, 0, 0);
+            predict(img::Kind::FixedVhd, (double)report.size, 0, 512);
+            predict(img::Kind::Vhdx, vhdx, vhdxVar, (double)vhdxFixed);
+            predict(img::Kind::Archive, archive, archiveVar, (double)archiveFixed);
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            if (progress) {
+                progress(samples.size(), samples.size());
+            }
+            return report;
+        }
+    }
+}
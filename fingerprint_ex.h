@@ -0,0 +1,332 @@
+/*
+
+    Disk fingerprints: which images already held is a disk nearly a copy of?
+
+    A fingerprint is a MinHash sketch of the set of block hashes of a
+    sample of the disk. Blocks are sampled by their index alone, one in
+    'rate', so every disk and image samples the same blocks whatever its
+    size, and a disk cloned from an image shares most of its sampled
+    blocks with it. Zero blocks are left out, or every mostly empty disk
+    would look like every other.
+
+    Each of the 128 slots keeps the least of one hash function over the
+    set. The share of slots two fingerprints agree on estimates the
+    Jaccard similarity of their sets, to within about 0.05 near 0.5. A
+    comparison is 128 integer compares; a store of thousands of images
+    is searched in well under a millisecond.
+
+    On disk, a store is:
+
+        u32 magic, u32 version, u32 count, then per fingerprint:
+        wstr name, u64 size, u32 blockSize, u32 rate, u32 samples,
+        u32 minimums[128]
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blk_io.h"
+#include "enum_cache.h"
+#include "hash_ex.h"
+#include "img_io.h"
+#include "img_write.h"
+
+namespace wde2
+{
+    namespace fingerprint
+    {
+        static const uint32_t _magic = 0x50464457;   // 'WDFP'
+        static const uint32_t _version = 1;
+        // minimums per fingerprint
+        static const size_t _slots = 128;
+
+        //-----------------------------------------------------------------------------
+        struct Options
+        {
+            uint32_t blockSize = 64 * 1024;
+            // one block in 'rate'. 64MB read per TB by default
+            uint32_t rate = 1024;
+            unsigned threads = 4;
+        };
+
+        // splitmix64 finalizer
+        static uint64_t mix(uint64_t h)
+        {
+            h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+            h ^= h >> 27; h *= 0x94d049bb133111ebull;
+            h ^= h >> 31;
+            return h;
+        }
+
+        // block indices are picked by a hash of the index, not its position,
+        // so a larger disk samples the same blocks as a smaller one and more
+        static bool sampled(uint64_t block, uint32_t rate)
+        {
+            return mix(block ^ 0x5744465053414d50ull) % rate == 0;
+        }
+
+        //-----------------------------------------------------------------------------
+        struct Fingerprint
+        {
+            // the image path, or the disk
+            std::wstring name;
+            uint64_t size = 0;
+            uint32_t blockSize = 0;
+            uint32_t rate = 0;
+            // blocks in the set: sampled and not zero
+            uint32_t samples = 0;
+            uint32_t minimums[_slots];
+
+            Fingerprint()
+            {
+                std::fill(minimums, minimums + _slots, 0xFFFFFFFFu);
+            }
+
+            void add(uint64_t blockHash)
+            {
+                for (size_t i = 0; i < _slots; i++)
+                {
+                    uint32_t v = (uint32_t)(mix(blockHash ^ (0x9e3779b97f4a7c15ull * (i + 1))) >> 32);
+                    minimums[i] = (std::min)(minimums[i], v);
+                }
+            }
+
+            void merge(const Fingerprint& other)
+            {
+                for (size_t i = 0; i < _slots; i++) {
+                    minimums[i] = (std::min)(minimums[i], other.minimums[i]);
+                }
+                samples += other.samples;
+            }
+
+            // estimated Jaccard similarity of the sampled blocks, 0 to 1. 0 if
+            // sampled differently or either set is empty
+            double similarity(const Fingerprint& other) const
+            {
+                if (blockSize != other.blockSize || rate != other.rate || samples == 0 || other.samples == 0) {
+                    return 0;
+                }
+                unsigned same = 0;
+                for (size_t i = 0; i < _slots; i++) {
+                    same += (minimums[i] == other.minimums[i]) ? 1 : 0;
+                }
+                return (double)same / _slots;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        struct Report
+        {
+            uint64_t blocks = 0;
+            uint64_t zeroBlocks = 0;
+            uint64_t bytesRead = 0;
+            uint64_t readErrors = 0;
+        };
+
+        // throws if none of the sampled blocks could be read
+        static Fingerprint take(blk::BlockSource& source, const std::wstring& name, Report& report,
+                                const Options& options = Options(),
+                                const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            Fingerprint fp;
+            fp.name = name;
+            fp.size = source.size();
+            fp.blockSize = options.blockSize;
+            fp.rate = options.rate;
+
+            // whole blocks only. a partial last block would not match a larger disk's
+            std::vector<uint64_t> picked;
+            for (uint64_t b = 0; b < source.size() / options.blockSize; b++)
+            {
+                if (sampled(b, options.rate)) {
+                    picked.push_back(b);
+                }
+            }
+            report.blocks = picked.size();
+
+            std::atomic<size_t> next{ 0 };
+            std::atomic<uint64_t> done{ 0 };
+            std::mutex lock;
+            auto work = [&]() {
+                Fingerprint local;
+                blk::AlignedBuffer buffer(options.blockSize);
+                uint64_t zero = 0, read = 0, errors = 0;
+                for (size_t i = next++; i < picked.size(); i = next++)
+                {
+                    if (!source.read(picked[i] * options.blockSize, buffer.data(), options.blockSize)) {
+                        errors++;
+                    }
+                    else if (img::isZero(buffer.data(), options.blockSize)) {
+                        zero++;
+                    }
+                    else
+                    {
+                        local.add(hash::xxh64(buffer.data(), options.blockSize));
+                        local.samples++;
+                    }
+                    read += options.blockSize;
+                    uint64_t d = ++done;
+                    if (progress && d % 256 == 0) {
+                        progress(d, picked.size());
+                    }
+                }
+                std::lock_guard<std::mutex> guard(lock);
+                fp.merge(local);
+                report.zeroBlocks += zero;
+                report.bytesRead += read;
+                report.readErrors += errors;
+            };
+            std::vector<std::thread> threads;
+            for (unsigned t = 1; t < (std::max)(1u, options.threads); t++) {
+                threads.emplace_back(work);
+            }
+            work();
+            for (auto& t : threads) {
+                t.join();
+            }
+            nv2::throw_if(picked.size() && report.readErrors == picked.size(),
+                          nv2::acc("Unable to read any of ") << picked.size() << " sampled blocks");
+            if (progress) {
+                progress(picked.size(), picked.size());
+            }
+            return fp;
+        }
+
+        //-----------------------------------------------------------------------------
+        // fingerprints of the images held, by name
+        class Store
+        {
+            std::vector<Fingerprint> m_fingerprints;
+
+        public:
+            const std::vector<Fingerprint>& fingerprints() const { return m_fingerprints; }
+
+            // a missing file is an empty store. false if it is not a store
+            bool load(const std::filesystem::path& path)
+            {
+                m_fingerprints.clear();
+                std::error_code ec;
+                if (!std::filesystem::exists(path, ec)) {
+                    return true;
+                }
+                std::ifstream is(path, std::ios::binary);
+                if (!is) {
+                    return false;
+                }
+                std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+                cache::ByteReader r(data.data(), data.size());
+                if (r.u32() != _magic || r.u32() != _version) {
+                    return false;
+                }
+                uint32_t count = r.u32();
+                for (uint32_t i = 0; i < count && r.ok(); i++)
+                {
+                    Fingerprint fp;
+                    fp.name = r.wstr();
+                    fp.size = r.u64();
+                    fp.blockSize = r.u32();
+                    fp.rate = r.u32();
+                    fp.samples = r.u32();
+                    for (uint32_t& m : fp.minimums) {
+                        m = r.u32();
+                    }
+                    m_fingerprints.push_back(fp);
+                }
+                return r.ok();
+            }
+
+            bool save(const std::filesystem::path& path) const
+            {
+                cache::ByteWriter w;
+                w.u32(_magic);
+                w.u32(_version);
+                w.u32((uint32_t)m_fingerprints.size());
+                for (const Fingerprint& fp : m_fingerprints)
+                {
+                    w.wstr(fp.name);
+                    w.u64(fp.size);
+                    w.u32(fp.blockSize);
+                    w.u32(fp.rate);
+                    w.u32(fp.samples);
+                    for (uint32_t m : fp.minimums) {
+                        w.u32(m);
+                    }
+                }
+                return cache::saveAtomically(path, w.buffer());
+            }
+
+            // replaces one of the same name
+            void put(const Fingerprint& fp)
+            {
+                for (Fingerprint& f : m_fingerprints)
+                {
+                    if (f.name == fp.name)
+                    {
+                        f = fp;
+                        return;
+                    }
+                }
+                m_fingerprints.push_back(fp);
+            }
+
+            // up to 'count' of the most similar, best first, leaving out 'fp' itself
+            std::vector<std::pair<double, const Fingerprint*>> best(const Fingerprint& fp, size_t count) const
+            {
+                std::vector<std::pair<double, const Fingerprint*>> found;
+                for (const Fingerprint& f : m_fingerprints)
+                {
+                    double s = f.similarity(fp);
+                    if (s > 0 && f.name != fp.name) {
+                        found.emplace_back(s, &f);
+                    }
+                }
+                count = (std::min)(count, found.size());
+                std::partial_sort(found.begin(), found.begin() + count, found.end(),
+                    [](const std::pair<double, const Fingerprint*>& a, const std::pair<double, const Fingerprint*>& b) {
+                        return a.first > b.first;
+                    });
+                found.resize(count);
+                return found;
+            }
+        };
+    }
+}
@@ -0,0 +1,580 @@
+/*
+
+    File level backup of a directory tree, i.e. from a VSS snapshot.
+
+    A work-stealing pool walks the tree: every directory and file is
+    a task on the queue of the thread that found it. Owners take the
+    newest task, idle threads steal the oldest from the others, so one
+    huge directory does not leave the rest of the pool waiting.
+
+    Files are copied in large unbuffered (FILE_FLAG_NO_BUFFERING or
+    O_DIRECT) chunks and hashed (XXH64) on the way. The previous run's
+    manifest (size, modification time, hash per relative path) lets
+    unchanged files be skipped: same size and time skips without
+    reading, same size and hash skips without writing. A new manifest
+    is written at the end for the next run.
+
+    Nothing here is specific to snapshots; point it at any directory.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "blk_io.h"
+#include "enum_cache.h"
+#include "hash_ex.h"
+
+namespace wde2
+{
+    namespace backup
+    {
+        static const uint32_t _magic = 0x4D464457;   // 'WDFM'
+        static const uint32_t _version = 1;
+
+        // unbuffered I/O wants sector aligned buffers, offsets and lengths
+        static const size_t _alignment = 4096;
+
+        //-----------------------------------------------------------------------------
+        // one file as of the last run. path is relative to the backup root, UTF-8, '/' separated
+        struct Entry
+        {
+            uint64_t size = 0;
+            // file_time_type ticks, only compared with the same platform's
+            int64_t modified = 0;
+            uint64_t hash = 0;
+        };
+        using Manifest = std::map<std::string, Entry>;
+
+        static bool loadManifest(const std::filesystem::path& path, Manifest& manifest)
+        {
+            manifest.clear();
+            std::ifstream is(path, std::ios::binary);
+            if (!is) {
+                return false;
+            }
+            std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+            cache::ByteReader r(data.data(), data.size());
+            if (r.u32() != _magic || r.u32() != _version) {
+                return false;
+            }
+            uint64_t count = r.u64();
+            for (uint64_t i = 0; i < count && r.ok(); i++)
+            {
+                uint32_t n = r.u32();
+                if (n > data.size()) {
+                    break;
+                }
+                std::string name(n, '\0');
+                r.bytes(&name[0], n);
+                Entry e;
+                e.size = r.u64();
+                e.modified = (int64_t)r.u64();
+                e.hash = r.u64();
+                manifest[name] = e;
+            }
+            if (!r.ok() || manifest.size() != count) {
+                manifest.clear();
+                return false;
+            }
+            return true;
+        }
+
+        static bool saveManifest(const std::filesystem::path& path, const Manifest& manifest)
+        {
+            cache::ByteWriter w;
+            w.u32(_magic);
+            w.u32(_version);
+            w.u64(manifest.size());
+            for (auto& m : manifest)
+            {
+                w.u32((uint32_t)m.first.size());
+                w.bytes(m.first.data(), m.first.size());
+                w.u64(m.second.size);
+                w.u64((uint64_t)m.second.modified);
+                w.u64(m.second.hash);
+            }
+            return cache::saveAtomically(path, w.buffer());
+        }
+
+        //-----------------------------------------------------------------------------
+        // per-thread deques. owners push and pop at the back, thieves take the front.
+        template <typename T>
+        class StealingPool
+        {
+            struct Lane
+            {
+                std::mutex lock;
+                std::deque<T> tasks;
+            };
+            std::vector<Lane> m_lanes;
+            // queued or running
+            std::atomic<uint64_t> m_pending{ 0 };
+
+            bool pop(size_t lane, T& task)
+            {
+                {
+                    Lane& own = m_lanes[lane];
+                    std::lock_guard<std::mutex> g(own.lock);
+                    if (!own.tasks.empty())
+                    {
+                        task = std::move(own.tasks.back());
+                        own.tasks.pop_back();
+                        return true;
+                    }
+                }
+                for (size_t i = 1; i < m_lanes.size(); i++)
+                {
+                    Lane& victim = m_lanes[(lane + i) % m_lanes.size()];
+                    std::lock_guard<std::mutex> g(victim.lock);
+                    if (!victim.tasks.empty())
+                    {
+                        task = std::move(victim.tasks.front());
+                        victim.tasks.pop_front();
+                        steals++;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+        public:
+            std::atomic<uint64_t> steals{ 0 };
+
+            explicit StealingPool(size_t lanes) : m_lanes((std::max)((size_t)1, lanes)) {}
+            size_t lanes() const { return m_lanes.size(); }
+
+            void push(size_t lane, T task)
+            {
+                m_pending++;
+                Lane& l = m_lanes[lane % m_lanes.size()];
+                std::lock_guard<std::mutex> g(l.lock);
+                l.tasks.push_back(std::move(task));
+            }
+
+            // f(size_t lane, T& task) may push more. returns when all are done.
+            template <typename F>
+            void run(F f)
+            {
+                auto worker = [&](size_t lane) {
+                    T task;
+                    unsigned idle = 0;
+                    while (m_pending.load() != 0)
+                    {
+                        if (!pop(lane, task))
+                        {
+                            // others are still expanding directories
+                            if (++idle < 64) {
+                                std::this_thread::yield();
+                            }
+                            else {
+                                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                            }
+                            continue;
+                        }
+                        idle = 0;
+                        f(lane, task);
+                        m_pending--;
+                    }
+                };
+                std::vector<std::thread> threads;
+                for (size_t i = 1; i < m_lanes.size(); i++) {
+                    threads.emplace_back(worker, i);
+                }
+                worker(0);
+                for (auto& t : threads) {
+                    t.join();
+                }
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // sequential, optionally unbuffered. falls back to buffered I/O
+        // where the file system refuses (i.e. tmpfs and O_DIRECT)
+        class SequentialFile
+        {
+#ifdef _WIN32
+            HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+            int m_fd = -1;
+#endif
+            bool m_unbuffered = false;
+
+        public:
+            SequentialFile() {}
+            ~SequentialFile() { close(); }
+            SequentialFile(const SequentialFile&) = delete;
+            SequentialFile& operator=(const SequentialFile&) = delete;
+
+            bool open(const std::filesystem::path& path, bool write, bool unbuffered)
+            {
+                close();
+                m_unbuffered = unbuffered;
+#ifdef _WIN32
+                DWORD flags = write ? FILE_FLAG_WRITE_THROUGH : FILE_FLAG_SEQUENTIAL_SCAN;
+                m_handle = ::CreateFileW(path.c_str(),
+                                        write ? GENERIC_WRITE : GENERIC_READ,
+                                        write ? 0 : (FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE),
+                                        NULL,
+                                        write ? CREATE_ALWAYS : OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL | flags | (unbuffered ? FILE_FLAG_NO_BUFFERING : 0),
+                                        NULL);
+                if (m_handle == INVALID_HANDLE_VALUE && unbuffered) {
+                    return open(path, write, false);
+                }
+                return m_handle != INVALID_HANDLE_VALUE;
+#else
+                int flags = write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+                m_fd = ::open(path.c_str(), flags | O_CLOEXEC | (unbuffered ? O_DIRECT : 0), 0644);
+                if (m_fd < 0 && unbuffered && errno == EINVAL) {
+                    return open(path, write, false);
+                }
+                return m_fd >= 0;
+#endif
+            }
+
+            void close()
+            {
+#ifdef _WIN32
+                if (m_handle != INVALID_HANDLE_VALUE) {
+                    ::CloseHandle(m_handle);
+                }
+                m_handle = INVALID_HANDLE_VALUE;
+#else
+                if (m_fd >= 0) {
+                    ::close(m_fd);
+                }
+                m_fd = -1;
+#endif
+            }
+
+            bool unbuffered() const { return m_unbuffered; }
+
+            // bytes read, short only at the end of the file. -1 on error
+            int64_t read(BYTE* buffer, size_t length)
+            {
+                size_t done = 0;
+                while (done < length)
+                {
+#ifdef _WIN32
+                    DWORD n = 0;
+                    if (!::ReadFile(m_handle, buffer + done, (DWORD)(length - done), &n, NULL)) {
+                        return -1;
+                    }
+#else
+                    ssize_t n = ::read(m_fd, buffer + done, length - done);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n < 0) {
+                        return -1;
+                    }
+#endif
+                    if (n == 0) {
+                        break;
+                    }
+                    done += (size_t)n;
+                    // unbuffered reads stop short only at the end
+                    if (m_unbuffered && done % _alignment) {
+                        break;
+                    }
+                }
+                return (int64_t)done;
+            }
+
+            bool write(const BYTE* buffer, size_t length)
+            {
+                size_t done = 0;
+                while (done < length)
+                {
+#ifdef _WIN32
+                    DWORD n = 0;
+                    if (!::WriteFile(m_handle, buffer + done, (DWORD)(length - done), &n, NULL) || n == 0) {
+                        return false;
+                    }
+#else
+                    ssize_t n = ::write(m_fd, buffer + done, length - done);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        return false;
+                    }
+#endif
+                    done += (size_t)n;
+                }
+                return true;
+            }
+
+            // drop the padding of the last unbuffered write
+            bool truncate(uint64_t size)
+            {
+#ifdef _WIN32
+                FILE_END_OF_FILE_INFO eof;
+                eof.EndOfFile.QuadPart = (LONGLONG)size;
+                return ::SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &eof, sizeof(eof)) != FALSE;
+#else
+                return ::ftruncate(m_fd, (off_t)size) == 0;
+#endif
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        struct Options
+        {
+            // 0 => one per core
+            unsigned threads = 0;
+            // per thread
+            size_t bufferSize = 4 * 1024 * 1024;
+            bool unbuffered = true;
+        };
+
+        struct Report
+        {
+            std::atomic<uint64_t> directories{ 0 };
+            std::atomic<uint64_t> files{ 0 };
+            std::atomic<uint64_t> copied{ 0 };
+            // same size and time
+            std::atomic<uint64_t> unchanged{ 0 };
+            // time changed, content did not
+            std::atomic<uint64_t> sameHash{ 0 };
+            std::atomic<uint64_t> bytesCopied{ 0 };
+            std::atomic<uint64_t> bytesHashed{ 0 };
+            std::atomic<uint64_t> steals{ 0 };
+            // in the previous manifest, gone from the source. the copy in the
+            // destination is kept; only the manifest forgets it
+            uint64_t stale = 0;
+            std::mutex lock;
+            std::vector<std::string> failures;
+
+            void fail(const std::string& what)
+            {
+                std::lock_guard<std::mutex> g(lock);
+                failures.push_back(what);
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // 'to' == nullptr only hashes. unbuffered chunks are rounded up to the
+        // alignment, the destination truncated to the real size at the end.
+        static bool copyFile(const std::filesystem::path& from, const std::filesystem::path* to,
+                             blk::AlignedBuffer& buffer, bool unbuffered, uint64_t& hash, uint64_t& bytes)
+        {
+            SequentialFile in;
+            SequentialFile out;
+            if (!in.open(from, false, unbuffered) || (to && !out.open(*to, true, unbuffered))) {
+                return false;
+            }
+            hash::Xxh64 h;
+            bytes = 0;
+            for (;;)
+            {
+                int64_t n = in.read(buffer.data(), buffer.size());
+                if (n < 0) {
+                    return false;
+                }
+                if (n == 0) {
+                    break;
+                }
+                h.update(buffer.data(), (size_t)n);
+                bytes += (uint64_t)n;
+                if (to)
+                {
+                    size_t length = (size_t)n;
+                    if (out.unbuffered() && length % _alignment)
+                    {
+                        size_t padded = (length + _alignment - 1) / _alignment * _alignment;
+                        memset(buffer.data() + length, 0, padded - length);
+                        length = padded;
+                    }
+                    if (!out.write(buffer.data(), length)) {
+                        return false;
+                    }
+                }
+                if ((size_t)n < buffer.size()) {
+                    break;
+                }
+            }
+            hash = h.digest();
+            return !to || !out.unbuffered() || out.truncate(bytes);
+        }
+
+        static std::string relativeName(const std::filesystem::path& relative)
+        {
+            return relative.generic_u8string();
+        }
+
+        //-----------------------------------------------------------------------------
+        // 'source' tree into 'destination'. 'manifestPath' is read if present and
+        // rewritten. per-file failures are collected in report.failures, the
+        // rest carries on; throws only if the run cannot start or finish.
+        static void run(const std::filesystem::path& source, const std::filesystem::path& destination,
+                        const std::filesystem::path& manifestPath, Report& report, const Options& options = Options())
+        {
+            namespace fs = std::filesystem;
+            std::error_code ec;
+            nv2::throw_if(!fs::is_directory(source, ec), nv2::acc("Not a directory: ") << source.wstring());
+            fs::create_directories(destination, ec);
+            nv2::throw_if(!fs::is_directory(destination, ec), nv2::acc("Unable to create ") << destination.wstring());
+
+            Manifest previous;
+            if (!manifestPath.empty() && fs::exists(manifestPath, ec) && !loadManifest(manifestPath, previous)) {
+                DBMSG("Ignoring unreadable manifest " << manifestPath.wstring());
+            }
+
+            struct Task
+            {
+                // relative to 'source'
+                fs::path relative;
+                bool directory = false;
+            };
+            unsigned threads = options.threads ? options.threads : (std::max)(1u, std::thread::hardware_concurrency());
+            StealingPool<Task> pool(threads);
+            // one manifest and buffer per lane, merged at the end
+            std::vector<Manifest> seen(pool.lanes());
+            std::vector<std::unique_ptr<blk::AlignedBuffer>> buffers(pool.lanes());
+            size_t bufferSize = (std::max)(_alignment, options.bufferSize / _alignment * _alignment);
+
+            auto visit = [&](size_t lane, Task& task) {
+                fs::path from = source / task.relative;
+                fs::path to = destination / task.relative;
+                if (task.directory)
+                {
+                    report.directories++;
+                    std::error_code dec;
+                    fs::create_directories(to, dec);
+                    for (fs::directory_iterator it(from, fs::directory_options::skip_permission_denied, dec), end; !dec && it != end; it.increment(dec))
+                    {
+                        std::error_code tec;
+                        // junctions and links are not followed
+                        if (it->is_symlink(tec)) {
+                            continue;
+                        }
+                        Task child;
+                        child.relative = task.relative / it->path().filename();
+                        child.directory = it->is_directory(tec);
+                        if (child.directory || it->is_regular_file(tec)) {
+                            pool.push(lane, std::move(child));
+                        }
+                    }
+                    if (dec) {
+                        report.fail(relativeName(task.relative) + ": " + dec.message());
+                    }
+                    return;
+                }
+
+                report.files++;
+                std::string name = relativeName(task.relative);
+                std::error_code fec;
+                Entry e;
+                e.size = fs::file_size(from, fec);
+                fs::file_time_type mtime = fs::last_write_time(from, fec);
+                e.modified = (int64_t)mtime.time_since_epoch().count();
+                if (fec) {
+                    report.fail(name + ": " + fec.message());
+                    return;
+                }
+                if (!buffers[lane]) {
+                    buffers[lane].reset(new blk::AlignedBuffer(bufferSize, _alignment));
+                }
+                auto it = previous.find(name);
+                bool present = it != previous.end() && it->second.size == e.size && fs::exists(to, fec)
+                               && fs::file_size(to, fec) == e.size;
+                if (present && it->second.modified == e.modified)
+                {
+                    report.unchanged++;
+                    seen[lane][name] = it->second;
+                    return;
+                }
+                uint64_t bytes = 0;
+                if (present)
+                {
+                    // touched, but maybe not changed. reading is cheaper than writing
+                    if (copyFile(from, nullptr, *buffers[lane], options.unbuffered, e.hash, bytes) && e.hash == it->second.hash)
+                    {
+                        report.bytesHashed += bytes;
+                        report.sameHash++;
+                        fs::last_write_time(to, mtime, fec);
+                        seen[lane][name] = e;
+                        return;
+                    }
+                    report.bytesHashed += bytes;
+                }
+                if (!copyFile(from, &to, *buffers[lane], options.unbuffered, e.hash, bytes)) {
+                    report.fail(name + ": copy failed");
+                    return;
+                }
+                fs::last_write_time(to, mtime, fec);
+                report.copied++;
+                report.bytesCopied += bytes;
+                e.size = bytes;
+                seen[lane][name] = e;
+            };
+
+            Task root;
+            root.directory = true;
+            pool.push(0, root);
+            pool.run(visit);
+            report.steals = pool.steals.load();
+
+            Manifest merged;
+            for (auto& m : seen) {
+                merged.insert(m.begin(), m.end());
+            }
+            for (auto& p : previous)
+            {
+                if (merged.find(p.first) == merged.end()) {
+                    report.stale++;
+                }
+            }
+            if (!manifestPath.empty()) {
+                nv2::throw_if(!saveManifest(manifestPath, merged), nv2::acc("Unable to write ") << manifestPath.wstring());
+            }
+        }
+    }
+}
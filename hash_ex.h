@@ -0,0 +1,228 @@
+/*
+
+    Checksums used by the on-disk formats wde2 reads and writes.
+
+    crc32: IEEE 802.3 (reflected 0xEDB88320), as used by GPT
+    headers and entry arrays. Slice-by-8.
+
+    crc32c: Castagnoli (reflected 0x82F63B78), as used by VHDX
+    headers, region tables and metadata. Same tables, other polynomial.
+
+    xxh64: XXH64, for content hashes of files and blocks where speed
+    matters and collisions are not adversarial. One shot or streamed.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace wde2
+{
+    namespace hash
+    {
+        //-----------------------------------------------------------------------------
+        // 8 x 256 tables for a reflected polynomial, built once
+        struct Crc32Tables
+        {
+            uint32_t t[8][256];
+
+            explicit Crc32Tables(uint32_t polynomial = 0xEDB88320u)
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++) {
+                        c = (c & 1) ? (polynomial ^ (c >> 1)) : (c >> 1);
+                    }
+                    t[0][i] = c;
+                }
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    for (int s = 1; s < 8; s++) {
+                        t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+                    }
+                }
+            }
+        };
+
+        static const Crc32Tables& crc32Tables()
+        {
+            static const Crc32Tables tables;
+            return tables;
+        }
+
+        static const Crc32Tables& crc32cTables()
+        {
+            static const Crc32Tables tables(0x82F63B78u);
+            return tables;
+        }
+
+        //-----------------------------------------------------------------------------
+        static uint32_t crc32Update(const Crc32Tables& tables, const void* data, size_t length, uint32_t crc)
+        {
+            const uint32_t (*t)[256] = tables.t;
+            const uint8_t* p = (const uint8_t*)data;
+            crc = ~crc;
+            while (length >= 8)
+            {
+                uint32_t lo = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+                uint32_t hi = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+                crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+                    ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+                p += 8;
+                length -= 8;
+            }
+            while (length--) {
+                crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        // incremental: crc32(b, n2, crc32(a, n1)) == crc32(a+b, n1+n2)
+        static uint32_t crc32(const void* data, size_t length, uint32_t crc = 0)
+        {
+            return crc32Update(crc32Tables(), data, length, crc);
+        }
+
+        // incremental, as crc32()
+        static uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0)
+        {
+            return crc32Update(crc32cTables(), data, length, crc);
+        }
+
+        //-----------------------------------------------------------------------------
+        class Xxh64
+        {
+            static const uint64_t P1 = 0x9E3779B185EBCA87ull;
+            static const uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+            static const uint64_t P3 = 0x165667B19E3779F9ull;
+            static const uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+            static const uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+            uint64_t m_v[4];
+            uint8_t m_buffer[32];
+            size_t m_buffered = 0;
+            uint64_t m_total = 0;
+            uint64_t m_seed;
+
+            static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+            static uint64_t read64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+            static uint32_t read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+            static uint64_t round(uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; }
+            static uint64_t merge(uint64_t acc, uint64_t v) { return (acc ^ round(0, v)) * P1 + P4; }
+
+            void stripe(const uint8_t* p)
+            {
+                m_v[0] = round(m_v[0], read64(p));
+                m_v[1] = round(m_v[1], read64(p + 8));
+                m_v[2] = round(m_v[2], read64(p + 16));
+                m_v[3] = round(m_v[3], read64(p + 24));
+            }
+
+        public:
+            explicit Xxh64(uint64_t seed = 0) : m_seed(seed)
+            {
+                m_v[0] = seed + P1 + P2;
+                m_v[1] = seed + P2;
+                m_v[2] = seed;
+                m_v[3] = seed - P1;
+            }
+
+            void update(const void* data, size_t length)
+            {
+                const uint8_t* p = (const uint8_t*)data;
+                m_total += length;
+                if (m_buffered)
+                {
+                    size_t n = (length < 32 - m_buffered) ? length : 32 - m_buffered;
+                    memcpy(m_buffer + m_buffered, p, n);
+                    m_buffered += n;
+                    p += n;
+                    length -= n;
+                    if (m_buffered < 32) {
+                        return;
+                    }
+                    stripe(m_buffer);
+                    m_buffered = 0;
+                }
+                for (; length >= 32; p += 32, length -= 32) {
+                    stripe(p);
+                }
+                memcpy(m_buffer, p, length);
+                m_buffered = length;
+            }
+
+            uint64_t digest() const
+            {
+                uint64_t h;
+                if (m_total >= 32)
+                {
+                    h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+                    for (int i = 0; i < 4; i++) {
+                        h = merge(h, m_v[i]);
+                    }
+                }
+                else {
+                    h = m_seed + P5;
+                }
+                h += m_total;
+                const uint8_t* p = m_buffer;
+                size_t length = m_buffered;
+                for (; length >= 8; p += 8, length -= 8) {
+                    h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+                }
+                if (length >= 4)
+                {
+                    h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+                    p += 4;
+                    length -= 4;
+                }
+                for (; length; p++, length--) {
+                    h = rotl(h ^ (*p * P5), 11) * P1;
+                }
+                h ^= h >> 33;
+                h *= P2;
+                h ^= h >> 29;
+                h *= P3;
+                h ^= h >> 32;
+                return h;
+            }
+        };
+
+        static uint64_t xxh64(const void* data, size_t length, uint64_t seed = 0)
+        {
+            Xxh64 h(seed);
+            h.update(data, length);
+            return h.digest();
+        }
+    }
+}
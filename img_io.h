@@ -0,0 +1,714 @@
+/*
+
+    Virtual disk images as block sources, without attaching them.
+
+    Fixed and dynamic VHD and VHDX are decoded from their own
+    metadata so an image can be read on any host, Linux included:
+    the virtual disk reads as a flat device, unallocated blocks as
+    zero. Differencing disks and VHDX files with a log waiting to
+    be replayed are refused; attach those once on Windows first.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "blk_io.h"
+#include "hash_ex.h"
+#include "log_ex.h"
+#include "lznt1.h"
+
+namespace wde2
+{
+    namespace img
+    {
+        // VHD is big endian throughout
+        static inline uint32_t be32(const BYTE* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+        static inline uint64_t be64(const BYTE* p) { return ((uint64_t)be32(p) << 32) | be32(p + 4); }
+        // VHDX little endian
+        static inline uint16_t le16(const BYTE* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+        static inline uint32_t le32(const BYTE* p) { return (uint32_t)le16(p) | ((uint32_t)le16(p + 2) << 16); }
+        static inline uint64_t le64(const BYTE* p) { return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32); }
+
+        enum class Kind
+        {
+            Raw,
+            FixedVhd,
+            DynamicVhd,
+            DifferencingVhd,
+            Vhdx,
+            DifferencingVhdx,
+            // wde2's own compressed image, see ArchiveSource
+            Archive,
+        };
+
+        static const char* kindName(Kind kind)
+        {
+            switch (kind)
+            {
+            case Kind::FixedVhd: return "fixed VHD";
+            case Kind::DynamicVhd: return "dynamic VHD";
+            case Kind::DifferencingVhd: return "differencing VHD";
+            case Kind::Vhdx: return "VHDX";
+            case Kind::DifferencingVhdx: return "differencing VHDX";
+            case Kind::Archive: return "archive";
+            default: return "raw";
+            }
+        }
+
+        //-----------------------------------------------------------------------------
+        // VHD footer: ones' complement of the byte sum, checksum field excluded
+        static uint32_t vhdChecksum(const BYTE* p, size_t length, size_t checksumOffset)
+        {
+            uint32_t sum = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                if (i < checksumOffset || i >= checksumOffset + 4) {
+                    sum += p[i];
+                }
+            }
+            return ~sum;
+        }
+
+        static const uint32_t _vhdFixed = 2;
+        static const uint32_t _vhdDynamic = 3;
+        static const uint32_t _vhdDifferencing = 4;
+        static const uint32_t _vhdUnallocated = 0xFFFFFFFF;
+
+        //-----------------------------------------------------------------------------
+        // a VHD's footer and, unless fixed, its dynamic header, both checksummed
+        struct VhdLayout
+        {
+            BYTE footer[512];
+            BYTE header[1024];
+            uint64_t size = 0;
+            uint32_t diskType = 0;
+            // dynamic and differencing only
+            uint64_t tableOffset = 0;
+            uint32_t entries = 0;
+            uint32_t blockSize = 0;
+            uint64_t bitmapBytes = 0;
+
+            bool read(blk::FileSource& file)
+            {
+                uint64_t fileSize = file.size();
+                if (fileSize < 512 || !file.read(fileSize - 512, footer, sizeof(footer))
+                    || memcmp(footer, "conectix", 8) != 0
+                    || be32(footer + 64) != vhdChecksum(footer, sizeof(footer), 64)) {
+                    return false;
+                }
+                size = be64(footer + 48);
+                diskType = be32(footer + 60);
+                if (diskType != _vhdDynamic && diskType != _vhdDifferencing) {
+                    return true;
+                }
+                if (!file.read(be64(footer + 16), header, sizeof(header))
+                    || memcmp(header, "cxsparse", 8) != 0
+                    || be32(header + 36) != vhdChecksum(header, sizeof(header), 36)) {
+                    return false;
+                }
+                tableOffset = be64(header + 16);
+                entries = be32(header + 28);
+                blockSize = be32(header + 32);
+                if (blockSize < 512 || (blockSize & (blockSize - 1)) || (uint64_t)entries * blockSize < size) {
+                    return false;
+                }
+                // one bit per sector, whole sectors
+                bitmapBytes = ((uint64_t)blockSize / 512 / 8 + 511) & ~511ull;
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // fixed or dynamic VHD
+        class VhdSource : public blk::BlockSource
+        {
+            std::unique_ptr<blk::FileSource> m_file;
+            Kind m_kind = Kind::Raw;
+            uint64_t m_size = 0;
+            uint32_t m_blockSize = 0;
+            uint64_t m_bitmapBytes = 0;
+            // sector offsets, host order
+            std::vector<uint32_t> m_bat;
+
+        public:
+            explicit VhdSource(std::unique_ptr<blk::FileSource> file) : m_file(std::move(file))
+            {
+                VhdLayout vhd;
+                if (!vhd.read(*m_file)) {
+                    return;
+                }
+                m_size = vhd.size;
+                if (vhd.diskType == _vhdFixed)
+                {
+                    m_kind = (m_size <= m_file->size() - 512) ? Kind::FixedVhd : Kind::Raw;
+                    return;
+                }
+                if (vhd.diskType == _vhdDifferencing) {
+                    m_kind = Kind::DifferencingVhd;
+                    return;
+                }
+                if (vhd.diskType != _vhdDynamic) {
+                    return;
+                }
+                m_blockSize = vhd.blockSize;
+                m_bitmapBytes = vhd.bitmapBytes;
+                std::vector<BYTE> raw((size_t)vhd.entries * 4);
+                if (!m_file->read(vhd.tableOffset, raw.data(), raw.size())) {
+                    return;
+                }
+                m_bat.resize(vhd.entries);
+                for (uint32_t i = 0; i < vhd.entries; i++) {
+                    m_bat[i] = be32(raw.data() + i * 4);
+                }
+                m_kind = Kind::DynamicVhd;
+            }
+
+            Kind kind() const { return m_kind; }
+            explicit operator bool() const { return m_kind == Kind::FixedVhd || m_kind == Kind::DynamicVhd; }
+            uint64_t size() const override { return m_size; }
+            DWORD sectorSize() const override { return 512; }
+
+            // true if any part of [offset, offset + length) is backed by file data
+            bool allocated(uint64_t offset, uint64_t length) const
+            {
+                if (m_kind != Kind::DynamicVhd) {
+                    return true;
+                }
+                for (uint64_t b = offset / m_blockSize; b * m_blockSize < offset + length && b < m_bat.size(); b++)
+                {
+                    if (m_bat[(size_t)b] != _vhdUnallocated) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                if (m_kind == Kind::FixedVhd) {
+                    return m_file->read(offset, buffer, length);
+                }
+                BYTE* p = (BYTE*)buffer;
+                while (length)
+                {
+                    uint64_t block = offset / m_blockSize;
+                    uint64_t within = offset % m_blockSize;
+                    size_t n = (size_t)(std::min)((uint64_t)length, m_blockSize - within);
+                    uint32_t sector = m_bat[(size_t)block];
+                    // the sector bitmap is not consulted: dynamic disks
+                    // zero the unwritten sectors of an allocated block
+                    if (sector == _vhdUnallocated) {
+                        memset(p, 0, n);
+                    }
+                    else if (!m_file->read((uint64_t)sector * 512 + m_bitmapBytes + within, p, n)) {
+                        return false;
+                    }
+                    p += n;
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // VHDX. GUIDs as stored on disk
+        static const BYTE _vhdxBatRegion[16] = { 0x66, 0x77, 0xC2, 0x2D, 0x23, 0xF6, 0x00, 0x42, 0x9D, 0x64, 0x11, 0x5E, 0x9B, 0xFD, 0x4A, 0x08 };
+        static const BYTE _vhdxMetadataRegion[16] = { 0x06, 0xA2, 0x7C, 0x8B, 0x90, 0x47, 0x9A, 0x4B, 0xB8, 0xFE, 0x57, 0x5F, 0x05, 0x0F, 0x88, 0x6E };
+        static const BYTE _vhdxFileParameters[16] = { 0x37, 0x67, 0xA1, 0xCA, 0x36, 0xFA, 0x43, 0x4D, 0xB3, 0xB6, 0x33, 0xF0, 0xAA, 0x44, 0xE7, 0x6B };
+        static const BYTE _vhdxVirtualDiskSize[16] = { 0x24, 0x42, 0xA5, 0x2F, 0x1B, 0xCD, 0x76, 0x48, 0xB2, 0x11, 0x5D, 0xBE, 0xD8, 0x3B, 0xF4, 0xB8 };
+        static const BYTE _vhdxLogicalSectorSize[16] = { 0x1D, 0xBF, 0x41, 0x81, 0x6F, 0xA9, 0x09, 0x47, 0xBA, 0x47, 0xF2, 0x33, 0xA8, 0xFA, 0xAB, 0x5F };
+        static const BYTE _vhdxParentLocator[16] = { 0x2D, 0x5F, 0xD3, 0xA8, 0x0B, 0xB3, 0x4D, 0x45, 0xAB, 0xF7, 0xD3, 0xD8, 0x48, 0x34, 0xAB, 0x0C };
+
+        static const uint64_t _vhdxHeader1 = 64 * 1024;
+        static const uint64_t _vhdxHeader2 = 128 * 1024;
+        static const uint64_t _vhdxRegion1 = 192 * 1024;
+        static const uint64_t _vhdxRegion2 = 256 * 1024;
+        static const uint64_t _vhdxMB = 1024 * 1024;
+
+        // payload BAT entry states
+        static const uint64_t _vhdxNotPresent = 0;
+        static const uint64_t _vhdxUndefined = 1;
+        static const uint64_t _vhdxZero = 2;
+        static const uint64_t _vhdxUnmapped = 3;
+        static const uint64_t _vhdxFullyPresent = 6;
+        static const uint64_t _vhdxPartiallyPresent = 7;
+
+        // checksum field zeroed for the calculation
+        static bool vhdxChecksumValid(const BYTE* p, size_t length)
+        {
+            std::vector<BYTE> copy(p, p + length);
+            memset(copy.data() + 4, 0, 4);
+            return hash::crc32c(copy.data(), length) == le32(p + 4);
+        }
+
+        //-----------------------------------------------------------------------------
+        // a VHDX's current header, regions and metadata
+        struct VhdxLayout
+        {
+            BYTE header[4096];
+            // which of the two headers is current
+            int slot = -1;
+            // LogGuid set => metadata or BAT updates not yet applied
+            bool needsReplay = false;
+            uint64_t batOffset = 0;
+            uint64_t batLength = 0;
+            uint64_t metaOffset = 0;
+            uint64_t metaLength = 0;
+            uint64_t size = 0;
+            uint32_t blockSize = 0;
+            uint32_t sectorSize = 512;
+            bool hasParent = false;
+            // the parent locator item as stored, differencing only
+            std::vector<BYTE> parentLocator;
+
+        private:
+            // the valid header with the highest sequence number
+            bool readHeader(blk::FileSource& file)
+            {
+                BYTE h[2][4096];
+                uint64_t best = 0;
+                for (int i = 0; i < 2; i++)
+                {
+                    if (file.read(i ? _vhdxHeader2 : _vhdxHeader1, h[i], sizeof(h[i]))
+                        && memcmp(h[i], "head", 4) == 0 && vhdxChecksumValid(h[i], sizeof(h[i]))
+                        && (slot < 0 || le64(h[i] + 8) > best))
+                    {
+                        best = le64(h[i] + 8);
+                        slot = i;
+                    }
+                }
+                if (slot < 0) {
+                    return false;
+                }
+                memcpy(header, h[slot], sizeof(h[slot]));
+                return true;
+            }
+
+            bool readRegions(blk::FileSource& file)
+            {
+                std::vector<BYTE> r(64 * 1024);
+                for (uint64_t at : { _vhdxRegion1, _vhdxRegion2 })
+                {
+                    if (!file.read(at, r.data(), r.size()) || memcmp(r.data(), "regi", 4) != 0 || !vhdxChecksumValid(r.data(), r.size())) {
+                        continue;
+                    }
+                    uint32_t count = (std::min)(le32(r.data() + 8), 2047u);
+                    batLength = metaLength = 0;
+                    for (uint32_t i = 0; i < count; i++)
+                    {
+                        const BYTE* e = r.data() + 16 + i * 32;
+                        if (memcmp(e, _vhdxBatRegion, 16) == 0) {
+                            batOffset = le64(e + 16);
+                            batLength = le32(e + 24);
+                        }
+                        else if (memcmp(e, _vhdxMetadataRegion, 16) == 0) {
+                            metaOffset = le64(e + 16);
+                            metaLength = le32(e + 24);
+                        }
+                        // an unknown required region means we cannot read this file
+                        else if (le32(e + 28) & 1) {
+                            return false;
+                        }
+                    }
+                    return batLength && metaLength;
+                }
+                return false;
+            }
+
+        public:
+            bool read(blk::FileSource& file)
+            {
+                BYTE signature[8];
+                if (!file.read(0, signature, sizeof(signature)) || memcmp(signature, "vhdxfile", 8) != 0 || !readHeader(file)) {
+                    return false;
+                }
+                static const BYTE null[16] = { 0 };
+                if (memcmp(header + 48, null, 16) != 0) {
+                    needsReplay = true;
+                    return false;
+                }
+                if (!readRegions(file) || metaLength > 16 * _vhdxMB) {
+                    return false;
+                }
+                std::vector<BYTE> meta((size_t)metaLength);
+                if (!file.read(metaOffset, meta.data(), meta.size()) || memcmp(meta.data(), "metadata", 8) != 0) {
+                    return false;
+                }
+                uint16_t count = le16(meta.data() + 10);
+                for (uint16_t i = 0; i < count && 32u + (i + 1) * 32u <= meta.size(); i++)
+                {
+                    const BYTE* e = meta.data() + 32 + i * 32;
+                    uint32_t offset = le32(e + 16);
+                    uint32_t length = le32(e + 20);
+                    if ((uint64_t)offset + length > meta.size() || length < 4) {
+                        continue;
+                    }
+                    const BYTE* v = meta.data() + offset;
+                    if (memcmp(e, _vhdxFileParameters, 16) == 0 && length >= 8) {
+                        blockSize = le32(v);
+                        hasParent = (le32(v + 4) & 2) != 0;
+                    }
+                    else if (memcmp(e, _vhdxVirtualDiskSize, 16) == 0 && length >= 8) {
+                        size = le64(v);
+                    }
+                    else if (memcmp(e, _vhdxLogicalSectorSize, 16) == 0) {
+                        sectorSize = le32(v);
+                    }
+                    else if (memcmp(e, _vhdxParentLocator, 16) == 0) {
+                        parentLocator.assign(v, v + length);
+                    }
+                }
+                return true;
+            }
+
+            // a sector bitmap entry follows every 'chunkRatio' payload entries
+            uint64_t chunkRatio() const { return ((1ull << 23) * sectorSize) / blockSize; }
+
+            // the layout is one the readers handle
+            bool valid() const
+            {
+                return blockSize >= _vhdxMB && !(blockSize & (blockSize - 1)) && (sectorSize == 512 || sectorSize == 4096) && size;
+            }
+        };
+
+        class VhdxSource : public blk::BlockSource
+        {
+            std::unique_ptr<blk::FileSource> m_file;
+            Kind m_kind = Kind::Raw;
+            uint64_t m_size = 0;
+            uint32_t m_blockSize = 0;
+            DWORD m_sectorSize = 512;
+            uint64_t m_chunkRatio = 0;
+            std::vector<uint64_t> m_bat;
+            bool m_needsReplay = false;
+
+        public:
+            explicit VhdxSource(std::unique_ptr<blk::FileSource> file) : m_file(std::move(file))
+            {
+                VhdxLayout vhdx;
+                if (!vhdx.read(*m_file))
+                {
+                    m_needsReplay = vhdx.needsReplay;
+                    return;
+                }
+                m_blockSize = vhdx.blockSize;
+                m_size = vhdx.size;
+                m_sectorSize = vhdx.sectorSize;
+                if (vhdx.hasParent) {
+                    m_kind = Kind::DifferencingVhdx;
+                    return;
+                }
+                if (!vhdx.valid()) {
+                    return;
+                }
+                m_chunkRatio = vhdx.chunkRatio();
+                uint64_t blocks = (m_size + m_blockSize - 1) / m_blockSize;
+                uint64_t entries = blocks + (blocks - 1) / m_chunkRatio;
+                if (entries * 8 > vhdx.batLength) {
+                    return;
+                }
+                std::vector<BYTE> raw((size_t)(entries * 8));
+                if (!m_file->read(vhdx.batOffset, raw.data(), raw.size())) {
+                    return;
+                }
+                m_bat.resize((size_t)blocks);
+                for (uint64_t b = 0; b < blocks; b++) {
+                    m_bat[(size_t)b] = le64(raw.data() + (b + b / m_chunkRatio) * 8);
+                }
+                m_kind = Kind::Vhdx;
+            }
+
+            Kind kind() const { return m_kind; }
+            bool needsReplay() const { return m_needsReplay; }
+            explicit operator bool() const { return m_kind == Kind::Vhdx; }
+            uint64_t size() const override { return m_size; }
+            DWORD sectorSize() const override { return m_sectorSize; }
+
+            bool allocated(uint64_t offset, uint64_t length) const
+            {
+                for (uint64_t b = offset / m_blockSize; b * m_blockSize < offset + length && b < m_bat.size(); b++)
+                {
+                    uint64_t state = m_bat[(size_t)b] & 7;
+                    if (state == _vhdxFullyPresent || state == _vhdxPartiallyPresent) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                BYTE* p = (BYTE*)buffer;
+                while (length)
+                {
+                    uint64_t block = offset / m_blockSize;
+                    uint64_t within = offset % m_blockSize;
+                    size_t n = (size_t)(std::min)((uint64_t)length, m_blockSize - within);
+                    uint64_t entry = m_bat[(size_t)block];
+                    if ((entry & 7) == _vhdxFullyPresent)
+                    {
+                        if (!m_file->read((entry >> 20) * _vhdxMB + within, p, n)) {
+                            return false;
+                        }
+                    }
+                    else {
+                        // not present, zero, unmapped or undefined
+                        memset(p, 0, n);
+                    }
+                    p += n;
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // wde2 archive (.wda): a 4KB header, then one record per block in disk
+        // order, then an index of record offsets and a trailer at the very end.
+        //
+        //  header   "wde2arch" version blockSize size sectorSize codec
+        //  record   storedLength type crc32c reserved, then the stored bytes
+        //  trailer  "wdaindex" indexOffset count crc32c(index) reserved
+        //
+        // a record is all zero (nothing stored), stored as is, or LZNT1
+        // compressed. the CRC32C is of the block as read from the disk.
+        static const uint32_t _archiveVersion = 1;
+        static const uint32_t _archiveHeader = 4096;
+        static const uint32_t _archiveRecord = 16;
+        static const uint32_t _archiveTrailer = 32;
+        static const uint32_t _archiveZero = 0;
+        static const uint32_t _archiveStored = 1;
+        static const uint32_t _archiveLznt1 = 2;
+
+        class ArchiveSource : public blk::BlockSource
+        {
+            std::unique_ptr<blk::FileSource> m_file;
+            uint64_t m_size = 0;
+            uint32_t m_blockSize = 0;
+            DWORD m_sectorSize = 512;
+            std::vector<uint64_t> m_index;
+            // the last block decoded, reads are mostly sequential
+            int64_t m_cached = -1;
+            std::vector<BYTE> m_block;
+            std::vector<BYTE> m_stored;
+
+            bool decode(uint64_t b)
+            {
+                if ((int64_t)b == m_cached) {
+                    return true;
+                }
+                m_cached = -1;
+                size_t length = (size_t)(std::min)((uint64_t)m_blockSize, m_size - b * m_blockSize);
+                BYTE record[_archiveRecord];
+                if (!m_file->read(m_index[(size_t)b], record, sizeof(record))) {
+                    return false;
+                }
+                uint32_t stored = le32(record);
+                uint32_t type = le32(record + 4);
+                m_block.assign(m_blockSize, 0);
+                if (type == _archiveStored || type == _archiveLznt1)
+                {
+                    if (stored > ntfs::lznt1Bound(m_blockSize)) {
+                        return false;
+                    }
+                    m_stored.resize(stored);
+                    if (!m_file->read(m_index[(size_t)b] + _archiveRecord, m_stored.data(), stored)) {
+                        return false;
+                    }
+                    if (type == _archiveStored) {
+                        memcpy(m_block.data(), m_stored.data(), (std::min)((size_t)stored, length));
+                    }
+                    else if (!ntfs::lznt1Decompress(m_stored.data(), stored, m_block.data(), length)) {
+                        return false;
+                    }
+                }
+                else if (type != _archiveZero) {
+                    return false;
+                }
+                if (hash::crc32c(m_block.data(), length) != le32(record + 8))
+                {
+                    LOG_WARN("Archive block " << b << " fails its checksum");
+                    return false;
+                }
+                m_cached = (int64_t)b;
+                return true;
+            }
+
+        public:
+            explicit ArchiveSource(std::unique_ptr<blk::FileSource> file) : m_file(std::move(file))
+            {
+                BYTE header[64];
+                BYTE trailer[_archiveTrailer];
+                uint64_t fileSize = m_file->size();
+                if (fileSize < _archiveHeader + _archiveTrailer || !m_file->read(0, header, sizeof(header))
+                    || memcmp(header, "wde2arch", 8) != 0 || le32(header + 8) != _archiveVersion
+                    || !m_file->read(fileSize - _archiveTrailer, trailer, sizeof(trailer)) || memcmp(trailer, "wdaindex", 8) != 0) {
+                    return;
+                }
+                m_blockSize = le32(header + 12);
+                m_size = le64(header + 16);
+                m_sectorSize = le32(header + 24);
+                uint64_t indexOffset = le64(trailer + 8);
+                uint64_t count = le64(trailer + 16);
+                if (m_blockSize == 0 || count != (m_size + m_blockSize - 1) / m_blockSize || indexOffset + count * 8 > fileSize) {
+                    return;
+                }
+                std::vector<BYTE> raw((size_t)(count * 8));
+                if (!m_file->read(indexOffset, raw.data(), raw.size()) || hash::crc32c(raw.data(), raw.size()) != le32(trailer + 24)) {
+                    return;
+                }
+                m_index.resize((size_t)count);
+                for (size_t i = 0; i < m_index.size(); i++) {
+                    m_index[i] = le64(raw.data() + i * 8);
+                }
+            }
+
+            explicit operator bool() const { return m_size && !m_index.empty(); }
+            uint64_t size() const override { return m_size; }
+            DWORD sectorSize() const override { return m_sectorSize; }
+
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                BYTE* p = (BYTE*)buffer;
+                while (length)
+                {
+                    uint64_t b = offset / m_blockSize;
+                    uint64_t within = offset % m_blockSize;
+                    size_t n = (size_t)(std::min)((uint64_t)length, m_blockSize - within);
+                    if (!decode(b)) {
+                        return false;
+                    }
+                    memcpy(p, m_block.data() + within, n);
+                    p += n;
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // raw file or device, minus nothing
+        class RawSource : public blk::BlockSource
+        {
+            std::unique_ptr<blk::FileSource> m_file;
+
+        public:
+            explicit RawSource(std::unique_ptr<blk::FileSource> file) : m_file(std::move(file)) {}
+            uint64_t size() const override { return m_file->size(); }
+            DWORD sectorSize() const override { return m_file->sectorSize(); }
+            bool read(uint64_t offset, void* buffer, size_t length) override { return m_file->read(offset, buffer, length); }
+        };
+
+        //-----------------------------------------------------------------------------
+        // by content, not extension: VHDX, VHD (fixed or dynamic), archive or raw.
+        // null if unreadable or a format we do not read; 'kind' says which.
+        static std::unique_ptr<blk::BlockSource> open(const std::filesystem::path& path, Kind* kind = nullptr)
+        {
+            Kind k = Kind::Raw;
+            std::unique_ptr<blk::BlockSource> ret;
+            std::unique_ptr<blk::FileSource> file(new blk::FileSource(path));
+            if (!*file || file->size() == 0) {
+                return ret;
+            }
+            BYTE head[8] = { 0 };
+            BYTE footer[8] = { 0 };
+            file->read(0, head, sizeof(head));
+            if (file->size() >= 1024) {
+                file->read(file->size() - 512, footer, sizeof(footer));
+            }
+            if (memcmp(head, "vhdxfile", 8) == 0)
+            {
+                std::unique_ptr<VhdxSource> vhdx(new VhdxSource(std::move(file)));
+                k = vhdx->kind();
+                if (vhdx->needsReplay()) {
+                    DBMSG("VHDX log needs replaying, attach it once first: " << path.wstring());
+                }
+                if (*vhdx) {
+                    ret = std::move(vhdx);
+                }
+            }
+            else if (memcmp(head, "wde2arch", 8) == 0)
+            {
+                std::unique_ptr<ArchiveSource> archive(new ArchiveSource(std::move(file)));
+                k = Kind::Archive;
+                if (*archive) {
+                    ret = std::move(archive);
+                }
+            }
+            else if (memcmp(footer, "conectix", 8) == 0)
+            {
+                std::unique_ptr<VhdSource> vhd(new VhdSource(std::move(file)));
+                k = vhd->kind();
+                if (*vhd) {
+                    ret = std::move(vhd);
+                }
+            }
+            else {
+                ret.reset(new RawSource(std::move(file)));
+            }
+            if (kind) {
+                *kind = k;
+            }
+            return ret;
+        }
+
+        //-----------------------------------------------------------------------------
+        // false only where an image opened above is known to hold nothing:
+        // unallocated blocks of a dynamic VHD or VHDX. the rest must be read
+        static bool allocated(const blk::BlockSource& image, uint64_t offset, uint64_t length)
+        {
+            if (const VhdSource* vhd = dynamic_cast<const VhdSource*>(&image)) {
+                return vhd->allocated(offset, length);
+            }
+            if (const VhdxSource* vhdx = dynamic_cast<const VhdxSource*>(&image)) {
+                return vhdx->allocated(offset, length);
+            }
+            return true;
+        }
+    }
+}
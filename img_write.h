@@ -0,0 +1,869 @@
+/*
+
+    Virtual disk images as write targets.
+
+    The clone engine (clone_ex.h) writes a device image through this
+    interface: a raw file, a fixed VHD which is the same plus a 512
+    byte footer, a dynamic VHDX which leaves zero blocks out, or a
+    compressed archive (see ArchiveSource in img_io.h). Raw images
+    and fixed VHDs can be reopened to be written in place, i.e. to
+    resume an interrupted clone.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cwctype>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "img_io.h"
+
+namespace wde2
+{
+    namespace img
+    {
+        static inline void putBe32(BYTE* p, uint32_t v) { p[0] = (BYTE)(v >> 24); p[1] = (BYTE)(v >> 16); p[2] = (BYTE)(v >> 8); p[3] = (BYTE)v; }
+        static inline void putBe64(BYTE* p, uint64_t v) { putBe32(p, (uint32_t)(v >> 32)); putBe32(p + 4, (uint32_t)v); }
+
+        //-----------------------------------------------------------------------------
+        // read/write file at byte offsets
+        class OutputFile
+        {
+#ifdef _WIN32
+            HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+            int m_fd = -1;
+#endif
+
+        public:
+            OutputFile() {}
+            ~OutputFile() { close(); }
+            OutputFile(const OutputFile&) = delete;
+            OutputFile& operator=(const OutputFile&) = delete;
+
+            // 'keep' opens an existing file as is, otherwise it is truncated
+            bool open(const std::filesystem::path& path, bool keep)
+            {
+                close();
+#ifdef _WIN32
+                m_handle = ::CreateFileW(path.c_str(),
+                                        GENERIC_READ | GENERIC_WRITE,
+                                        FILE_SHARE_READ,
+                                        NULL,
+                                        keep ? OPEN_ALWAYS : CREATE_ALWAYS,
+                                        FILE_ATTRIBUTE_NORMAL,
+                                        NULL);
+                return m_handle != INVALID_HANDLE_VALUE;
+#else
+                m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (keep ? 0 : O_TRUNC), 0644);
+                return m_fd >= 0;
+#endif
+            }
+
+            void close()
+            {
+#ifdef _WIN32
+                if (m_handle != INVALID_HANDLE_VALUE) {
+                    ::CloseHandle(m_handle);
+                }
+                m_handle = INVALID_HANDLE_VALUE;
+#else
+                if (m_fd >= 0) {
+                    ::close(m_fd);
+                }
+                m_fd = -1;
+#endif
+            }
+
+            uint64_t size() const
+            {
+#ifdef _WIN32
+                LARGE_INTEGER li{ 0 };
+                return ::GetFileSizeEx(m_handle, &li) ? (uint64_t)li.QuadPart : 0;
+#else
+                off_t end = ::lseek(m_fd, 0, SEEK_END);
+                return end < 0 ? 0 : (uint64_t)end;
+#endif
+            }
+
+            bool resize(uint64_t size)
+            {
+#ifdef _WIN32
+                FILE_END_OF_FILE_INFO eof;
+                eof.EndOfFile.QuadPart = (LONGLONG)size;
+                return ::SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &eof, sizeof(eof)) != FALSE;
+#else
+                return ::ftruncate(m_fd, (off_t)size) == 0;
+#endif
+            }
+
+            bool write(uint64_t offset, const void* data, size_t length)
+            {
+                const BYTE* p = (const BYTE*)data;
+                while (length)
+                {
+#ifdef _WIN32
+                    OVERLAPPED ov{ 0 };
+                    ov.Offset = (DWORD)offset;
+                    ov.OffsetHigh = (DWORD)(offset >> 32);
+                    DWORD chunk = (DWORD)(std::min)(length, (size_t)(1u << 30));
+                    DWORD n = 0;
+                    if (!::WriteFile(m_handle, p, chunk, &n, &ov) || n == 0) {
+                        return false;
+                    }
+#else
+                    ssize_t n = ::pwrite(m_fd, p, length, (off_t)offset);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        return false;
+                    }
+#endif
+                    p += n;
+                    offset += (uint64_t)n;
+                    length -= (size_t)n;
+                }
+                return true;
+            }
+
+            bool read(uint64_t offset, void* data, size_t length)
+            {
+                BYTE* p = (BYTE*)data;
+                while (length)
+                {
+#ifdef _WIN32
+                    OVERLAPPED ov{ 0 };
+                    ov.Offset = (DWORD)offset;
+                    ov.OffsetHigh = (DWORD)(offset >> 32);
+                    DWORD chunk = (DWORD)(std::min)(length, (size_t)(1u << 30));
+                    DWORD n = 0;
+                    if (!::ReadFile(m_handle, p, chunk, &n, &ov) || n == 0) {
+                        return false;
+                    }
+#else
+                    ssize_t n = ::pread(m_fd, p, length, (off_t)offset);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        return false;
+                    }
+#endif
+                    p += n;
+                    offset += (uint64_t)n;
+                    length -= (size_t)n;
+                }
+                return true;
+            }
+
+            bool flush()
+            {
+#ifdef _WIN32
+                return ::FlushFileBuffers(m_handle) != FALSE;
+#else
+                return ::fsync(m_fd) == 0;
+#endif
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        class ImageWriter
+        {
+        public:
+            virtual ~ImageWriter() {}
+            // of the virtual disk
+            virtual uint64_t size() const = 0;
+            virtual Kind kind() const = 0;
+            // [offset, offset + length) of the virtual disk
+            virtual bool write(uint64_t offset, const void* data, size_t length) = 0;
+            // metadata and flush. the image is complete once this returns true
+            virtual bool finish() = 0;
+            // what was written, where the format allows reading it back
+            virtual bool read(uint64_t /*offset*/, void* /*data*/, size_t /*length*/) { return false; }
+        };
+
+        //-----------------------------------------------------------------------------
+        // flat image, or a fixed VHD when 'vhd' is set: the same with a footer
+        class FlatWriter : public ImageWriter
+        {
+            OutputFile m_file;
+            uint64_t m_size = 0;
+            bool m_vhd = false;
+            BYTE m_uniqueId[16] = { 0 };
+
+            // CHS as the VHD specification computes it
+            static void geometry(uint64_t size, BYTE* p)
+            {
+                uint64_t total = (std::min)(size / 512, (uint64_t)65535 * 16 * 255);
+                uint32_t spt = 0, heads = 0, cth = 0;
+                if (total >= (uint64_t)65535 * 16 * 63)
+                {
+                    spt = 255;
+                    heads = 16;
+                    cth = (uint32_t)(total / spt);
+                }
+                else
+                {
+                    spt = 17;
+                    cth = (uint32_t)(total / spt);
+                    heads = (std::max)((cth + 1023) / 1024, 4u);
+                    if (cth >= heads * 1024 || heads > 16)
+                    {
+                        spt = 31;
+                        heads = 16;
+                        cth = (uint32_t)(total / spt);
+                    }
+                    if (cth >= heads * 1024)
+                    {
+                        spt = 63;
+                        heads = 16;
+                        cth = (uint32_t)(total / spt);
+                    }
+                }
+                uint32_t cylinders = cth / heads;
+                p[0] = (BYTE)(cylinders >> 8);
+                p[1] = (BYTE)cylinders;
+                p[2] = (BYTE)heads;
+                p[3] = (BYTE)spt;
+            }
+
+        public:
+            FlatWriter(uint64_t size, bool vhd) : m_size(size), m_vhd(vhd) {}
+
+            bool open(const std::filesystem::path& path, bool keep)
+            {
+                if (!m_file.open(path, keep)) {
+                    return false;
+                }
+                if (m_vhd && keep && m_file.size() == m_size + 512)
+                {
+                    // the same disk again
+                    BYTE footer[512];
+                    if (m_file.read(m_size, footer, sizeof(footer)) && memcmp(footer, "conectix", 8) == 0) {
+                        memcpy(m_uniqueId, footer + 68, 16);
+                    }
+                }
+                else if (m_vhd)
+                {
+                    std::random_device rd;
+                    for (BYTE& b : m_uniqueId) {
+                        b = (BYTE)rd();
+                    }
+                }
+                return m_file.resize(m_size + (m_vhd ? 512 : 0));
+            }
+
+            uint64_t size() const override { return m_size; }
+            Kind kind() const override { return m_vhd ? Kind::FixedVhd : Kind::Raw; }
+            OutputFile& file() { return m_file; }
+
+            bool write(uint64_t offset, const void* data, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                return m_file.write(offset, data, length);
+            }
+
+            bool read(uint64_t offset, void* data, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                return m_file.read(offset, data, length);
+            }
+
+            bool finish() override
+            {
+                if (m_vhd)
+                {
+                    BYTE footer[512] = { 0 };
+                    memcpy(footer, "conectix", 8);
+                    putBe32(footer + 8, 2);
+                    putBe32(footer + 12, 0x00010000);
+                    putBe64(footer + 16, 0xFFFFFFFFFFFFFFFFull);
+                    // seconds since 1/1/2000
+                    putBe32(footer + 24, (uint32_t)(::time(nullptr) - 946684800));
+                    memcpy(footer + 28, "wde2", 4);
+                    putBe32(footer + 32, 0x00010000);
+                    memcpy(footer + 36, "Wi2k", 4);
+                    putBe64(footer + 40, m_size);
+                    putBe64(footer + 48, m_size);
+                    geometry(m_size, footer + 56);
+                    putBe32(footer + 60, _vhdFixed);
+                    memcpy(footer + 68, m_uniqueId, 16);
+                    putBe32(footer + 64, vhdChecksum(footer, sizeof(footer), 64));
+                    if (!m_file.write(m_size, footer, sizeof(footer))) {
+                        return false;
+                    }
+                }
+                return m_file.flush();
+            }
+        };
+
+        static inline void putLe16(BYTE* p, uint16_t v) { p[0] = (BYTE)v; p[1] = (BYTE)(v >> 8); }
+        static inline void putLe32(BYTE* p, uint32_t v) { putLe16(p, (uint16_t)v); putLe16(p + 2, (uint16_t)(v >> 16)); }
+        static inline void putLe64(BYTE* p, uint64_t v) { putLe32(p, (uint32_t)v); putLe32(p + 4, (uint32_t)(v >> 32)); }
+
+        static bool isZero(const BYTE* p, size_t length)
+        {
+            size_t i = 0;
+            for (; i + 8 <= length; i += 8)
+            {
+                uint64_t v;
+                memcpy(&v, p + i, 8);
+                if (v) {
+                    return false;
+                }
+            }
+            for (; i < length; i++)
+            {
+                if (p[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static void randomGuid(BYTE* p)
+        {
+            std::random_device rd;
+            for (int i = 0; i < 16; i++) {
+                p[i] = (BYTE)rd();
+            }
+            // version 4, variant 1
+            p[7] = (BYTE)((p[7] & 0x0F) | 0x40);
+            p[8] = (BYTE)((p[8] & 0x3F) | 0x80);
+        }
+
+        //-----------------------------------------------------------------------------
+        // dynamic VHDX. a block is allocated on the first write that is not all
+        // zero; blocks never allocated are marked zero. headers, region tables,
+        // metadata and BAT are written by finish(), so the file is only valid
+        // once that returns. writes may arrive in any order.
+        static const BYTE _vhdxPage83Data[16] = { 0xAB, 0x12, 0xCA, 0xBE, 0xE6, 0xB2, 0x23, 0x45, 0x93, 0xEF, 0xC3, 0x09, 0xE0, 0x00, 0xC7, 0x46 };
+        static const BYTE _vhdxPhysicalSectorSize[16] = { 0xC7, 0x48, 0xA3, 0xCD, 0x5D, 0x44, 0x71, 0x44, 0x9C, 0xC9, 0xE9, 0x88, 0x52, 0x51, 0xC5, 0x56 };
+        static const uint64_t _vhdxLogOffset = 1 * _vhdxMB;
+        static const uint64_t _vhdxMetadataOffset = 2 * _vhdxMB;
+        static const uint64_t _vhdxBatOffset = 3 * _vhdxMB;
+
+        class VhdxWriter : public ImageWriter
+        {
+            OutputFile m_file;
+            uint64_t m_size = 0;
+            uint32_t m_blockSize = 0;
+            uint32_t m_sectorSize = 512;
+            uint64_t m_chunkRatio = 0;
+            uint64_t m_batLength = 0;
+            // file offset of the next block
+            uint64_t m_next = 0;
+            // per payload block, file offset or 0
+            std::vector<uint64_t> m_blocks;
+
+            bool writeHeaders()
+            {
+                std::vector<BYTE> buffer(64 * 1024, 0);
+                // file type identifier
+                memcpy(buffer.data(), "vhdxfile", 8);
+                const char* creator = "wde2";
+                for (int i = 0; creator[i]; i++) {
+                    putLe16(buffer.data() + 8 + i * 2, (uint16_t)creator[i]);
+                }
+                if (!m_file.write(0, buffer.data(), buffer.size())) {
+                    return false;
+                }
+                // two headers, the second current
+                BYTE fileWrite[16], dataWrite[16];
+                randomGuid(fileWrite);
+                randomGuid(dataWrite);
+                for (int i = 0; i < 2; i++)
+                {
+                    BYTE h[4096] = { 0 };
+                    memcpy(h, "head", 4);
+                    putLe64(h + 8, (uint64_t)i);
+                    memcpy(h + 16, fileWrite, 16);
+                    memcpy(h + 32, dataWrite, 16);
+                    // log guid stays null: nothing to replay
+                    putLe16(h + 64, 0);
+                    putLe16(h + 66, 1);
+                    putLe32(h + 68, (uint32_t)_vhdxMB);
+                    putLe64(h + 72, _vhdxLogOffset);
+                    putLe32(h + 4, hash::crc32c(h, sizeof(h)));
+                    if (!m_file.write(i ? _vhdxHeader2 : _vhdxHeader1, h, sizeof(h))) {
+                        return false;
+                    }
+                }
+                // region tables, both the same
+                std::fill(buffer.begin(), buffer.end(), 0);
+                BYTE* r = buffer.data();
+                memcpy(r, "regi", 4);
+                putLe32(r + 8, 2);
+                memcpy(r + 16, _vhdxBatRegion, 16);
+                putLe64(r + 32, _vhdxBatOffset);
+                putLe32(r + 40, (uint32_t)m_batLength);
+                putLe32(r + 44, 1);
+                memcpy(r + 48, _vhdxMetadataRegion, 16);
+                putLe64(r + 64, _vhdxMetadataOffset);
+                putLe32(r + 72, (uint32_t)_vhdxMB);
+                putLe32(r + 76, 1);
+                putLe32(r + 4, hash::crc32c(r, buffer.size()));
+                return m_file.write(_vhdxRegion1, r, buffer.size()) && m_file.write(_vhdxRegion2, r, buffer.size());
+            }
+
+            bool writeMetadata()
+            {
+                std::vector<BYTE> m((size_t)_vhdxMB, 0);
+                memcpy(m.data(), "metadata", 8);
+                putLe16(m.data() + 10, 5);
+                // items follow the 64KB table
+                uint32_t at = 64 * 1024;
+                auto item = [&](int i, const BYTE* id, uint32_t length, uint32_t flags) {
+                    BYTE* e = m.data() + 32 + i * 32;
+                    memcpy(e, id, 16);
+                    putLe32(e + 16, at);
+                    putLe32(e + 20, length);
+                    putLe32(e + 24, flags);
+                    BYTE* v = m.data() + at;
+                    at += 8 * ((length + 7) / 8);
+                    return v;
+                };
+                // IsRequired 4, IsVirtualDisk 2
+                BYTE* v = item(0, _vhdxFileParameters, 8, 4);
+                putLe32(v, m_blockSize);
+                v = item(1, _vhdxVirtualDiskSize, 8, 6);
+                putLe64(v, m_size);
+                v = item(2, _vhdxPage83Data, 16, 6);
+                randomGuid(v);
+                v = item(3, _vhdxLogicalSectorSize, 4, 6);
+                putLe32(v, m_sectorSize);
+                v = item(4, _vhdxPhysicalSectorSize, 4, 6);
+                putLe32(v, 4096);
+                return m_file.write(_vhdxMetadataOffset, m.data(), m.size());
+            }
+
+            bool writeBat()
+            {
+                std::vector<BYTE> bat((size_t)m_batLength, 0);
+                for (size_t b = 0; b < m_blocks.size(); b++)
+                {
+                    uint64_t entry = m_blocks[b] ? ((m_blocks[b] / _vhdxMB) << 20) | _vhdxFullyPresent : _vhdxZero;
+                    putLe64(bat.data() + (b + b / m_chunkRatio) * 8, entry);
+                }
+                return m_file.write(_vhdxBatOffset, bat.data(), bat.size());
+            }
+
+        public:
+            VhdxWriter(uint64_t size, uint32_t blockSize = 2 * 1024 * 1024, uint32_t sectorSize = 512)
+                : m_size(size), m_blockSize(blockSize), m_sectorSize(sectorSize)
+            {
+                m_chunkRatio = ((1ull << 23) * m_sectorSize) / m_blockSize;
+                uint64_t blocks = (m_size + m_blockSize - 1) / m_blockSize;
+                uint64_t entries = blocks + (blocks ? (blocks - 1) / m_chunkRatio : 0);
+                m_batLength = (std::max)(_vhdxMB, (entries * 8 + _vhdxMB - 1) / _vhdxMB * _vhdxMB);
+                m_blocks.assign((size_t)blocks, 0);
+                m_next = _vhdxBatOffset + m_batLength;
+            }
+
+            bool open(const std::filesystem::path& path) { return m_file.open(path, false); }
+            uint64_t size() const override { return m_size; }
+            Kind kind() const override { return Kind::Vhdx; }
+
+            bool write(uint64_t offset, const void* data, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                const BYTE* p = (const BYTE*)data;
+                while (length)
+                {
+                    size_t b = (size_t)(offset / m_blockSize);
+                    uint64_t within = offset % m_blockSize;
+                    size_t n = (size_t)(std::min)((uint64_t)length, m_blockSize - within);
+                    if (!m_blocks[b] && !isZero(p, n))
+                    {
+                        m_blocks[b] = m_next;
+                        m_next += m_blockSize;
+                        // the rest of a new block must read as zero
+                        if (!m_file.resize(m_next)) {
+                            return false;
+                        }
+                    }
+                    if (m_blocks[b] && !m_file.write(m_blocks[b] + within, p, n)) {
+                        return false;
+                    }
+                    p += n;
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+
+            bool read(uint64_t offset, void* data, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                BYTE* p = (BYTE*)data;
+                while (length)
+                {
+                    size_t b = (size_t)(offset / m_blockSize);
+                    uint64_t within = offset % m_blockSize;
+                    size_t n = (size_t)(std::min)((uint64_t)length, m_blockSize - within);
+                    if (!m_blocks[b]) {
+                        memset(p, 0, n);
+                    }
+                    else if (!m_file.read(m_blocks[b] + within, p, n)) {
+                        return false;
+                    }
+                    p += n;
+                    offset += n;
+                    length -= n;
+                }
+                return true;
+            }
+
+            bool finish() override
+            {
+                return m_file.resize(m_next) && writeBat() && writeMetadata() && writeHeaders() && m_file.flush();
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // a fixed set of threads for the life of the owner. run() hands out
+        // fn(0) .. fn(count - 1) to them and the caller, and returns when all are done
+        class Workers
+        {
+            std::vector<std::thread> m_threads;
+            std::mutex m_lock;
+            std::condition_variable m_start;
+            std::condition_variable m_done;
+            // of the current run, set under the lock while no worker is busy
+            const std::function<void(size_t)>* m_fn = nullptr;
+            size_t m_count = 0;
+            std::atomic<size_t> m_next{ 0 };
+            uint64_t m_generation = 0;
+            size_t m_busy = 0;
+            bool m_stop = false;
+
+            void drain(const std::function<void(size_t)>& fn, size_t count)
+            {
+                for (size_t i = m_next++; i < count; i = m_next++) {
+                    fn(i);
+                }
+            }
+
+            void work()
+            {
+                uint64_t seen = 0;
+                std::unique_lock<std::mutex> g(m_lock);
+                for (;;)
+                {
+                    m_start.wait(g, [&] { return m_stop || m_generation != seen; });
+                    if (m_stop) {
+                        return;
+                    }
+                    seen = m_generation;
+                    const std::function<void(size_t)>* fn = m_fn;
+                    size_t count = m_count;
+                    m_busy++;
+                    g.unlock();
+                    drain(*fn, count);
+                    g.lock();
+                    if (--m_busy == 0) {
+                        m_done.notify_all();
+                    }
+                }
+            }
+
+        public:
+            // 'threads' includes the caller
+            explicit Workers(size_t threads)
+            {
+                for (size_t i = 1; i < threads; i++) {
+                    m_threads.emplace_back([this]() { work(); });
+                }
+            }
+
+            ~Workers()
+            {
+                {
+                    std::lock_guard<std::mutex> g(m_lock);
+                    m_stop = true;
+                }
+                m_start.notify_all();
+                for (auto& t : m_threads) {
+                    t.join();
+                }
+            }
+
+            Workers(const Workers&) = delete;
+            Workers& operator=(const Workers&) = delete;
+
+            size_t size() const { return m_threads.size() + 1; }
+
+            void run(size_t count, const std::function<void(size_t)>& fn)
+            {
+                {
+                    std::unique_lock<std::mutex> g(m_lock);
+                    // a worker late for the last run must see it through first
+                    m_done.wait(g, [&] { return m_busy == 0; });
+                    m_fn = &fn;
+                    m_count = count;
+                    m_next = 0;
+                    m_generation++;
+                }
+                m_start.notify_all();
+                drain(fn, count);
+                std::unique_lock<std::mutex> g(m_lock);
+                m_done.wait(g, [&] { return m_busy == 0; });
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // writes the archive ArchiveSource reads. blocks must arrive in order;
+        // they are compressed a batch at a time, a block per worker.
+        class ArchiveWriter : public ImageWriter
+        {
+            OutputFile m_file;
+            uint64_t m_size = 0;
+            uint32_t m_blockSize = 0;
+            uint32_t m_sectorSize = 512;
+            // next byte expected, and where the next record goes
+            uint64_t m_offset = 0;
+            uint64_t m_fileOffset = _archiveHeader;
+            std::vector<uint64_t> m_index;
+            // filled blocks waiting to be compressed
+            std::vector<std::vector<BYTE>> m_batch;
+            std::vector<size_t> m_lengths;
+            size_t m_batchCount = 0;
+            // of the block being filled
+            size_t m_filled = 0;
+            Workers m_workers;
+
+            struct Packed
+            {
+                uint32_t type = _archiveZero;
+                uint32_t crc = 0;
+                std::vector<BYTE> data;
+            };
+
+            static void pack(const std::vector<BYTE>& block, size_t length, Packed& out)
+            {
+                out.crc = hash::crc32c(block.data(), length);
+                if (isZero(block.data(), length))
+                {
+                    out.type = _archiveZero;
+                    out.data.clear();
+                    return;
+                }
+                out.data.resize(ntfs::lznt1Bound(length));
+                size_t n = ntfs::lznt1Compress(block.data(), length, out.data.data());
+                if (n >= length)
+                {
+                    out.type = _archiveStored;
+                    out.data.assign(block.begin(), block.begin() + length);
+                    return;
+                }
+                out.type = _archiveLznt1;
+                out.data.resize(n);
+            }
+
+            bool flushBatch()
+            {
+                std::vector<Packed> packed(m_batchCount);
+                m_workers.run(m_batchCount, [this, &packed](size_t i) { pack(m_batch[i], m_lengths[i], packed[i]); });
+                for (Packed& p : packed)
+                {
+                    BYTE record[_archiveRecord] = { 0 };
+                    putLe32(record, (uint32_t)p.data.size());
+                    putLe32(record + 4, p.type);
+                    putLe32(record + 8, p.crc);
+                    m_index.push_back(m_fileOffset);
+                    if (!m_file.write(m_fileOffset, record, sizeof(record))
+                        || (p.data.size() && !m_file.write(m_fileOffset + sizeof(record), p.data.data(), p.data.size()))) {
+                        return false;
+                    }
+                    m_fileOffset += sizeof(record) + p.data.size();
+                }
+                m_batchCount = 0;
+                return true;
+            }
+
+        public:
+            ArchiveWriter(uint64_t size, uint32_t sectorSize = 512, uint32_t blockSize = 1024 * 1024)
+                : m_size(size), m_blockSize(blockSize), m_sectorSize(sectorSize),
+                  m_workers((std::max)(1u, std::thread::hardware_concurrency()))
+            {
+                m_batch.resize(m_workers.size());
+                m_lengths.resize(m_batch.size());
+            }
+
+            bool open(const std::filesystem::path& path)
+            {
+                if (!m_file.open(path, false)) {
+                    return false;
+                }
+                BYTE header[_archiveHeader] = { 0 };
+                memcpy(header, "wde2arch", 8);
+                putLe32(header + 8, _archiveVersion);
+                putLe32(header + 12, m_blockSize);
+                putLe64(header + 16, m_size);
+                putLe32(header + 24, m_sectorSize);
+                putLe32(header + 28, 1);
+                return m_file.write(0, header, sizeof(header));
+            }
+
+            uint64_t size() const override { return m_size; }
+            Kind kind() const override { return Kind::Archive; }
+
+            // in order only: 'offset' must follow the previous write
+            bool write(uint64_t offset, const void* data, size_t length) override
+            {
+                if (offset != m_offset || length > m_size - offset) {
+                    return false;
+                }
+                const BYTE* p = (const BYTE*)data;
+                while (length)
+                {
+                    if (m_filled == 0) {
+                        m_batch[m_batchCount].resize(m_blockSize);
+                    }
+                    size_t n = (std::min)(length, (size_t)m_blockSize - m_filled);
+                    memcpy(m_batch[m_batchCount].data() + m_filled, p, n);
+                    m_filled += n;
+                    p += n;
+                    length -= n;
+                    m_offset += n;
+                    if (m_filled == m_blockSize)
+                    {
+                        m_lengths[m_batchCount++] = m_filled;
+                        m_filled = 0;
+                        if (m_batchCount == m_batch.size() && !flushBatch()) {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+
+            bool finish() override
+            {
+                if (m_offset != m_size) {
+                    return false;
+                }
+                // a partly filled last block
+                if (m_filled)
+                {
+                    m_lengths[m_batchCount++] = m_filled;
+                    m_filled = 0;
+                }
+                if (m_batchCount && !flushBatch()) {
+                    return false;
+                }
+                std::vector<BYTE> index(m_index.size() * 8);
+                for (size_t i = 0; i < m_index.size(); i++) {
+                    putLe64(index.data() + i * 8, m_index[i]);
+                }
+                BYTE trailer[_archiveTrailer] = { 0 };
+                memcpy(trailer, "wdaindex", 8);
+                putLe64(trailer + 8, m_fileOffset);
+                putLe64(trailer + 16, m_index.size());
+                putLe32(trailer + 24, hash::crc32c(index.data(), index.size()));
+                return m_file.write(m_fileOffset, index.data(), index.size())
+                    && m_file.write(m_fileOffset + index.size(), trailer, sizeof(trailer))
+                    && m_file.resize(m_fileOffset + index.size() + sizeof(trailer))
+                    && m_file.flush();
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // by extension: .vhd is a fixed VHD, .vhdx a dynamic VHDX, .wda an archive
+        // and anything else a raw image
+        static Kind kindFor(const std::filesystem::path& path)
+        {
+            std::wstring ext = path.extension().wstring();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](wchar_t c) { return (wchar_t)std::towlower(c); });
+            if (ext == L".vhdx") {
+                return Kind::Vhdx;
+            }
+            if (ext == L".wda") {
+                return Kind::Archive;
+            }
+            return (ext == L".vhd") ? Kind::FixedVhd : Kind::Raw;
+        }
+
+        // the format follows kindFor(). 'size' is rounded up to whole sectors.
+        // 'keep' reopens an existing raw image or fixed VHD; the other formats are
+        // always written from scratch. null if the file cannot be opened.
+        static std::unique_ptr<ImageWriter> create(const std::filesystem::path& path, uint64_t size, bool keep = false,
+                                                   uint32_t sectorSize = 512)
+        {
+            Kind kind = kindFor(path);
+            size = (size + 511) & ~511ull;
+            if (kind == Kind::Vhdx || kind == Kind::Archive)
+            {
+                if (keep) {
+                    return nullptr;
+                }
+                if (kind == Kind::Archive)
+                {
+                    std::unique_ptr<ArchiveWriter> w(new ArchiveWriter(size, sectorSize));
+                    return w->open(path) ? std::unique_ptr<ImageWriter>(w.release()) : nullptr;
+                }
+                size = (size + sectorSize - 1) / sectorSize * sectorSize;
+                std::unique_ptr<VhdxWriter> w(new VhdxWriter(size, 2 * 1024 * 1024, sectorSize == 4096 ? 4096 : 512));
+                return w->open(path) ? std::unique_ptr<ImageWriter>(w.release()) : nullptr;
+            }
+            std::unique_ptr<FlatWriter> w(new FlatWriter(size, kind == Kind::FixedVhd));
+            if (!w->open(path, keep)) {
+                return nullptr;
+            }
+            return std::unique_ptr<ImageWriter>(w.release());
+        }
+    }
+}
@@ -0,0 +1,765 @@
+/*
+
+    Device throughput benchmark and per-device I/O profiles.
+
+    run() measures sequential and random reads over a matrix of block
+    sizes and queue depths. A queue depth of N is N threads, each with
+    its own unbuffered handle, so the requests reach the device side by
+    side rather than queueing behind one file object. Sequential threads
+    share a cursor; random ones pick aligned blocks anywhere on the
+    device. Nothing is written unless asked, and then only to a scratch
+    file that the benchmark creates and deletes.
+
+    derive() reduces the matrix to a Profile: the smallest block size
+    and depth that reach 90% of the best sequential rate, which keeps
+    the memory in flight down on devices that saturate early. Profiles
+    are stored per ProductId/SerialNumber, so a USB disk keeps its
+    profile whichever port or device number it turns up on, and
+    sequential() hands the clone, refresh and restore paths the
+    parameters of the device they are about to use.
+
+    select() starts from what the device says it is, the StorageClass
+    enumeration collects: one stream for rotational media, deeper
+    queues and parallel streams for solid state, shallow queues behind
+    USB bridges, and no unmap where TRIM is known to be off. Measured
+    figures from a profile win over the guesses.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#endif
+
+#include "blk_io.h"
+#include "enum_cache.h"
+
+namespace wde2
+{
+    namespace io
+    {
+        // 'WDEP' + version
+        static const uint32_t _profileMagic = 0x50454457;
+        static const uint32_t _profileVersion = 1;
+        // a profile's rate is 'good enough' at this share of the best
+        static const double _goodEnough = 0.9;
+
+        //-----------------------------------------------------------------------------
+        struct Options
+        {
+            std::vector<uint32_t> blockSizes = { 4 * 1024, 64 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+            std::vector<uint32_t> depths = { 1, 4, 16, 32 };
+            // per cell of the matrix
+            double seconds = 1;
+            // also sequential and random writes, to a new scratch file only
+            bool write = false;
+            uint64_t scratchSize = 1024ull * 1024 * 1024;
+        };
+
+        struct Cell
+        {
+            bool random = false;
+            bool write = false;
+            uint32_t blockSize = 0;
+            uint32_t depth = 0;
+            uint64_t ios = 0;
+            uint64_t bytes = 0;
+            double seconds = 0;
+            double latencyMs = 0;
+            double p99Ms = 0;
+            // false if an I/O failed part way
+            bool ok = true;
+
+            double rate() const { return seconds > 0 ? bytes / seconds : 0; }
+            double iops() const { return seconds > 0 ? ios / seconds : 0; }
+        };
+
+        struct Result
+        {
+            uint64_t size = 0;
+            DWORD sectorSize = 512;
+            // reads bypassed the OS cache
+            bool direct = false;
+            std::vector<Cell> cells;
+        };
+
+        //-----------------------------------------------------------------------------
+        // unbuffered, synchronous. one per thread
+        class Handle
+        {
+            uint64_t m_size = 0;
+            DWORD m_sectorSize = 512;
+            bool m_direct = false;
+#ifdef _WIN32
+            HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+            int m_fd = -1;
+#endif
+
+        public:
+            Handle() {}
+            Handle(const Handle&) = delete;
+            Handle& operator=(const Handle&) = delete;
+            ~Handle()
+            {
+#ifdef _WIN32
+                if (m_handle != INVALID_HANDLE_VALUE) {
+                    ::CloseHandle(m_handle);
+                }
+#else
+                if (m_fd >= 0) {
+                    ::close(m_fd);
+                }
+#endif
+            }
+
+            bool open(const std::filesystem::path& path, bool write)
+            {
+#ifdef _WIN32
+                m_handle = ::CreateFileW(path.c_str(),
+                                        GENERIC_READ | (write ? GENERIC_WRITE : 0),
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                        NULL,
+                                        OPEN_EXISTING,
+                                        FILE_FLAG_NO_BUFFERING | (write ? FILE_FLAG_WRITE_THROUGH : 0),
+                                        NULL);
+                if (m_handle == INVALID_HANDLE_VALUE) {
+                    return false;
+                }
+                m_direct = true;
+                LARGE_INTEGER li{ 0 };
+                if (::GetFileSizeEx(m_handle, &li) && li.QuadPart) {
+                    m_size = (uint64_t)li.QuadPart;
+                }
+                else
+                {
+                    DWORD bytesReturned = 0;
+                    GET_LENGTH_INFORMATION gli{ 0 };
+                    DISK_GEOMETRY_EX geom{ 0 };
+                    if (::DeviceIoControl(m_handle, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &gli, sizeof(gli), &bytesReturned, NULL)) {
+                        m_size = (uint64_t)gli.Length.QuadPart;
+                    }
+                    if (::DeviceIoControl(m_handle, IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0, &geom, sizeof(geom), &bytesReturned, NULL)) {
+                        m_sectorSize = geom.Geometry.BytesPerSector;
+                    }
+                }
+#else
+                int flags = (write ? O_RDWR : O_RDONLY) | O_CLOEXEC;
+                m_fd = ::open(path.c_str(), flags | O_DIRECT);
+                m_direct = m_fd >= 0;
+                // tmpfs and some FUSE file systems refuse O_DIRECT
+                if (m_fd < 0) {
+                    m_fd = ::open(path.c_str(), flags);
+                }
+                if (m_fd < 0) {
+                    return false;
+                }
+                struct stat st;
+                if (::fstat(m_fd, &st) == 0 && S_ISBLK(st.st_mode))
+                {
+                    unsigned long long bytes = 0;
+                    int ssz = 0;
+                    if (::ioctl(m_fd, BLKGETSIZE64, &bytes) == 0) {
+                        m_size = bytes;
+                    }
+                    if (::ioctl(m_fd, BLKSSZGET, &ssz) == 0 && ssz >= 512) {
+                        m_sectorSize = (DWORD)ssz;
+                    }
+                }
+                else if (::fstat(m_fd, &st) == 0) {
+                    m_size = (uint64_t)st.st_size;
+                }
+#endif
+                return m_size != 0;
+            }
+
+            uint64_t size() const { return m_size; }
+            DWORD sectorSize() const { return m_sectorSize; }
+            bool direct() const { return m_direct; }
+
+            bool read(uint64_t offset, void* buffer, size_t length)
+            {
+#ifdef _WIN32
+                OVERLAPPED ov{ 0 };
+                ov.Offset = (DWORD)offset;
+                ov.OffsetHigh = (DWORD)(offset >> 32);
+                DWORD n = 0;
+                return ::ReadFile(m_handle, buffer, (DWORD)length, &n, &ov) && n == length;
+#else
+                return ::pread(m_fd, buffer, length, (off_t)offset) == (ssize_t)length;
+#endif
+            }
+
+            bool write(uint64_t offset, const void* buffer, size_t length)
+            {
+#ifdef _WIN32
+                OVERLAPPED ov{ 0 };
+                ov.Offset = (DWORD)offset;
+                ov.OffsetHigh = (DWORD)(offset >> 32);
+                DWORD n = 0;
+                return ::WriteFile(m_handle, buffer, (DWORD)length, &n, &ov) && n == length;
+#else
+                return ::pwrite(m_fd, buffer, length, (off_t)offset) == (ssize_t)length;
+#endif
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        static bool isDevice(const std::filesystem::path& path)
+        {
+#ifdef _WIN32
+            return path.wstring().rfind(L"\\\\.\\", 0) == 0;
+#else
+            return path.native().rfind("/dev/", 0) == 0;
+#endif
+        }
+
+        // 'depth' threads on one cell for 'seconds'
+        static Cell runCell(const std::filesystem::path& path, uint64_t size, bool random, bool write,
+                            uint32_t blockSize, uint32_t depth, double seconds, uint64_t seed)
+        {
+            Cell cell;
+            cell.random = random;
+            cell.write = write;
+            cell.blockSize = blockSize;
+            cell.depth = depth;
+            uint64_t blocks = size / blockSize;
+            std::vector<std::unique_ptr<Handle>> handles;
+            for (uint32_t t = 0; t < depth; t++)
+            {
+                handles.emplace_back(new Handle());
+                if (!handles.back()->open(path, write))
+                {
+                    cell.ok = false;
+                    return cell;
+                }
+            }
+            // sequential cells start somewhere new, past what the device may have cached
+            std::mt19937_64 pick(seed);
+            std::atomic<uint64_t> cursor(std::uniform_int_distribution<uint64_t>(0, blocks - 1)(pick));
+            std::atomic<bool> failed(false);
+            std::mutex lock;
+            std::vector<float> latencies;
+            auto started = std::chrono::steady_clock::now();
+            auto deadline = started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+            auto work = [&](uint32_t t) {
+                Handle& h = *handles[t];
+                blk::AlignedBuffer buffer(blockSize);
+                std::mt19937_64 rng(seed * 131 + t);
+                // incompressible, for devices that compress or deduplicate
+                for (size_t i = 0; i + 8 <= blockSize; i += 8) {
+                    uint64_t v = rng();
+                    memcpy(buffer.data() + i, &v, 8);
+                }
+                std::vector<float> mine;
+                uint64_t ios = 0;
+                while (!failed && std::chrono::steady_clock::now() < deadline)
+                {
+                    uint64_t b = random ? std::uniform_int_distribution<uint64_t>(0, blocks - 1)(rng) : cursor++ % blocks;
+                    auto t0 = std::chrono::steady_clock::now();
+                    bool ok = write ? h.write(b * blockSize, buffer.data(), blockSize) : h.read(b * blockSize, buffer.data(), blockSize);
+                    if (!ok)
+                    {
+                        failed = true;
+                        break;
+                    }
+                    mine.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count());
+                    ios++;
+                }
+                std::lock_guard<std::mutex> guard(lock);
+                latencies.insert(latencies.end(), mine.begin(), mine.end());
+                cell.ios += ios;
+            };
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < depth; t++) {
+                threads.emplace_back(work, t);
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+            cell.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            cell.bytes = cell.ios * blockSize;
+            cell.ok = !failed;
+            if (!latencies.empty())
+            {
+                double sum = 0;
+                for (float l : latencies) {
+                    sum += l;
+                }
+                cell.latencyMs = sum / latencies.size();
+                size_t p99 = latencies.size() * 99 / 100;
+                std::nth_element(latencies.begin(), latencies.begin() + p99, latencies.end());
+                cell.p99Ms = latencies[p99];
+            }
+            return cell;
+        }
+
+        //-----------------------------------------------------------------------------
+        // reads 'path', a disk or file. with options.write 'path' must not
+        // exist: a scratch file is written there and deleted afterwards
+        static Result run(const std::filesystem::path& path, const Options& options = Options(),
+                          const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            Result result;
+            // removes the scratch file however run() ends
+            struct Scratch
+            {
+                std::filesystem::path path;
+                ~Scratch()
+                {
+                    std::error_code ec;
+                    if (!path.empty()) {
+                        std::filesystem::remove(path, ec);
+                    }
+                }
+            } scratch;
+            if (options.write)
+            {
+                std::error_code ec;
+                nv2::throw_if(isDevice(path), nv2::acc("Write tests only run on a scratch file, not on a disk"));
+                nv2::throw_if(std::filesystem::exists(path, ec), nv2::acc("Write tests need a new file: ") << path.wstring() << " exists");
+                {
+                    std::ofstream create(path, std::ios::binary);
+                    nv2::throw_if(!create, nv2::acc("Unable to create ") << path.wstring());
+                }
+                scratch.path = path;
+                std::filesystem::resize_file(path, options.scratchSize, ec);
+                nv2::throw_if(!!ec, nv2::acc("Unable to size ") << path.wstring());
+                // written out in full, so that reads do not come back from holes
+                Handle h;
+                nv2::throw_if(!h.open(path, true), nv2::acc("Unable to open ") << path.wstring());
+                blk::AlignedBuffer buffer(4 * 1024 * 1024);
+                memset(buffer.data(), 0xA5, buffer.size());
+                for (uint64_t offset = 0; offset < options.scratchSize; offset += buffer.size())
+                {
+                    size_t n = (size_t)(std::min)((uint64_t)buffer.size(), options.scratchSize - offset);
+                    nv2::throw_if(!h.write(offset, buffer.data(), n), nv2::acc("Unable to write ") << path.wstring());
+                }
+            }
+            {
+                Handle h;
+                nv2::throw_if(!h.open(path, false), nv2::acc("Unable to read ") << path.wstring());
+                result.size = h.size();
+                result.sectorSize = h.sectorSize();
+                result.direct = h.direct();
+            }
+            uint64_t total = options.blockSizes.size() * options.depths.size() * (options.write ? 4 : 2), done = 0;
+            uint64_t seed = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+            for (bool write : { false, true })
+            {
+                if (write && !options.write) {
+                    continue;
+                }
+                for (bool random : { false, true })
+                {
+                    for (uint32_t blockSize : options.blockSizes)
+                    {
+                        for (uint32_t depth : options.depths)
+                        {
+                            if (blockSize >= result.sectorSize && blockSize % result.sectorSize == 0 && blockSize <= result.size) {
+                                result.cells.push_back(runCell(path, result.size, random, write, blockSize, depth, options.seconds, seed++));
+                            }
+                            if (progress) {
+                                progress(++done, total);
+                            }
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        //-----------------------------------------------------------------------------
+        struct Profile
+        {
+            // ProductId/SerialNumber
+            std::wstring key;
+            // sequential, bytes per second
+            uint32_t readBlockSize = 0;
+            uint32_t readDepth = 0;
+            double readRate = 0;
+            // 0 if not measured
+            uint32_t writeBlockSize = 0;
+            uint32_t writeDepth = 0;
+            double writeRate = 0;
+            // random reads of the smallest block size
+            uint32_t randomBlockSize = 0;
+            uint32_t randomDepth = 0;
+            double randomIops = 0;
+            // time_t
+            uint64_t measured = 0;
+        };
+
+        // the least memory in flight within _goodEnough of the best rate
+        static const Cell* pickSequential(const Result& result, bool write)
+        {
+            double best = 0;
+            for (const Cell& c : result.cells)
+            {
+                if (c.ok && !c.random && c.write == write) {
+                    best = (std::max)(best, c.rate());
+                }
+            }
+            const Cell* pick = nullptr;
+            for (const Cell& c : result.cells)
+            {
+                if (!c.ok || c.random || c.write != write || c.rate() < best * _goodEnough || best == 0) {
+                    continue;
+                }
+                uint64_t inFlight = (uint64_t)c.blockSize * c.depth;
+                if (!pick || inFlight < (uint64_t)pick->blockSize * pick->depth
+                    || (inFlight == (uint64_t)pick->blockSize * pick->depth && c.depth < pick->depth)) {
+                    pick = &c;
+                }
+            }
+            return pick;
+        }
+
+        static Profile derive(const Result& result, const std::wstring& key)
+        {
+            Profile p;
+            p.key = key;
+            p.measured = (uint64_t)::time(nullptr);
+            if (const Cell* c = pickSequential(result, false))
+            {
+                p.readBlockSize = c->blockSize;
+                p.readDepth = c->depth;
+                p.readRate = c->rate();
+            }
+            if (const Cell* c = pickSequential(result, true))
+            {
+                p.writeBlockSize = c->blockSize;
+                p.writeDepth = c->depth;
+                p.writeRate = c->rate();
+            }
+            for (const Cell& c : result.cells)
+            {
+                if (!c.ok || !c.random || c.write) {
+                    continue;
+                }
+                if (p.randomBlockSize == 0 || c.blockSize < p.randomBlockSize
+                    || (c.blockSize == p.randomBlockSize && c.iops() > p.randomIops))
+                {
+                    p.randomBlockSize = c.blockSize;
+                    p.randomDepth = c.depth;
+                    p.randomIops = c.iops();
+                }
+            }
+            return p;
+        }
+
+        //-----------------------------------------------------------------------------
+        // ProductId/SerialNumber of a disk, empty for a file or a disk that
+        // reports neither
+        static std::wstring deviceKey(const std::filesystem::path& path)
+        {
+            if (!isDevice(path)) {
+                return std::wstring();
+            }
+            std::wstring product, serial;
+            auto trim = [](std::wstring s) {
+                s.erase(0, s.find_first_not_of(L' '));
+                s.erase(s.find_last_not_of(L' ') + 1);
+                return s;
+            };
+#ifdef _WIN32
+            // no access needed to query properties
+            HANDLE hDevice = ::CreateFileW(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+            if (hDevice == INVALID_HANDLE_VALUE) {
+                return std::wstring();
+            }
+            uw32::Handle wh(hDevice);
+            STORAGE_PROPERTY_QUERY query;
+            ZeroMemory(&query, sizeof(query));
+            query.PropertyId = StorageDeviceProperty;
+            query.QueryType = PropertyStandardQuery;
+            char propQueryOut[_8KB] = { 0 };
+            DWORD bytesReturned = 0;
+            if (::DeviceIoControl(hDevice, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query),
+                                  &propQueryOut, sizeof(propQueryOut) - 1, &bytesReturned, NULL))
+            {
+                STORAGE_DEVICE_DESCRIPTOR* pDevDesc = (STORAGE_DEVICE_DESCRIPTOR*)&propQueryOut[0];
+                if (pDevDesc->ProductIdOffset) {
+                    product = nv2::n2w(&propQueryOut[pDevDesc->ProductIdOffset]);
+                }
+                if (pDevDesc->SerialNumberOffset) {
+                    serial = nv2::n2w(&propQueryOut[pDevDesc->SerialNumberOffset]);
+                }
+            }
+#else
+            std::string name = path.filename().string();
+            lnx::Fd device(::open(("/sys/class/block/" + name + "/device").c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            if (!device) {
+                return std::wstring();
+            }
+            product = lnx::widen(lnx::readAttr(device.get(), "model"));
+            std::string s = lnx::readAttr(device.get(), "serial");
+            if (s.empty()) {
+                s = lnx::serialFromVpd80(lnx::readRaw(device.get(), "vpd_pg80"));
+            }
+            serial = lnx::widen(s);
+#endif
+            product = trim(product);
+            serial = trim(serial);
+            return (product.empty() && serial.empty()) ? std::wstring() : product + L"/" + serial;
+        }
+
+        //-----------------------------------------------------------------------------
+        using ProfileMap = std::map<std::wstring, Profile>;
+
+        // %LOCALAPPDATA%\wde2\profiles.bin, or ~/.config/wde2/profiles.bin
+        static std::filesystem::path profilePath()
+        {
+#ifdef _WIN32
+            const char* base = ::getenv("LOCALAPPDATA");
+            std::filesystem::path dir = base ? std::filesystem::path(base) : std::filesystem::temp_directory_path();
+#else
+            const char* xdg = ::getenv("XDG_CONFIG_HOME");
+            const char* home = ::getenv("HOME");
+            std::filesystem::path dir = xdg ? std::filesystem::path(xdg) : std::filesystem::path(home ? home : "/tmp") / ".config";
+#endif
+            return dir / "wde2" / "profiles.bin";
+        }
+
+        static bool load(const std::filesystem::path& path, ProfileMap& profiles)
+        {
+            profiles.clear();
+            std::ifstream is(path, std::ios::binary);
+            if (!is) {
+                return false;
+            }
+            std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+            cache::ByteReader r(data.data(), data.size());
+            if (r.u32() != _profileMagic || r.u32() != _profileVersion) {
+                return false;
+            }
+            uint32_t count = r.u32();
+            for (uint32_t i = 0; i < count && r.ok(); i++)
+            {
+                Profile p;
+                p.key = r.wstr();
+                p.readBlockSize = r.u32();
+                p.readDepth = r.u32();
+                p.readRate = (double)r.u64();
+                p.writeBlockSize = r.u32();
+                p.writeDepth = r.u32();
+                p.writeRate = (double)r.u64();
+                p.randomBlockSize = r.u32();
+                p.randomDepth = r.u32();
+                p.randomIops = (double)r.u64();
+                p.measured = r.u64();
+                profiles[p.key] = p;
+            }
+            if (!r.ok()) {
+                profiles.clear();
+            }
+            return r.ok();
+        }
+
+        static bool save(const std::filesystem::path& path, const ProfileMap& profiles)
+        {
+            cache::ByteWriter w;
+            w.u32(_profileMagic);
+            w.u32(_profileVersion);
+            w.u32((uint32_t)profiles.size());
+            for (auto& e : profiles)
+            {
+                const Profile& p = e.second;
+                w.wstr(p.key);
+                w.u32(p.readBlockSize);
+                w.u32(p.readDepth);
+                w.u64((uint64_t)p.readRate);
+                w.u32(p.writeBlockSize);
+                w.u32(p.writeDepth);
+                w.u64((uint64_t)p.writeRate);
+                w.u32(p.randomBlockSize);
+                w.u32(p.randomDepth);
+                w.u64((uint64_t)p.randomIops);
+                w.u64(p.measured);
+            }
+            std::error_code ec;
+            std::filesystem::create_directories(path.parent_path(), ec);
+            return cache::saveAtomically(path, w.buffer());
+        }
+
+        //-----------------------------------------------------------------------------
+        enum class Media
+        {
+            Unknown,
+            Rotational,
+            SolidState
+        };
+
+        // I/O parameters for a sequential pass over 'path'
+        struct Plan
+        {
+            size_t blockSize = 0;
+            unsigned depth = 0;
+            // from a stored profile rather than the defaults
+            bool profiled = false;
+            Media media = Media::Unknown;
+            // readers, each with its own handle, sharing one cursor
+            unsigned streams = 1;
+            // unmap zero ranges rather than write them
+            bool unmap = true;
+
+            size_t window() const { return blockSize * depth; }
+        };
+
+        // the profile of the device at 'path', or the caller's defaults for a
+        // file or a device never benchmarked. write plans fall back to the
+        // read figures when only reads were measured
+        static Plan sequential(const std::filesystem::path& path, bool write, size_t blockSize, unsigned depth)
+        {
+            Plan plan;
+            plan.blockSize = blockSize;
+            plan.depth = depth;
+            std::wstring key = deviceKey(path);
+            ProfileMap profiles;
+            if (key.empty() || !load(profilePath(), profiles)) {
+                return plan;
+            }
+            auto it = profiles.find(key);
+            if (it == profiles.end()) {
+                return plan;
+            }
+            const Profile& p = it->second;
+            bool useWrite = write && p.writeBlockSize;
+            uint32_t b = useWrite ? p.writeBlockSize : p.readBlockSize;
+            uint32_t d = useWrite ? p.writeDepth : p.readDepth;
+            if (b == 0 || d == 0) {
+                return plan;
+            }
+            // below 64KB the per request cost dominates whatever the device says
+            plan.blockSize = (std::min)((std::max)((size_t)b, (size_t)64 * 1024), (size_t)8 * 1024 * 1024);
+            plan.depth = (std::min)((std::max)(d, 1u), 64u);
+            plan.profiled = true;
+            return plan;
+        }
+
+        //-----------------------------------------------------------------------------
+        // the storage class of the device at 'path'. nothing is known of a file
+        static StorageClass storageClass(const std::filesystem::path& path)
+        {
+            StorageClass storage;
+            if (!isDevice(path)) {
+                return storage;
+            }
+#ifdef _WIN32
+            HANDLE hDevice = ::CreateFileW(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+            if (hDevice == INVALID_HANDLE_VALUE) {
+                return storage;
+            }
+            uw32::Handle wh(hDevice);
+            QueryStorageClass(hDevice, storage);
+#else
+            std::string name = path.filename().string();
+            std::string blockPath = "/sys/class/block/" + name;
+            lnx::Fd dirfd(::open(blockPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            if (!dirfd) {
+                return storage;
+            }
+            char resolved[PATH_MAX] = { 0 };
+            lnx::readStorageClass(dirfd.get(), ::realpath(blockPath.c_str(), resolved) ? resolved : blockPath, name, storage);
+#endif
+            return storage;
+        }
+
+        // how to drive the device at 'path'. the storage class sets the shape: one
+        // stream on rotational media, where a second reader only adds seeks, and
+        // deep queues with several streams on solid state. a stored profile then
+        // replaces the block size and depth with measured ones. the caller's
+        // defaults stand for a file or a device that says nothing
+        static Plan select(const std::filesystem::path& path, bool write, size_t blockSize, unsigned depth)
+        {
+            StorageClass storage = storageClass(path);
+            Plan plan;
+            plan.blockSize = blockSize;
+            plan.depth = depth;
+            if (storage.hasSeekPenalty) {
+                plan.media = storage.IncursSeekPenalty ? Media::Rotational : Media::SolidState;
+            }
+            // files, and devices that do not say, are tried
+            plan.unmap = !storage.hasTrim || storage.TrimEnabled;
+            bool nvme = storage.BusType == BusTypeNvme;
+            if (plan.media == Media::Rotational)
+            {
+                // a few requests let the drive sort them, more just queue
+                plan.blockSize = (std::max)(blockSize, (size_t)1024 * 1024);
+                plan.depth = (std::min)(depth, 4u);
+                plan.streams = 1;
+            }
+            else if (plan.media == Media::SolidState)
+            {
+                // SATA queues 32 at most
+                plan.depth = (std::max)(depth, nvme ? 32u : 16u);
+                plan.streams = nvme ? 4 : 2;
+            }
+            // bridges queue little and often misreport the rest
+            if (storage.BusType == BusTypeUsb)
+            {
+                plan.depth = (std::min)(plan.depth, 4u);
+                plan.streams = 1;
+            }
+            Plan measured = sequential(path, write, plan.blockSize, plan.depth);
+            if (measured.profiled)
+            {
+                plan.blockSize = measured.blockSize;
+                plan.depth = measured.depth;
+                plan.profiled = true;
+            }
+            return plan;
+        }
+    }
+}
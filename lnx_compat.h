@@ -0,0 +1,191 @@
+/*
+
+    Minimal Win32 type definitions for non-Windows builds.
+
+    Lets the wde2 disk/partition model in structs.h compile
+    unchanged on Linux so the portable backends can fill the same
+    DiskInfo/PartitionInfo structures the Win32 IOCTLs do.
+
+    Layouts mirror winioctl.h closely enough for our purposes but
+    are *not* binary compatible with it: WCHAR is 32 bits here.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef uint64_t DWORD64;
+typedef int BOOL;
+typedef uint8_t BOOLEAN;
+typedef wchar_t WCHAR;
+typedef DWORD DEVICE_TYPE;
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE 1
+#endif
+
+//-----------------------------------------------------------------------------
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    } u;
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _GUID {
+    DWORD Data1;
+    WORD Data2;
+    WORD Data3;
+    BYTE Data4[8];
+} GUID;
+
+//-----------------------------------------------------------------------------
+// winioctl.h subset
+#define FILE_DEVICE_DISK 0x00000007
+
+typedef enum _MEDIA_TYPE {
+    Unknown = 0,
+    RemovableMedia = 11,
+    FixedMedia = 12
+} MEDIA_TYPE;
+
+typedef struct _DISK_GEOMETRY {
+    LARGE_INTEGER Cylinders;
+    MEDIA_TYPE MediaType;
+    DWORD TracksPerCylinder;
+    DWORD SectorsPerTrack;
+    DWORD BytesPerSector;
+} DISK_GEOMETRY;
+
+typedef struct _STORAGE_DEVICE_NUMBER {
+    DEVICE_TYPE DeviceType;
+    DWORD DeviceNumber;
+    DWORD PartitionNumber;
+} STORAGE_DEVICE_NUMBER;
+
+// values as ntddstor.h
+typedef enum _STORAGE_BUS_TYPE {
+    BusTypeUnknown = 0x00,
+    BusTypeScsi = 0x01,
+    BusTypeAta = 0x03,
+    BusTypeUsb = 0x07,
+    BusTypeSata = 0x0B,
+    BusTypeSd = 0x0C,
+    BusTypeMmc = 0x0D,
+    BusTypeVirtual = 0x0E,
+    BusTypeNvme = 0x11
+} STORAGE_BUS_TYPE;
+
+typedef enum _PARTITION_STYLE {
+    PARTITION_STYLE_MBR,
+    PARTITION_STYLE_GPT,
+    PARTITION_STYLE_RAW
+} PARTITION_STYLE;
+
+typedef struct _PARTITION_INFORMATION_MBR {
+    BYTE PartitionType;
+    BOOLEAN BootIndicator;
+    BOOLEAN RecognizedPartition;
+    DWORD HiddenSectors;
+    GUID PartitionId;
+} PARTITION_INFORMATION_MBR;
+
+typedef struct _PARTITION_INFORMATION_GPT {
+    GUID PartitionType;
+    GUID PartitionId;
+    DWORD64 Attributes;
+    WCHAR Name[36];
+} PARTITION_INFORMATION_GPT;
+
+typedef struct _PARTITION_INFORMATION_EX {
+    PARTITION_STYLE PartitionStyle;
+    LARGE_INTEGER StartingOffset;
+    LARGE_INTEGER PartitionLength;
+    DWORD PartitionNumber;
+    BOOLEAN RewritePartition;
+    BOOLEAN IsServicePartition;
+    union {
+        PARTITION_INFORMATION_MBR Mbr;
+        PARTITION_INFORMATION_GPT Gpt;
+    };
+} PARTITION_INFORMATION_EX;
+
+typedef struct _DRIVE_LAYOUT_INFORMATION_MBR {
+    DWORD Signature;
+    DWORD CheckSum;
+} DRIVE_LAYOUT_INFORMATION_MBR;
+
+typedef struct _DRIVE_LAYOUT_INFORMATION_GPT {
+    GUID DiskId;
+    LARGE_INTEGER StartingUsableOffset;
+    LARGE_INTEGER UsableLength;
+    DWORD MaxPartitionCount;
+} DRIVE_LAYOUT_INFORMATION_GPT;
+
+typedef struct _DRIVE_LAYOUT_INFORMATION_EX {
+    DWORD PartitionStyle;
+    DWORD PartitionCount;
+    union {
+        DRIVE_LAYOUT_INFORMATION_MBR Mbr;
+        DRIVE_LAYOUT_INFORMATION_GPT Gpt;
+    };
+    PARTITION_INFORMATION_EX PartitionEntry[1];
+} DRIVE_LAYOUT_INFORMATION_EX;
+
+// https://learn.microsoft.com/en-us/windows/win32/fileio/disk-partition-types
+#define PARTITION_ENTRY_UNUSED      0x00
+#define PARTITION_FAT_12            0x01
+#define PARTITION_FAT_16            0x04
+#define PARTITION_EXTENDED          0x05
+#define PARTITION_HUGE              0x06
+#define PARTITION_IFS               0x07
+#define PARTITION_FAT32             0x0B
+#define PARTITION_FAT32_XINT13      0x0C
+#define PARTITION_XINT13            0x0E
+#define PARTITION_XINT13_EXTENDED   0x0F
+#define PARTITION_MSFT_RECOVERY     0x27
+#define PARTITION_LDM               0x42
+#define PARTITION_GPT               0xEE
+
+#endif // _WIN32
@@ -0,0 +1,468 @@
+/*
+
+    Linux backend for wde2::enumerate()
+
+    Builds the same DiskInfo/PartitionInfo model BuildDeviceList()
+    does on Windows, from /sys/block/<disk> attributes plus a raw
+    read of the leading sectors of /dev/<disk> for the MBR/GPT.
+
+    Both roots are configurable so a fake sysfs tree and a
+    directory of image files can stand in for the real thing.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "log_ex.h"
+#include "structs.h"
+#include "pt_raw.h"
+#include "trace_ex.h"
+
+namespace wde2
+{
+    namespace lnx
+    {
+        //-----------------------------------------------------------------------------
+        struct SysfsConfig
+        {
+            // root of the sysfs tree, i.e. block devices are in <sysRoot>/block
+            std::string sysRoot = "/sys";
+            // device nodes. DEVNAME from uevent is resolved against this
+            std::string devRoot = "/dev";
+            // query threads. 0 => one per core
+            unsigned threads = 0;
+        };
+
+        //-----------------------------------------------------------------------------
+        // RAII for the directory/file descriptors
+        class Fd
+        {
+            int m_fd = -1;
+        public:
+            explicit Fd(int fd = -1) : m_fd(fd) {}
+            ~Fd() { if (m_fd >= 0) ::close(m_fd); }
+            Fd(const Fd&) = delete;
+            Fd& operator=(const Fd&) = delete;
+            int get() const { return m_fd; }
+            explicit operator bool() const { return m_fd >= 0; }
+        };
+
+        //-----------------------------------------------------------------------------
+        static std::string trim(const std::string& s)
+        {
+            size_t b = s.find_first_not_of(" \t\r\n");
+            if (b == std::string::npos) {
+                return std::string();
+            }
+            size_t e = s.find_last_not_of(" \t\r\n");
+            return s.substr(b, e - b + 1);
+        }
+
+        // sysfs strings are ASCII
+        static std::wstring widen(const std::string& s)
+        {
+            return std::wstring(s.begin(), s.end());
+        }
+
+        //-----------------------------------------------------------------------------
+        // Read a small attribute relative to an already open directory. openat()
+        // avoids a full path walk per attribute. returns raw (untrimmed) bytes.
+        static std::string readRaw(int dirfd, const char* name)
+        {
+            std::string ret;
+            if (dirfd < 0) {
+                return ret;
+            }
+            Fd fd(::openat(dirfd, name, O_RDONLY | O_CLOEXEC));
+            if (!fd) {
+                return ret;
+            }
+            // attributes are at most a page
+            char buffer[4096];
+            ssize_t n = ::read(fd.get(), buffer, sizeof(buffer));
+            if (n > 0) {
+                ret.assign(buffer, (size_t)n);
+            }
+            return ret;
+        }
+
+        static std::string readAttr(int dirfd, const char* name)
+        {
+            return trim(readRaw(dirfd, name));
+        }
+
+        static uint64_t readAttrU64(int dirfd, const char* name, uint64_t def = 0)
+        {
+            std::string s = readAttr(dirfd, name);
+            if (s.empty()) {
+                return def;
+            }
+            return strtoull(s.c_str(), nullptr, 10);
+        }
+
+        //-----------------------------------------------------------------------------
+        // uevent batches MAJOR, MINOR, DEVNAME and DEVTYPE into one read
+        static std::map<std::string, std::string> readUevent(int dirfd)
+        {
+            std::map<std::string, std::string> ret;
+            std::string s = readRaw(dirfd, "uevent");
+            size_t pos = 0;
+            while (pos < s.size())
+            {
+                size_t eol = s.find('\n', pos);
+                if (eol == std::string::npos) {
+                    eol = s.size();
+                }
+                std::string line = s.substr(pos, eol - pos);
+                size_t eq = line.find('=');
+                if (eq != std::string::npos) {
+                    ret[line.substr(0, eq)] = line.substr(eq + 1);
+                }
+                pos = eol + 1;
+            }
+            return ret;
+        }
+
+        //-----------------------------------------------------------------------------
+        // SCSI unit serial number VPD page 0x80: 4 byte header then ASCII
+        static std::string serialFromVpd80(const std::string& page)
+        {
+            if (page.size() < 4) {
+                return std::string();
+            }
+            size_t len = ((unsigned char)page[2] << 8) | (unsigned char)page[3];
+            len = (std::min)(len, page.size() - 4);
+            return trim(page.substr(4, len));
+        }
+
+        //-----------------------------------------------------------------------------
+        // whole disks only. partitions are not listed in /sys/block but
+        // loop, ram, dm-* and friends are.
+        static bool isWholeDisk(const std::string& name)
+        {
+            auto digitsFrom = [&](size_t pos) {
+                size_t i = pos;
+                while (i < name.size() && isdigit((unsigned char)name[i])) i++;
+                return i;
+            };
+            auto lettersFrom = [&](size_t pos) {
+                size_t i = pos;
+                while (i < name.size() && islower((unsigned char)name[i])) i++;
+                return i;
+            };
+            // sdX, vdX, hdX, xvdX
+            for (const char* prefix : { "sd", "vd", "hd", "xvd" })
+            {
+                size_t pl = strlen(prefix);
+                if (name.compare(0, pl, prefix) == 0 && name.size() > pl) {
+                    return lettersFrom(pl) == name.size();
+                }
+            }
+            // nvmeXnY
+            if (name.compare(0, 4, "nvme") == 0)
+            {
+                size_t i = digitsFrom(4);
+                if (i == 4 || i >= name.size() || name[i] != 'n') {
+                    return false;
+                }
+                size_t j = digitsFrom(i + 1);
+                return (j > i + 1 && j == name.size());
+            }
+            // mmcblkX
+            if (name.compare(0, 6, "mmcblk") == 0)
+            {
+                size_t i = digitsFrom(6);
+                return (i > 6 && i == name.size());
+            }
+            return false;
+        }
+
+        // nvme0n1 => nvme0n1p1, sda => sda1
+        static std::string partitionNodeName(const std::string& disk, DWORD partitionNumber)
+        {
+            std::string ret = disk;
+            if (!disk.empty() && isdigit((unsigned char)disk.back())) {
+                ret += "p";
+            }
+            ret += std::to_string(partitionNumber);
+            return ret;
+        }
+
+        // sdb before sdaa, nvme2n1 before nvme10n1
+        static bool deviceOrder(const std::string& a, const std::string& b)
+        {
+            if (a.size() != b.size()) {
+                return a.size() < b.size();
+            }
+            return a < b;
+        }
+
+        //-----------------------------------------------------------------------------
+        // The StorageClass counterparts. 'dirfd' is /sys/block/<name>, 'sysPath'
+        // its resolved /sys/devices/... path, which names the bus on the way down.
+        static void readStorageClass(int dirfd, const std::string& sysPath, const std::string& name,
+                                     wde2::StorageClass& storage)
+        {
+            storage = wde2::StorageClass();
+            Fd queue(::openat(dirfd, "queue", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            std::string rotational = readAttr(queue.get(), "rotational");
+            if (!rotational.empty())
+            {
+                storage.hasSeekPenalty = true;
+                storage.IncursSeekPenalty = rotational != "0";
+            }
+            std::string discard = readAttr(queue.get(), "discard_max_bytes");
+            if (!discard.empty())
+            {
+                storage.hasTrim = true;
+                storage.MaxUnmapBytes = strtoull(discard.c_str(), nullptr, 10);
+                storage.TrimEnabled = storage.MaxUnmapBytes != 0;
+            }
+            storage.BytesPerPhysicalSector = (DWORD)readAttrU64(queue.get(), "physical_block_size");
+            storage.BytesOffsetForSectorAlignment = (DWORD)readAttrU64(dirfd, "alignment_offset");
+
+            // a USB bridge in front of a SATA disk is USB
+            if (sysPath.find("/usb") != std::string::npos) {
+                storage.BusType = BusTypeUsb;
+            }
+            else if (name.compare(0, 4, "nvme") == 0) {
+                storage.BusType = BusTypeNvme;
+            }
+            else if (name.compare(0, 6, "mmcblk") == 0) {
+                storage.BusType = BusTypeMmc;
+            }
+            else if (sysPath.find("/virtio") != std::string::npos) {
+                storage.BusType = BusTypeVirtual;
+            }
+            else if (sysPath.find("/ata") != std::string::npos) {
+                storage.BusType = BusTypeSata;
+            }
+            else if (sysPath.find("/host") != std::string::npos) {
+                storage.BusType = BusTypeScsi;
+            }
+        }
+
+        //-----------------------------------------------------------------------------
+        // Decode the layout from the device itself. pt::parse() reads a
+        // standard MBR/GPT in a single pread.
+        static void readLayout(const std::string& devicePath, wde2::DiskInfo& di)
+        {
+            memset(&di.DriveLayout, 0, sizeof(di.DriveLayout));
+            di.DriveLayout.PartitionStyle = PARTITION_STYLE_RAW;
+
+            wde2::trace::Span span("readLayout", "ioctl");
+            wde2::blk::FileSource source(devicePath);
+            if (!source) {
+                DBMSG2("open failed: " << devicePath.c_str() << " " << errno);
+                return;
+            }
+            // sysfs size wins over whatever the node reports, i.e. for image files
+            uint64_t size = di.DiskSize.QuadPart ? (uint64_t)di.DiskSize.QuadPart : source.size();
+            wde2::blk::SliceSource slice(source, 0, size);
+            wde2::pt::parse(slice, di.Geometry.BytesPerSector, di);
+        }
+
+        //-----------------------------------------------------------------------------
+        static wde2::DiskInfo queryDevice(const SysfsConfig& cfg,
+                                          const std::string& name,
+                                          int deviceNumber)
+        {
+            wde2::trace::Span span("queryDevice", "enumerate", "disk", (uint64_t)deviceNumber);
+            wde2::DiskInfo diskInfo;
+            memset(&diskInfo.StorageDeviceNumber, 0, sizeof(diskInfo.StorageDeviceNumber));
+            memset(&diskInfo.Geometry, 0, sizeof(diskInfo.Geometry));
+            diskInfo.DiskSize.QuadPart = 0;
+            diskInfo.StorageDeviceNumber.DeviceType = FILE_DEVICE_DISK;
+            diskInfo.StorageDeviceNumber.DeviceNumber = (DWORD)deviceNumber;
+            diskInfo.StorageDeviceNumber.PartitionNumber = 0;
+
+            std::string blockPath = cfg.sysRoot + "/block/" + name;
+            Fd dirfd(::open(blockPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            nv2::throw_if(!dirfd, nv2::acc("Cannot open ") << blockPath);
+
+            // /sys/devices/... path is the nearest thing to the SetupDi interface path
+            char resolved[PATH_MAX] = { 0 };
+            if (::realpath(blockPath.c_str(), resolved)) {
+                diskInfo.DevicePath = widen(resolved);
+            }
+            else {
+                diskInfo.DevicePath = widen(blockPath);
+            }
+
+            std::map<std::string, std::string> uevent = readUevent(dirfd.get());
+            std::string devName = uevent.count("DEVNAME") ? uevent["DEVNAME"] : name;
+            std::string devicePath = cfg.devRoot + "/" + devName;
+            diskInfo.DeviceName = widen(devicePath);
+
+            // always in 512 byte units, whatever the logical block size
+            uint64_t sectors512 = readAttrU64(dirfd.get(), "size");
+            diskInfo.DiskSize.QuadPart = (LONGLONG)(sectors512 * 512);
+
+            {
+                Fd queue(::openat(dirfd.get(), "queue", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+                diskInfo.Geometry.BytesPerSector = (DWORD)readAttrU64(queue.get(), "logical_block_size", 512);
+            }
+            if (diskInfo.Geometry.BytesPerSector < 512) {
+                diskInfo.Geometry.BytesPerSector = 512;
+            }
+            diskInfo.Geometry.MediaType = readAttrU64(dirfd.get(), "removable") ? RemovableMedia : FixedMedia;
+            // the same fiction Windows reports for LBA disks
+            diskInfo.Geometry.TracksPerCylinder = 255;
+            diskInfo.Geometry.SectorsPerTrack = 63;
+            diskInfo.Geometry.Cylinders.QuadPart = diskInfo.DiskSize.QuadPart /
+                (255ll * 63ll * diskInfo.Geometry.BytesPerSector);
+
+            {
+                Fd device(::openat(dirfd.get(), "device", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+                diskInfo.VendorId = widen(readAttr(device.get(), "vendor"));
+                diskInfo.ProductId = widen(readAttr(device.get(), "model"));
+                // SCSI uses 'rev', NVMe 'firmware_rev'
+                std::string rev = readAttr(device.get(), "rev");
+                if (rev.empty()) {
+                    rev = readAttr(device.get(), "firmware_rev");
+                }
+                diskInfo.ProductRevision = widen(rev);
+                std::string serial = readAttr(device.get(), "serial");
+                if (serial.empty()) {
+                    serial = serialFromVpd80(readRaw(device.get(), "vpd_pg80"));
+                }
+                diskInfo.SerialNumber = widen(serial);
+            }
+
+            readStorageClass(dirfd.get(), std::string(diskInfo.DevicePath.begin(), diskInfo.DevicePath.end()), name, diskInfo.Storage);
+            readLayout(devicePath, diskInfo);
+
+            // volumeID => partition device node, i.e. /dev/sda1. Linux numbers
+            // MBR primaries by slot and logical drives from 5, and skips EBR links.
+            bool mbr = (diskInfo.DriveLayout.PartitionStyle == PARTITION_STYLE_MBR);
+            for (auto& partition : diskInfo.partitions)
+            {
+                DWORD key = partition.first;
+                DWORD pn = partition.second.piex.PartitionNumber;
+                if (mbr) {
+                    pn = (key < 4) ? key + 1 : ((key % 4) == 0 ? 5 + (key - 4) / 4 : 0);
+                }
+                if (pn) {
+                    partition.second.volumeID = widen(cfg.devRoot + "/" + partitionNodeName(devName, pn));
+                }
+            }
+
+            DBMSG2("Drive " << deviceNumber << ": " << devicePath.c_str()
+                << " partitions: " << diskInfo.partitions.size());
+            return diskInfo;
+        }
+
+        //-----------------------------------------------------------------------------
+        static std::map<int, wde2::DiskInfo> BuildDeviceList(const SysfsConfig& cfg = SysfsConfig())
+        {
+            std::map<int, wde2::DiskInfo> vdi;
+
+            std::vector<std::string> names;
+            std::string blockRoot = cfg.sysRoot + "/block";
+            DIR* dir = ::opendir(blockRoot.c_str());
+            nv2::throw_if(dir == nullptr, nv2::acc("Cannot open ") << blockRoot);
+            while (struct dirent* de = ::readdir(dir))
+            {
+                std::string name = de->d_name;
+                if (isWholeDisk(name)) {
+                    names.push_back(name);
+                }
+            }
+            ::closedir(dir);
+            std::sort(names.begin(), names.end(), deviceOrder);
+
+            // each device is independent, so fan out. results land in
+            // a slot per device so the workers never share anything.
+            std::vector<wde2::DiskInfo> results(names.size());
+            std::vector<char> ok(names.size(), 0);
+            std::atomic<size_t> next{ 0 };
+            auto worker = [&]()
+            {
+                for (size_t i = next++; i < names.size(); i = next++)
+                {
+                    try
+                    {
+                        results[i] = queryDevice(cfg, names[i], (int)i);
+                        ok[i] = 1;
+                    }
+                    catch (const std::exception& ex)
+                    {
+                        LOG_WARN("Skipping " << names[i].c_str() << ": " << ex.what());
+                    }
+                }
+            };
+
+            unsigned threads = cfg.threads ? cfg.threads : std::thread::hardware_concurrency();
+            threads = (std::max)(1u, (std::min)(threads, (unsigned)names.size()));
+            std::vector<std::thread> pool;
+            for (unsigned t = 1; t < threads; t++) {
+                pool.emplace_back([&]() {
+                    wde2::trace::nameThread("enumerate");
+                    worker();
+                });
+            }
+            worker();
+            for (auto& t : pool) {
+                t.join();
+            }
+
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                if (ok[i]) {
+                    vdi[(int)i] = results[i];
+                }
+            }
+            return vdi;
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+    // Linux counterpart of enumerate() in wde2.h
+    std::map<int, wde2::DiskInfo> enumerate(const lnx::SysfsConfig& cfg = lnx::SysfsConfig())
+    {
+        std::map<int, wde2::DiskInfo> vdi = lnx::BuildDeviceList(cfg);
+        return vdi;
+    }
+}
+
+#endif // _WIN32
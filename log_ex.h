@@ -0,0 +1,610 @@
+/*
+
+    Asynchronous leveled logger.
+
+    A call site captures its arguments into a fixed size record in a
+    ring that belongs to the calling thread, and returns. Nothing is
+    formatted there: integers, doubles and pointers are copied as they
+    are, strings are copied (truncated to fit), and anything else is
+    formatted through nv2::acc as a fallback. Each ring has a single
+    producer, its thread, and a single consumer, the sink thread, so
+    it needs two atomic counters and no lock. A full ring drops the
+    record and counts the drop rather than block the caller.
+
+    The sink thread wakes every few milliseconds, takes what every ring
+    holds, orders it by time and formats and writes it to stderr.
+    flush() waits for a pass to complete, and the sink drains the rings
+    once more when it stops at exit.
+
+    Levels below WDE2_LOG_LEVEL are removed by the preprocessor, so
+    their arguments are not even evaluated. Above that a relaxed load
+    of the runtime level decides, which costs a nanosecond or two.
+
+    DBMSG2 maps onto LOG_DEBUG. DBMSG stays synchronous: main writes
+    its text output with it, and that has to stay in order with the
+    rest of std::wcout.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// 0 debug, 1 info, 2 warn, 3 error, 4 off. calls below are compiled out
+#ifndef WDE2_LOG_LEVEL
+#ifdef _DEBUG
+#define WDE2_LOG_LEVEL 0
+#else
+#define WDE2_LOG_LEVEL 1
+#endif
+#endif
+
+namespace wde2
+{
+    namespace log
+    {
+        //-----------------------------------------------------------------------------
+        enum class Level : int
+        {
+            Debug = 0,
+            Info = 1,
+            Warn = 2,
+            Error = 3,
+            Off = 4
+        };
+
+        static std::atomic<int>& threshold()
+        {
+            static std::atomic<int> level{ WDE2_LOG_LEVEL };
+            return level;
+        }
+
+        static bool enabled(Level level)
+        {
+            return (int)level >= threshold().load(std::memory_order_relaxed);
+        }
+
+        // the compile-time floor still applies
+        static void setLevel(Level level)
+        {
+            threshold().store((std::max)((int)level, WDE2_LOG_LEVEL), std::memory_order_relaxed);
+        }
+
+        static bool parseLevel(const std::wstring& name, Level& level)
+        {
+            static const wchar_t* names[] = { L"debug", L"info", L"warn", L"error", L"off" };
+            for (int i = 0; i <= (int)Level::Off; i++)
+            {
+                if (name == names[i])
+                {
+                    level = (Level)i;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //-----------------------------------------------------------------------------
+        // arguments are stored as a tag byte and the value
+        enum class Tag : uint8_t
+        {
+            End,
+            Int,
+            UInt,
+            Real,
+            Pointer,
+            Char,
+            Text,
+            WideText
+        };
+
+        // 256 bytes, four cache lines
+        static const size_t _payload = 232;
+
+        struct Record
+        {
+            int64_t ticks = 0;
+            const char* file = nullptr;
+            uint32_t line = 0;
+            uint8_t level = 0;
+            // arguments did not fit
+            uint8_t truncated = 0;
+            uint16_t used = 0;
+            uint8_t payload[_payload];
+        };
+
+        //-----------------------------------------------------------------------------
+        // single producer, single consumer
+        class Ring
+        {
+        public:
+            static const size_t _capacity = 1024;
+
+        private:
+            std::unique_ptr<Record[]> m_records;
+            alignas(64) std::atomic<uint64_t> m_head{ 0 };
+            alignas(64) std::atomic<uint64_t> m_tail{ 0 };
+            std::atomic<uint64_t> m_dropped{ 0 };
+            std::atomic<bool> m_retired{ false };
+            unsigned m_thread = 0;
+
+        public:
+            explicit Ring(unsigned thread) : m_records(new Record[_capacity]), m_thread(thread) {}
+
+            unsigned thread() const { return m_thread; }
+
+            // producer
+            Record* claim()
+            {
+                uint64_t head = m_head.load(std::memory_order_relaxed);
+                if (head - m_tail.load(std::memory_order_acquire) >= _capacity)
+                {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                return &m_records[head % _capacity];
+            }
+
+            void publish()
+            {
+                m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            void retire() { m_retired.store(true, std::memory_order_release); }
+
+            // consumer
+            template <typename F>
+            size_t drain(F&& f)
+            {
+                uint64_t tail = m_tail.load(std::memory_order_relaxed);
+                uint64_t head = m_head.load(std::memory_order_acquire);
+                for (uint64_t i = tail; i < head; i++) {
+                    f(m_thread, m_records[i % _capacity]);
+                }
+                m_tail.store(head, std::memory_order_release);
+                return (size_t)(head - tail);
+            }
+
+            uint64_t takeDropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+            bool finished() const
+            {
+                return m_retired.load(std::memory_order_acquire)
+                    && m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // times are shown from the first use of the logger
+        static int64_t epoch()
+        {
+            static int64_t start = std::chrono::steady_clock::now().time_since_epoch().count();
+            return start;
+        }
+
+        static void format(const Record& r, std::wstring& out)
+        {
+            static const wchar_t* levels[] = { L"D", L"I", L"W", L"E" };
+            const char* file = r.file ? r.file : "";
+            const char* slash = (std::max)(strrchr(file, '/'), strrchr(file, '\\'));
+            file = slash ? slash + 1 : file;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::duration(r.ticks - epoch())).count();
+            wchar_t prefix[64];
+            swprintf(prefix, 64, L"[%10.6f] %ls ", seconds, levels[(std::min)((int)r.level, 3)]);
+            out += prefix;
+            for (const char* p = file; *p; p++) {
+                out += (wchar_t)(unsigned char)*p;
+            }
+            out += L"(" + std::to_wstring(r.line) + L"): ";
+
+            const uint8_t* p = r.payload;
+            const uint8_t* end = r.payload + r.used;
+            while (p < end && (Tag)*p != Tag::End)
+            {
+                Tag tag = (Tag)*p++;
+                switch (tag)
+                {
+                case Tag::Int:
+                {
+                    int64_t v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    out += std::to_wstring(v);
+                    break;
+                }
+                case Tag::UInt:
+                {
+                    uint64_t v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    out += std::to_wstring(v);
+                    break;
+                }
+                case Tag::Real:
+                {
+                    double v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    wchar_t buffer[32];
+                    swprintf(buffer, 32, L"%g", v);
+                    out += buffer;
+                    break;
+                }
+                case Tag::Pointer:
+                {
+                    uint64_t v;
+                    memcpy(&v, p, sizeof(v));
+                    p += sizeof(v);
+                    wchar_t buffer[32];
+                    swprintf(buffer, 32, L"0x%llx", (unsigned long long)v);
+                    out += buffer;
+                    break;
+                }
+                case Tag::Char:
+                    out += (wchar_t)*p++;
+                    break;
+                case Tag::Text:
+                {
+                    uint16_t n;
+                    memcpy(&n, p, sizeof(n));
+                    p += sizeof(n);
+                    for (uint16_t i = 0; i < n; i++) {
+                        out += (wchar_t)p[i];
+                    }
+                    p += n;
+                    break;
+                }
+                case Tag::WideText:
+                {
+                    uint16_t n;
+                    memcpy(&n, p, sizeof(n));
+                    p += sizeof(n);
+                    for (uint16_t i = 0; i < n; i++)
+                    {
+                        wchar_t c;
+                        memcpy(&c, p + i * sizeof(wchar_t), sizeof(c));
+                        out += c;
+                    }
+                    p += n * sizeof(wchar_t);
+                    break;
+                }
+                default:
+                    p = end;
+                    break;
+                }
+            }
+            if (r.truncated) {
+                out += L"...";
+            }
+        }
+
+        //-----------------------------------------------------------------------------
+        // owns the rings and the sink thread
+        class Logger
+        {
+            std::mutex m_lock;
+            std::vector<std::shared_ptr<Ring>> m_rings;
+            unsigned m_threads = 0;
+            std::condition_variable m_wake;
+            std::condition_variable m_done;
+            uint64_t m_requested = 0;
+            uint64_t m_passes = 0;
+            bool m_stop = false;
+            std::thread m_sink;
+
+            struct Entry
+            {
+                unsigned thread;
+                Record record;
+            };
+
+            // one pass over every ring, in time order
+            void pass()
+            {
+                std::vector<std::shared_ptr<Ring>> rings;
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    rings = m_rings;
+                }
+                std::vector<Entry> entries;
+                std::wstring out;
+                for (auto& ring : rings)
+                {
+                    ring->drain([&](unsigned thread, const Record& r) { entries.push_back({ thread, r }); });
+                    uint64_t dropped = ring->takeDropped();
+                    if (dropped) {
+                        out += L"[log] " + std::to_wstring(dropped) + L" messages dropped on thread " + std::to_wstring(ring->thread()) + L"\n";
+                    }
+                }
+                std::stable_sort(entries.begin(), entries.end(),
+                                 [](const Entry& a, const Entry& b) { return a.record.ticks < b.record.ticks; });
+                for (const Entry& e : entries)
+                {
+                    format(e.record, out);
+                    out += L"\n";
+                }
+                if (!out.empty()) {
+                    std::wcerr << out << std::flush;
+                }
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(),
+                                             [](const std::shared_ptr<Ring>& r) { return r->finished(); }),
+                              m_rings.end());
+            }
+
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                while (!m_stop)
+                {
+                    m_wake.wait_for(lock, std::chrono::milliseconds(5), [&]() { return m_stop || m_requested > m_passes; });
+                    uint64_t requested = m_requested;
+                    lock.unlock();
+                    pass();
+                    lock.lock();
+                    m_passes = (std::max)(m_passes, requested);
+                    m_done.notify_all();
+                }
+            }
+
+        public:
+            Logger()
+            {
+                epoch();
+                m_sink = std::thread([this]() { run(); });
+            }
+
+            ~Logger()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_stop = true;
+                }
+                m_wake.notify_all();
+                m_sink.join();
+                pass();
+            }
+
+            std::shared_ptr<Ring> attach()
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_rings.push_back(std::make_shared<Ring>(m_threads++));
+                return m_rings.back();
+            }
+
+            // everything logged before the call is written when it returns
+            void flush()
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                if (m_stop) {
+                    return;
+                }
+                uint64_t ticket = ++m_requested;
+                m_wake.notify_all();
+                m_done.wait(lock, [&]() { return m_stop || m_passes >= ticket; });
+            }
+        };
+
+        static Logger& logger()
+        {
+            static Logger instance;
+            return instance;
+        }
+
+        static void flush()
+        {
+            logger().flush();
+        }
+
+        //-----------------------------------------------------------------------------
+        // the calling thread's ring, registered on first use
+        struct ThreadRing
+        {
+            std::shared_ptr<Ring> ring;
+            ThreadRing() : ring(logger().attach()) {}
+            ~ThreadRing() { ring->retire(); }
+        };
+
+        static Ring& ring()
+        {
+            thread_local ThreadRing local;
+            return *local.ring;
+        }
+
+        //-----------------------------------------------------------------------------
+        // collects the arguments of one call into a record, published on destruction
+        class Capture
+        {
+            Ring& m_ring;
+            Record* m_record = nullptr;
+
+            void put(Tag tag, const void* p, size_t n)
+            {
+                if (!m_record || m_record->truncated) {
+                    return;
+                }
+                if (m_record->used + 1 + n > _payload)
+                {
+                    m_record->truncated = 1;
+                    return;
+                }
+                m_record->payload[m_record->used++] = (uint8_t)tag;
+                memcpy(m_record->payload + m_record->used, p, n);
+                m_record->used = (uint16_t)(m_record->used + n);
+            }
+
+            template <typename C>
+            void text(Tag tag, const C* s, size_t n)
+            {
+                if (!m_record || m_record->truncated) {
+                    return;
+                }
+                // as much as fits, then the record is full
+                size_t room = _payload - (std::min)((size_t)_payload, m_record->used + 1 + sizeof(uint16_t));
+                uint16_t count = (uint16_t)(std::min)(n, room / sizeof(C));
+                uint8_t header[1 + sizeof(uint16_t)] = { (uint8_t)tag };
+                memcpy(header + 1, &count, sizeof(count));
+                if (m_record->used + sizeof(header) > _payload)
+                {
+                    m_record->truncated = 1;
+                    return;
+                }
+                memcpy(m_record->payload + m_record->used, header, sizeof(header));
+                m_record->used = (uint16_t)(m_record->used + sizeof(header));
+                memcpy(m_record->payload + m_record->used, s, count * sizeof(C));
+                m_record->used = (uint16_t)(m_record->used + count * sizeof(C));
+                if (count < n) {
+                    m_record->truncated = 1;
+                }
+            }
+
+        public:
+            Capture(Level level, const char* file, uint32_t line) : m_ring(ring())
+            {
+                m_record = m_ring.claim();
+                if (m_record)
+                {
+                    m_record->ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+                    m_record->file = file;
+                    m_record->line = line;
+                    m_record->level = (uint8_t)level;
+                    m_record->truncated = 0;
+                    m_record->used = 0;
+                }
+            }
+
+            ~Capture()
+            {
+                if (m_record) {
+                    m_ring.publish();
+                }
+            }
+
+            Capture(const Capture&) = delete;
+            Capture& operator=(const Capture&) = delete;
+
+            Capture& operator<<(bool v) { return *this << (v ? "1" : "0"); }
+            Capture& operator<<(char c) { put(Tag::Char, &c, 1); return *this; }
+            Capture& operator<<(const char* s) { text(Tag::Text, s ? s : "(null)", s ? strlen(s) : 6); return *this; }
+            Capture& operator<<(const wchar_t* s) { text(Tag::WideText, s ? s : L"(null)", s ? wcslen(s) : 6); return *this; }
+            Capture& operator<<(const std::string& s) { text(Tag::Text, s.data(), s.size()); return *this; }
+            Capture& operator<<(const std::wstring& s) { text(Tag::WideText, s.data(), s.size()); return *this; }
+
+            Capture& operator<<(wchar_t c) { text(Tag::WideText, &c, 1); return *this; }
+
+            template <typename T>
+            Capture& operator<<(const T& v)
+            {
+                typedef typename std::remove_cv<typename std::remove_pointer<typename std::decay<T>::type>::type>::type Element;
+                if constexpr (std::is_array<T>::value || std::is_pointer<T>::value)
+                {
+                    const Element* p = v;
+                    if constexpr (std::is_same<Element, char>::value || std::is_same<Element, wchar_t>::value) {
+                        return *this << p;
+                    }
+                    uint64_t x = (uint64_t)(uintptr_t)p;
+                    put(Tag::Pointer, &x, sizeof(x));
+                }
+                else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+                {
+                    int64_t x = (int64_t)v;
+                    put(Tag::Int, &x, sizeof(x));
+                }
+                else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value)
+                {
+                    uint64_t x = (uint64_t)v;
+                    put(Tag::UInt, &x, sizeof(x));
+                }
+                else if constexpr (std::is_floating_point<T>::value)
+                {
+                    double x = (double)v;
+                    put(Tag::Real, &x, sizeof(x));
+                }
+                else if (m_record && !m_record->truncated)
+                {
+                    // GUIDs and the rest: formatted here after all
+                    nv2::acc a;
+                    a << v;
+                    *this << a.wstr();
+                }
+                return *this;
+            }
+        };
+    }
+}
+
+//-----------------------------------------------------------------------------
+#define WDE2_LOG(level, x) \
+    do { \
+        if (wde2::log::enabled(level)) { \
+            wde2::log::Capture _capture(level, __FILE__, __LINE__); \
+            _capture << x; \
+        } \
+    } while (0)
+
+#if WDE2_LOG_LEVEL <= 0
+#define LOG_DEBUG(x) WDE2_LOG(wde2::log::Level::Debug, x)
+#else
+#define LOG_DEBUG(x) do {} while (0)
+#endif
+#if WDE2_LOG_LEVEL <= 1
+#define LOG_INFO(x) WDE2_LOG(wde2::log::Level::Info, x)
+#else
+#define LOG_INFO(x) do {} while (0)
+#endif
+#if WDE2_LOG_LEVEL <= 2
+#define LOG_WARN(x) WDE2_LOG(wde2::log::Level::Warn, x)
+#else
+#define LOG_WARN(x) do {} while (0)
+#endif
+#if WDE2_LOG_LEVEL <= 3
+#define LOG_ERROR(x) WDE2_LOG(wde2::log::Level::Error, x)
+#else
+#define LOG_ERROR(x) do {} while (0)
+#endif
+
+// existing DBMSG2 call sites log at debug level
+#ifdef DBMSG2
+#undef DBMSG2
+#endif
+#define DBMSG2(x) LOG_DEBUG(x)
@@ -0,0 +1,245 @@
+/*
+
+    LZNT1, the NTFS compression codec.
+
+    Data is coded in independent 4KB chunks, each behind a two byte
+    header giving its coded length and whether it is compressed or
+    stored. Within a chunk, groups of eight tokens follow a flag byte:
+    a literal byte, or a 16 bit back reference whose split between
+    displacement and length widens with the position in the chunk.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "structs.h"
+
+namespace wde2
+{
+    namespace ntfs
+    {
+        static const size_t _lznt1Chunk = 4096;
+
+        //-----------------------------------------------------------------------------
+        // one LZNT1 compressed unit into 'out', which the caller has zeroed.
+        // each chunk inflates to 4KB; a short chunk leaves zeros behind it.
+        // false if the stream is corrupt.
+        static bool lznt1Decompress(const BYTE* in, size_t inLength, BYTE* out, size_t outLength)
+        {
+            static const size_t chunkSize = 4096;
+            size_t ip = 0;
+            size_t op = 0;
+            while (ip + 2 <= inLength && op < outLength)
+            {
+                uint16_t header = (uint16_t)(in[ip] | (in[ip + 1] << 8));
+                if (header == 0) {
+                    break;
+                }
+                // bytes following the header
+                size_t length = (size_t)(header & 0x0FFF) + 1;
+                ip += 2;
+                if (ip + length > inLength) {
+                    return false;
+                }
+                size_t chunkStart = op;
+                size_t chunkEnd = (std::min)(op + chunkSize, outLength);
+                if (!(header & 0x8000))
+                {
+                    memcpy(out + op, in + ip, (std::min)(length, chunkEnd - op));
+                }
+                else
+                {
+                    const BYTE* p = in + ip;
+                    const BYTE* end = p + length;
+                    while (p < end && op < chunkEnd)
+                    {
+                        BYTE flags = *p++;
+                        for (int bit = 0; bit < 8 && p < end && op < chunkEnd; bit++, flags >>= 1)
+                        {
+                            if (!(flags & 1)) {
+                                out[op++] = *p++;
+                                continue;
+                            }
+                            // back reference. the offset/length split moves
+                            // with the position in the chunk
+                            if (p + 2 > end || op == chunkStart) {
+                                return false;
+                            }
+                            uint16_t token = (uint16_t)(p[0] | (p[1] << 8));
+                            p += 2;
+                            unsigned lengthBits = 12;
+                            for (size_t i = op - chunkStart - 1; i >= 0x10; i >>= 1) {
+                                lengthBits--;
+                            }
+                            size_t displacement = (size_t)(token >> lengthBits) + 1;
+                            size_t count = (size_t)(token & ((1u << lengthBits) - 1)) + 3;
+                            if (displacement > op - chunkStart) {
+                                return false;
+                            }
+                            count = (std::min)(count, chunkEnd - op);
+                            // may overlap, byte at a time
+                            for (size_t k = 0; k < count; k++, op++) {
+                                out[op] = out[op - displacement];
+                            }
+                        }
+                    }
+                }
+                ip += length;
+                op = chunkEnd;
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------------------
+        // bits of a back reference token given to the length at 'position' in the chunk
+        static unsigned lznt1LengthBits(size_t position)
+        {
+            unsigned lengthBits = 12;
+            for (size_t i = position - 1; i >= 0x10; i >>= 1) {
+                lengthBits--;
+            }
+            return lengthBits;
+        }
+
+        // worst case: every chunk stored, plus its header
+        static size_t lznt1Bound(size_t length)
+        {
+            return length + ((length + _lznt1Chunk - 1) / _lznt1Chunk) * 2;
+        }
+
+        // 'out' must hold lznt1Bound(inLength). returns the coded length. chunks
+        // that do not shrink are stored, so the output never exceeds the bound.
+        // matches are found through a short hash chain: fast rather than tight.
+        static size_t lznt1Compress(const BYTE* in, size_t inLength, BYTE* out)
+        {
+            static const unsigned hashBits = 12;
+            static const unsigned maxChain = 16;
+            int16_t head[1 << hashBits];
+            int16_t prev[_lznt1Chunk];
+            BYTE coded[_lznt1Chunk + _lznt1Chunk / 8 + 8];
+            size_t op = 0;
+            for (size_t chunk = 0; chunk < inLength; chunk += _lznt1Chunk)
+            {
+                const BYTE* p = in + chunk;
+                size_t n = (std::min)(_lznt1Chunk, inLength - chunk);
+                memset(head, 0xFF, sizeof(head));
+                auto hashAt = [&](size_t i) {
+                    return (unsigned)(((p[i] << 8) ^ (p[i + 1] << 4) ^ p[i + 2]) & ((1 << hashBits) - 1));
+                };
+                auto insert = [&](size_t i) {
+                    if (i + 3 <= n)
+                    {
+                        unsigned h = hashAt(i);
+                        prev[i] = head[h];
+                        head[h] = (int16_t)i;
+                    }
+                };
+                size_t cp = 0;
+                size_t pos = 0;
+                // no room to gain once the coded form reaches the chunk size
+                while (pos < n && cp < n)
+                {
+                    size_t flagPos = cp++;
+                    BYTE flags = 0;
+                    for (int bit = 0; bit < 8 && pos < n; bit++)
+                    {
+                        size_t bestLength = 0;
+                        size_t bestDisplacement = 0;
+                        unsigned lengthBits = pos ? lznt1LengthBits(pos) : 12;
+                        if (pos && pos + 3 <= n)
+                        {
+                            size_t maxLength = (std::min)((size_t)(1u << lengthBits) + 2, n - pos);
+                            size_t maxDisplacement = (size_t)1 << (16 - lengthBits);
+                            unsigned chain = 0;
+                            for (int16_t c = head[hashAt(pos)]; c >= 0 && chain < maxChain; c = prev[c], chain++)
+                            {
+                                size_t displacement = pos - (size_t)c;
+                                if (displacement > maxDisplacement) {
+                                    break;
+                                }
+                                size_t length = 0;
+                                while (length < maxLength && p[c + length] == p[pos + length]) {
+                                    length++;
+                                }
+                                if (length > bestLength)
+                                {
+                                    bestLength = length;
+                                    bestDisplacement = displacement;
+                                    if (length == maxLength) {
+                                        break;
+                                    }
+                                }
+                            }
+                        }
+                        if (bestLength >= 3)
+                        {
+                            uint16_t token = (uint16_t)(((bestDisplacement - 1) << lengthBits) | (bestLength - 3));
+                            coded[cp++] = (BYTE)token;
+                            coded[cp++] = (BYTE)(token >> 8);
+                            flags |= (BYTE)(1 << bit);
+                            for (size_t k = 0; k < bestLength; k++) {
+                                insert(pos + k);
+                            }
+                            pos += bestLength;
+                        }
+                        else
+                        {
+                            coded[cp++] = p[pos];
+                            insert(pos);
+                            pos++;
+                        }
+                    }
+                    coded[flagPos] = flags;
+                }
+                if (pos < n || cp >= n)
+                {
+                    // stored
+                    uint16_t header = (uint16_t)(0x3000 | (n - 1));
+                    out[op++] = (BYTE)header;
+                    out[op++] = (BYTE)(header >> 8);
+                    memcpy(out + op, p, n);
+                    op += n;
+                }
+                else
+                {
+                    uint16_t header = (uint16_t)(0xB000 | (cp - 1));
+                    out[op++] = (BYTE)header;
+                    out[op++] = (BYTE)(header >> 8);
+                    memcpy(out + op, coded, cp);
+                    op += cp;
+                }
+            }
+            return op;
+        }
+    }
+}
@@ -33,6 +33,8 @@
 
 */
 
+// before Windows.h, which otherwise brings in the older winsock.h
+#include <winsock2.h>
 #include <Windows.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -48,10 +50,29 @@
 #include <g40/nv2_opt.h>
 #include <g40/nv2_w32.h>
 
+// before the headers that use DBMSG2
+#include "log_ex.h"
 #include "wde2.h"
 #include "vhd_ex.h"
 #include "w32_sig.h"
 #include "w32_vss.h"
+#include "enum_cache.h"
+#include "sig_index.h"
+#include "out_fmt.h"
+#include "pt_bench.h"
+#include "mft_catalog.h"
+#include "img_io.h"
+#include "ntfs_extract.h"
+#include "clone_ex.h"
+#include "net_clone.h"
+#include "restore_ex.h"
+#include "pt_align.h"
+#include "estimate_ex.h"
+#include "io_bench.h"
+#include "metrics_ex.h"
+#include "fingerprint_ex.h"
+#include "patch_ex.h"
+#include "chain_ex.h"
 
 #pragma comment( lib, "setupapi.lib" )
 
@@ -76,6 +97,11 @@ int main(int argc, char* argv[])
 #endif
 {
     int ret = -1;
+    // written on the way out, failed or not
+    string_t trace_file = _T("");
+    // likewise the final metrics
+    std::unique_ptr<wde2::metrics::Textfile> metrics_file;
+    std::unique_ptr<wde2::net::MetricsListener> metrics_listener;
     try
     {
         //
@@ -109,6 +135,36 @@ int main(int argc, char* argv[])
         bool  modifyMBRSignature = false;
         bool  checkMBRSignature = false;
         bool test_volume_access = false;
+        string_t cache_path = _T("");
+        string_t sig_index = _T("");
+        string_t fingerprint_store = _T("");
+        string_t sig_allocate = _T("");
+        string_t output_format = _T("");
+        string_t log_level = _T("");
+        string_t metrics_target = _T("");
+        bool parse_bench = false;
+        bool mft_index = false;
+        string_t mft_query = _T("");
+        bool extract_file = false;
+        bool file_backup = false;
+        string_t rescue_map = _T("");
+        bool refresh_image = false;
+        bool live_clone = false;
+        bool stream_compress = false;
+        bool stream_checksum = false;
+        bool receive_image = false;
+        bool restore_image = false;
+        bool restore_compare = false;
+        bool image_diff = false;
+        bool image_patch = false;
+        bool merge_image = false;
+        bool flatten_image = false;
+        bool realign = false;
+        string_t sector_size = _T("");
+        string_t virtual_size = _T("");
+        bool estimate_clone = false;
+        bool bench_device = false;
+        bool bench_write = false;
         // map options to default values
         std::vector<nv2::ap::Opt> opts = 
         {
@@ -123,11 +179,41 @@ int main(int argc, char* argv[])
             { _T("-i"), disk_index, _T("Display disks matching Index by range or individually (1, 0-2 or 0,3,4)") },
 
             //{ _T("-pr"), partition_range, _T("List partition range") },
-            { _T("-cv"), vhd_create, _T("Clone a disk to VHD: 'diskNumber' '/path/to/file.vhd'") },
+            { _T("-cv"), vhd_create, _T("Clone a disk to VHD: 'diskNumber' '/path/to/file.vhd' [more images: .vhd fixed, .vhdx dynamic, .wda compressed, other raw]") },
+            { _T("-rm"), rescue_map, _T("With -cv: read the disk directly, zero-filling unreadable sectors, to a fixed VHD or raw image. Progress is kept in '/path/to/map' so a rerun resumes") },
+            { _T("-lc"), live_clone, _T("Live converging clone of a disk in use: passes write only what changed until few blocks do, then a last pass reads VSS snapshots of its volumes: 'diskNumber' '/path/to/file.vhd' [threshold, default 64M]") },
+            { _T("-rf"), refresh_image, _T("Refresh a raw image or fixed VHD of a disk in place, writing only the blocks that changed: 'diskNumber' '/path/to/file.vhd'") },
+            { _T("-al"), realign, _T("With -cv: move partitions to 1MB boundaries in the image, rewriting the MBR/GPT and boot sector HiddenSectors") },
+            { _T("-ss"), sector_size, _T("With -cv: logical sector size of the images, '512' or '4096', converting the MBR/GPT and NTFS/FAT boot sectors") },
+            { _T("-vs"), virtual_size, _T("With -cv: size of the images, e.g. '500G', larger or smaller than the disk but large enough for its partitions") },
+            { _T("-es"), estimate_clone, _T("Estimate a clone from a sample of the disk: image size per format and duration, and whether the images fit: 'diskNumber' ['/path/to/file.vhdx' ...]") },
+            { _T("-bt"), bench_device, _T("Benchmark sequential and random reads over block sizes and queue depths, storing a disk's profile for -cv, -rf and -rs: 'diskNumber|/path/to/file'") },
+            { _T("-bw"), bench_write, _T("With -bt: add write tests, to a new scratch file only, deleted afterwards: '/path/to/new/file'") },
+            { _T("-nz"), stream_compress, _T("With -cv to 'tcp://host:port': compress blocks on the wire (LZNT1)") },
+            { _T("-nc"), stream_checksum, _T("With -cv to 'tcp://host:port': CRC32C every block, checked by the receiver") },
+            { _T("-rx"), receive_image, _T("Receive a disk streamed by -cv into an image: '[host:]port' '/path/to/file.vhdx'") },
+            { _T("-rs"), restore_image, _T("Restore a VHD/VHDX/.wda/raw image onto a disk or raw image file, unmapping zero ranges: '/path/to/image' 'diskNumber|/path/to/file.img'") },
+            { _T("-rc"), restore_compare, _T("With -rs: read the target first and write only the blocks that differ") },
+            { _T("-df"), image_diff, _T("Write the blocks that differ between two images of the same size as a compact patch: '/path/to/old' '/path/to/new' '/path/to/patch'") },
+            { _T("-pa"), image_patch, _T("Apply a -df patch in place to a raw image or fixed VHD of the old image, resuming one interrupted: '/path/to/patch' '/path/to/image'") },
+            { _T("-mg"), merge_image, _T("Merge a differencing VHD or VHDX into its parent in place: '/path/to/child.vhd[x]'") },
+            { _T("-fl"), flatten_image, _T("Flatten a differencing VHD or VHDX chain into a new standalone image: '/path/to/child.vhd[x]' '/path/to/new.(img|vhd|vhdx|wda)'") },
             { _T("-av"), vhd_attach, _T("Attach VHD: '/path/to/file.vhd'") },
             { _T("-dv"), vhd_detach, _T("Detach VHD: '/path/to/file.vhd'") },
             { _T("-ms"), modifyMBRSignature, _T("Modify MBR signature: 'diskNumber' 'signature'") },
-            { _T("-cs"), checkMBRSignature, _T("Check MBR signature for collisions/duplicates") },
+            { _T("-cs"), checkMBRSignature, _T("Check MBR signature and GPT disk/partition GUIDs for collisions/duplicates") },
+            { _T("-fp"), fingerprint_store, _T("Fingerprint disks and images from a sample of their blocks, reporting the most similar images in the store and adding the images to it: '/path/to/store' 'diskNumber|/path/to/image' ...") },
+            { _T("-si"), sig_index, _T("Signature index: '/path/to/index' [export|image ...]. Ingests, or reports collisions if none given") },
+            { _T("-sa"), sig_allocate, _T("Allocate unique 'mbr' signature or 'guid' from the -si index: [count]") },
+            { _T("-ec"), cache_path, _T("Cache enumeration in '/path/to/cache' and refresh only changed disks") },
+            { _T("-o"), output_format, _T("Output format for listing, -cs, -si and -cv progress: 'text' (default), 'json' (JSON Lines), or 'csv' / 'csv:<type>' for one record type") },
+            { _T("-tr"), trace_file, _T("Record a timeline of VSS phases, enumeration IOCTLs and copy stages to a Chrome trace file: '/path/to/trace.json'") },
+            { _T("-mx"), metrics_target, _T("Publish Prometheus metrics for -cv, -rf, -rx and -rs to a node-exporter textfile, or on a loopback port: '/path/to/wde2.prom|port'") },
+            { _T("-lv"), log_level, _T("Log level for diagnostics on stderr: 'debug', 'info' (default), 'warn', 'error' or 'off'") },
+            { _T("-mi"), mft_index, _T("Index the NTFS volumes of a disk or image into an MFT catalog: '\\\\.\\PhysicalDriveN|/path/to/image' '/path/to/catalog'") },
+            { _T("-mq"), mft_query, _T("Query MFT catalogs for 'name[*]' or '\\path[*]': catalog|directory ...") },
+            { _T("-ex"), extract_file, _T("Extract a file from an NTFS volume of a disk or VHD/VHDX/raw image without attaching it: 'image' '[volume:]\\path\\to\\file' '/path/to/output'") },
+            { _T("-fb"), file_backup, _T("File level backup of a directory from a VSS snapshot, copying only changed files: 'volume' '\\directory' '/path/to/destination' ['/path/to/manifest']") },
 
             // disable these experimental, PoC, options
             // create a shadow copy from 'volume', allow access via 'Destination DOS name'.
@@ -135,6 +221,7 @@ int main(int argc, char* argv[])
             // { _T("-x-sc"), shadow_copy, _T("(Experimental: Shadow Copy: 'volume' 'Destination DOS name'") },
             // testing. check path naming is correct and volume can be opened
             // { _T("-x-tva"), test_volume_access, _T("test_volume_access") },
+            { _T("-x-ptb"), parse_bench, _T("(Experimental: partition table parser benchmark: [count] or 'image|directory' ...)") },
         };
 
         // parse the command line. returns any positionals in vp
@@ -146,6 +233,53 @@ int main(int argc, char* argv[])
             return 0;
         }
 
+        // machine readable output. null for the default text
+        std::unique_ptr<wde2::out::RecordWriter> writer;
+        if (trace_file.size()) {
+            wde2::trace::start();
+        }
+        if (log_level.size())
+        {
+            wde2::log::Level level = wde2::log::Level::Info;
+            nv2::throw_if(!wde2::log::parseLevel(log_level, level),
+                        nv2::acc("-lv expects 'debug', 'info', 'warn', 'error' or 'off' not ") << log_level);
+            wde2::log::setLevel(level);
+        }
+        if (metrics_target.size())
+        {
+            if (metrics_target.find_first_not_of(_T("0123456789")) == string_t::npos)
+            {
+                metrics_listener.reset(new wde2::net::MetricsListener());
+                nv2::throw_if(!metrics_listener->start(wde2::sig::narrow(metrics_target)),
+                              nv2::acc("Unable to listen on port ") << metrics_target);
+            }
+            else {
+                metrics_file.reset(new wde2::metrics::Textfile(metrics_target));
+            }
+        }
+        if (output_format.size())
+        {
+            wde2::out::Format format = wde2::out::Format::Text;
+            std::string only;
+            nv2::throw_if(!wde2::out::parseFormat(output_format, format, only),
+                        nv2::acc("-o expects 'text', 'json', 'csv' or 'csv:<type>' not ") << output_format);
+            if (format != wde2::out::Format::Text) {
+                writer.reset(new wde2::out::RecordWriter(format, stdout, only));
+            }
+        }
+        // shared by -cs and -si
+        auto reportCollision = [&](const wde2::sig::SigIndex::Collision& c)
+        {
+            if (writer) {
+                wde2::out::writeCollision(*writer, wde2::sig::kindName(c.key.kind), c.key.toString().c_str(),
+                                          c.first.c_str(), c.other.c_str());
+            }
+            else {
+                std::cout << "\t" << wde2::sig::kindName(c.key.kind) << " collision: "
+                            << c.first << " and " << c.other << " => " << c.key.toString() << std::endl;
+            }
+        };
+
         // e.g. -sc g:\ u:\test\copied -d 6 -p
         if (shadow_copy)
         {
@@ -157,11 +291,883 @@ int main(int argc, char* argv[])
         // -cv
         else if (vhd_create)
         {
-            if (vp.size() != 2)
+            if (vp.size() < 2)
                 throw std::runtime_error("Expecting drivenumber and path/to/VHD");
+            if (rescue_map.size() && vp.size() != 2)
+                throw std::runtime_error("-rm clones to a single image");
             DWORD dwError = 0;
-            if (!vhdc::CloneVHDFromDisk(vp[0].c_str(),vp[1].c_str(),&dwError)) {
-                throw dwError;
+            std::function<void(ULONGLONG, ULONGLONG)> progress;
+            ULONGLONG start = ::GetTickCount64();
+            if (writer)
+            {
+                progress = [&](ULONGLONG completed, ULONGLONG total) {
+                    wde2::out::writeProgress(*writer, "clone", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            // wde2 reads the disk itself for anything but a plain clone
+            bool stream = vp[1].find(_T("tcp://")) == 0;
+            std::unique_ptr<wde2::blk::FileSource> disk;
+            std::unique_ptr<wde2::pt::RealignedSource> aligned;
+            wde2::blk::BlockSource* source = nullptr;
+            // realign, new sector size or size
+            bool relayout = realign || sector_size.size() || virtual_size.size();
+            if (stream || rescue_map.size() || vp.size() > 2 || relayout)
+            {
+                string_t physicaldisk = _T("\\\\.\\PhysicalDrive") + vp[0];
+                disk.reset(new wde2::blk::FileSource(physicaldisk));
+                nv2::throw_if(!*disk || disk->size() == 0, nv2::acc("Unable to read ") << physicaldisk);
+                source = disk.get();
+            }
+            // clone from a view of the disk with its partitions moved
+            if (relayout)
+            {
+                nv2::throw_if(rescue_map.size() != 0, nv2::acc("-al, -ss and -vs cannot be combined with -rm"));
+                wde2::pt::LayoutOptions layout;
+                layout.alignment = realign ? wde2::pt::_alignment : 0;
+                layout.sectorSize = sector_size.size() ? (DWORD)wde2::xstoi(sector_size) : 0;
+                layout.size = virtual_size.size() ? wde2::xstosize(virtual_size) : 0;
+                for (size_t i = 1; i < vp.size() && layout.sectorSize == 4096; i++)
+                {
+                    nv2::throw_if(wde2::img::kindFor(vp[i]) == wde2::img::Kind::FixedVhd, nv2::acc("VHD images have 512 byte sectors: use .vhdx for ") << vp[i]);
+                }
+                aligned.reset(new wde2::pt::RealignedSource(*disk, layout));
+                nv2::throw_if(!*aligned, nv2::acc("Unable to convert the layout: ") << aligned->error().c_str());
+                for (auto& m : aligned->moves())
+                {
+                    if (writer)
+                    {
+                        writer->begin("alignment");
+                        writer->field("partition", m.number);
+                        writer->field("offsetBefore", m.from);
+                        writer->field("offsetAfter", m.to);
+                        writer->field("length", m.length);
+                        writer->field("alignedBefore", (m.from % wde2::pt::_alignment) == 0);
+                        writer->field("alignedAfter", (m.to % wde2::pt::_alignment) == 0);
+                        writer->field("fileSystem", m.fileSystem);
+                        writer->field("bootSectors", m.bootSectors);
+                        writer->end();
+                    }
+                    else {
+                        std::wcout << "\tPartition " << m.number << ": offset " << m.from
+                                   << ((m.from % wde2::pt::_alignment) ? " (misaligned)" : " (aligned)") << " => " << m.to
+                                   << ((m.to % wde2::pt::_alignment) ? " (misaligned)" : " (aligned)")
+                                   << ", " << m.bootSectors << " boot sectors updated" << std::endl;
+                    }
+                }
+                if (writer)
+                {
+                    writer->begin("layout");
+                    writer->field("sizeBefore", disk->size());
+                    writer->field("sizeAfter", aligned->size());
+                    writer->field("sectorSizeBefore", (uint32_t)disk->sectorSize());
+                    writer->field("sectorSizeAfter", (uint32_t)aligned->sectorSize());
+                    writer->end();
+                }
+                else {
+                    std::wcout << "\tImage: " << aligned->size() << " bytes, " << aligned->sectorSize() << " byte sectors" << std::endl;
+                }
+                source = aligned.get();
+            }
+            if (source) {
+                wde2::metrics::job().begin("clone", source->size());
+            }
+            // stream to a receiver started with -rx
+            if (stream)
+            {
+                nv2::throw_if(vp.size() != 2 || rescue_map.size(), nv2::acc("A tcp:// clone has one destination and no -rm"));
+                wde2::net::StreamOptions options;
+                options.compress = stream_compress;
+                options.checksum = stream_checksum;
+                std::string address = wde2::sig::narrow(vp[1].substr(6));
+                wde2::net::SendReport report = wde2::net::send(*source, address, options, progress);
+                if (writer)
+                {
+                    writer->begin("stream");
+                    writer->field("disk", vp[0]);
+                    writer->field("address", address);
+                    writer->field("blocks", report.blocks);
+                    writer->field("zeroBlocks", report.zeroBlocks);
+                    writer->field("bytesRead", report.bytesRead);
+                    writer->field("bytesSent", report.bytesSent);
+                    writer->field("elapsedMs", (uint64_t)(report.seconds * 1000));
+                    writer->end();
+                }
+                else {
+                    std::wcout << "Streamed: " << report.blocks << " blocks, " << report.zeroBlocks << " zero blocks skipped, "
+                               << report.bytesSent << " bytes sent, " << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+                }
+            }
+            else if (rescue_map.size())
+            {
+                // block hashes for a later -rf
+                wde2::clone::Options options;
+                options.manifest = wde2::clone::manifestPath(vp[1]);
+                wde2::clone::Report report = wde2::clone::rescue(*disk, vp[1], rescue_map, options, progress);
+                for (auto& r : report.badRanges)
+                {
+                    if (writer)
+                    {
+                        writer->begin("badRange");
+                        writer->field("offset", r.start);
+                        writer->field("length", r.end - r.start);
+                        writer->field("lba", r.start / disk->sectorSize());
+                        writer->end();
+                    }
+                    else {
+                        std::wcout << "\tUnreadable: LBA " << (r.start / disk->sectorSize()) << " +" << ((r.end - r.start) / disk->sectorSize())
+                                   << " sectors, zero-filled" << std::endl;
+                    }
+                }
+                if (!writer)
+                {
+                    std::wcout << (report.resumed ? "Resumed: " : "Cloned: ") << report.good << " bytes read, " << report.bad << " unreadable, "
+                               << report.recovered << " recovered on retry, " << report.readErrors << " read errors" << std::endl;
+                }
+            }
+            // one or more images: read the disk once, write them all
+            else if (vp.size() > 2 || relayout)
+            {
+                std::vector<std::unique_ptr<wde2::img::ImageWriter>> images;
+                std::vector<wde2::img::ImageWriter*> targets;
+                for (size_t i = 1; i < vp.size(); i++)
+                {
+                    images.push_back(wde2::img::create(vp[i], source->size(), false, source->sectorSize()));
+                    nv2::throw_if(!images.back(), nv2::acc("Unable to create ") << vp[i]);
+                    targets.push_back(images.back().get());
+                }
+                // as much in flight as the disk's class or profile wants, from one reader
+                wde2::clone::FanOutOptions options;
+                wde2::io::Plan plan = wde2::io::select(_T("\\\\.\\PhysicalDrive") + vp[0], false, options.chunkSize, 1);
+                options.chunkSize = (std::min)((std::max)(plan.window(), (size_t)1024 * 1024), (size_t)16 * 1024 * 1024);
+                options.maxLag = (std::max)((size_t)4, (size_t)128 * 1024 * 1024 / options.chunkSize);
+                // block hashes for a later -rf of any raw image or fixed VHD
+                auto flat = [](wde2::img::Kind kind) { return kind == wde2::img::Kind::Raw || kind == wde2::img::Kind::FixedVhd; };
+                for (auto* t : targets) {
+                    options.hashBlocks = options.hashBlocks || flat(t->kind());
+                }
+                wde2::clone::FanOutReport report = wde2::clone::fanOut(*source, targets, options, progress);
+                images.clear();
+                size_t failures = 0;
+                for (size_t i = 0; i < report.targets.size(); i++)
+                {
+                    const wde2::clone::TargetReport& t = report.targets[i];
+                    failures += t.error.empty() ? 0 : 1;
+                    if (t.error.empty() && flat(t.kind)) {
+                        wde2::clone::saveManifest(report.manifest, vp[i + 1]);
+                    }
+                    if (writer)
+                    {
+                        writer->begin("target");
+                        writer->field("image", vp[i + 1]);
+                        writer->field("kind", wde2::img::kindName(t.kind));
+                        writer->field("bytesWritten", t.bytesWritten);
+                        writer->field("stalls", t.stalls);
+                        writer->field("elapsedMs", (uint64_t)(t.seconds * 1000));
+                        writer->field("error", t.error.c_str());
+                        writer->end();
+                    }
+                    else {
+                        std::wcout << "\t" << vp[i + 1] << " (" << wde2::img::kindName(t.kind) << "): "
+                                   << (t.error.empty() ? "complete" : t.error.c_str()) << ", " << t.stalls << " stalls" << std::endl;
+                    }
+                }
+                nv2::throw_if(failures != 0, nv2::acc("Clone: ") << failures << " of " << report.targets.size() << " images failed");
+            }
+            else
+            {
+                if (!vhdc::CloneVHDFromDisk(vp[0].c_str(),vp[1].c_str(),&dwError,nullptr,progress)) {
+                    throw dwError;
+                }
+                // the virtual disk API cannot hash as it goes, so a fixed VHD is read back
+                wde2::clone::writeManifest(vp[1]);
+            }
+        }
+        // -rf
+        else if (refresh_image)
+        {
+            if (vp.size() != 2)
+                throw std::runtime_error("Expecting drivenumber and path/to/VHD");
+            string_t physicaldisk = _T("\\\\.\\PhysicalDrive") + vp[0];
+            wde2::blk::FileSource disk(physicaldisk);
+            nv2::throw_if(!disk || disk.size() == 0, nv2::acc("Unable to read ") << physicaldisk);
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "refresh", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            // a handle per stream, each reading its own batches
+            wde2::io::Plan plan = wde2::io::select(physicaldisk, false, 8 * 1024 * 1024, 1);
+            std::vector<std::unique_ptr<wde2::blk::FileSource>> handles;
+            std::vector<wde2::blk::BlockSource*> stripes;
+            for (unsigned i = 1; i < plan.streams; i++)
+            {
+                handles.emplace_back(new wde2::blk::FileSource(physicaldisk));
+                if (*handles.back() && handles.back()->size() == disk.size()) {
+                    stripes.push_back(handles.back().get());
+                }
+            }
+            wde2::metrics::job().begin("refresh", disk.size());
+            size_t readSize = plan.window() / plan.streams;
+            readSize = (std::min)((std::max)(readSize, (size_t)1024 * 1024), (size_t)16 * 1024 * 1024);
+            wde2::clone::RefreshReport report = wde2::clone::refresh(disk, vp[1], wde2::clone::manifestPath(vp[1]), 0, 1024 * 1024,
+                                                                     readSize, progress, stripes);
+            if (writer)
+            {
+                writer->begin("refresh");
+                writer->field("disk", vp[0]);
+                writer->field("image", vp[1]);
+                writer->field("blocks", report.blocks);
+                writer->field("changed", report.changed);
+                writer->field("bytesRead", report.bytesRead);
+                writer->field("bytesWritten", report.bytesWritten);
+                writer->field("rebuilt", report.rebuilt);
+                writer->field("elapsedMs", (uint64_t)(::GetTickCount64() - start));
+                writer->end();
+            }
+            else {
+                std::wcout << "Refreshed " << vp[1] << ": " << report.changed << " of " << report.blocks << " blocks changed, "
+                           << report.bytesWritten << " bytes written" << (report.rebuilt ? " (image hashed first)" : "") << ", "
+                           << (::GetTickCount64() - start) << "ms" << std::endl;
+            }
+        }
+        // -lc
+        else if (live_clone)
+        {
+            if (vp.size() != 2 && vp.size() != 3)
+                throw std::runtime_error("Expecting drivenumber, path/to/VHD and optional threshold");
+            int number = wde2::xstoi(vp[0]);
+            string_t physicaldisk = _T("\\\\.\\PhysicalDrive") + vp[0];
+            wde2::blk::FileSource disk(physicaldisk);
+            nv2::throw_if(!disk || disk.size() == 0, nv2::acc("Unable to read ") << physicaldisk);
+            // the volumes, for the snapshot
+            std::map<int, wde2::DiskInfo> vdi = wde2::enumerate();
+            nv2::throw_if(vdi.find(number) == vdi.end(), nv2::acc("No disk ") << vp[0]);
+            wde2::clone::ConvergeOptions options;
+            if (vp.size() == 3) {
+                options.threshold = wde2::xstosize(vp[2]);
+            }
+            // as -rf: a handle per stream
+            wde2::io::Plan plan = wde2::io::select(physicaldisk, false, 8 * 1024 * 1024, 1);
+            std::vector<std::unique_ptr<wde2::blk::FileSource>> handles;
+            std::vector<wde2::blk::BlockSource*> stripes;
+            for (unsigned i = 1; i < plan.streams; i++)
+            {
+                handles.emplace_back(new wde2::blk::FileSource(physicaldisk));
+                if (*handles.back() && handles.back()->size() == disk.size()) {
+                    stripes.push_back(handles.back().get());
+                }
+            }
+            options.readSize = (std::min)((std::max)(plan.window() / plan.streams, (size_t)1024 * 1024), (size_t)16 * 1024 * 1024);
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "converge", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            size_t passes = 0;
+            auto passed = [&](const wde2::clone::PassReport& p) {
+                passes++;
+                if (writer)
+                {
+                    writer->begin("pass");
+                    writer->field("pass", (uint64_t)passes);
+                    writer->field("snapshot", p.snapshot);
+                    writer->field("changed", p.refresh.changed);
+                    writer->field("bytesWritten", p.refresh.bytesWritten);
+                    writer->field("elapsedMs", (uint64_t)(p.seconds * 1000));
+                    writer->end();
+                }
+                else {
+                    std::wcout << "\tPass " << passes << (p.snapshot ? " (snapshot)" : "") << ": " << p.refresh.changed << " of " << p.refresh.blocks
+                               << " blocks changed, " << p.refresh.bytesWritten << " bytes written, " << (uint64_t)(p.seconds * 1000) << "ms" << std::endl;
+                }
+            };
+            vss::DiskSnapshot snapshot(disk, vdi[number]);
+            wde2::metrics::job().begin("converge", disk.size());
+            wde2::clone::ConvergeReport report = wde2::clone::converge(disk, vp[1], options,
+                [&](const std::function<void(wde2::blk::BlockSource&)>& pass) { return snapshot.run(pass); },
+                progress, passed, stripes);
+            if (writer)
+            {
+                writer->begin("converge");
+                writer->field("disk", vp[0]);
+                writer->field("image", vp[1]);
+                writer->field("passes", (uint64_t)report.passes.size());
+                writer->field("converged", report.converged);
+                writer->field("consistent", report.consistent);
+                writer->field("elapsedMs", (uint64_t)(report.seconds * 1000));
+                writer->end();
+            }
+            else {
+                std::wcout << "Cloned " << vp[1] << " in " << report.passes.size() << " passes, "
+                           << (report.converged ? "converged" : "stopped converging") << ", "
+                           << (report.consistent ? "last pass from a snapshot" : "no volumes to snapshot: not consistent") << ", "
+                           << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+            }
+        }
+        // -rx
+        else if (receive_image)
+        {
+            if (vp.size() != 2)
+                throw std::runtime_error("Expecting [host:]port and path/to/image");
+            std::string address = wde2::sig::narrow(vp[0]);
+            wde2::net::Socket listener = wde2::net::Socket::listen(address);
+            nv2::throw_if(!listener, nv2::acc("Unable to listen on ") << address.c_str());
+            if (!writer) {
+                std::wcout << "Waiting on " << vp[0] << std::endl;
+            }
+            wde2::net::Socket connection = listener.accept();
+            listener.close();
+            nv2::throw_if(!connection, nv2::acc("Unable to accept a connection on ") << address.c_str());
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "receive", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            // the size comes with the stream
+            wde2::metrics::job().begin("receive", 0);
+            wde2::net::ReceiveReport report = wde2::net::receive(connection, vp[1], progress);
+            if (writer)
+            {
+                writer->begin("receive");
+                writer->field("image", vp[1]);
+                writer->field("kind", wde2::img::kindName(report.kind));
+                writer->field("size", report.size);
+                writer->field("blocks", report.blocks);
+                writer->field("bytesReceived", report.bytesReceived);
+                writer->field("bytesWritten", report.bytesWritten);
+                writer->field("compressed", report.compressed);
+                writer->field("checksummed", report.checksummed);
+                writer->field("elapsedMs", (uint64_t)(report.seconds * 1000));
+                writer->end();
+            }
+            else {
+                std::wcout << "Received " << vp[1] << " (" << wde2::img::kindName(report.kind) << "): " << report.blocks << " blocks, "
+                           << report.bytesReceived << " bytes received, " << report.bytesWritten << " bytes written, "
+                           << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+            }
+        }
+        // -rs
+        else if (restore_image)
+        {
+            if (vp.size() != 2)
+                throw std::runtime_error("Expecting path/to/image and drivenumber or path/to/image");
+            wde2::img::Kind kind = wde2::img::Kind::Raw;
+            std::unique_ptr<wde2::blk::BlockSource> image = wde2::img::open(vp[0], &kind);
+            nv2::throw_if(!image, nv2::acc("Unable to open ") << vp[0]);
+            bool number = !vp[1].empty() && vp[1].find_first_not_of(_T("0123456789")) == string_t::npos;
+            string_t target = number ? _T("\\\\.\\PhysicalDrive") + vp[1] : vp[1];
+            // 8 x 1MB writes in flight unless the target's class or profile says otherwise
+            wde2::io::Plan plan = wde2::io::select(target, true, 1024 * 1024, 8);
+            wde2::blk::AsyncTarget disk(plan.blockSize, plan.depth);
+            nv2::throw_if(!disk.open(target, image->size()), nv2::acc("Unable to open ") << target << " for writing");
+            // never the disk Windows runs from
+            nv2::throw_if(disk.holdsSystem(), nv2::acc("Refusing to restore over the system disk ") << target);
+            nv2::throw_if(!disk.lockVolumes(), nv2::acc("Unable to lock and dismount the volumes of ") << target << ", close anything using them");
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "restore", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            wde2::restore::Options options;
+            options.compare = restore_compare;
+            // no point asking a disk with TRIM off
+            options.unmap = plan.unmap;
+            wde2::metrics::job().begin("restore", image->size());
+            wde2::restore::Report report = wde2::restore::run(*image, disk, options, progress);
+            disk.close();
+            if (writer)
+            {
+                writer->begin("restore");
+                writer->field("image", vp[0]);
+                writer->field("kind", wde2::img::kindName(kind));
+                writer->field("target", target);
+                writer->field("blocks", report.blocks);
+                writer->field("bytesRead", report.bytesRead);
+                writer->field("bytesWritten", report.bytesWritten);
+                writer->field("identical", report.identical);
+                writer->field("bytesUnmapped", report.bytesUnmapped);
+                writer->field("bytesZeroed", report.bytesZeroed);
+                writer->field("elapsedMs", (uint64_t)(report.seconds * 1000));
+                writer->end();
+            }
+            else {
+                std::wcout << "Restored " << vp[0] << " to " << target << ": " << report.bytesWritten << " bytes written, "
+                           << report.identical << " identical blocks skipped, " << report.bytesUnmapped << " bytes unmapped, "
+                           << report.bytesZeroed << " bytes zero-filled, " << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+            }
+        }
+        // -df
+        else if (image_diff)
+        {
+            if (vp.size() != 3)
+                throw std::runtime_error("Expecting path/to/old path/to/new and path/to/patch");
+            wde2::img::Kind oldKind = wde2::img::Kind::Raw, newKind = wde2::img::Kind::Raw;
+            std::unique_ptr<wde2::blk::BlockSource> before = wde2::img::open(vp[0], &oldKind);
+            nv2::throw_if(!before, nv2::acc("Unable to open ") << vp[0]);
+            std::unique_ptr<wde2::blk::BlockSource> after = wde2::img::open(vp[1], &newKind);
+            nv2::throw_if(!after, nv2::acc("Unable to open ") << vp[1]);
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "diff", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            wde2::patch::DiffReport report = wde2::patch::diff(*before, *after, vp[2], wde2::patch::Options(), progress);
+            if (writer)
+            {
+                writer->begin("diff");
+                writer->field("old", vp[0]);
+                writer->field("new", vp[1]);
+                writer->field("patch", vp[2]);
+                writer->field("size", report.size);
+                writer->field("bytesCompared", report.bytesCompared);
+                writer->field("bytesSkipped", report.bytesSkipped);
+                writer->field("runs", report.runs);
+                writer->field("changedBytes", report.changedBytes);
+                writer->field("patchBytes", report.patchBytes);
+                writer->field("elapsedMs", (uint64_t)(report.seconds * 1000));
+                writer->end();
+            }
+            else {
+                std::wcout << "Compared " << vp[0] << " (" << wde2::img::kindName(oldKind) << ") with " << vp[1] << " ("
+                           << wde2::img::kindName(newKind) << "): " << report.changedBytes << " bytes changed in " << report.runs
+                           << " runs, patch " << vp[2] << " is " << report.patchBytes << " bytes, "
+                           << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+            }
+        }
+        // -pa
+        else if (image_patch)
+        {
+            if (vp.size() != 2)
+                throw std::runtime_error("Expecting path/to/patch and path/to/image");
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "patch", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            wde2::patch::ApplyReport report = wde2::patch::apply(vp[0], vp[1], progress);
+            if (writer)
+            {
+                writer->begin("patch");
+                writer->field("patch", vp[0]);
+                writer->field("image", vp[1]);
+                writer->field("runs", report.runs);
+                writer->field("written", report.written);
+                writer->field("skipped", report.skipped);
+                writer->field("bytesWritten", report.bytesWritten);
+                writer->field("resumed", report.resumed);
+                writer->field("elapsedMs", (uint64_t)(report.seconds * 1000));
+                writer->end();
+            }
+            else {
+                std::wcout << "Patched " << vp[1] << (report.resumed ? L" (resumed)" : L"") << ": " << report.written << " of "
+                           << report.runs << " runs written, " << report.skipped << " already in place, " << report.bytesWritten
+                           << " bytes, " << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+            }
+        }
+        // -mg
+        else if (merge_image)
+        {
+            if (vp.size() != 1)
+                throw std::runtime_error("Expecting path/to/child");
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "merge", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            wde2::chain::Report report = wde2::chain::merge(vp[0], wde2::chain::Options(), progress);
+            if (writer)
+            {
+                writer->begin("merge");
+                writer->field("image", vp[0]);
+                writer->field("parent", report.parent.wstring());
+                writer->field("size", report.size);
+                writer->field("bytesRead", report.bytesRead);
+                writer->field("bytesWritten", report.bytesWritten);
+                writer->field("bytesZero", report.bytesZero);
+                writer->field("elapsedMs", (uint64_t)(report.seconds * 1000));
+                writer->end();
+            }
+            else {
+                std::wcout << "Merged " << vp[0] << " into " << report.parent.wstring() << ": " << report.bytesWritten
+                           << " bytes written, " << report.bytesZero << " bytes zeroed, "
+                           << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+            }
+        }
+        // -fl
+        else if (flatten_image)
+        {
+            if (vp.size() != 2)
+                throw std::runtime_error("Expecting path/to/child and path/to/new");
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "flatten", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            wde2::chain::Report report = wde2::chain::flatten(vp[0], vp[1], wde2::chain::Options(), progress);
+            if (writer)
+            {
+                writer->begin("flatten");
+                writer->field("image", vp[0]);
+                writer->field("output", vp[1]);
+                writer->field("levels", (uint64_t)report.levels);
+                writer->field("size", report.size);
+                writer->field("bytesRead", report.bytesRead);
+                writer->field("bytesWritten", report.bytesWritten);
+                writer->field("bytesZero", report.bytesZero);
+                writer->field("elapsedMs", (uint64_t)(report.seconds * 1000));
+                writer->end();
+            }
+            else {
+                std::wcout << "Flattened " << report.levels << " levels of " << vp[0] << " into " << vp[1] << ": "
+                           << report.bytesRead << " bytes read, " << report.bytesZero << " bytes zero, "
+                           << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+            }
+        }
+        // -es
+        else if (estimate_clone)
+        {
+            if (vp.size() < 1)
+                throw std::runtime_error("Expecting drivenumber and optional path/to/image ...");
+            string_t physicaldisk = _T("\\\\.\\PhysicalDrive") + vp[0];
+            wde2::blk::FileSource disk(physicaldisk);
+            nv2::throw_if(!disk || disk.size() == 0, nv2::acc("Unable to read ") << physicaldisk);
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "estimate", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            wde2::estimate::Report report = wde2::estimate::run(disk, wde2::estimate::Options(), progress);
+            for (auto& r : report.regions)
+            {
+                if (writer)
+                {
+                    writer->begin("region");
+                    writer->field("partition", r.partition);
+                    writer->field("offset", r.offset);
+                    writer->field("length", r.length);
+                    writer->field("fileSystem", r.fileSystem);
+                    writer->field("samples", r.samples);
+                    writer->field("zeroRatio", r.zeroRatio);
+                    writer->field("compressRatio", r.compressRatio);
+                    writer->field("allocated", r.allocated);
+                    writer->end();
+                }
+                else {
+                    std::wcout << "\t" << (r.partition ? L"Partition " + std::to_wstring(r.partition) : std::wstring(L"Unpartitioned"))
+                               << ": offset " << r.offset << ", " << r.length << " bytes, " << r.samples << " samples, "
+                               << (int)(r.zeroRatio * 100) << "% zero, compresses to " << (int)(r.compressRatio * 100) << "%";
+                    if (r.allocated >= 0) {
+                        std::wcout << ", " << r.fileSystem << " " << (int)(r.allocated * 100) << "% in use";
+                    }
+                    std::wcout << std::endl;
+                }
+            }
+            for (auto& p : report.predictions)
+            {
+                if (writer)
+                {
+                    writer->begin("estimate");
+                    writer->field("kind", wde2::img::kindName(p.kind));
+                    writer->field("bytes", p.bytes);
+                    writer->field("bytesLow", p.bytesLow);
+                    writer->field("bytesHigh", p.bytesHigh);
+                    writer->field("seconds", p.seconds);
+                    writer->field("secondsLow", p.secondsLow);
+                    writer->field("secondsHigh", p.secondsHigh);
+                    writer->end();
+                }
+                else {
+                    std::wcout << "\t" << wde2::img::kindName(p.kind) << ": " << p.bytes << " bytes (" << p.bytesLow << " - " << p.bytesHigh
+                               << "), " << (uint64_t)p.seconds << "s (" << (uint64_t)p.secondsLow << " - " << (uint64_t)p.secondsHigh << ")" << std::endl;
+                }
+            }
+            // will the images fit where they are to go
+            size_t short_of_space = 0;
+            for (size_t i = 1; i < vp.size(); i++)
+            {
+                const wde2::estimate::Prediction* p = report.find(wde2::img::kindFor(vp[i]));
+                std::filesystem::path folder = std::filesystem::absolute(std::filesystem::path(vp[i])).parent_path();
+                std::error_code ec;
+                std::filesystem::space_info space = std::filesystem::space(folder, ec);
+                bool fits = !ec && p->bytesHigh <= space.available;
+                short_of_space += fits ? 0 : 1;
+                if (writer)
+                {
+                    writer->begin("room");
+                    writer->field("image", vp[i]);
+                    writer->field("kind", wde2::img::kindName(p->kind));
+                    writer->field("bytesHigh", p->bytesHigh);
+                    writer->field("available", (uint64_t)(ec ? 0 : space.available));
+                    writer->field("fits", fits);
+                    writer->end();
+                }
+                else {
+                    std::wcout << "\t" << vp[i] << ": needs up to " << p->bytesHigh << " bytes, " << (uint64_t)(ec ? 0 : space.available)
+                               << " available" << (fits ? L"" : L" - does not fit") << std::endl;
+                }
+            }
+            if (!writer)
+            {
+                std::wcout << "Estimated from " << report.samples << " blocks (" << report.bytesSampled << " bytes): "
+                           << (int)(report.zeroRatio * 100) << "% zero, compresses to " << (int)(report.compressRatio * 100) << "%, reads at "
+                           << (uint64_t)(report.readRateLow / 1048576) << " - " << (uint64_t)(report.readRateHigh / 1048576) << "MB/s, "
+                           << (uint64_t)(report.seconds * 1000) << "ms" << std::endl;
+            }
+            nv2::throw_if(short_of_space != 0, nv2::acc("Not enough space for ") << short_of_space << " image(s)");
+        }
+        // -bt
+        else if (bench_device)
+        {
+            if (vp.size() != 1)
+                throw std::runtime_error("Expecting drivenumber or path/to/file");
+            string_t target = iswdigit(vp[0][0]) ? _T("\\\\.\\PhysicalDrive") + vp[0] : vp[0];
+            ULONGLONG start = ::GetTickCount64();
+            std::function<void(uint64_t, uint64_t)> progress;
+            if (writer)
+            {
+                progress = [&](uint64_t completed, uint64_t total) {
+                    wde2::out::writeProgress(*writer, "bench", completed, total, ::GetTickCount64() - start);
+                };
+            }
+            wde2::io::Options options;
+            options.write = bench_write;
+            wde2::io::Result result = wde2::io::run(target, options, progress);
+            for (auto& c : result.cells)
+            {
+                if (writer)
+                {
+                    writer->begin("bench");
+                    writer->field("pattern", c.random ? "random" : "sequential");
+                    writer->field("operation", c.write ? "write" : "read");
+                    writer->field("blockSize", c.blockSize);
+                    writer->field("depth", c.depth);
+                    writer->field("mbPerSecond", c.rate() / (1024 * 1024));
+                    writer->field("iops", c.iops());
+                    writer->field("latencyMs", c.latencyMs);
+                    writer->field("p99Ms", c.p99Ms);
+                    writer->field("ok", c.ok);
+                    writer->end();
+                }
+                else {
+                    std::wcout << "\t" << (c.random ? "random     " : "sequential ") << (c.write ? "write " : "read  ")
+                               << c.blockSize / 1024 << "KB x " << c.depth << ": " << (uint64_t)(c.rate() / (1024 * 1024)) << "MB/s, "
+                               << (uint64_t)c.iops() << " IOPS, " << c.latencyMs << "ms mean, " << c.p99Ms << "ms p99"
+                               << (c.ok ? "" : " (failed)") << std::endl;
+                }
+            }
+            // kept for disks only: a file says little about what it is stored on
+            wde2::io::Profile profile = wde2::io::derive(result, wde2::io::deviceKey(target));
+            bool saved = false;
+            if (!profile.key.empty())
+            {
+                wde2::io::ProfileMap profiles;
+                wde2::io::load(wde2::io::profilePath(), profiles);
+                profiles[profile.key] = profile;
+                saved = wde2::io::save(wde2::io::profilePath(), profiles);
+            }
+            if (writer)
+            {
+                writer->begin("profile");
+                writer->field("device", profile.key);
+                writer->field("readBlockSize", profile.readBlockSize);
+                writer->field("readDepth", profile.readDepth);
+                writer->field("readMbPerSecond", profile.readRate / (1024 * 1024));
+                writer->field("writeBlockSize", profile.writeBlockSize);
+                writer->field("writeDepth", profile.writeDepth);
+                writer->field("writeMbPerSecond", profile.writeRate / (1024 * 1024));
+                writer->field("randomIops", profile.randomIops);
+                writer->field("unbuffered", result.direct);
+                writer->field("saved", saved);
+                writer->end();
+            }
+            else {
+                std::wcout << "Sequential reads: " << profile.readBlockSize / 1024 << "KB x " << profile.readDepth << " ("
+                           << (uint64_t)(profile.readRate / (1024 * 1024)) << "MB/s)";
+                if (profile.writeBlockSize) {
+                    std::wcout << ", writes: " << profile.writeBlockSize / 1024 << "KB x " << profile.writeDepth << " ("
+                               << (uint64_t)(profile.writeRate / (1024 * 1024)) << "MB/s)";
+                }
+                std::wcout << ", " << (uint64_t)profile.randomIops << " random IOPS" << std::endl;
+                if (saved) {
+                    std::wcout << "Profile of " << profile.key << " saved to " << wde2::io::profilePath().wstring() << std::endl;
+                }
+            }
+        }
+        // -x-ptb
+        else if (parse_bench)
+        {
+            std::vector<std::unique_ptr<wde2::blk::BlockSource>> images;
+            if (vp.empty() || iswdigit(vp[0][0])) {
+                images = wde2::pt::bench::synthesize(vp.empty() ? 4096 : (size_t)wde2::xstoi(vp[0]));
+            }
+            else
+            {
+                for (auto& path : vp) {
+                    wde2::pt::bench::addImages(path, images);
+                }
+            }
+            nv2::throw_if(images.empty(), nv2::acc("No images to parse"));
+            for (bool checkBackup : { true, false })
+            {
+                wde2::pt::bench::Result result = wde2::pt::bench::run(images, 4, checkBackup);
+                printf("%s: %llu images, %llu parses in %.3fs => %.0f parses/s, %.2f reads and %.0f bytes per parse, %llu partitions, %llu failed\n",
+                    checkBackup ? "GPT backup checked" : "Primary only",
+                    (unsigned long long)result.images,
+                    (unsigned long long)result.parses,
+                    result.seconds,
+                    result.parses / (std::max)(result.seconds, 1e-9),
+                    (double)result.reads / result.parses,
+                    (double)result.bytes / result.parses,
+                    (unsigned long long)result.partitions,
+                    (unsigned long long)result.failures);
+            }
+        }
+        // -mi
+        else if (mft_index)
+        {
+            if (vp.size() != 2)
+                throw std::runtime_error("Expecting disk or image and path/to/catalog");
+            wde2::img::Kind kind = wde2::img::Kind::Raw;
+            std::unique_ptr<wde2::blk::BlockSource> source = wde2::img::open(vp[0], &kind);
+            nv2::throw_if(!source, nv2::acc("Unable to read ") << vp[0] << " (" << wde2::img::kindName(kind) << ")");
+            size_t files = wde2::catalog::build(*source, wde2::catalog::utf8(vp[0]), vp[1]);
+            if (!writer) {
+                std::wcout << "Indexed " << files << " files from " << vp[0] << " into " << vp[1] << std::endl;
+            }
+        }
+        // -ex
+        else if (extract_file)
+        {
+            if (vp.size() != 3)
+                throw std::runtime_error("Expecting image, path in volume and path/to/output");
+            wde2::img::Kind kind = wde2::img::Kind::Raw;
+            std::unique_ptr<wde2::blk::BlockSource> source = wde2::img::open(vp[0], &kind);
+            nv2::throw_if(!source, nv2::acc("Unable to read ") << vp[0] << " (" << wde2::img::kindName(kind) << ")");
+            ULONGLONG start = ::GetTickCount64();
+            wde2::ntfs::ExtractReport report = wde2::ntfs::extract(*source, wde2::catalog::utf8(vp[1]), vp[2]);
+            if (writer)
+            {
+                writer->begin("extract");
+                writer->field("image", vp[0]);
+                writer->field("kind", wde2::img::kindName(kind));
+                writer->field("volume", report.volume);
+                writer->field("path", vp[1]);
+                writer->field("record", report.record);
+                writer->field("size", report.size);
+                writer->field("compressed", report.compressed);
+                writer->field("sparse", report.sparse);
+                writer->field("indexed", report.indexed);
+                writer->field("reads", report.reads);
+                writer->field("bytesRead", report.bytesRead);
+                writer->field("elapsedMs", (uint64_t)(::GetTickCount64() - start));
+                writer->end();
+            }
+            else {
+                std::wcout << "Extracted " << report.size << " bytes from volume " << report.volume << " of " << vp[0]
+                           << " in " << report.reads << " reads, " << (::GetTickCount64() - start) << "ms" << std::endl;
+            }
+        }
+        // -fb
+        else if (file_backup)
+        {
+            if (vp.size() != 3 && vp.size() != 4)
+                throw std::runtime_error("Expecting volume, directory, path/to/destination and optional path/to/manifest");
+            // by default the manifest sits beside the copy
+            std::wstring manifest = (vp.size() == 4) ? vp[3] : vp[2] + _T(".wdfm");
+            ULONGLONG start = ::GetTickCount64();
+            vss::FileBackup backup(vp[1], manifest);
+            backup.doSnapshotCopy(vp[0], vp[2]);
+            wde2::backup::Report& report = backup.report;
+            if (writer)
+            {
+                writer->begin("backup");
+                writer->field("volume", vp[0]);
+                writer->field("directory", vp[1]);
+                writer->field("destination", vp[2]);
+                writer->field("manifest", manifest);
+                writer->field("directories", report.directories.load());
+                writer->field("files", report.files.load());
+                writer->field("copied", report.copied.load());
+                writer->field("unchanged", report.unchanged.load());
+                writer->field("sameHash", report.sameHash.load());
+                writer->field("stale", report.stale);
+                writer->field("bytesCopied", report.bytesCopied.load());
+                writer->field("bytesHashed", report.bytesHashed.load());
+                writer->field("failures", (uint64_t)report.failures.size());
+                writer->field("elapsedMs", (uint64_t)(::GetTickCount64() - start));
+                writer->end();
+            }
+            else
+            {
+                std::wcout << "Copied " << report.copied << " of " << report.files << " files (" << report.bytesCopied << " bytes), "
+                           << (report.unchanged + report.sameHash) << " unchanged, " << report.stale << " stale kept, "
+                           << (::GetTickCount64() - start) << "ms" << std::endl;
+            }
+            for (auto& f : report.failures) {
+                std::cerr << "\t" << f << std::endl;
+            }
+            nv2::throw_if(report.failures.size() != 0, nv2::acc("File backup: ") << report.failures.size() << " failures");
+        }
+        // -mq
+        else if (mft_query.size())
+        {
+            if (vp.empty())
+                throw std::runtime_error("Expecting one or more catalogs or directories");
+            std::vector<std::filesystem::path> catalogs(vp.begin(), vp.end());
+            size_t hits = wde2::catalog::query(catalogs, wde2::catalog::utf8(mft_query),
+                [&](const wde2::catalog::Catalog& c, const wde2::catalog::Entry& e)
+            {
+                std::string path = c.path(e);
+                std::string modified = wde2::catalog::fileTimeToString(e.modified);
+                if (writer)
+                {
+                    writer->begin("file");
+                    writer->field("source", c.source());
+                    writer->field("volume", c.volume(e).offset);
+                    writer->field("path", path);
+                    writer->field("directory", (e.attributes & wde2::catalog::_attributeDirectory) != 0);
+                    writer->field("size", e.size);
+                    writer->field("created", wde2::catalog::fileTimeToString(e.created));
+                    writer->field("modified", modified);
+                    writer->field("accessed", wde2::catalog::fileTimeToString(e.accessed));
+                    writer->field("record", wde2::ntfs::refRecord(e.reference));
+                    writer->hex("attributes", e.attributes);
+                    writer->field("runs", e.runCount);
+                    writer->end();
+                }
+                else {
+                    printf("%s:%s\t%llu\t%s\n", c.source().c_str(), path.c_str(), (unsigned long long)e.size, modified.c_str());
+                }
+            });
+            if (!writer) {
+                std::cout << hits << " matches" << std::endl;
             }
         }
         // -ca
@@ -198,35 +1204,157 @@ int main(int argc, char* argv[])
         //
         else if (checkMBRSignature) 
         {
-            std::cout << "Checking for MBR drive signature collisions" << std::endl;
-            // map signature to drive index
-            using map_t = std::map<DWORD,int>;
-            using iter_t = map_t::iterator;
-            map_t mapper;
+            if (!writer) {
+                std::cout << "Checking for MBR signature and GPT GUID collisions" << std::endl;
+            }
+            // in-memory index. signatures, disk GUIDs and partition GUIDs
+            wde2::sig::SigIndex index;
             // drive index => disk info
-            std::map<int, wde2::DiskInfo> vdi = wde2::enumerate();
+            std::map<int, wde2::DiskInfo> vdi = wde2::cache::enumerate(cache_path);
             for (auto& di : vdi)
             {
-                // applies to MBR only
-                if (di.second.DriveLayout.PartitionStyle == PARTITION_STYLE_MBR) 
+                std::string source = "\\\\.\\PhysicalDrive" + std::to_string(di.first);
+                if (writer)
                 {
-                    std::cout << "\t\\\\.\\PhysicalDrive" << di.first << " => " << nv2::to_hex(di.second.DriveLayout.Mbr.Signature) << std::endl;
-
-                    iter_t iter = mapper.find(di.second.DriveLayout.Mbr.Signature);
-                    if (iter == mapper.end()) {
-                        mapper[di.second.DriveLayout.Mbr.Signature] = di.first;
+                    for (auto& key : index.keysOf(di.second)) {
+                        wde2::out::writeIdentity(*writer, source.c_str(), wde2::sig::kindName(key.kind), key.toString().c_str());
+                    }
+                }
+                else if (di.second.DriveLayout.PartitionStyle == PARTITION_STYLE_MBR) 
+                {
+                    std::cout << "\t" << source << " => " << nv2::to_hex(di.second.DriveLayout.Mbr.Signature) << std::endl;
+                }
+                else if (di.second.DriveLayout.PartitionStyle == PARTITION_STYLE_GPT)
+                {
+                    std::cout << "\t" << source << " => " << wde2::pt::guidToString(di.second.DriveLayout.Gpt.DiskId) << std::endl;
+                }
+                for (auto& c : index.insertDisk(di.second, source)) {
+                    reportCollision(c);
+                }
+            }
+        }
+        // -fp
+        else if (fingerprint_store.size())
+        {
+            if (vp.empty())
+                throw std::runtime_error("Expecting one or more drivenumbers or path/to/image");
+            wde2::fingerprint::Store store;
+            nv2::throw_if(!store.load(fingerprint_store), nv2::acc("Not a fingerprint store: ") << fingerprint_store);
+            bool added = false;
+            for (const string_t& name : vp)
+            {
+                // a disk is looked up. an image is held, so it is stored as well
+                bool disk = iswdigit(name[0]) && name.find_first_not_of(_T("0123456789")) == string_t::npos;
+                string_t path = disk ? _T("\\\\.\\PhysicalDrive") + name : name;
+                std::unique_ptr<wde2::blk::BlockSource> source;
+                if (disk) {
+                    source.reset(new wde2::blk::FileSource(path));
+                }
+                else {
+                    source = wde2::img::open(path);
+                }
+                nv2::throw_if(!source || source->size() == 0, nv2::acc("Unable to read ") << path);
+                ULONGLONG start = ::GetTickCount64();
+                std::function<void(uint64_t, uint64_t)> progress;
+                if (writer)
+                {
+                    progress = [&](uint64_t completed, uint64_t total) {
+                        wde2::out::writeProgress(*writer, "fingerprint", completed, total, ::GetTickCount64() - start);
+                    };
+                }
+                wde2::fingerprint::Report report;
+                wde2::fingerprint::Fingerprint fp = wde2::fingerprint::take(*source, disk ? path : std::filesystem::absolute(path).wstring(),
+                                                                            report, wde2::fingerprint::Options(), progress);
+                if (writer)
+                {
+                    writer->begin("fingerprint");
+                    writer->field("source", path);
+                    writer->field("size", fp.size);
+                    writer->field("blocks", report.blocks);
+                    writer->field("samples", (uint64_t)fp.samples);
+                    writer->field("zeroBlocks", report.zeroBlocks);
+                    writer->field("readErrors", report.readErrors);
+                    writer->field("elapsedMs", (uint64_t)(::GetTickCount64() - start));
+                    writer->end();
+                }
+                else {
+                    std::wcout << path << ": " << fp.samples << " of " << report.blocks << " sampled blocks hashed, " << report.zeroBlocks
+                               << " zero, " << (::GetTickCount64() - start) << "ms" << std::endl;
+                }
+                for (auto& match : store.best(fp, 5))
+                {
+                    if (writer)
+                    {
+                        writer->begin("match");
+                        writer->field("source", path);
+                        writer->field("image", match.second->name);
+                        writer->field("similarity", match.first);
+                        writer->end();
+                    }
+                    else {
+                        std::wcout << "\t" << (int)(match.first * 100 + 0.5) << "% " << match.second->name << std::endl;
+                    }
+                }
+                if (!disk)
+                {
+                    store.put(fp);
+                    added = true;
+                }
+            }
+            nv2::throw_if(added && !store.save(fingerprint_store), nv2::acc("Unable to write ") << fingerprint_store);
+        }
+        // -si
+        else if (sig_index.size())
+        {
+            wde2::sig::SigIndex index(sig_index);
+            if (sig_allocate.size())
+            {
+                int count = vp.size() ? wde2::xstoi(vp[0]) : 1;
+                std::string owner = "allocated:" + std::to_string((long long)time(nullptr));
+                for (int i = 0; i < count; i++)
+                {
+                    if (sig_allocate == _T("mbr")) {
+                        std::cout << nv2::to_hex(index.allocateSignature(owner)) << std::endl;
+                    }
+                    else if (sig_allocate == _T("guid")) {
+                        std::cout << wde2::pt::guidToString(index.allocateGUID(owner)) << std::endl;
                     }
                     else {
-                        std::cout << "\tMBR signature collision: "
-                                    << "\\\\.\\PhysicalDrive" << iter->second
-                                    << " and "
-                                    << "\\\\.\\PhysicalDrive" << di.first
-                                    << " => "
-                                    << nv2::to_hex(iter->first)
-                                    << std::endl;
+                        throw std::runtime_error("-sa expects 'mbr' or 'guid'");
+                    }
+                }
+            }
+            else if (vp.empty())
+            {
+                if (!writer) {
+                    std::cout << index.size() << " identities from " << index.sourceCount() << " sources" << std::endl;
+                }
+                for (auto& c : index.collisions()) {
+                    reportCollision(c);
+                }
+            }
+            else
+            {
+                for (auto& file : vp)
+                {
+                    std::map<int, wde2::DiskInfo> vdi = wde2::sig::readExport(file);
+                    for (auto& di : vdi)
+                    {
+                        // i.e. host42.cache:\\.\PhysicalDrive3
+                        std::string source = wde2::sig::narrow(file) + ":" + wde2::sig::narrow(di.second.DeviceName);
+                        if (index.hasSource(source)) {
+                            continue;
+                        }
+                        for (auto& c : index.insertDisk(di.second, source)) {
+                            reportCollision(c);
+                        }
                     }
                 }
+                if (!writer) {
+                    std::cout << index.size() << " identities from " << index.sourceCount() << " sources" << std::endl;
+                }
             }
+            nv2::throw_if(!index.save(), nv2::acc("Unable to write ") << sig_index);
         }
         else
         {
@@ -246,11 +1374,13 @@ int main(int argc, char* argv[])
                 list_partitions = true;
             }
             //
-            std::map<int, wde2::DiskInfo> vdi = wde2::enumerate();
+            std::map<int, wde2::DiskInfo> vdi = wde2::cache::enumerate(cache_path);
             //
             int diskCount = (int)vdi.size();
             //
-            printf("Detected %d disks\n", diskCount);
+            if (!writer) {
+                printf("Detected %d disks\n", diskCount);
+            }
             //
             if (diskCount == 0) {
                 throw std::runtime_error("Unlikely! Zero (0) disks detected");
@@ -331,6 +1461,16 @@ int main(int argc, char* argv[])
                 if (disks.find(id.first) == disks.end())
                     continue;
                 
+                // -o json|csv: every field, one record per disk and partition
+                if (writer)
+                {
+                    wde2::out::writeDisk(*writer, id.first, id.second);
+                    for (auto& partition : id.second.partitions) {
+                        wde2::out::writePartition(*writer, id.first, partition.first, partition.second);
+                    }
+                    continue;
+                }
+
                 wde2::DiskInfo di = id.second;
 
                 DBMSG("----------------- #" << di.StorageDeviceNumber.DeviceNumber);
@@ -381,6 +1521,10 @@ int main(int argc, char* argv[])
                     DBMSG("SerialNumber: " << di.SerialNumber);
                     DBMSG("ProductRevision: " << di.ProductRevision);
                     DBMSG("BytesPerSector: " << di.Geometry.BytesPerSector);
+                    DBMSG("Storage: " << wde2::out::busName(di.Storage.BusType)
+                        << (di.Storage.hasSeekPenalty ? (di.Storage.IncursSeekPenalty ? ", rotational" : ", solid state") : "")
+                        << (di.Storage.TrimEnabled ? ", TRIM" : "")
+                        << ", physical sector " << di.Storage.BytesPerPhysicalSector);
 
                     if (di.DriveLayout.PartitionStyle == PARTITION_STYLE_MBR)
                     {
@@ -480,6 +1624,8 @@ int main(int argc, char* argv[])
     }
     catch (const std::exception& ex)
     {
+        // what led up to it first
+        wde2::log::flush();
         std::cout << "Error: " << ex.what() << std::endl;
     }
     catch (const DWORD& ex)
@@ -490,6 +1636,17 @@ int main(int argc, char* argv[])
     {
         std::cout << "Unknown error ..." << std::endl;
     }
+    if (trace_file.size() && wde2::trace::enabled())
+    {
+        std::string trace = wde2::trace::stop();
+        if (!wde2::cache::saveAtomically(trace_file, trace.data(), trace.size())) {
+            std::wcout << "Unable to write " << trace_file << std::endl;
+        }
+    }
+    // the textfile is written once more, showing how the job ended
+    wde2::metrics::job().end(ret == 0);
+    metrics_file.reset();
+    metrics_listener.reset();
     //
     return ret;
 }
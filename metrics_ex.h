@@ -0,0 +1,283 @@
+/*
+
+    Job metrics in the Prometheus text format.
+
+    The copy paths count what they do into one process-wide set of
+    counters, gauges and histograms: bytes read and written, zero
+    blocks skipped, read errors and retries, read and write latency,
+    and queue depth. Every update is a relaxed atomic add or store;
+    nothing on the copy path takes a lock or formats anything.
+
+    render() formats a snapshot on demand. Textfile rewrites it every
+    few seconds for the node-exporter textfile collector, by rename so
+    the collector never reads half a file. net::MetricsListener in
+    net_clone.h serves the same text over HTTP on loopback.
+
+    A stalled job shows as a flat wde2_bytes_read_total while
+    wde2_job_running is 1, e.g. rate(wde2_bytes_read_total[5m]) == 0.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "enum_cache.h"
+
+namespace wde2
+{
+    namespace metrics
+    {
+        //-----------------------------------------------------------------------------
+        class Counter
+        {
+            std::atomic<uint64_t> m_value{ 0 };
+        public:
+            void add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+            uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+        };
+
+        class Gauge
+        {
+            std::atomic<int64_t> m_value{ 0 };
+        public:
+            void set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+            int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+        };
+
+        // upper bounds in seconds, +Inf implied
+        static const double _bounds[] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+        static const size_t _buckets = sizeof(_bounds) / sizeof(_bounds[0]);
+
+        class Histogram
+        {
+            // per bucket, not cumulative. the last is +Inf
+            std::atomic<uint64_t> m_counts[_buckets + 1];
+            std::atomic<uint64_t> m_sumNs{ 0 };
+
+        public:
+            Histogram()
+            {
+                for (auto& c : m_counts) {
+                    c.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            void observe(std::chrono::steady_clock::duration d)
+            {
+                int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+                double seconds = ns / 1e9;
+                size_t b = 0;
+                while (b < _buckets && seconds > _bounds[b]) {
+                    b++;
+                }
+                m_counts[b].fetch_add(1, std::memory_order_relaxed);
+                m_sumNs.fetch_add((uint64_t)(ns < 0 ? 0 : ns), std::memory_order_relaxed);
+            }
+
+            uint64_t count(size_t b) const { return m_counts[b].load(std::memory_order_relaxed); }
+            double sum() const { return m_sumNs.load(std::memory_order_relaxed) / 1e9; }
+        };
+
+        // times a scope, or up to end(), into a histogram
+        class Timer
+        {
+            Histogram* m_histogram;
+            std::chrono::steady_clock::time_point m_start;
+        public:
+            explicit Timer(Histogram& h) : m_histogram(&h), m_start(std::chrono::steady_clock::now()) {}
+            ~Timer() { end(); }
+
+            void end()
+            {
+                if (m_histogram)
+                {
+                    m_histogram->observe(std::chrono::steady_clock::now() - m_start);
+                    m_histogram = nullptr;
+                }
+            }
+
+            Timer(const Timer&) = delete;
+            Timer& operator=(const Timer&) = delete;
+        };
+
+        //-----------------------------------------------------------------------------
+        // everything one process reports. one job runs at a time
+        struct Job
+        {
+            Counter bytesRead;
+            Counter bytesWritten;
+            // blocks not written because they were zero, or already in place
+            Counter zeroBlocks;
+            Counter identicalBlocks;
+            Counter readErrors;
+            Counter retries;
+            Counter bytesReceived;
+            Histogram readLatency;
+            Histogram writeLatency;
+            Gauge queueDepth;
+            Gauge size;
+            Gauge running;
+            Gauge failed;
+            Gauge started;
+            // set before the job starts, read by the publishers
+            std::atomic<const char*> operation{ "" };
+
+            void begin(const char* op, uint64_t bytes)
+            {
+                operation.store(op, std::memory_order_relaxed);
+                size.set((int64_t)bytes);
+                started.set((int64_t)std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count());
+                running.set(1);
+            }
+
+            void end(bool ok)
+            {
+                queueDepth.set(0);
+                failed.set(ok ? 0 : 1);
+                running.set(0);
+            }
+        };
+
+        static Job& job()
+        {
+            static Job instance;
+            return instance;
+        }
+
+        //-----------------------------------------------------------------------------
+        static std::string render()
+        {
+            Job& j = job();
+            std::string op = j.operation.load(std::memory_order_relaxed);
+            std::string labels = "{operation=\"" + op + "\"}";
+            std::string out;
+            char line[256];
+            auto metric = [&](const char* name, const char* type, const char* help, const std::string& value) {
+                out += std::string("# HELP ") + name + " " + help + "\n";
+                out += std::string("# TYPE ") + name + " " + type + "\n";
+                out += name + labels + " " + value + "\n";
+            };
+            auto u = [](uint64_t v) { return std::to_string(v); };
+            auto i = [](int64_t v) { return std::to_string(v); };
+            metric("wde2_job_running", "gauge", "1 while a job runs", i(j.running.value()));
+            metric("wde2_job_failed", "gauge", "1 if the last job ended in an error", i(j.failed.value()));
+            metric("wde2_job_start_time_seconds", "gauge", "Unix time the job started", i(j.started.value()));
+            metric("wde2_job_size_bytes", "gauge", "Bytes the job covers", i(j.size.value()));
+            metric("wde2_bytes_read_total", "counter", "Bytes read from the source", u(j.bytesRead.value()));
+            metric("wde2_bytes_written_total", "counter", "Bytes written to the target", u(j.bytesWritten.value()));
+            metric("wde2_bytes_received_total", "counter", "Bytes received from the network", u(j.bytesReceived.value()));
+            metric("wde2_zero_blocks_skipped_total", "counter", "Zero blocks not written", u(j.zeroBlocks.value()));
+            metric("wde2_identical_blocks_skipped_total", "counter", "Blocks not written because the target already held them", u(j.identicalBlocks.value()));
+            metric("wde2_read_errors_total", "counter", "Source reads that failed", u(j.readErrors.value()));
+            metric("wde2_retries_total", "counter", "Reads retried after an error", u(j.retries.value()));
+            metric("wde2_queue_depth", "gauge", "Buffers queued between pipeline stages", i(j.queueDepth.value()));
+
+            auto histogram = [&](const char* name, const char* help, const Histogram& h) {
+                out += std::string("# HELP ") + name + " " + help + "\n";
+                out += std::string("# TYPE ") + name + " histogram\n";
+                uint64_t cumulative = 0;
+                for (size_t b = 0; b <= _buckets; b++)
+                {
+                    cumulative += h.count(b);
+                    if (b < _buckets) {
+                        snprintf(line, sizeof(line), "%s_bucket{operation=\"%s\",le=\"%g\"} %llu\n", name, op.c_str(), _bounds[b], (unsigned long long)cumulative);
+                    }
+                    else {
+                        snprintf(line, sizeof(line), "%s_bucket{operation=\"%s\",le=\"+Inf\"} %llu\n", name, op.c_str(), (unsigned long long)cumulative);
+                    }
+                    out += line;
+                }
+                snprintf(line, sizeof(line), "%s_sum%s %.6f\n%s_count%s %llu\n", name, labels.c_str(), h.sum(),
+                         name, labels.c_str(), (unsigned long long)cumulative);
+                out += line;
+            };
+            histogram("wde2_read_latency_seconds", "Time per source read", j.readLatency);
+            histogram("wde2_write_latency_seconds", "Time per target write", j.writeLatency);
+            return out;
+        }
+
+        //-----------------------------------------------------------------------------
+        // node-exporter textfile, rewritten every 'interval' and once more on stop
+        class Textfile
+        {
+            std::filesystem::path m_path;
+            std::chrono::seconds m_interval;
+            std::mutex m_lock;
+            std::condition_variable m_wake;
+            bool m_stop = false;
+            std::thread m_thread;
+
+            bool write()
+            {
+                std::string text = render();
+                return cache::saveAtomically(m_path, text.data(), text.size());
+            }
+
+        public:
+            Textfile(const std::filesystem::path& path, std::chrono::seconds interval = std::chrono::seconds(5))
+                : m_path(path), m_interval(interval)
+            {
+                m_thread = std::thread([this]() {
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    while (!m_stop)
+                    {
+                        lock.unlock();
+                        write();
+                        lock.lock();
+                        m_wake.wait_for(lock, m_interval, [&]() { return m_stop; });
+                    }
+                });
+            }
+
+            ~Textfile()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_stop = true;
+                }
+                m_wake.notify_all();
+                m_thread.join();
+                write();
+            }
+
+            Textfile(const Textfile&) = delete;
+            Textfile& operator=(const Textfile&) = delete;
+        };
+    }
+}
@@ -0,0 +1,642 @@
+/*
+
+    Compact, sorted, memory mappable file catalog of a disk image.
+
+    Built from the $MFT of every NTFS volume on the image (see
+    ntfs_mft.h), written once and then queried by mapping it:
+    no parsing, no allocation per entry, binary search by full
+    path or by file name.
+
+    Layout, little endian, offsets from the start of the file:
+
+        Header
+        Volume[volumeCount]
+        Entry[entryCount]      sorted by folded path
+        uint32_t[entryCount]   entry indices sorted by folded file name
+        Run[runCount]          data runs, contiguous per entry
+        char[stringsSize]      UTF-8 paths and the source name
+
+    Folding is ASCII case-insensitive with '/' == '\'.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "enum_cache.h"
+#include "ntfs_mft.h"
+
+namespace wde2
+{
+    namespace catalog
+    {
+        static const uint32_t _magic = 0x434D4457;   // 'WDMC'
+        static const uint32_t _version = 1;
+
+#pragma pack(push, 1)
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t headerSize;
+            uint32_t volumeCount;
+            uint64_t entryCount;
+            uint64_t volumesOffset;
+            uint64_t entriesOffset;
+            uint64_t nameIndexOffset;
+            uint64_t runsOffset;
+            uint64_t runCount;
+            uint64_t stringsOffset;
+            uint64_t stringsSize;
+            // UTF-8 image path, in the string pool
+            uint32_t sourceOffset;
+            uint32_t sourceLength;
+            // FILETIME of the build
+            uint64_t created;
+        };
+
+        struct Volume
+        {
+            uint64_t offset;
+            uint64_t length;
+            uint64_t serial;
+            uint32_t clusterSize;
+            uint32_t recordSize;
+        };
+
+        struct Entry
+        {
+            uint32_t pathOffset;
+            uint32_t pathLength;
+            // file name starts at pathOffset + leafOffset
+            uint32_t leafOffset;
+            uint32_t volume;
+            uint64_t size;
+            uint64_t created;
+            uint64_t modified;
+            uint64_t changed;
+            uint64_t accessed;
+            // MFT record number | sequence << 48
+            uint64_t reference;
+            uint32_t attributes;
+            uint32_t runCount;
+            uint64_t runIndex;
+        };
+
+        struct Run
+        {
+            uint64_t vcn;
+            // < 0 => sparse
+            int64_t lcn;
+            uint64_t clusters;
+        };
+#pragma pack(pop)
+
+        static_assert(sizeof(Header) == 96, "catalog header layout");
+        static_assert(sizeof(Volume) == 32, "catalog volume layout");
+        static_assert(sizeof(Entry) == 80, "catalog entry layout");
+        static_assert(sizeof(Run) == 24, "catalog run layout");
+
+        // entries with this bit are directories
+        static const uint32_t _attributeDirectory = 0x10;
+
+        //-----------------------------------------------------------------------------
+        static inline char fold(char c)
+        {
+            if (c >= 'A' && c <= 'Z') {
+                return (char)(c - 'A' + 'a');
+            }
+            return (c == '/') ? '\\' : c;
+        }
+
+        // <0, 0, >0. if 'prefix', a matching prefix of 'a' compares equal
+        static int compareFolded(const char* a, size_t an, const char* b, size_t bn, bool prefix = false)
+        {
+            size_t n = (std::min)(an, bn);
+            for (size_t i = 0; i < n; i++)
+            {
+                unsigned char ca = (unsigned char)fold(a[i]);
+                unsigned char cb = (unsigned char)fold(b[i]);
+                if (ca != cb) {
+                    return ca < cb ? -1 : 1;
+                }
+            }
+            if (prefix && an >= bn) {
+                return 0;
+            }
+            return (an < bn) ? -1 : (an > bn ? 1 : 0);
+        }
+
+        //-----------------------------------------------------------------------------
+        // FILETIME => 2024-05-01T12:34:56Z
+        static std::string fileTimeToString(uint64_t ft)
+        {
+            if (ft < 116444736000000000ull) {
+                return "";
+            }
+            int64_t secs = (int64_t)((ft - 116444736000000000ull) / 10000000ull);
+            int64_t days = secs / 86400;
+            int64_t rem = secs % 86400;
+            // civil from days, H. Hinnant
+            days += 719468;
+            int64_t era = days / 146097;
+            int64_t doe = days - era * 146097;
+            int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+            int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+            int64_t mp = (5 * doy + 2) / 153;
+            int64_t d = doy - (153 * mp + 2) / 5 + 1;
+            int64_t m = mp < 10 ? mp + 3 : mp - 9;
+            int64_t y = yoe + era * 400 + (m <= 2);
+            char buffer[48];
+            snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02dZ",
+                (int)y, (int)m, (int)d, (int)(rem / 3600), (int)((rem / 60) % 60), (int)(rem % 60));
+            return buffer;
+        }
+
+        static uint64_t fileTimeNow()
+        {
+            return (uint64_t)time(nullptr) * 10000000ull + 116444736000000000ull;
+        }
+
+        //-----------------------------------------------------------------------------
+        // one volume's files, as produced by MftReader
+        struct VolumeFiles
+        {
+            ntfs::Volume volume;
+            std::vector<ntfs::File> files;
+        };
+
+        // 'source' is recorded so hits can name the image they came from
+        static bool write(const std::filesystem::path& path, const std::string& source, const std::vector<VolumeFiles>& volumes)
+        {
+            struct Item
+            {
+                const ntfs::File* file;
+                uint32_t volume;
+            };
+            std::vector<Item> items;
+            for (size_t v = 0; v < volumes.size(); v++)
+            {
+                for (auto& f : volumes[v].files) {
+                    items.push_back({ &f, (uint32_t)v });
+                }
+            }
+            std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+                int c = compareFolded(a.file->path.data(), a.file->path.size(), b.file->path.data(), b.file->path.size());
+                return c ? c < 0 : a.volume < b.volume;
+            });
+
+            std::vector<Entry> entries(items.size());
+            std::vector<Run> runs;
+            std::string strings;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                const ntfs::File& f = *items[i].file;
+                Entry& e = entries[i];
+                memset(&e, 0, sizeof(e));
+                e.pathOffset = (uint32_t)strings.size();
+                e.pathLength = (uint32_t)f.path.size();
+                size_t slash = f.path.find_last_of('\\');
+                e.leafOffset = (slash == std::string::npos) ? 0 : (uint32_t)(slash + 1);
+                e.volume = items[i].volume;
+                e.size = f.size;
+                e.created = f.created;
+                e.modified = f.modified;
+                e.changed = f.changed;
+                e.accessed = f.accessed;
+                e.reference = f.record | ((uint64_t)f.sequence << 48);
+                e.attributes = f.attributes | (f.directory ? _attributeDirectory : 0);
+                e.runIndex = runs.size();
+                e.runCount = (uint32_t)f.runs.size();
+                for (auto& r : f.runs) {
+                    runs.push_back({ r.vcn, r.lcn, r.clusters });
+                }
+                strings += f.path;
+                if (strings.size() > 0xFFFFFFFFull) {
+                    return false;
+                }
+            }
+            // name index
+            std::vector<uint32_t> byName(entries.size());
+            for (uint32_t i = 0; i < byName.size(); i++) {
+                byName[i] = i;
+            }
+            std::sort(byName.begin(), byName.end(), [&](uint32_t a, uint32_t b) {
+                const Entry& ea = entries[a];
+                const Entry& eb = entries[b];
+                int c = compareFolded(strings.data() + ea.pathOffset + ea.leafOffset, ea.pathLength - ea.leafOffset,
+                                      strings.data() + eb.pathOffset + eb.leafOffset, eb.pathLength - eb.leafOffset);
+                return c ? c < 0 : a < b;
+            });
+
+            Header h;
+            memset(&h, 0, sizeof(h));
+            h.magic = _magic;
+            h.version = _version;
+            h.headerSize = sizeof(Header);
+            h.volumeCount = (uint32_t)volumes.size();
+            h.entryCount = entries.size();
+            h.volumesOffset = sizeof(Header);
+            h.entriesOffset = h.volumesOffset + volumes.size() * sizeof(Volume);
+            h.nameIndexOffset = h.entriesOffset + entries.size() * sizeof(Entry);
+            h.runsOffset = h.nameIndexOffset + byName.size() * sizeof(uint32_t);
+            // keep runs 8 byte aligned
+            h.runsOffset = (h.runsOffset + 7) & ~7ull;
+            h.runCount = runs.size();
+            h.stringsOffset = h.runsOffset + runs.size() * sizeof(Run);
+            h.sourceOffset = (uint32_t)strings.size();
+            h.sourceLength = (uint32_t)source.size();
+            strings += source;
+            h.stringsSize = strings.size();
+            h.created = fileTimeNow();
+
+            std::filesystem::path tmp = path;
+            tmp += ".tmp";
+            bool ok = false;
+            {
+                std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+                os.write((const char*)&h, sizeof(h));
+                for (auto& v : volumes)
+                {
+                    Volume cv{ v.volume.offset, v.volume.length, v.volume.serial, v.volume.clusterSize, v.volume.recordSize };
+                    os.write((const char*)&cv, sizeof(cv));
+                }
+                os.write((const char*)entries.data(), (std::streamsize)(entries.size() * sizeof(Entry)));
+                os.write((const char*)byName.data(), (std::streamsize)(byName.size() * sizeof(uint32_t)));
+                static const char pad[8] = { 0 };
+                uint64_t at = h.nameIndexOffset + byName.size() * sizeof(uint32_t);
+                os.write(pad, (std::streamsize)(h.runsOffset - at));
+                os.write((const char*)runs.data(), (std::streamsize)(runs.size() * sizeof(Run)));
+                os.write(strings.data(), (std::streamsize)strings.size());
+                ok = !!os;
+            }
+            if (!ok)
+            {
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                return false;
+            }
+            return cache::commitAtomically(tmp, path);
+        }
+
+        //-----------------------------------------------------------------------------
+        // read only mapping of a whole file
+        class MappedFile
+        {
+            const BYTE* m_data = nullptr;
+            uint64_t m_size = 0;
+#ifdef _WIN32
+            HANDLE m_file = INVALID_HANDLE_VALUE;
+            HANDLE m_mapping = NULL;
+#endif
+
+        public:
+            MappedFile() {}
+            ~MappedFile() { close(); }
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            bool open(const std::filesystem::path& path)
+            {
+                close();
+#ifdef _WIN32
+                m_file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+                if (m_file == INVALID_HANDLE_VALUE) {
+                    return false;
+                }
+                LARGE_INTEGER li{ 0 };
+                if (!::GetFileSizeEx(m_file, &li) || li.QuadPart == 0) {
+                    return false;
+                }
+                m_mapping = ::CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (m_mapping == NULL) {
+                    return false;
+                }
+                m_data = (const BYTE*)::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+                m_size = (uint64_t)li.QuadPart;
+#else
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                    return false;
+                }
+                struct stat st;
+                if (::fstat(fd, &st) == 0 && st.st_size > 0)
+                {
+                    void* p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                    if (p != MAP_FAILED)
+                    {
+                        m_data = (const BYTE*)p;
+                        m_size = (uint64_t)st.st_size;
+                    }
+                }
+                ::close(fd);
+#endif
+                return m_data != nullptr;
+            }
+
+            void close()
+            {
+#ifdef _WIN32
+                if (m_data) {
+                    ::UnmapViewOfFile(m_data);
+                }
+                if (m_mapping) {
+                    ::CloseHandle(m_mapping);
+                }
+                if (m_file != INVALID_HANDLE_VALUE) {
+                    ::CloseHandle(m_file);
+                }
+                m_mapping = NULL;
+                m_file = INVALID_HANDLE_VALUE;
+#else
+                if (m_data) {
+                    ::munmap((void*)m_data, (size_t)m_size);
+                }
+#endif
+                m_data = nullptr;
+                m_size = 0;
+            }
+
+            const BYTE* data() const { return m_data; }
+            uint64_t size() const { return m_size; }
+        };
+
+        //-----------------------------------------------------------------------------
+        // what to look for. "\path\to\file" (or with '/') matches full paths,
+        // anything else file names. a trailing '*' makes it a prefix match.
+        struct Query
+        {
+            bool byPath = false;
+            bool prefix = false;
+            std::string text;
+
+            explicit Query(const std::string& pattern)
+            {
+                text = pattern;
+                byPath = text.find_first_of("\\/") != std::string::npos;
+                if (!text.empty() && text.back() == '*')
+                {
+                    prefix = true;
+                    text.pop_back();
+                }
+                if (byPath && !text.empty() && text[0] != '\\' && text[0] != '/') {
+                    text.insert(text.begin(), '\\');
+                }
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        class Catalog
+        {
+            MappedFile m_map;
+            const Header* m_header = nullptr;
+            const Volume* m_volumes = nullptr;
+            const Entry* m_entries = nullptr;
+            const uint32_t* m_byName = nullptr;
+            const Run* m_runs = nullptr;
+            const char* m_strings = nullptr;
+
+            const char* leafOf(const Entry& e) const { return m_strings + e.pathOffset + e.leafOffset; }
+            size_t leafLength(const Entry& e) const { return e.pathLength - e.leafOffset; }
+
+        public:
+
+            // false if not a catalog or truncated
+            bool open(const std::filesystem::path& path)
+            {
+                if (!m_map.open(path) || m_map.size() < sizeof(Header)) {
+                    return false;
+                }
+                const BYTE* base = m_map.data();
+                const Header* h = (const Header*)base;
+                // 'count' items of 'unit' bytes at 'offset', without wrapping
+                uint64_t size = m_map.size();
+                auto fits = [size](uint64_t offset, uint64_t count, uint64_t unit) {
+                    return offset <= size && count <= (size - offset) / unit;
+                };
+                if (h->magic != _magic || h->version != _version
+                    || !fits(h->volumesOffset, h->volumeCount, sizeof(Volume))
+                    || !fits(h->entriesOffset, h->entryCount, sizeof(Entry))
+                    || !fits(h->nameIndexOffset, h->entryCount, sizeof(uint32_t))
+                    || !fits(h->runsOffset, h->runCount, sizeof(Run))
+                    || !fits(h->stringsOffset, h->stringsSize, 1)
+                    || (uint64_t)h->sourceOffset + h->sourceLength > h->stringsSize) {
+                    return false;
+                }
+                // and every entry within them, once, so lookups need not check
+                const Entry* entries = (const Entry*)(base + h->entriesOffset);
+                const uint32_t* byName = (const uint32_t*)(base + h->nameIndexOffset);
+                for (uint64_t i = 0; i < h->entryCount; i++)
+                {
+                    const Entry& e = entries[i];
+                    if ((uint64_t)e.pathOffset + e.pathLength > h->stringsSize || e.leafOffset > e.pathLength
+                        || e.volume >= h->volumeCount
+                        || e.runIndex > h->runCount || e.runCount > h->runCount - e.runIndex
+                        || byName[i] >= h->entryCount) {
+                        return false;
+                    }
+                }
+                m_header = h;
+                m_volumes = (const Volume*)(base + h->volumesOffset);
+                m_entries = entries;
+                m_byName = byName;
+                m_runs = (const Run*)(base + h->runsOffset);
+                m_strings = (const char*)(base + h->stringsOffset);
+                return true;
+            }
+
+            const Header& header() const { return *m_header; }
+            size_t size() const { return (size_t)m_header->entryCount; }
+            const Entry& entry(size_t i) const { return m_entries[i]; }
+            const Volume& volume(const Entry& e) const { return m_volumes[e.volume]; }
+            const Run* runs(const Entry& e) const { return m_runs + e.runIndex; }
+            std::string path(const Entry& e) const { return std::string(m_strings + e.pathOffset, e.pathLength); }
+            std::string source() const { return std::string(m_strings + m_header->sourceOffset, m_header->sourceLength); }
+
+            //-----------------------------------------------------------------------------
+            // calls f(const Entry&) for every match. returns the match count
+            template <typename F>
+            size_t find(const Query& q, F f) const
+            {
+                const char* t = q.text.data();
+                size_t tn = q.text.size();
+                size_t n = size();
+                size_t count = 0;
+                if (q.byPath)
+                {
+                    const Entry* first = std::lower_bound(m_entries, m_entries + n, q, [&](const Entry& e, const Query&) {
+                        return compareFolded(m_strings + e.pathOffset, e.pathLength, t, tn) < 0;
+                    });
+                    for (const Entry* e = first; e < m_entries + n; e++)
+                    {
+                        if (compareFolded(m_strings + e->pathOffset, e->pathLength, t, tn, q.prefix) != 0) {
+                            break;
+                        }
+                        f(*e);
+                        count++;
+                    }
+                }
+                else
+                {
+                    const uint32_t* first = std::lower_bound(m_byName, m_byName + n, q, [&](uint32_t i, const Query&) {
+                        const Entry& e = m_entries[i];
+                        return compareFolded(leafOf(e), leafLength(e), t, tn) < 0;
+                    });
+                    for (const uint32_t* i = first; i < m_byName + n; i++)
+                    {
+                        const Entry& e = m_entries[*i];
+                        if (compareFolded(leafOf(e), leafLength(e), t, tn, q.prefix) != 0) {
+                            break;
+                        }
+                        f(e);
+                        count++;
+                    }
+                }
+                return count;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // 'paths' are catalogs or directories of them. calls f(const Catalog&, const Entry&)
+        // for each match. each catalog is mapped only for the duration of its search.
+        template <typename F>
+        static size_t query(const std::vector<std::filesystem::path>& paths, const std::string& pattern, F f)
+        {
+            Query q(pattern);
+            size_t count = 0;
+            std::error_code ec;
+            for (auto& path : paths)
+            {
+                if (std::filesystem::is_directory(path, ec))
+                {
+                    std::vector<std::filesystem::path> children;
+                    for (auto& entry : std::filesystem::directory_iterator(path, ec))
+                    {
+                        if (entry.is_regular_file(ec)) {
+                            children.push_back(entry.path());
+                        }
+                    }
+                    std::sort(children.begin(), children.end());
+                    count += query(children, pattern, f);
+                    continue;
+                }
+                Catalog c;
+                if (!c.open(path)) {
+                    DBMSG2("Not a catalog: " << path.wstring());
+                    continue;
+                }
+                count += c.find(q, [&](const Entry& e) { f(c, e); });
+            }
+            return count;
+        }
+
+        //-----------------------------------------------------------------------------
+        // command line patterns and image names into the catalog's UTF-8
+        static std::string utf8(const std::wstring& s)
+        {
+            std::string ret;
+            for (size_t i = 0; i < s.size(); i++)
+            {
+                uint32_t c = (uint32_t)s[i];
+                if (c >= 0xD800 && c <= 0xDBFF && i + 1 < s.size())
+                {
+                    uint32_t lo = (uint32_t)s[i + 1];
+                    if (lo >= 0xDC00 && lo <= 0xDFFF)
+                    {
+                        c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+                        i++;
+                    }
+                }
+                if (c < 0x80) {
+                    ret.push_back((char)c);
+                }
+                else if (c < 0x800)
+                {
+                    ret.push_back((char)(0xC0 | (c >> 6)));
+                    ret.push_back((char)(0x80 | (c & 0x3F)));
+                }
+                else if (c < 0x10000)
+                {
+                    ret.push_back((char)(0xE0 | (c >> 12)));
+                    ret.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+                    ret.push_back((char)(0x80 | (c & 0x3F)));
+                }
+                else
+                {
+                    ret.push_back((char)(0xF0 | (c >> 18)));
+                    ret.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+                    ret.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+                    ret.push_back((char)(0x80 | (c & 0x3F)));
+                }
+            }
+            return ret;
+        }
+
+        //-----------------------------------------------------------------------------
+        // index every NTFS volume on 'source' into 'catalogPath'. returns the file count.
+        static size_t build(blk::BlockSource& source, const std::string& sourceName, const std::filesystem::path& catalogPath)
+        {
+            std::vector<VolumeFiles> volumes;
+            size_t files = 0;
+            for (auto& v : ntfs::findVolumes(source))
+            {
+                ntfs::MftReader reader(source, v.offset, v.length);
+                if (!reader.open()) {
+                    DBMSG("Unable to read $MFT of volume at " << v.offset);
+                    continue;
+                }
+                VolumeFiles vf;
+                vf.volume = reader.volume();
+                vf.files = reader.files();
+                DBMSG2("Volume at " << v.offset << ": " << vf.files.size() << " files");
+                files += vf.files.size();
+                volumes.push_back(std::move(vf));
+            }
+            nv2::throw_if(volumes.empty(), nv2::acc("No NTFS volumes found on ") << sourceName);
+            nv2::throw_if(!write(catalogPath, sourceName, volumes), nv2::acc("Unable to write ") << catalogPath.wstring());
+            return files;
+        }
+    }
+}
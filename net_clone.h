@@ -0,0 +1,864 @@
+/*
+
+    Stream a disk to a remote receiver over TCP.
+
+    The sender reads the disk front to back and sends each block that is
+    not all zero as a frame on a single connection. Frames follow each
+    other without waiting for the receiver; it answers once, after the
+    last frame, when the image is complete. Blocks may be compressed
+    with LZNT1 and may carry a CRC32C of their contents.
+
+    Both ends overlap their work: the sender reads, encodes and sends on
+    separate threads, the receiver receives, decodes and writes, so the
+    link rather than either disk sets the pace. The receiver writes the
+    image in any format img::create knows; nothing is staged locally.
+
+    stream:  hello (64), then frames of a 32 byte header and a payload,
+             then an end frame. the receiver replies (64) to the hello
+             and to the end frame, or with an error at any point.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blk_io.h"
+#include "clone_ex.h"
+#include "hash_ex.h"
+#include "img_io.h"
+#include "img_write.h"
+#include "lznt1.h"
+#include "metrics_ex.h"
+
+namespace wde2
+{
+    namespace net
+    {
+        static const uint32_t _streamVersion = 1;
+        static const size_t _helloSize = 64;
+        static const size_t _frameSize = 32;
+        static const size_t _replySize = 64;
+        static const uint32_t _maxBlockSize = 16 * 1024 * 1024;
+        // hello flags
+        static const uint32_t _streamLznt1 = 1;
+        static const uint32_t _streamCrc32c = 2;
+        // frame types
+        static const uint32_t _frameData = 1;
+        static const uint32_t _frameEnd = 2;
+        // payload encodings
+        static const uint32_t _encodingRaw = 0;
+        static const uint32_t _encodingLznt1 = 1;
+
+#ifdef _WIN32
+        typedef SOCKET socket_t;
+        static const socket_t _invalidSocket = INVALID_SOCKET;
+#else
+        typedef int socket_t;
+        static const socket_t _invalidSocket = -1;
+#endif
+
+        //-----------------------------------------------------------------------------
+        // "host:port", "[v6 address]:port", or just "port" for any local address
+        static bool splitAddress(const std::string& address, std::string& host, std::string& port)
+        {
+            host.clear();
+            port = address;
+            if (address.size() && address[0] == '[')
+            {
+                size_t close = address.find("]:");
+                if (close == std::string::npos) {
+                    return false;
+                }
+                host = address.substr(1, close - 1);
+                port = address.substr(close + 2);
+            }
+            else
+            {
+                size_t colon = address.rfind(':');
+                if (colon != std::string::npos)
+                {
+                    host = address.substr(0, colon);
+                    port = address.substr(colon + 1);
+                }
+            }
+            return !port.empty() && port.find_first_not_of("0123456789") == std::string::npos;
+        }
+
+        //-----------------------------------------------------------------------------
+        // blocking TCP socket, closed on destruction
+        class Socket
+        {
+            socket_t m_socket = _invalidSocket;
+
+            static bool startup()
+            {
+#ifdef _WIN32
+                static const bool started = []() {
+                    WSADATA data;
+                    return ::WSAStartup(MAKEWORD(2, 2), &data) == 0;
+                }();
+                return started;
+#else
+                return true;
+#endif
+            }
+
+            // large buffers keep a fast link busy across scheduling gaps
+            void tune()
+            {
+                int size = 8 * 1024 * 1024;
+                ::setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, (const char*)&size, sizeof(size));
+                ::setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, (const char*)&size, sizeof(size));
+            }
+
+            static addrinfo* resolve(const std::string& address, bool passive)
+            {
+                std::string host, port;
+                if (!startup() || !splitAddress(address, host, port)) {
+                    return nullptr;
+                }
+                addrinfo hints = {};
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_STREAM;
+                hints.ai_protocol = IPPROTO_TCP;
+                hints.ai_flags = passive ? AI_PASSIVE : 0;
+                addrinfo* found = nullptr;
+                if (::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0) {
+                    return nullptr;
+                }
+                return found;
+            }
+
+        public:
+            Socket() {}
+            explicit Socket(socket_t s) : m_socket(s) {}
+            Socket(Socket&& other) noexcept : m_socket(other.m_socket) { other.m_socket = _invalidSocket; }
+            Socket& operator=(Socket&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    close();
+                    m_socket = other.m_socket;
+                    other.m_socket = _invalidSocket;
+                }
+                return *this;
+            }
+            Socket(const Socket&) = delete;
+            Socket& operator=(const Socket&) = delete;
+            ~Socket() { close(); }
+
+            explicit operator bool() const { return m_socket != _invalidSocket; }
+
+            void close()
+            {
+                if (m_socket != _invalidSocket)
+                {
+#ifdef _WIN32
+                    ::closesocket(m_socket);
+#else
+                    ::close(m_socket);
+#endif
+                    m_socket = _invalidSocket;
+                }
+            }
+
+            // invalid on failure
+            static Socket connect(const std::string& address)
+            {
+                addrinfo* found = resolve(address, false);
+                Socket s;
+                for (addrinfo* a = found; a && !s; a = a->ai_next)
+                {
+                    s = Socket(::socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+                    if (!s) {
+                        continue;
+                    }
+                    s.tune();
+                    if (::connect(s.m_socket, a->ai_addr, (int)a->ai_addrlen) != 0) {
+                        s.close();
+                    }
+                }
+                if (found) {
+                    ::freeaddrinfo(found);
+                }
+                return s;
+            }
+
+            static Socket listen(const std::string& address)
+            {
+                addrinfo* found = resolve(address, true);
+                Socket s;
+                for (addrinfo* a = found; a && !s; a = a->ai_next)
+                {
+                    s = Socket(::socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+                    if (!s) {
+                        continue;
+                    }
+#ifndef _WIN32
+                    // a receiver restarted straight away must not wait for TIME_WAIT
+                    int on = 1;
+                    ::setsockopt(s.m_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#endif
+                    s.tune();
+                    if (::bind(s.m_socket, a->ai_addr, (int)a->ai_addrlen) != 0 || ::listen(s.m_socket, 1) != 0) {
+                        s.close();
+                    }
+                }
+                if (found) {
+                    ::freeaddrinfo(found);
+                }
+                return s;
+            }
+
+            // the accepted socket inherits the buffer sizes of the listener
+            Socket accept()
+            {
+                return Socket(::accept(m_socket, nullptr, nullptr));
+            }
+
+            bool sendAll(const void* data, size_t length)
+            {
+                const char* p = (const char*)data;
+                while (length)
+                {
+                    int n = (int)(std::min)(length, (size_t)1 << 30);
+#ifdef _WIN32
+                    int sent = ::send(m_socket, p, n, 0);
+#else
+                    int sent = (int)::send(m_socket, p, n, MSG_NOSIGNAL);
+#endif
+                    if (sent <= 0) {
+                        return false;
+                    }
+                    p += sent;
+                    length -= sent;
+                }
+                return true;
+            }
+
+            // a receive that waits longer fails
+            void timeout(unsigned ms)
+            {
+#ifdef _WIN32
+                DWORD t = ms;
+#else
+                timeval t = { (time_t)(ms / 1000), (suseconds_t)((ms % 1000) * 1000) };
+#endif
+                ::setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&t, sizeof(t));
+            }
+
+            // what has arrived, up to 'length'. 0 once the peer has closed
+            int recvSome(void* data, size_t length)
+            {
+                return (int)::recv(m_socket, (char*)data, (int)(std::min)(length, (size_t)1 << 30), 0);
+            }
+
+            // false if the peer closed the connection first
+            bool recvAll(void* data, size_t length)
+            {
+                char* p = (char*)data;
+                while (length)
+                {
+                    int n = (int)(std::min)(length, (size_t)1 << 30);
+                    int got = (int)::recv(m_socket, p, n, 0);
+                    if (got <= 0) {
+                        return false;
+                    }
+                    p += got;
+                    length -= got;
+                }
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        struct StreamOptions
+        {
+            uint32_t blockSize = 1024 * 1024;
+            bool compress = false;
+            bool checksum = false;
+            // batches queued between stages
+            size_t depth = 4;
+        };
+
+        struct SendReport
+        {
+            uint64_t size = 0;
+            uint64_t bytesRead = 0;
+            // frames sent, and zero blocks that were not
+            uint64_t blocks = 0;
+            uint64_t zeroBlocks = 0;
+            // payload and headers
+            uint64_t bytesSent = 0;
+            double seconds = 0;
+        };
+
+        struct ReceiveReport
+        {
+            uint64_t size = 0;
+            img::Kind kind = img::Kind::Raw;
+            uint64_t blocks = 0;
+            uint64_t bytesReceived = 0;
+            uint64_t bytesWritten = 0;
+            bool compressed = false;
+            bool checksummed = false;
+            double seconds = 0;
+        };
+
+        //-----------------------------------------------------------------------------
+        // a block in flight. 'data' is the content, 'payload' what goes on the
+        // wire when it differs, i.e. compressed
+        struct StreamBlock
+        {
+            uint64_t offset = 0;
+            uint32_t length = 0;
+            uint32_t encoding = _encodingRaw;
+            uint32_t crc = 0;
+            std::vector<BYTE> data;
+            std::vector<BYTE> payload;
+            std::string error;
+        };
+        using StreamBatch = std::vector<StreamBlock>;
+
+        // a block per worker, as ArchiveWriter does
+        static void forEachBlock(img::Workers& workers, StreamBatch& batch, const std::function<void(StreamBlock&)>& fn)
+        {
+            workers.run(batch.size(), [&](size_t i) { fn(batch[i]); });
+        }
+
+        static size_t streamWidth()
+        {
+            return (std::max)(4u, std::thread::hardware_concurrency());
+        }
+
+        //-----------------------------------------------------------------------------
+        static bool sendReply(Socket& s, uint32_t status, uint64_t bytes, const std::string& message)
+        {
+            BYTE reply[_replySize] = { 0 };
+            memcpy(reply, "wde2rply", 8);
+            img::putLe32(reply + 8, status);
+            img::putLe64(reply + 16, bytes);
+            memcpy(reply + 24, message.c_str(), (std::min)(message.size(), _replySize - 24 - 1));
+            return s.sendAll(reply, sizeof(reply));
+        }
+
+        // false if no reply could be read; 'message' is empty on success
+        static bool readReply(Socket& s, uint64_t& bytes, std::string& message)
+        {
+            BYTE reply[_replySize] = { 0 };
+            if (!s.recvAll(reply, sizeof(reply)) || memcmp(reply, "wde2rply", 8) != 0) {
+                return false;
+            }
+            bytes = img::le64(reply + 16);
+            message.clear();
+            if (img::le32(reply + 8) != 0)
+            {
+                reply[_replySize - 1] = 0;
+                message = (const char*)reply + 24;
+                if (message.empty()) {
+                    message = "receiver failed";
+                }
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------------------
+        // the whole of 'source' to the receiver at 'address'. throws on a read,
+        // connection or receiver error, with the receiver's reason where it gave one
+        static SendReport send(blk::BlockSource& source, const std::string& address,
+                               const StreamOptions& options = StreamOptions(),
+                               const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            SendReport report;
+            report.size = source.size();
+            auto started = std::chrono::steady_clock::now();
+            DWORD ss = (std::max)(source.sectorSize(), (DWORD)512);
+            uint32_t blockSize = (std::max)((uint32_t)ss, (std::min)(options.blockSize, _maxBlockSize) / ss * ss);
+
+            Socket s = Socket::connect(address);
+            nv2::throw_if(!s, nv2::acc("Unable to connect to ") << address.c_str());
+
+            BYTE hello[_helloSize] = { 0 };
+            memcpy(hello, "wde2strm", 8);
+            img::putLe32(hello + 8, _streamVersion);
+            img::putLe32(hello + 12, (options.compress ? _streamLznt1 : 0) | (options.checksum ? _streamCrc32c : 0));
+            img::putLe64(hello + 16, report.size);
+            img::putLe32(hello + 24, ss);
+            img::putLe32(hello + 28, blockSize);
+            uint64_t bytes = 0;
+            std::string message;
+            nv2::throw_if(!s.sendAll(hello, sizeof(hello)) || !readReply(s, bytes, message),
+                          nv2::acc("No answer from ") << address.c_str());
+            nv2::throw_if(!message.empty(), nv2::acc("Receiver: ") << message.c_str());
+
+            size_t width = streamWidth();
+            img::Workers workers(width);
+            clone::BoundedQueue<StreamBatch> read(options.depth);
+            clone::BoundedQueue<StreamBatch> encoded(options.depth);
+            std::string readError;
+
+            // read, dropping zero blocks
+            std::thread reader([&]() {
+                StreamBatch batch;
+                for (uint64_t offset = 0; offset < report.size; offset += blockSize)
+                {
+                    StreamBlock b;
+                    b.offset = offset;
+                    b.length = (uint32_t)(std::min)((uint64_t)blockSize, report.size - offset);
+                    b.data.resize(b.length);
+                    metrics::Timer timer(metrics::job().readLatency);
+                    if (!source.read(offset, b.data.data(), b.length))
+                    {
+                        readError = "Source read failed at " + std::to_string(offset) + ", use -cv with -rm for a failing disk";
+                        metrics::job().readErrors.add();
+                        break;
+                    }
+                    timer.end();
+                    report.bytesRead += b.length;
+                    metrics::job().bytesRead.add(b.length);
+                    if (img::isZero(b.data.data(), b.length))
+                    {
+                        report.zeroBlocks++;
+                        metrics::job().zeroBlocks.add();
+                        continue;
+                    }
+                    batch.push_back(std::move(b));
+                    if (batch.size() == width)
+                    {
+                        if (!read.push(std::move(batch))) {
+                            break;
+                        }
+                        batch.clear();
+                    }
+                }
+                if (batch.size() && readError.empty()) {
+                    read.push(std::move(batch));
+                }
+                read.close();
+            });
+
+            // compress and checksum a batch at a time, in parallel
+            std::thread encoder([&]() {
+                StreamBatch batch;
+                while (read.pop(batch))
+                {
+                    if (options.compress || options.checksum)
+                    {
+                        forEachBlock(workers, batch, [&](StreamBlock& b) {
+                            if (options.checksum) {
+                                b.crc = hash::crc32c(b.data.data(), b.length);
+                            }
+                            if (options.compress)
+                            {
+                                b.payload.resize(ntfs::lznt1Bound(b.length));
+                                size_t n = ntfs::lznt1Compress(b.data.data(), b.length, b.payload.data());
+                                if (n && n < b.length)
+                                {
+                                    b.payload.resize(n);
+                                    b.encoding = _encodingLznt1;
+                                }
+                                else {
+                                    b.payload.clear();
+                                }
+                            }
+                        });
+                    }
+                    if (!encoded.push(std::move(batch))) {
+                        break;
+                    }
+                }
+                encoded.close();
+            });
+
+            // send. the receiver is not waited for until the end
+            std::string sendError;
+            StreamBatch batch;
+            auto reported = started;
+            while (sendError.empty() && encoded.pop(batch))
+            {
+                for (StreamBlock& b : batch)
+                {
+                    const std::vector<BYTE>& payload = (b.encoding == _encodingRaw) ? b.data : b.payload;
+                    BYTE frame[_frameSize] = { 0 };
+                    img::putLe32(frame, _frameData);
+                    img::putLe32(frame + 4, b.encoding);
+                    img::putLe64(frame + 8, b.offset);
+                    img::putLe32(frame + 16, b.length);
+                    img::putLe32(frame + 20, (uint32_t)payload.size());
+                    img::putLe32(frame + 24, b.crc);
+                    if (!s.sendAll(frame, sizeof(frame)) || !s.sendAll(payload.data(), payload.size()))
+                    {
+                        sendError = "Connection lost at " + std::to_string(b.offset);
+                        break;
+                    }
+                    report.blocks++;
+                    report.bytesSent += sizeof(frame) + payload.size();
+                    if (progress && std::chrono::steady_clock::now() - reported >= std::chrono::milliseconds(500))
+                    {
+                        progress(b.offset + b.length, report.size);
+                        reported = std::chrono::steady_clock::now();
+                    }
+                }
+            }
+            // unblocks the other stages if we stopped early
+            read.close();
+            encoded.close();
+            reader.join();
+            encoder.join();
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            // the receiver sees the connection drop without an end frame
+            nv2::throw_if(!readError.empty(), nv2::acc(readError.c_str()));
+
+            if (sendError.empty())
+            {
+                BYTE end[_frameSize] = { 0 };
+                img::putLe32(end, _frameEnd);
+                img::putLe64(end + 8, report.blocks);
+                if (!s.sendAll(end, sizeof(end))) {
+                    sendError = "Connection lost at the end";
+                }
+            }
+            // a receiver that failed says why before it hangs up
+            if (readReply(s, bytes, message)) {
+                nv2::throw_if(!message.empty(), nv2::acc("Receiver: ") << message.c_str());
+            }
+            else if (sendError.empty()) {
+                sendError = "No answer from the receiver";
+            }
+            nv2::throw_if(!sendError.empty(), nv2::acc(sendError.c_str()));
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            if (progress) {
+                progress(report.size, report.size);
+            }
+            return report;
+        }
+
+        //-----------------------------------------------------------------------------
+        // one stream from an accepted connection into 'imagePath'. throws on a
+        // stream or image error, after telling the sender
+        static ReceiveReport receive(Socket& s, const std::filesystem::path& imagePath,
+                                     const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            ReceiveReport report;
+            auto started = std::chrono::steady_clock::now();
+            auto fail = [&](const std::string& why) {
+                sendReply(s, 1, report.bytesWritten, why);
+                nv2::throw_if(true, nv2::acc(why.c_str()));
+            };
+
+            BYTE hello[_helloSize];
+            nv2::throw_if(!s.recvAll(hello, sizeof(hello)) || memcmp(hello, "wde2strm", 8) != 0,
+                          nv2::acc("Not a wde2 stream"));
+            uint32_t flags = img::le32(hello + 12);
+            uint32_t sectorSize = img::le32(hello + 24);
+            uint32_t blockSize = img::le32(hello + 28);
+            report.size = img::le64(hello + 16);
+            report.compressed = (flags & _streamLznt1) != 0;
+            report.checksummed = (flags & _streamCrc32c) != 0;
+            if (img::le32(hello + 8) != _streamVersion) {
+                fail("unsupported stream version");
+            }
+            if (report.size == 0 || blockSize == 0 || blockSize > _maxBlockSize || (sectorSize != 512 && sectorSize != 4096)) {
+                fail("bad stream header");
+            }
+            std::unique_ptr<img::ImageWriter> image = img::create(imagePath, report.size, false, sectorSize);
+            if (!image) {
+                fail("unable to create " + imagePath.u8string());
+            }
+            report.kind = image->kind();
+            metrics::job().size.set((int64_t)report.size);
+            if (!sendReply(s, 0, 0, std::string())) {
+                nv2::throw_if(true, nv2::acc("Connection lost"));
+            }
+
+            size_t width = streamWidth();
+            img::Workers workers(width);
+            clone::BoundedQueue<StreamBatch> received(4);
+            clone::BoundedQueue<StreamBatch> decoded(4);
+            std::string streamError;
+            uint64_t expected = 0;
+            bool ended = false;
+
+            std::thread receiver([&]() {
+                StreamBatch batch;
+                size_t limit = ntfs::lznt1Bound(blockSize);
+                // report.blocks belongs to the writing thread
+                uint64_t frames = 0;
+                while (true)
+                {
+                    BYTE frame[_frameSize];
+                    if (!s.recvAll(frame, sizeof(frame)))
+                    {
+                        streamError = "connection lost";
+                        break;
+                    }
+                    uint32_t type = img::le32(frame);
+                    if (type == _frameEnd)
+                    {
+                        expected = img::le64(frame + 8);
+                        ended = true;
+                        break;
+                    }
+                    StreamBlock b;
+                    b.encoding = img::le32(frame + 4);
+                    b.offset = img::le64(frame + 8);
+                    b.length = img::le32(frame + 16);
+                    uint32_t n = img::le32(frame + 20);
+                    b.crc = img::le32(frame + 24);
+                    if (type != _frameData || b.length == 0 || b.length > blockSize
+                        || b.offset > report.size || b.length > report.size - b.offset || n > limit
+                        || (b.encoding == _encodingRaw && n != b.length) || b.encoding > _encodingLznt1)
+                    {
+                        streamError = "bad frame after " + std::to_string(frames) + " blocks";
+                        break;
+                    }
+                    std::vector<BYTE>& into = (b.encoding == _encodingRaw) ? b.data : b.payload;
+                    into.resize(n);
+                    if (!s.recvAll(into.data(), n))
+                    {
+                        streamError = "connection lost";
+                        break;
+                    }
+                    frames++;
+                    report.bytesReceived += sizeof(frame) + n;
+                    metrics::job().bytesReceived.add(sizeof(frame) + n);
+                    batch.push_back(std::move(b));
+                    if (batch.size() == width)
+                    {
+                        if (!received.push(std::move(batch))) {
+                            break;
+                        }
+                        batch.clear();
+                    }
+                }
+                if (batch.size()) {
+                    received.push(std::move(batch));
+                }
+                received.close();
+            });
+
+            std::thread decoder([&]() {
+                StreamBatch batch;
+                while (received.pop(batch))
+                {
+                    forEachBlock(workers, batch, [&](StreamBlock& b) {
+                        if (b.encoding == _encodingLznt1)
+                        {
+                            b.data.resize(b.length);
+                            if (!ntfs::lznt1Decompress(b.payload.data(), b.payload.size(), b.data.data(), b.length))
+                            {
+                                b.error = "bad compressed block at " + std::to_string(b.offset);
+                                return;
+                            }
+                            b.payload = std::vector<BYTE>();
+                        }
+                        if (report.checksummed && hash::crc32c(b.data.data(), b.length) != b.crc) {
+                            b.error = "checksum mismatch at " + std::to_string(b.offset);
+                        }
+                    });
+                    if (!decoded.push(std::move(batch))) {
+                        break;
+                    }
+                }
+                decoded.close();
+            });
+
+            // an archive is written strictly in order, so the gaps are filled
+            bool sequential = (report.kind == img::Kind::Archive);
+            std::vector<BYTE> zero(sequential ? blockSize : 0);
+            uint64_t next = 0;
+            auto fillTo = [&](uint64_t offset) {
+                while (next < offset)
+                {
+                    size_t n = (size_t)(std::min)((uint64_t)zero.size(), offset - next);
+                    if (!image->write(next, zero.data(), n)) {
+                        return false;
+                    }
+                    next += n;
+                }
+                return true;
+            };
+
+            std::string writeError;
+            StreamBatch batch;
+            auto reported = started;
+            while (writeError.empty() && decoded.pop(batch))
+            {
+                metrics::job().queueDepth.set((int64_t)(received.size() + decoded.size()));
+                for (StreamBlock& b : batch)
+                {
+                    if (!b.error.empty())
+                    {
+                        writeError = b.error;
+                        break;
+                    }
+                    metrics::Timer timer(metrics::job().writeLatency);
+                    if ((sequential && (b.offset < next || !fillTo(b.offset)))
+                        || !image->write(b.offset, b.data.data(), b.length))
+                    {
+                        writeError = "write failed at " + std::to_string(b.offset);
+                        break;
+                    }
+                    timer.end();
+                    next = b.offset + b.length;
+                    report.blocks++;
+                    report.bytesWritten += b.length;
+                    metrics::job().bytesWritten.add(b.length);
+                    if (progress && std::chrono::steady_clock::now() - reported >= std::chrono::milliseconds(500))
+                    {
+                        progress(next, report.size);
+                        reported = std::chrono::steady_clock::now();
+                    }
+                }
+            }
+            // the receiver thread stops at its next push; the sender is
+            // still streaming, so that is soon
+            received.close();
+            decoded.close();
+            receiver.join();
+            decoder.join();
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+            if (!writeError.empty()) {
+                fail(writeError);
+            }
+            if (!streamError.empty()) {
+                fail(streamError);
+            }
+            if (!ended || expected != report.blocks) {
+                fail("stream ended after " + std::to_string(report.blocks) + " of " + std::to_string(expected) + " blocks");
+            }
+            if ((sequential && !fillTo(image->size())) || !image->finish()) {
+                fail("unable to complete the image");
+            }
+            image.reset();
+            sendReply(s, 0, report.bytesWritten, std::string());
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            if (progress) {
+                progress(report.size, report.size);
+            }
+            return report;
+        }
+
+        //-----------------------------------------------------------------------------
+        // serves metrics::render() to a Prometheus scrape on a loopback port.
+        // one connection at a time: a scrape every few seconds needs no more
+        class MetricsListener
+        {
+            std::string m_address;
+            Socket m_listener;
+            std::atomic<bool> m_stop{ false };
+            std::thread m_thread;
+
+            void serve(Socket& s)
+            {
+                // the request line and headers. the path is not looked at
+                std::string request;
+                char buffer[1024];
+                while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+                {
+                    int n = s.recvSome(buffer, sizeof(buffer));
+                    if (n <= 0) {
+                        return;
+                    }
+                    request.append(buffer, n);
+                }
+                std::string body = metrics::render();
+                std::string reply = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                    + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+                if (request.compare(0, 5, "HEAD ") != 0) {
+                    reply += body;
+                }
+                s.sendAll(reply.data(), reply.size());
+            }
+
+        public:
+            // false if the port can not be bound
+            bool start(const std::string& port)
+            {
+                m_address = "127.0.0.1:" + port;
+                m_listener = Socket::listen(m_address);
+                if (!m_listener) {
+                    return false;
+                }
+                m_thread = std::thread([this]() {
+                    while (!m_stop)
+                    {
+                        Socket s = m_listener.accept();
+                        if (m_stop) {
+                            break;
+                        }
+                        if (!s)
+                        {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                            continue;
+                        }
+                        // a client that says nothing must not hold up the next, or stop()
+                        s.timeout(2000);
+                        serve(s);
+                    }
+                });
+                return true;
+            }
+
+            ~MetricsListener()
+            {
+                if (m_thread.joinable())
+                {
+                    m_stop = true;
+                    // wakes accept()
+                    Socket::connect(m_address);
+                    m_thread.join();
+                }
+            }
+        };
+    }
+}
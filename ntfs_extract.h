@@ -0,0 +1,411 @@
+/*
+
+    Single file extraction from an NTFS volume on an image or disk,
+    without attaching or mounting anything.
+
+    The path is resolved through the $I30 directory indexes from the
+    root (falling back to a full $MFT scan), then the file's $DATA
+    runs are read directly: physically contiguous runs coalesce into
+    large reads, sparse runs become holes in the output, compressed
+    files are decompressed one compression unit at a time (LZNT1)
+    through a read-ahead window. Encrypted files are refused.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "blk_io.h"
+#include "log_ex.h"
+#include "lznt1.h"
+#include "ntfs_mft.h"
+
+namespace wde2
+{
+    namespace ntfs
+    {
+        //-----------------------------------------------------------------------------
+        // the unnamed $DATA of a record from MftReader::readFile()
+        class DataReader
+        {
+            MftReader& m_reader;
+            const Record& m_rec;
+            uint64_t m_cs;
+            // read-ahead over physically contiguous runs, compressed files only
+            std::vector<BYTE> m_window;
+            int64_t m_windowLcn = -1;
+            uint64_t m_windowClusters = 0;
+
+            bool readVolume(uint64_t offset, void* buffer, size_t length)
+            {
+                reads++;
+                bytesRead += length;
+                return m_reader.readVolume(offset, buffer, length);
+            }
+
+            // [vcn, vcn + count) as extents, gaps in the run list as sparse
+            void map(uint64_t vcn, uint64_t count, std::vector<Run>& pieces) const
+            {
+                pieces.clear();
+                const std::vector<Run>& runs = m_rec.runs;
+                auto it = std::upper_bound(runs.begin(), runs.end(), vcn, [](uint64_t v, const Run& r) { return v < r.vcn; });
+                if (it != runs.begin()) {
+                    --it;
+                }
+                uint64_t end = vcn + count;
+                for (; it != runs.end() && vcn < end; ++it)
+                {
+                    if (it->vcn + it->clusters <= vcn) {
+                        continue;
+                    }
+                    if (it->vcn > vcn)
+                    {
+                        Run hole;
+                        hole.vcn = vcn;
+                        hole.lcn = -1;
+                        hole.clusters = (std::min)(it->vcn, end) - vcn;
+                        pieces.push_back(hole);
+                        vcn += hole.clusters;
+                        continue;
+                    }
+                    Run piece;
+                    piece.vcn = vcn;
+                    piece.clusters = (std::min)(it->vcn + it->clusters, end) - vcn;
+                    piece.lcn = (it->lcn < 0) ? -1 : it->lcn + (int64_t)(vcn - it->vcn);
+                    pieces.push_back(piece);
+                    vcn += piece.clusters;
+                }
+                if (vcn < end)
+                {
+                    Run hole;
+                    hole.vcn = vcn;
+                    hole.lcn = -1;
+                    hole.clusters = end - vcn;
+                    pieces.push_back(hole);
+                }
+            }
+
+            // the physically contiguous stretch starting at 'lcn', in clusters
+            uint64_t stretch(int64_t lcn) const
+            {
+                const std::vector<Run>& runs = m_rec.runs;
+                for (size_t i = 0; i < runs.size(); i++)
+                {
+                    const Run& r = runs[i];
+                    if (r.lcn < 0 || lcn < r.lcn || lcn >= r.lcn + (int64_t)r.clusters) {
+                        continue;
+                    }
+                    int64_t end = r.lcn + (int64_t)r.clusters;
+                    for (size_t j = i + 1; j < runs.size(); j++)
+                    {
+                        if (runs[j].lcn < 0) {
+                            continue;
+                        }
+                        if (runs[j].lcn != end) {
+                            break;
+                        }
+                        end += (int64_t)runs[j].clusters;
+                    }
+                    return (uint64_t)(end - lcn);
+                }
+                return 0;
+            }
+
+            bool readClusters(int64_t lcn, uint64_t clusters, BYTE* buffer)
+            {
+                if (lcn < m_windowLcn || lcn + (int64_t)clusters > m_windowLcn + (int64_t)m_windowClusters)
+                {
+                    uint64_t want = (std::max)(clusters, (std::min)(stretch(lcn), (uint64_t)(chunkSize / m_cs)));
+                    m_window.resize((size_t)(want * m_cs));
+                    m_windowLcn = -1;
+                    if (!readVolume((uint64_t)lcn * m_cs, m_window.data(), m_window.size())) {
+                        return false;
+                    }
+                    m_windowLcn = lcn;
+                    m_windowClusters = want;
+                }
+                memcpy(buffer, m_window.data() + (size_t)((uint64_t)(lcn - m_windowLcn) * m_cs), (size_t)(clusters * m_cs));
+                return true;
+            }
+
+            // zero what lies past the initialized size
+            void clip(uint64_t offset, BYTE* data, size_t length) const
+            {
+                if (offset + length > m_rec.initializedSize)
+                {
+                    size_t valid = (offset < m_rec.initializedSize) ? (size_t)(m_rec.initializedSize - offset) : 0;
+                    memset(data + valid, 0, length - valid);
+                }
+            }
+
+            template <typename F>
+            bool readPlain(F& sink)
+            {
+                const std::vector<Run>& runs = m_rec.runs;
+                uint64_t size = m_rec.dataSize;
+                std::vector<BYTE> buffer;
+                for (size_t i = 0; i < runs.size();)
+                {
+                    const Run& r = runs[i];
+                    uint64_t start = r.vcn * m_cs;
+                    if (start >= size) {
+                        break;
+                    }
+                    if (r.lcn < 0) {
+                        i++;
+                        continue;
+                    }
+                    // coalesce runs contiguous both in the file and on disk
+                    uint64_t clusters = r.clusters;
+                    size_t j = i + 1;
+                    while (j < runs.size() && runs[j].lcn >= 0
+                        && runs[j].vcn == r.vcn + clusters && runs[j].lcn == r.lcn + (int64_t)clusters)
+                    {
+                        clusters += runs[j].clusters;
+                        j++;
+                    }
+                    uint64_t end = (std::min)(start + clusters * m_cs, size);
+                    for (uint64_t o = start; o < end;)
+                    {
+                        size_t n = (size_t)(std::min)((uint64_t)chunkSize, end - o);
+                        // whole clusters, devices want whole sectors
+                        size_t aligned = (size_t)((n + m_cs - 1) / m_cs * m_cs);
+                        buffer.resize(aligned);
+                        if (!readVolume((uint64_t)r.lcn * m_cs + (o - start), buffer.data(), aligned)) {
+                            return false;
+                        }
+                        clip(o, buffer.data(), n);
+                        if (!sink(o, buffer.data(), n)) {
+                            return false;
+                        }
+                        o += n;
+                    }
+                    i = j;
+                }
+                return true;
+            }
+
+            template <typename F>
+            bool readCompressed(F& sink)
+            {
+                uint64_t unitClusters = 1ull << m_rec.compressionUnit;
+                size_t unitBytes = (size_t)(unitClusters * m_cs);
+                uint64_t size = m_rec.dataSize;
+                std::vector<BYTE> unit(unitBytes);
+                std::vector<BYTE> packed(unitBytes);
+                std::vector<Run> pieces;
+                for (uint64_t vcn = 0; vcn * m_cs < size; vcn += unitClusters)
+                {
+                    uint64_t offset = vcn * m_cs;
+                    size_t n = (size_t)(std::min)((uint64_t)unitBytes, size - offset);
+                    map(vcn, unitClusters, pieces);
+                    uint64_t allocated = 0;
+                    for (auto& piece : pieces) {
+                        allocated += (piece.lcn < 0) ? 0 : piece.clusters;
+                    }
+                    // a fully sparse unit is a hole
+                    if (allocated == 0) {
+                        continue;
+                    }
+                    // a full unit was stored as is, a partial one is compressed
+                    BYTE* target = (allocated == unitClusters) ? unit.data() : packed.data();
+                    size_t at = 0;
+                    for (auto& piece : pieces)
+                    {
+                        if (piece.lcn < 0) {
+                            continue;
+                        }
+                        if (!readClusters(piece.lcn, piece.clusters, target + at)) {
+                            return false;
+                        }
+                        at += (size_t)(piece.clusters * m_cs);
+                    }
+                    if (target == packed.data())
+                    {
+                        std::fill(unit.begin(), unit.end(), 0);
+                        if (!lznt1Decompress(packed.data(), at, unit.data(), unitBytes)) {
+                            LOG_WARN("Corrupt compression unit at VCN " << vcn);
+                            return false;
+                        }
+                    }
+                    clip(offset, unit.data(), n);
+                    if (!sink(offset, unit.data(), n)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        public:
+
+            // largest single read
+            size_t chunkSize = 8 * 1024 * 1024;
+            uint64_t reads = 0;
+            uint64_t bytesRead = 0;
+
+            DataReader(MftReader& reader, const Record& rec)
+                : m_reader(reader), m_rec(rec), m_cs(reader.volume().clusterSize)
+            {
+            }
+
+            bool compressed() const { return m_rec.compressionUnit != 0 && !m_rec.dataResident; }
+            bool sparse() const { return (m_rec.dataFlags & _flagSparse) != 0; }
+
+            // calls sink(uint64_t offset, const BYTE* data, size_t length) in
+            // ascending offset order, holes skipped. false on error, or if the
+            // sink returns false.
+            template <typename F>
+            bool read(F sink)
+            {
+                if (m_rec.dataFlags & _flagEncrypted) {
+                    DBMSG("Encrypted (EFS) data cannot be read offline");
+                    return false;
+                }
+                if (m_rec.dataResident) {
+                    return m_rec.residentData.empty() || sink(0, m_rec.residentData.data(), m_rec.residentData.size());
+                }
+                return compressed() ? readCompressed(sink) : readPlain(sink);
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        struct ExtractReport
+        {
+            // 1 based, as findVolumes() orders them
+            unsigned volume = 0;
+            uint64_t record = 0;
+            uint64_t size = 0;
+            bool compressed = false;
+            bool sparse = false;
+            // through the directory indexes, or by a full $MFT scan
+            bool indexed = false;
+            // all I/O, $MFT included
+            uint64_t reads = 0;
+            uint64_t bytesRead = 0;
+        };
+
+        // "2:\path" selects the second NTFS volume, "C:\path" just drops the letter
+        static unsigned splitVolume(std::string& path)
+        {
+            size_t colon = path.find(':');
+            if (colon == std::string::npos || colon == 0) {
+                return 0;
+            }
+            std::string head = path.substr(0, colon);
+            unsigned volume = 0;
+            if (std::all_of(head.begin(), head.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                volume = (unsigned)std::stoul(head);
+            }
+            else if (head.size() != 1) {
+                return 0;
+            }
+            path.erase(0, colon + 1);
+            return volume;
+        }
+
+        //-----------------------------------------------------------------------------
+        // 'path' (optionally "N:\...") from 'source' into 'out'. holes in the
+        // file stay holes where the output file system allows. throws on failure.
+        static ExtractReport extract(blk::BlockSource& source, std::string path, const std::filesystem::path& out)
+        {
+            ExtractReport report;
+            blk::CountingSource counting(source);
+            unsigned wanted = splitVolume(path);
+            std::vector<Volume> volumes = findVolumes(counting);
+            nv2::throw_if(volumes.empty(), nv2::acc("No NTFS volumes found"));
+            nv2::throw_if(wanted > volumes.size(), nv2::acc("No NTFS volume ") << wanted << " (" << volumes.size() << " found)");
+            for (unsigned v = 1; v <= volumes.size(); v++)
+            {
+                if (wanted && v != wanted) {
+                    continue;
+                }
+                MftReader reader(counting, volumes[v - 1].offset, volumes[v - 1].length);
+                if (!reader.open()) {
+                    continue;
+                }
+                uint64_t ref = 0;
+                Record rec;
+                report.indexed = reader.resolve(path, ref, rec);
+                if (!report.indexed)
+                {
+                    // index in an extension record, or a non-ASCII case mismatch
+                    std::string wantedPath = path;
+                    std::replace(wantedPath.begin(), wantedPath.end(), '/', '\\');
+                    if (wantedPath.empty() || wantedPath[0] != '\\') {
+                        wantedPath.insert(wantedPath.begin(), '\\');
+                    }
+                    bool found = false;
+                    for (auto& f : reader.files())
+                    {
+                        if (sameName(f.path, wantedPath))
+                        {
+                            ref = f.record | ((uint64_t)f.sequence << 48);
+                            found = reader.readFile(ref, rec);
+                            break;
+                        }
+                    }
+                    if (!found) {
+                        continue;
+                    }
+                }
+                nv2::throw_if(rec.directory, nv2::acc("Is a directory: ") << path);
+                DataReader data(reader, rec);
+                std::ofstream os(out, std::ios::binary | std::ios::trunc);
+                nv2::throw_if(!os, nv2::acc("Unable to create ") << out.wstring());
+                bool ok = data.read([&](uint64_t offset, const BYTE* p, size_t n) {
+                    os.seekp((std::streamoff)offset);
+                    os.write((const char*)p, (std::streamsize)n);
+                    return (bool)os;
+                });
+                os.close();
+                nv2::throw_if(!ok || !os, nv2::acc("Unable to extract ") << path);
+                // trailing hole
+                std::error_code ec;
+                std::filesystem::resize_file(out, rec.dataSize, ec);
+                report.volume = v;
+                report.record = refRecord(ref);
+                report.size = rec.dataSize;
+                report.compressed = data.compressed();
+                report.sparse = data.sparse();
+                report.reads = counting.reads;
+                report.bytesRead = counting.bytes;
+                return report;
+            }
+            nv2::throw_if(true, nv2::acc("Not found: ") << path);
+            return report;
+        }
+    }
+}
@@ -0,0 +1,908 @@
+/*
+
+    Offline NTFS $MFT reader.
+
+    Decodes the boot sector of an NTFS volume found on any
+    blk::BlockSource, locates the $MFT through its own $DATA runs
+    (following $ATTRIBUTE_LIST if the MFT is fragmented) and
+    decodes every FILE record in parallel. The MFT is split into
+    large contiguous chunks which worker threads claim in order,
+    so the device still sees near sequential reads.
+
+    Produces one File per name (hard links give several), with
+    the full path, $STANDARD_INFORMATION times and attributes, the
+    unnamed $DATA size and its data runs.
+
+    Single files can also be looked up by path through the $I30
+    directory indexes and read back, a handful of I/Os instead of
+    the whole MFT (see ntfs_extract.h).
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blk_io.h"
+#include "pt_raw.h"
+
+namespace wde2
+{
+    namespace ntfs
+    {
+        using pt::le16;
+        using pt::le32;
+        using pt::le64;
+
+        // attribute types we use
+        static const uint32_t _attrStandardInformation = 0x10;
+        static const uint32_t _attrAttributeList = 0x20;
+        static const uint32_t _attrFileName = 0x30;
+        static const uint32_t _attrData = 0x80;
+        static const uint32_t _attrIndexRoot = 0x90;
+        static const uint32_t _attrIndexAllocation = 0xA0;
+        static const uint32_t _attrEnd = 0xFFFFFFFF;
+
+        // well known records
+        static const uint64_t _recordMft = 0;
+        static const uint64_t _recordRoot = 5;
+
+        // 48 bit record number of a file reference
+        // attribute header flags
+        static const uint16_t _flagCompressed = 0x0001;
+        static const uint16_t _flagEncrypted = 0x4000;
+        static const uint16_t _flagSparse = 0x8000;
+
+        static inline uint64_t refRecord(uint64_t ref) { return ref & 0x0000FFFFFFFFFFFFull; }
+        static inline uint16_t refSequence(uint64_t ref) { return (uint16_t)(ref >> 48); }
+
+        //-----------------------------------------------------------------------------
+        // one extent. lcn < 0 => sparse
+        struct Run
+        {
+            uint64_t vcn = 0;
+            int64_t lcn = 0;
+            uint64_t clusters = 0;
+        };
+
+        // mapping pairs. false if malformed.
+        static bool decodeRuns(const BYTE* p, const BYTE* end, uint64_t startVcn, std::vector<Run>& runs)
+        {
+            uint64_t vcn = startVcn;
+            int64_t lcn = 0;
+            while (p < end && *p)
+            {
+                int lengthBytes = *p & 0x0F;
+                int offsetBytes = *p >> 4;
+                p++;
+                if (lengthBytes == 0 || lengthBytes > 8 || offsetBytes > 8 || p + lengthBytes + offsetBytes > end) {
+                    return false;
+                }
+                uint64_t length = 0;
+                for (int i = 0; i < lengthBytes; i++) {
+                    length |= (uint64_t)p[i] << (8 * i);
+                }
+                p += lengthBytes;
+                Run run;
+                run.vcn = vcn;
+                run.clusters = length;
+                if (offsetBytes == 0) {
+                    run.lcn = -1;
+                }
+                else
+                {
+                    // signed, relative to the previous run
+                    int64_t delta = 0;
+                    for (int i = 0; i < offsetBytes; i++) {
+                        delta |= (int64_t)p[i] << (8 * i);
+                    }
+                    if (p[offsetBytes - 1] & 0x80) {
+                        delta |= -((int64_t)1 << (8 * offsetBytes));
+                    }
+                    lcn += delta;
+                    run.lcn = lcn;
+                }
+                p += offsetBytes;
+                runs.push_back(run);
+                vcn += length;
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------------------
+        struct Volume
+        {
+            // of the volume on its source
+            uint64_t offset = 0;
+            uint64_t length = 0;
+            DWORD bytesPerSector = 0;
+            DWORD clusterSize = 0;
+            DWORD recordSize = 0;
+            uint64_t mftLcn = 0;
+            uint64_t serial = 0;
+        };
+
+        // boot sector at the start of the volume
+        static bool decodeBoot(const BYTE* b, Volume& v)
+        {
+            if (memcmp(b + 3, "NTFS    ", 8) != 0) {
+                return false;
+            }
+            v.bytesPerSector = le16(b + 0x0B);
+            BYTE spc = b[0x0D];
+            int8_t cpr = (int8_t)b[0x40];
+            // > 0x80 => 2^(256-n) sectors, for clusters beyond 64KB. a shift
+            // that large is not a volume anyway
+            if ((spc > 0x80 && 256 - spc >= 32) || (cpr < 0 && -cpr >= 32)) {
+                return false;
+            }
+            uint64_t sectorsPerCluster = (spc > 0x80) ? (1ull << (256 - spc)) : spc;
+            uint64_t clusterSize = v.bytesPerSector * sectorsPerCluster;
+            uint64_t recordSize = (cpr < 0) ? (1ull << (-cpr)) : (uint64_t)cpr * clusterSize;
+            v.clusterSize = (DWORD)clusterSize;
+            v.recordSize = (DWORD)recordSize;
+            v.mftLcn = le64(b + 0x30);
+            v.serial = le64(b + 0x48);
+            return v.bytesPerSector >= 256 && v.bytesPerSector <= 4096
+                && clusterSize >= v.bytesPerSector && clusterSize <= 0x80000000ull
+                && recordSize >= 256 && recordSize <= 65536;
+        }
+
+        //-----------------------------------------------------------------------------
+        // multi-sector transfer protection works in 512 byte strides
+        // whatever the sector size, as per ntfs-3g's NTFS_BLOCK_SIZE
+        static const DWORD _fixupStride = 512;
+
+        // 'FILE' record or 'INDX' block: check the signature and undo the update sequence fixups
+        static bool applyFixups(BYTE* r, DWORD recordSize, DWORD stride = _fixupStride, const char* signature = "FILE")
+        {
+            if (memcmp(r, signature, 4) != 0) {
+                return false;
+            }
+            uint16_t usaOffset = le16(r + 0x04);
+            uint16_t usaCount = le16(r + 0x06);
+            if (usaCount == 0 || usaOffset + usaCount * 2u > recordSize || (usaCount - 1u) * stride > recordSize) {
+                return false;
+            }
+            const BYTE* usa = r + usaOffset;
+            for (uint16_t i = 1; i < usaCount; i++)
+            {
+                BYTE* tail = r + i * stride - 2;
+                // torn write
+                if (tail[0] != usa[0] || tail[1] != usa[1]) {
+                    return false;
+                }
+                tail[0] = usa[i * 2];
+                tail[1] = usa[i * 2 + 1];
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------------------
+        static std::string utf8(const BYTE* utf16le, size_t units)
+        {
+            std::string s;
+            s.reserve(units);
+            for (size_t i = 0; i < units; i++)
+            {
+                uint32_t c = le16(utf16le + i * 2);
+                if (c >= 0xD800 && c <= 0xDBFF && i + 1 < units)
+                {
+                    uint32_t lo = le16(utf16le + (i + 1) * 2);
+                    if (lo >= 0xDC00 && lo <= 0xDFFF)
+                    {
+                        c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+                        i++;
+                    }
+                }
+                if (c < 0x80) {
+                    s += (char)c;
+                }
+                else if (c < 0x800)
+                {
+                    s += (char)(0xC0 | (c >> 6));
+                    s += (char)(0x80 | (c & 0x3F));
+                }
+                else if (c < 0x10000)
+                {
+                    s += (char)(0xE0 | (c >> 12));
+                    s += (char)(0x80 | ((c >> 6) & 0x3F));
+                    s += (char)(0x80 | (c & 0x3F));
+                }
+                else
+                {
+                    s += (char)(0xF0 | (c >> 18));
+                    s += (char)(0x80 | ((c >> 12) & 0x3F));
+                    s += (char)(0x80 | ((c >> 6) & 0x3F));
+                    s += (char)(0x80 | (c & 0x3F));
+                }
+            }
+            return s;
+        }
+
+        //-----------------------------------------------------------------------------
+        // decoded FILE record. extension records carry attributes of their base.
+        struct Record
+        {
+            bool inUse = false;
+            bool directory = false;
+            uint16_t sequence = 0;
+            // 0 for a base record
+            uint64_t baseRef = 0;
+            // $STANDARD_INFORMATION
+            uint64_t created = 0;
+            uint64_t modified = 0;
+            uint64_t changed = 0;
+            uint64_t accessed = 0;
+            uint32_t attributes = 0;
+            // $FILE_NAME, DOS-only names dropped
+            struct Name
+            {
+                uint64_t parentRef = 0;
+                std::string name;
+            };
+            std::vector<Name> names;
+            // unnamed $DATA
+            bool hasData = false;
+            bool dataResident = false;
+            uint64_t dataSize = 0;
+            // beyond this $DATA reads as zero
+            uint64_t initializedSize = 0;
+            // _flagCompressed etc.
+            uint16_t dataFlags = 0;
+            // log2 clusters per compression unit, 0 if not compressed
+            BYTE compressionUnit = 0;
+            std::vector<Run> runs;
+            // decodeRecord(..., true) only: resident $DATA and the $I30 index
+            std::vector<BYTE> residentData;
+            std::vector<BYTE> indexRoot;
+            std::vector<Run> indexRuns;
+            // $ATTRIBUTE_LIST, only kept for the $MFT itself
+            std::vector<uint64_t> dataExtensions;
+        };
+
+        static void decodeAttributeList(const BYTE* p, size_t length, std::vector<uint64_t>& refs)
+        {
+            size_t pos = 0;
+            while (pos + 0x1A <= length)
+            {
+                uint32_t type = le32(p + pos);
+                uint16_t entryLength = le16(p + pos + 4);
+                if (entryLength < 0x1A) {
+                    break;
+                }
+                if (type == _attrData && p[pos + 6] == 0) {
+                    refs.push_back(refRecord(le64(p + pos + 0x10)));
+                }
+                pos += entryLength;
+            }
+        }
+
+        static bool isI30(const BYTE* a)
+        {
+            static const BYTE name[8] = { '$', 0, 'I', 0, '3', 0, '0', 0 };
+            return a[9] == 4 && le16(a + 0x0A) + 8u <= le32(a + 4) && memcmp(a + le16(a + 0x0A), name, 8) == 0;
+        }
+
+        // 'r' has had its fixups applied. 'values' keeps the resident
+        // $DATA and directory index for a single file's read.
+        static bool decodeRecord(const BYTE* r, DWORD recordSize, Record& rec, bool values = false)
+        {
+            uint16_t flags = le16(r + 0x16);
+            rec.inUse = (flags & 0x01) != 0;
+            rec.directory = (flags & 0x02) != 0;
+            rec.sequence = le16(r + 0x10);
+            rec.baseRef = le64(r + 0x20);
+            if (!rec.inUse) {
+                return true;
+            }
+            uint32_t used = (std::min)(le32(r + 0x18), recordSize);
+            uint32_t pos = le16(r + 0x14);
+            while (pos + 16 <= used)
+            {
+                const BYTE* a = r + pos;
+                uint32_t type = le32(a);
+                if (type == _attrEnd) {
+                    break;
+                }
+                uint32_t length = le32(a + 4);
+                if (length < 16 || length > used - pos) {
+                    return false;
+                }
+                bool nonResident = a[8] != 0;
+                BYTE nameLength = a[9];
+                if (!nonResident)
+                {
+                    uint32_t valueLength = le32(a + 0x10);
+                    uint16_t valueOffset = le16(a + 0x14);
+                    if (valueOffset > length || valueLength > length - valueOffset) {
+                        return false;
+                    }
+                    const BYTE* v = a + valueOffset;
+                    if (type == _attrStandardInformation && valueLength >= 0x24)
+                    {
+                        rec.created = le64(v);
+                        rec.modified = le64(v + 0x08);
+                        rec.changed = le64(v + 0x10);
+                        rec.accessed = le64(v + 0x18);
+                        rec.attributes = le32(v + 0x20);
+                    }
+                    else if (type == _attrFileName && valueLength >= 0x42)
+                    {
+                        BYTE units = v[0x40];
+                        BYTE nameSpace = v[0x41];
+                        // DOS 8.3 alias of a Win32 name
+                        if (nameSpace != 2 && 0x42u + units * 2u <= valueLength)
+                        {
+                            Record::Name n;
+                            n.parentRef = le64(v);
+                            n.name = utf8(v + 0x42, units);
+                            rec.names.push_back(n);
+                        }
+                    }
+                    else if (type == _attrData && nameLength == 0)
+                    {
+                        rec.hasData = true;
+                        rec.dataResident = true;
+                        rec.dataSize = valueLength;
+                        rec.initializedSize = valueLength;
+                        if (values) {
+                            rec.residentData.assign(v, v + valueLength);
+                        }
+                    }
+                    else if (type == _attrIndexRoot && values && isI30(a)) {
+                        rec.indexRoot.assign(v, v + valueLength);
+                    }
+                    else if (type == _attrAttributeList) {
+                        decodeAttributeList(v, valueLength, rec.dataExtensions);
+                    }
+                }
+                else if (type == _attrData && nameLength == 0 && length >= 0x40)
+                {
+                    uint64_t startVcn = le64(a + 0x10);
+                    uint16_t runsOffset = le16(a + 0x20);
+                    // only the first segment holds the sizes
+                    if (startVcn == 0)
+                    {
+                        rec.dataSize = le64(a + 0x30);
+                        rec.initializedSize = le64(a + 0x38);
+                        rec.dataFlags = le16(a + 0x0C);
+                        rec.compressionUnit = (rec.dataFlags & _flagCompressed) ? a[0x22] : 0;
+                    }
+                    rec.hasData = true;
+                    if (runsOffset >= length || !decodeRuns(a + runsOffset, a + length, startVcn, rec.runs)) {
+                        return false;
+                    }
+                }
+                else if (type == _attrIndexAllocation && values && isI30(a) && length >= 0x40)
+                {
+                    uint16_t runsOffset = le16(a + 0x20);
+                    if (runsOffset >= length || !decodeRuns(a + runsOffset, a + length, le64(a + 0x10), rec.indexRuns)) {
+                        return false;
+                    }
+                }
+                pos += length;
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------------------
+        // one per name of every in-use file
+        struct File
+        {
+            uint64_t record = 0;
+            uint16_t sequence = 0;
+            bool directory = false;
+            // '\' separated, from the volume root. UTF-8
+            std::string path;
+            uint64_t size = 0;
+            uint64_t created = 0;
+            uint64_t modified = 0;
+            uint64_t changed = 0;
+            uint64_t accessed = 0;
+            uint32_t attributes = 0;
+            std::vector<Run> runs;
+        };
+
+        //-----------------------------------------------------------------------------
+        // ASCII case-insensitive. NTFS folds all of Unicode through $UpCase,
+        // other characters must match exactly here.
+        static bool sameName(const std::string& a, const std::string& b)
+        {
+            if (a.size() != b.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < a.size(); i++)
+            {
+                char x = (a[i] >= 'A' && a[i] <= 'Z') ? (char)(a[i] - 'A' + 'a') : a[i];
+                char y = (b[i] >= 'A' && b[i] <= 'Z') ? (char)(b[i] - 'A' + 'a') : b[i];
+                if (x != y) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //-----------------------------------------------------------------------------
+        class MftReader
+        {
+            blk::BlockSource& m_source;
+            Volume m_volume;
+            // of the $MFT's own $DATA
+            std::vector<Run> m_mftRuns;
+            uint64_t m_recordCount = 0;
+
+            // [vcn byte offset, length) of the $MFT. one read per run touched.
+            bool readMft(uint64_t offset, BYTE* buffer, size_t length)
+            {
+                uint64_t cs = m_volume.clusterSize;
+                for (const Run& run : m_mftRuns)
+                {
+                    uint64_t runStart = run.vcn * cs;
+                    uint64_t runEnd = runStart + run.clusters * cs;
+                    if (length == 0) {
+                        break;
+                    }
+                    if (offset >= runEnd || offset < runStart) {
+                        continue;
+                    }
+                    size_t n = (size_t)(std::min)((uint64_t)length, runEnd - offset);
+                    if (run.lcn < 0) {
+                        memset(buffer, 0, n);
+                    }
+                    else if (!m_source.read(m_volume.offset + (uint64_t)run.lcn * cs + (offset - runStart), buffer, n)) {
+                        return false;
+                    }
+                    buffer += n;
+                    offset += n;
+                    length -= n;
+                }
+                return length == 0;
+            }
+
+            bool readRecord(uint64_t number, std::vector<BYTE>& buffer, Record& rec, bool values = false)
+            {
+                buffer.resize(m_volume.recordSize);
+                return readMft(number * m_volume.recordSize, buffer.data(), buffer.size())
+                    && applyFixups(buffer.data(), m_volume.recordSize)
+                    && decodeRecord(buffer.data(), m_volume.recordSize, rec, values);
+            }
+
+            // entries of one index node, 'p' at its index header
+            static bool scanIndex(const BYTE* p, size_t length, const std::string& name, uint64_t& ref)
+            {
+                if (length < 0x10) {
+                    return false;
+                }
+                size_t used = (std::min)((size_t)le32(p + 4), length);
+                for (size_t pos = le32(p); pos + 0x10 <= used;)
+                {
+                    const BYTE* e = p + pos;
+                    uint16_t entryLength = le16(e + 8);
+                    uint16_t keyLength = le16(e + 10);
+                    // last entry carries no key
+                    if ((le16(e + 12) & 2) || entryLength < 0x10 || pos + entryLength > used) {
+                        break;
+                    }
+                    // key is a $FILE_NAME value
+                    if (keyLength >= 0x42 && 0x10u + keyLength <= entryLength)
+                    {
+                        const BYTE* k = e + 0x10;
+                        BYTE units = k[0x40];
+                        if (0x42u + units * 2u <= keyLength && sameName(utf8(k + 0x42, units), name))
+                        {
+                            ref = le64(e);
+                            return true;
+                        }
+                    }
+                    pos += entryLength;
+                }
+                return false;
+            }
+
+        public:
+
+            // bytes per parallel read
+            size_t chunkSize = 4 * 1024 * 1024;
+            unsigned threads = 0;
+
+            // 'volumeOffset' is where the NTFS boot sector lives on 'source'
+            MftReader(blk::BlockSource& source, uint64_t volumeOffset, uint64_t volumeLength)
+                : m_source(source)
+            {
+                m_volume.offset = volumeOffset;
+                m_volume.length = volumeLength;
+            }
+
+            const Volume& volume() const { return m_volume; }
+            uint64_t recordCount() const { return m_recordCount; }
+
+            // volume relative, for file data
+            bool readVolume(uint64_t offset, void* buffer, size_t length)
+            {
+                return offset <= m_volume.length && length <= m_volume.length - offset
+                    && m_source.read(m_volume.offset + offset, buffer, length);
+            }
+
+            // boot sector and $MFT extents. false if not NTFS or unreadable
+            bool open()
+            {
+                std::vector<BYTE> boot(4096);
+                size_t n = (size_t)(std::min)((uint64_t)boot.size(), m_volume.length);
+                if (n < 512 || !m_source.read(m_volume.offset, boot.data(), n) || !decodeBoot(boot.data(), m_volume)) {
+                    return false;
+                }
+                // record 0 sits at the MFT LCN
+                Run first;
+                first.lcn = (int64_t)m_volume.mftLcn;
+                first.clusters = (m_volume.recordSize + m_volume.clusterSize - 1) / m_volume.clusterSize;
+                m_mftRuns.assign(1, first);
+                std::vector<BYTE> buffer;
+                Record mft;
+                if (!readRecord(_recordMft, buffer, mft) || mft.runs.empty()) {
+                    return false;
+                }
+                std::vector<Run> runs = mft.runs;
+                m_mftRuns = runs;
+                // fragmented MFT: the rest of $DATA is in extension records
+                for (uint64_t ref : mft.dataExtensions)
+                {
+                    if (ref == _recordMft) {
+                        continue;
+                    }
+                    Record ext;
+                    if (!readRecord(ref, buffer, ext)) {
+                        return false;
+                    }
+                    runs.insert(runs.end(), ext.runs.begin(), ext.runs.end());
+                    std::sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) { return a.vcn < b.vcn; });
+                    m_mftRuns = runs;
+                }
+                m_recordCount = mft.dataSize / m_volume.recordSize;
+                return m_recordCount > _recordRoot;
+            }
+
+            //-----------------------------------------------------------------------------
+            // one file: its base record, values kept, with the $DATA runs of its
+            // extension records folded in. false if unreadable, not in use or
+            // 'ref' carries a sequence number the record no longer has.
+            bool readFile(uint64_t ref, Record& rec)
+            {
+                std::vector<BYTE> buffer;
+                uint64_t number = refRecord(ref);
+                uint16_t sequence = refSequence(ref);
+                rec = Record();
+                if (number >= m_recordCount || !readRecord(number, buffer, rec, true)
+                    || !rec.inUse || rec.baseRef || (sequence && sequence != rec.sequence)) {
+                    return false;
+                }
+                std::vector<uint64_t> extensions = rec.dataExtensions;
+                std::sort(extensions.begin(), extensions.end());
+                extensions.erase(std::unique(extensions.begin(), extensions.end()), extensions.end());
+                for (uint64_t e : extensions)
+                {
+                    if (e == number) {
+                        continue;
+                    }
+                    Record ext;
+                    if (e >= m_recordCount || !readRecord(e, buffer, ext, true) || refRecord(ext.baseRef) != number) {
+                        return false;
+                    }
+                    rec.hasData = rec.hasData || ext.hasData;
+                    rec.runs.insert(rec.runs.end(), ext.runs.begin(), ext.runs.end());
+                    // the first segment moved out of the base record
+                    if (ext.dataSize)
+                    {
+                        rec.dataSize = ext.dataSize;
+                        rec.initializedSize = ext.initializedSize;
+                        rec.dataFlags = ext.dataFlags;
+                        rec.compressionUnit = ext.compressionUnit;
+                    }
+                }
+                std::sort(rec.runs.begin(), rec.runs.end(), [](const Run& a, const Run& b) { return a.vcn < b.vcn; });
+                return true;
+            }
+
+            // 'name' in directory 'dir' through its $I30 index. every entry is
+            // compared, case-insensitively, so $UpCase collation is not needed
+            // and a directory costs its index size in reads at most.
+            bool findChild(const Record& dir, const std::string& name, uint64_t& ref)
+            {
+                if (dir.indexRoot.size() < 0x20) {
+                    return false;
+                }
+                if (scanIndex(dir.indexRoot.data() + 0x10, dir.indexRoot.size() - 0x10, name, ref)) {
+                    return true;
+                }
+                // large directory: the INDX blocks of $INDEX_ALLOCATION
+                DWORD blockSize = le32(dir.indexRoot.data() + 8);
+                if (blockSize < 512 || blockSize > 65536 || (blockSize & (blockSize - 1))) {
+                    return false;
+                }
+                uint64_t cs = m_volume.clusterSize;
+                size_t span = (std::max)((size_t)blockSize, chunkSize - chunkSize % blockSize);
+                std::vector<BYTE> buffer;
+                for (const Run& run : dir.indexRuns)
+                {
+                    if (run.lcn < 0) {
+                        continue;
+                    }
+                    uint64_t bytes = run.clusters * cs;
+                    for (uint64_t done = 0; done < bytes;)
+                    {
+                        size_t n = (size_t)(std::min)((uint64_t)span, bytes - done);
+                        buffer.resize(n);
+                        if (!readVolume((uint64_t)run.lcn * cs + done, buffer.data(), n)) {
+                            return false;
+                        }
+                        for (size_t b = 0; b + blockSize <= n; b += blockSize)
+                        {
+                            BYTE* block = buffer.data() + b;
+                            if (applyFixups(block, blockSize, _fixupStride, "INDX")
+                                && scanIndex(block + 0x18, blockSize - 0x18, name, ref)) {
+                                return true;
+                            }
+                        }
+                        done += n;
+                    }
+                }
+                return false;
+            }
+
+            // '\Users\jerry\notes.txt' ('/' separates too) => reference and record,
+            // walking the directory indexes from the root
+            bool resolve(const std::string& path, uint64_t& ref, Record& rec)
+            {
+                ref = _recordRoot;
+                if (!readFile(ref, rec)) {
+                    return false;
+                }
+                size_t pos = 0;
+                while (pos < path.size())
+                {
+                    size_t end = path.find_first_of("\\/", pos);
+                    if (end == std::string::npos) {
+                        end = path.size();
+                    }
+                    if (end == pos) {
+                        pos++;
+                        continue;
+                    }
+                    std::string name = path.substr(pos, end - pos);
+                    pos = end;
+                    uint64_t child = 0;
+                    if (!rec.directory || !findChild(rec, name, child)) {
+                        return false;
+                    }
+                    // an index entry left behind by a delete points at a reused record
+                    uint64_t parent = refRecord(ref);
+                    if (!readFile(child, rec) || std::none_of(rec.names.begin(), rec.names.end(),
+                            [&](const Record::Name& n) { return refRecord(n.parentRef) == parent; })) {
+                        return false;
+                    }
+                    ref = child;
+                }
+                return true;
+            }
+
+            //-----------------------------------------------------------------------------
+            // every record, decoded in parallel. index == record number.
+            std::vector<Record> readAll()
+            {
+                std::vector<Record> records((size_t)m_recordCount);
+                uint64_t perChunk = (std::max)((uint64_t)1, (uint64_t)(chunkSize / m_volume.recordSize));
+                uint64_t chunks = (m_recordCount + perChunk - 1) / perChunk;
+                std::atomic<uint64_t> next(0);
+                unsigned count = threads ? threads : (std::max)(1u, std::thread::hardware_concurrency());
+                count = (unsigned)(std::min)((uint64_t)count, chunks);
+                auto worker = [&]() {
+                    std::vector<BYTE> buffer;
+                    for (;;)
+                    {
+                        uint64_t chunk = next.fetch_add(1);
+                        if (chunk >= chunks) {
+                            break;
+                        }
+                        uint64_t first = chunk * perChunk;
+                        uint64_t n = (std::min)(perChunk, m_recordCount - first);
+                        buffer.resize((size_t)(n * m_volume.recordSize));
+                        if (!readMft(first * m_volume.recordSize, buffer.data(), buffer.size())) {
+                            continue;
+                        }
+                        for (uint64_t i = 0; i < n; i++)
+                        {
+                            BYTE* r = buffer.data() + i * m_volume.recordSize;
+                            Record& rec = records[(size_t)(first + i)];
+                            if (!applyFixups(r, m_volume.recordSize) ||
+                                !decodeRecord(r, m_volume.recordSize, rec)) {
+                                rec = Record();
+                            }
+                        }
+                    }
+                };
+                std::vector<std::thread> pool;
+                for (unsigned i = 1; i < count; i++) {
+                    pool.emplace_back(worker);
+                }
+                worker();
+                for (auto& t : pool) {
+                    t.join();
+                }
+                return records;
+            }
+
+            //-----------------------------------------------------------------------------
+            // fold extension records into their bases and resolve paths
+            std::vector<File> files()
+            {
+                std::vector<Record> records = readAll();
+                size_t count = records.size();
+                for (size_t i = 0; i < count; i++)
+                {
+                    Record& ext = records[i];
+                    if (!ext.inUse || ext.baseRef == 0) {
+                        continue;
+                    }
+                    uint64_t base = refRecord(ext.baseRef);
+                    if (base >= count || !records[(size_t)base].inUse) {
+                        continue;
+                    }
+                    Record& rec = records[(size_t)base];
+                    rec.names.insert(rec.names.end(), ext.names.begin(), ext.names.end());
+                    if (ext.hasData && !ext.dataResident)
+                    {
+                        rec.hasData = true;
+                        rec.runs.insert(rec.runs.end(), ext.runs.begin(), ext.runs.end());
+                        if (ext.dataSize) {
+                            rec.dataSize = ext.dataSize;
+                        }
+                    }
+                    ext.inUse = false;
+                }
+
+                // directory paths on demand, memoised. '\?' roots an orphan
+                static const std::string orphan = "\\?";
+                std::vector<std::string> dirPath(count);
+                std::vector<char> resolved(count, 0);
+                auto pathOf = [&](uint64_t parentRef) -> const std::string& {
+                    // walk up to the root or a directory already resolved
+                    std::vector<uint64_t> chain;
+                    uint64_t r = refRecord(parentRef);
+                    uint16_t seq = refSequence(parentRef);
+                    const std::string* base = &orphan;
+                    for (;;)
+                    {
+                        if (r == _recordRoot) {
+                            base = &dirPath[(size_t)r];
+                            break;
+                        }
+                        if (r >= count || chain.size() > 1024) {
+                            break;
+                        }
+                        const Record& d = records[(size_t)r];
+                        // parent deleted or its record reused
+                        if (!d.inUse || !d.directory || d.names.empty() || (seq && d.sequence != seq)) {
+                            break;
+                        }
+                        if (resolved[(size_t)r]) {
+                            base = &dirPath[(size_t)r];
+                            break;
+                        }
+                        chain.push_back(r);
+                        r = refRecord(d.names[0].parentRef);
+                        seq = refSequence(d.names[0].parentRef);
+                    }
+                    // and back down
+                    while (!chain.empty())
+                    {
+                        size_t c = (size_t)chain.back();
+                        chain.pop_back();
+                        dirPath[c] = *base + "\\" + records[c].names[0].name;
+                        resolved[c] = 1;
+                        base = &dirPath[c];
+                    }
+                    return *base;
+                };
+
+                std::vector<File> files;
+                for (size_t i = 0; i < count; i++)
+                {
+                    Record& rec = records[i];
+                    if (!rec.inUse || rec.baseRef) {
+                        continue;
+                    }
+                    std::sort(rec.runs.begin(), rec.runs.end(), [](const Run& a, const Run& b) { return a.vcn < b.vcn; });
+                    for (auto& name : rec.names)
+                    {
+                        // the root names itself '.'
+                        if (i == _recordRoot) {
+                            continue;
+                        }
+                        File f;
+                        f.record = i;
+                        f.sequence = rec.sequence;
+                        f.directory = rec.directory;
+                        f.path = pathOf(name.parentRef) + "\\" + name.name;
+                        f.size = rec.dataSize;
+                        f.created = rec.created;
+                        f.modified = rec.modified;
+                        f.changed = rec.changed;
+                        f.accessed = rec.accessed;
+                        f.attributes = rec.attributes;
+                        f.runs = rec.runs;
+                        files.push_back(std::move(f));
+                    }
+                }
+                return files;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // NTFS volumes of a disk: each partition of the layout, or the
+        // whole source if it is itself a volume (i.e. \\.\C: or a partition image)
+        static std::vector<Volume> findVolumes(blk::BlockSource& source)
+        {
+            std::vector<std::pair<uint64_t, uint64_t>> candidates;
+            wde2::DiskInfo di;
+            if (pt::parseAnySectorSize(source, di) && di.DriveLayout.PartitionStyle != PARTITION_STYLE_RAW)
+            {
+                for (auto& partition : di.partitions)
+                {
+                    const PARTITION_INFORMATION_EX& piex = partition.second.piex;
+                    if (piex.PartitionStyle == PARTITION_STYLE_MBR && pt::isExtendedMbrType(piex.Mbr.PartitionType)) {
+                        continue;
+                    }
+                    candidates.push_back({ (uint64_t)piex.StartingOffset.QuadPart, (uint64_t)piex.PartitionLength.QuadPart });
+                }
+            }
+            else {
+                candidates.push_back({ 0, source.size() });
+            }
+            std::vector<Volume> volumes;
+            BYTE boot[512];
+            for (auto& c : candidates)
+            {
+                Volume v;
+                if (c.first + c.second <= source.size() && source.read(c.first, boot, sizeof(boot)) && decodeBoot(boot, v))
+                {
+                    v.offset = c.first;
+                    v.length = c.second;
+                    volumes.push_back(v);
+                }
+            }
+            return volumes;
+        }
+    }
+}
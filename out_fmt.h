@@ -0,0 +1,702 @@
+/*
+
+    Machine readable output for wde2: JSON Lines or CSV.
+
+    Everything is formatted straight into a reusable fixed size
+    buffer which is flushed with a single fwrite() when full. No
+    field allocates: integers, hex and GUIDs use table driven
+    formatters and wide strings are UTF-8 encoded in place.
+
+    CSV holds one record type per run, so its columns never change.
+    The header goes before the first row: a record is staged in a
+    second fixed buffer while the field names are collected as
+    pointers to their literals.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "structs.h"
+
+namespace wde2
+{
+    namespace out
+    {
+        //-----------------------------------------------------------------------------
+        enum class Format
+        {
+            Text,       // existing DBMSG output
+            JsonLines,
+            Csv,
+        };
+
+        // "text", "json", "csv" or "csv:<type>". anything else is an error
+        template <typename S>
+        static bool parseFormat(const S& name, Format& format, std::string& type)
+        {
+            auto is = [&](const char* s) {
+                size_t n = strlen(s);
+                if (name.size() != n) return false;
+                for (size_t i = 0; i < n; i++) {
+                    if ((char)name[i] != s[i]) return false;
+                }
+                return true;
+            };
+            type.clear();
+            if (is("text")) { format = Format::Text; return true; }
+            if (is("json") || is("jsonl")) { format = Format::JsonLines; return true; }
+            if (is("csv")) { format = Format::Csv; return true; }
+            if (name.size() > 4 && name[0] == 'c' && name[1] == 's' && name[2] == 'v' && name[3] == ':')
+            {
+                for (size_t i = 4; i < name.size(); i++) {
+                    type.push_back((char)name[i]);
+                }
+                format = Format::Csv;
+                return true;
+            }
+            return false;
+        }
+
+        //-----------------------------------------------------------------------------
+        // Append-only byte buffer of fixed capacity. Overflow calls the
+        // owner's flush. Never allocates after construction.
+        class Buffer
+        {
+            char* m_data;
+            size_t m_capacity;
+            size_t m_length = 0;
+
+        public:
+            Buffer(char* data, size_t capacity) : m_data(data), m_capacity(capacity) {}
+            size_t length() const { return m_length; }
+            size_t space() const { return m_capacity - m_length; }
+            const char* data() const { return m_data; }
+            void clear() { m_length = 0; }
+            // caller guarantees space
+            void put(char c) { m_data[m_length++] = c; }
+            void put(const char* p, size_t n) { memcpy(m_data + m_length, p, n); m_length += n; }
+        };
+
+        //-----------------------------------------------------------------------------
+        static const char _hexUpper[] = "0123456789ABCDEF";
+
+        // table driven two digits at a time
+        static size_t formatU64(char* out, uint64_t v)
+        {
+            static const char digits[] =
+                "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                "8081828384858687888990919293949596979899";
+            char tmp[24];
+            char* p = tmp + sizeof(tmp);
+            while (v >= 100)
+            {
+                unsigned i = (unsigned)(v % 100) * 2;
+                v /= 100;
+                *--p = digits[i + 1];
+                *--p = digits[i];
+            }
+            if (v >= 10)
+            {
+                unsigned i = (unsigned)v * 2;
+                *--p = digits[i + 1];
+                *--p = digits[i];
+            }
+            else {
+                *--p = (char)('0' + v);
+            }
+            size_t n = (size_t)(tmp + sizeof(tmp) - p);
+            memcpy(out, p, n);
+            return n;
+        }
+
+        // 0x + fixed width upper case hex
+        static size_t formatHex(char* out, uint64_t v, int nibbles)
+        {
+            out[0] = '0';
+            out[1] = 'x';
+            for (int i = 0; i < nibbles; i++) {
+                out[2 + i] = _hexUpper[(v >> ((nibbles - 1 - i) * 4)) & 0xF];
+            }
+            return (size_t)nibbles + 2;
+        }
+
+        // {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}, 38 chars
+        static size_t formatGUID(char* out, const GUID& g)
+        {
+            char* p = out;
+            *p++ = '{';
+            for (int i = 7; i >= 0; i--) *p++ = _hexUpper[(g.Data1 >> (i * 4)) & 0xF];
+            *p++ = '-';
+            for (int i = 3; i >= 0; i--) *p++ = _hexUpper[(g.Data2 >> (i * 4)) & 0xF];
+            *p++ = '-';
+            for (int i = 3; i >= 0; i--) *p++ = _hexUpper[(g.Data3 >> (i * 4)) & 0xF];
+            *p++ = '-';
+            for (int i = 0; i < 8; i++)
+            {
+                if (i == 2) *p++ = '-';
+                *p++ = _hexUpper[g.Data4[i] >> 4];
+                *p++ = _hexUpper[g.Data4[i] & 0xF];
+            }
+            *p++ = '}';
+            return (size_t)(p - out);
+        }
+
+        //-----------------------------------------------------------------------------
+        // Streaming record writer. One record per line in JSON Lines mode. CSV
+        // writes one record type, 'only' or else the first written, after a
+        // header line. Records of any other type are left out.
+        //
+        //  w.begin("disk");
+        //  w.field("DeviceNumber", 4);
+        //  w.end();
+        //
+        class RecordWriter
+        {
+            static constexpr size_t _bufferSize = 64 * 1024;
+            static constexpr size_t _maxFields = 64;
+            // longest single scalar we format: a GUID
+            static constexpr size_t _scalarMax = 48;
+
+            Format m_format;
+            FILE* m_fp;
+            // the only allocations, made once
+            std::unique_ptr<char[]> m_main;
+            std::unique_ptr<char[]> m_stage;
+            Buffer m_out;
+            // CSV: record is staged here so the header can go first
+            Buffer m_row;
+            const char* m_type = nullptr;
+            const char* m_names[_maxFields];
+            size_t m_fieldCount = 0;
+            // CSV: the one record type written
+            std::string m_only;
+            bool m_header = false;
+
+            Buffer& target() { return (m_format == Format::Csv) ? m_row : m_out; }
+
+            void put(const char* p, size_t n) { put(target(), p, n); }
+            void put(char c) { put(&c, 1); }
+            void put(const char* s) { put(s, strlen(s)); }
+
+            // the main buffer flushes when full. the CSV row buffer is
+            // sized well beyond any record we produce.
+            void put(Buffer& b, const char* p, size_t n)
+            {
+                while (n)
+                {
+                    if (&b == &m_out && b.space() == 0) {
+                        flush();
+                    }
+                    size_t chunk = (std::min)(n, b.space());
+                    if (chunk == 0) {
+                        // CSV row overflow. drop rather than allocate
+                        return;
+                    }
+                    b.put(p, chunk);
+                    p += chunk;
+                    n -= chunk;
+                }
+            }
+
+            void separator(const char* name)
+            {
+                if (m_format == Format::JsonLines)
+                {
+                    put(m_fieldCount ? ",\"" : "\"");
+                    put(name);
+                    put("\":");
+                }
+                else if (m_fieldCount) {
+                    put(',');
+                }
+                if (m_fieldCount < _maxFields) {
+                    m_names[m_fieldCount] = name;
+                }
+                m_fieldCount++;
+            }
+
+            // one UTF-8 sequence per code point, surrogate pairs combined
+            template <typename C>
+            void putText(const C* s, size_t n)
+            {
+                bool json = (m_format == Format::JsonLines);
+                bool quote = json;
+                if (!json)
+                {
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        if (s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r') {
+                            quote = true;
+                            break;
+                        }
+                    }
+                }
+                if (quote) {
+                    put('"');
+                }
+                for (size_t i = 0; i < n; i++)
+                {
+                    uint32_t c = (uint32_t)s[i];
+                    if (sizeof(C) == 1) {
+                        c &= 0xFF;
+                    }
+                    if (c >= 0xD800 && c <= 0xDBFF && i + 1 < n)
+                    {
+                        uint32_t lo = (uint32_t)s[i + 1];
+                        if (lo >= 0xDC00 && lo <= 0xDFFF)
+                        {
+                            c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+                            i++;
+                        }
+                    }
+                    char tmp[8];
+                    size_t len = 0;
+                    if (c == '"')
+                    {
+                        if (json) { tmp[len++] = '\\'; }
+                        else { tmp[len++] = '"'; }
+                        tmp[len++] = '"';
+                    }
+                    else if (c == '\\' && json)
+                    {
+                        tmp[len++] = '\\';
+                        tmp[len++] = '\\';
+                    }
+                    else if (c < 0x20)
+                    {
+                        if (json)
+                        {
+                            tmp[len++] = '\\';
+                            tmp[len++] = 'u';
+                            tmp[len++] = '0';
+                            tmp[len++] = '0';
+                            tmp[len++] = _hexUpper[c >> 4];
+                            tmp[len++] = _hexUpper[c & 0xF];
+                        }
+                        else {
+                            tmp[len++] = (char)c;
+                        }
+                    }
+                    else if (c < 0x80) {
+                        tmp[len++] = (char)c;
+                    }
+                    else if (c < 0x800)
+                    {
+                        tmp[len++] = (char)(0xC0 | (c >> 6));
+                        tmp[len++] = (char)(0x80 | (c & 0x3F));
+                    }
+                    else if (c < 0x10000)
+                    {
+                        tmp[len++] = (char)(0xE0 | (c >> 12));
+                        tmp[len++] = (char)(0x80 | ((c >> 6) & 0x3F));
+                        tmp[len++] = (char)(0x80 | (c & 0x3F));
+                    }
+                    else
+                    {
+                        tmp[len++] = (char)(0xF0 | (c >> 18));
+                        tmp[len++] = (char)(0x80 | ((c >> 12) & 0x3F));
+                        tmp[len++] = (char)(0x80 | ((c >> 6) & 0x3F));
+                        tmp[len++] = (char)(0x80 | (c & 0x3F));
+                    }
+                    put(tmp, len);
+                }
+                if (quote) {
+                    put('"');
+                }
+            }
+
+        public:
+
+            RecordWriter(Format format, FILE* fp = stdout, const std::string& only = std::string())
+                : m_format(format), m_fp(fp),
+                  m_main(new char[_bufferSize]),
+                  m_stage(new char[_bufferSize]),
+                  m_out(m_main.get(), _bufferSize),
+                  m_row(m_stage.get(), _bufferSize),
+                  m_only(only)
+            {
+            }
+
+            ~RecordWriter()
+            {
+                flush();
+            }
+
+            RecordWriter(const RecordWriter&) = delete;
+            RecordWriter& operator=(const RecordWriter&) = delete;
+
+            Format format() const { return m_format; }
+
+            void flush()
+            {
+                if (m_out.length())
+                {
+                    fwrite(m_out.data(), 1, m_out.length(), m_fp);
+                    m_out.clear();
+                }
+                fflush(m_fp);
+            }
+
+            //-----------------------------------------------------------------------------
+            // 'type' must be a string literal (or otherwise outlive the writer)
+            void begin(const char* type)
+            {
+                m_type = type;
+                m_fieldCount = 0;
+                m_row.clear();
+                if (m_format == Format::JsonLines)
+                {
+                    put("{\"type\":\"");
+                    put(type);
+                    put('"');
+                    // 'type' counts as the first field
+                    m_fieldCount = 1;
+                    m_names[0] = "type";
+                }
+                else
+                {
+                    m_names[0] = "type";
+                    put(type);
+                    m_fieldCount = 1;
+                }
+            }
+
+            void end()
+            {
+                if (m_format == Format::JsonLines)
+                {
+                    put("}\n");
+                    return;
+                }
+                // CSV: one type per run, header first time round
+                if (m_only.empty()) {
+                    m_only = m_type;
+                }
+                if (m_only != m_type) {
+                    return;
+                }
+                if (!m_header)
+                {
+                    m_header = true;
+                    // names are literals so need no quoting
+                    size_t count = (std::min)(m_fieldCount, _maxFields);
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        if (i) put(m_out, ",", 1);
+                        put(m_out, m_names[i], strlen(m_names[i]));
+                    }
+                    put(m_out, "\n", 1);
+                }
+                put(m_out, m_row.data(), m_row.length());
+                put(m_out, "\n", 1);
+            }
+
+            //-----------------------------------------------------------------------------
+            void field(const char* name, uint64_t v)
+            {
+                separator(name);
+                char tmp[_scalarMax];
+                put(tmp, formatU64(tmp, v));
+            }
+            void field(const char* name, int64_t v)
+            {
+                separator(name);
+                char tmp[_scalarMax];
+                size_t n = 0;
+                uint64_t u = (uint64_t)v;
+                if (v < 0)
+                {
+                    tmp[n++] = '-';
+                    u = (uint64_t)0 - u;
+                }
+                n += formatU64(tmp + n, u);
+                put(tmp, n);
+            }
+            void field(const char* name, uint32_t v) { field(name, (uint64_t)v); }
+            void field(const char* name, int v) { field(name, (int64_t)v); }
+            // ratios and rates, to 4 places. JSON has no NaN or infinity
+            void field(const char* name, double v)
+            {
+                separator(name);
+                char tmp[_scalarMax];
+                int n = snprintf(tmp, sizeof(tmp), "%.4f", (v == v && v - v == 0) ? v : 0.0);
+                put(tmp, (n > 0 && n < (int)sizeof(tmp)) ? (size_t)n : 0);
+            }
+            void field(const char* name, bool v)
+            {
+                separator(name);
+                put(v ? "true" : "false");
+            }
+            void field(const char* name, const GUID& g)
+            {
+                separator(name);
+                char tmp[_scalarMax];
+                size_t n = 0;
+                if (m_format == Format::JsonLines) tmp[n++] = '"';
+                n += formatGUID(tmp + n, g);
+                if (m_format == Format::JsonLines) tmp[n++] = '"';
+                put(tmp, n);
+            }
+            void field(const char* name, const char* s)
+            {
+                separator(name);
+                putText(s, strlen(s));
+            }
+            void field(const char* name, const std::wstring& s)
+            {
+                separator(name);
+                putText(s.c_str(), s.size());
+            }
+            void field(const char* name, const WCHAR* s, size_t n)
+            {
+                separator(name);
+                putText(s, n);
+            }
+            void field(const char* name, const std::string& s)
+            {
+                separator(name);
+                putText(s.c_str(), s.size());
+            }
+            // zero padded hex, i.e. signatures and checksums
+            void hex(const char* name, uint64_t v, int nibbles = 8)
+            {
+                separator(name);
+                char tmp[_scalarMax];
+                size_t n = 0;
+                if (m_format == Format::JsonLines) tmp[n++] = '"';
+                n += formatHex(tmp + n, v, nibbles);
+                if (m_format == Format::JsonLines) tmp[n++] = '"';
+                put(tmp, n);
+            }
+            // field not applicable to this record (i.e. Gpt.* on an MBR disk)
+            void null(const char* name)
+            {
+                separator(name);
+                if (m_format == Format::JsonLines) {
+                    put("null");
+                }
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        static const char* styleName(DWORD style)
+        {
+            switch (style)
+            {
+            case PARTITION_STYLE_MBR: return "MBR";
+            case PARTITION_STYLE_GPT: return "GPT";
+            }
+            return "RAW";
+        }
+
+        static const char* busName(DWORD bus)
+        {
+            switch (bus)
+            {
+            case BusTypeScsi: return "SCSI";
+            case BusTypeAta: return "ATA";
+            case BusTypeUsb: return "USB";
+            case BusTypeSata: return "SATA";
+            case BusTypeSd: return "SD";
+            case BusTypeMmc: return "MMC";
+            case BusTypeVirtual: return "Virtual";
+            case BusTypeNvme: return "NVMe";
+            }
+            return "Unknown";
+        }
+
+        //-----------------------------------------------------------------------------
+        // every DiskInfo field including the DRIVE_LAYOUT_INFORMATION_EX header.
+        // columns are fixed per record type so CSV stays rectangular.
+        static void writeDisk(RecordWriter& w, int index, const wde2::DiskInfo& di)
+        {
+            const DRIVE_LAYOUT_INFORMATION_EX& dl = di.DriveLayout;
+            bool mbr = (dl.PartitionStyle == PARTITION_STYLE_MBR);
+            bool gpt = (dl.PartitionStyle == PARTITION_STYLE_GPT);
+            w.begin("disk");
+            w.field("index", index);
+            w.field("StorageDeviceNumber.DeviceType", (uint32_t)di.StorageDeviceNumber.DeviceType);
+            w.field("StorageDeviceNumber.DeviceNumber", (uint32_t)di.StorageDeviceNumber.DeviceNumber);
+            w.field("StorageDeviceNumber.PartitionNumber", (uint32_t)di.StorageDeviceNumber.PartitionNumber);
+            w.field("DevicePath", di.DevicePath);
+            w.field("DeviceName", di.DeviceName);
+            w.field("SerialNumber", di.SerialNumber);
+            w.field("VendorId", di.VendorId);
+            w.field("ProductId", di.ProductId);
+            w.field("ProductRevision", di.ProductRevision);
+            w.field("canBePartitioned", di.canBePartitioned);
+            w.field("Geometry.Cylinders", (int64_t)di.Geometry.Cylinders.QuadPart);
+            w.field("Geometry.MediaType", (uint32_t)di.Geometry.MediaType);
+            w.field("Geometry.TracksPerCylinder", (uint32_t)di.Geometry.TracksPerCylinder);
+            w.field("Geometry.SectorsPerTrack", (uint32_t)di.Geometry.SectorsPerTrack);
+            w.field("Geometry.BytesPerSector", (uint32_t)di.Geometry.BytesPerSector);
+            w.field("DiskSize", (int64_t)di.DiskSize.QuadPart);
+            w.field("Storage.BusType", busName(di.Storage.BusType));
+            if (di.Storage.hasSeekPenalty) {
+                w.field("Storage.IncursSeekPenalty", di.Storage.IncursSeekPenalty);
+            }
+            else {
+                w.null("Storage.IncursSeekPenalty");
+            }
+            if (di.Storage.hasTrim) {
+                w.field("Storage.TrimEnabled", di.Storage.TrimEnabled);
+            }
+            else {
+                w.null("Storage.TrimEnabled");
+            }
+            w.field("Storage.MaxUnmapBytes", di.Storage.MaxUnmapBytes);
+            w.field("Storage.BytesPerPhysicalSector", (uint32_t)di.Storage.BytesPerPhysicalSector);
+            w.field("Storage.BytesOffsetForSectorAlignment", (uint32_t)di.Storage.BytesOffsetForSectorAlignment);
+            w.field("DriveLayout.PartitionStyle", styleName(dl.PartitionStyle));
+            w.field("DriveLayout.PartitionCount", (uint32_t)dl.PartitionCount);
+            if (mbr)
+            {
+                w.hex("DriveLayout.Mbr.Signature", dl.Mbr.Signature);
+                w.hex("DriveLayout.Mbr.CheckSum", dl.Mbr.CheckSum);
+            }
+            else
+            {
+                w.null("DriveLayout.Mbr.Signature");
+                w.null("DriveLayout.Mbr.CheckSum");
+            }
+            if (gpt)
+            {
+                w.field("DriveLayout.Gpt.DiskId", dl.Gpt.DiskId);
+                w.field("DriveLayout.Gpt.StartingUsableOffset", (int64_t)dl.Gpt.StartingUsableOffset.QuadPart);
+                w.field("DriveLayout.Gpt.UsableLength", (int64_t)dl.Gpt.UsableLength.QuadPart);
+                w.field("DriveLayout.Gpt.MaxPartitionCount", (uint32_t)dl.Gpt.MaxPartitionCount);
+            }
+            else
+            {
+                w.null("DriveLayout.Gpt.DiskId");
+                w.null("DriveLayout.Gpt.StartingUsableOffset");
+                w.null("DriveLayout.Gpt.UsableLength");
+                w.null("DriveLayout.Gpt.MaxPartitionCount");
+            }
+            w.field("partitions", (uint64_t)di.partitions.size());
+            w.end();
+        }
+
+        //-----------------------------------------------------------------------------
+        static void writePartition(RecordWriter& w, int disk, DWORD key, const wde2::PartitionInfo& pi)
+        {
+            const PARTITION_INFORMATION_EX& piex = pi.piex;
+            bool mbr = (piex.PartitionStyle == PARTITION_STYLE_MBR);
+            bool gpt = (piex.PartitionStyle == PARTITION_STYLE_GPT);
+            w.begin("partition");
+            w.field("disk", disk);
+            w.field("index", (uint32_t)key);
+            w.field("volumeID", pi.volumeID);
+            w.field("PartitionStyle", styleName(piex.PartitionStyle));
+            w.field("StartingOffset", (int64_t)piex.StartingOffset.QuadPart);
+            w.field("PartitionLength", (int64_t)piex.PartitionLength.QuadPart);
+            w.field("PartitionNumber", (uint32_t)piex.PartitionNumber);
+            w.field("RewritePartition", piex.RewritePartition != 0);
+            w.field("IsServicePartition", piex.IsServicePartition != 0);
+            if (mbr)
+            {
+                w.hex("Mbr.PartitionType", piex.Mbr.PartitionType, 2);
+                w.field("Mbr.BootIndicator", piex.Mbr.BootIndicator != 0);
+                w.field("Mbr.RecognizedPartition", piex.Mbr.RecognizedPartition != 0);
+                w.field("Mbr.HiddenSectors", (uint32_t)piex.Mbr.HiddenSectors);
+                w.field("Mbr.PartitionId", piex.Mbr.PartitionId);
+            }
+            else
+            {
+                w.null("Mbr.PartitionType");
+                w.null("Mbr.BootIndicator");
+                w.null("Mbr.RecognizedPartition");
+                w.null("Mbr.HiddenSectors");
+                w.null("Mbr.PartitionId");
+            }
+            if (gpt)
+            {
+                w.field("Gpt.PartitionType", piex.Gpt.PartitionType);
+                w.field("Gpt.PartitionId", piex.Gpt.PartitionId);
+                w.hex("Gpt.Attributes", piex.Gpt.Attributes, 16);
+                // fixed 36 WCHAR, NUL padded
+                size_t n = 0;
+                while (n < 36 && piex.Gpt.Name[n]) n++;
+                w.field("Gpt.Name", piex.Gpt.Name, n);
+            }
+            else
+            {
+                w.null("Gpt.PartitionType");
+                w.null("Gpt.PartitionId");
+                w.null("Gpt.Attributes");
+                w.null("Gpt.Name");
+            }
+            w.end();
+        }
+
+        //-----------------------------------------------------------------------------
+        // -cs
+        static void writeIdentity(RecordWriter& w, const char* source, const char* kind, const char* value)
+        {
+            w.begin("identity");
+            w.field("source", source);
+            w.field("kind", kind);
+            w.field("value", value);
+            w.end();
+        }
+
+        static void writeCollision(RecordWriter& w, const char* kind, const char* value,
+                                   const char* first, const char* other)
+        {
+            w.begin("collision");
+            w.field("kind", kind);
+            w.field("value", value);
+            w.field("first", first);
+            w.field("other", other);
+            w.end();
+        }
+
+        //-----------------------------------------------------------------------------
+        // long running operations. flushed so collectors see it as it happens.
+        static void writeProgress(RecordWriter& w, const char* operation,
+                                  uint64_t completed, uint64_t total, uint64_t elapsedMs)
+        {
+            w.begin("progress");
+            w.field("operation", operation);
+            w.field("completed", completed);
+            w.field("total", total);
+            w.field("elapsedMs", elapsedMs);
+            w.end();
+            w.flush();
+        }
+    }
+}
@@ -0,0 +1,640 @@
+/*
+
+    Image patches: what changed between two images, and applying it.
+
+    diff() reads two images of the same size, in any format img::open()
+    reads, in large aligned chunks on several threads, compares them a
+    block at a time and writes the blocks that differ as a patch. Ranges
+    unallocated in both images are not read. Adjacent changed blocks are
+    merged into runs of up to 1MB, each LZNT1 compressed where that is
+    smaller. Chunks are compared out of order but written in order, with
+    only a few in flight, so a patch of a large image is written in one
+    sequential pass.
+
+    A patch is:
+
+        header, 64 bytes:
+            u32 magic, u32 version, u32 blockSize, u32 runLimit, u64 size,
+            u64 runs, u64 changedBytes, u64 payloadBytes, u64 id,
+            u32 reserved, u32 crc32c of the header before it
+        per run, 40 bytes and the payload:
+            u64 offset, u32 length, u32 payloadLength, u8 encoding,
+            u8 reserved[3], u32 crc32c of the payload, u64 xxh64 of the old
+            content, u64 xxh64 of the new
+        trailer, 16 bytes:
+            u32 magic, u32 crc32c of the runs and payloads, u64 runs
+
+    apply() patches a raw image or fixed VHD in place. Nothing is written
+    until the whole patch has checked out and every run of the target is
+    either the old content or already the new, so a patch never lands on
+    the wrong base. Runs are then written in batches, a journal naming
+    the batch is saved and synced, rename and directory included, before
+    it, and the target flushed after it. An
+    interrupted apply is resumed by running it again: runs before the
+    batch are done, those in it are rewritten whatever they hold, and
+    those after it are checked as before.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blk_io.h"
+#include "enum_cache.h"
+#include "hash_ex.h"
+#include "img_io.h"
+#include "img_write.h"
+#include "lznt1.h"
+
+namespace wde2
+{
+    namespace patch
+    {
+        static const uint32_t _magic = 0x54504457;          // 'WDPT'
+        static const uint32_t _trailerMagic = 0x45504457;   // 'WDPE'
+        static const uint32_t _journalMagic = 0x4A504457;   // 'WDPJ'
+        static const uint32_t _version = 1;
+        static const size_t _headerSize = 64;
+        static const size_t _recordSize = 40;
+        static const size_t _trailerSize = 16;
+        static const BYTE _encodingRaw = 0;
+        static const BYTE _encodingLznt1 = 1;
+
+        //-----------------------------------------------------------------------------
+        struct Options
+        {
+            // compared and patched in whole blocks
+            uint32_t blockSize = 64 * 1024;
+            // per read, per image. a multiple of runLimit
+            uint32_t readSize = 4 * 1024 * 1024;
+            // longest run of changed blocks
+            uint32_t runLimit = 1024 * 1024;
+            unsigned threads = 4;
+            bool compress = true;
+        };
+
+        struct Header
+        {
+            uint32_t blockSize = 0;
+            uint32_t runLimit = 0;
+            uint64_t size = 0;
+            uint64_t runs = 0;
+            uint64_t changedBytes = 0;
+            uint64_t payloadBytes = 0;
+            // names the patch in an apply journal
+            uint64_t id = 0;
+
+            void encode(BYTE* p) const
+            {
+                memset(p, 0, _headerSize);
+                img::putLe32(p, _magic);
+                img::putLe32(p + 4, _version);
+                img::putLe32(p + 8, blockSize);
+                img::putLe32(p + 12, runLimit);
+                img::putLe64(p + 16, size);
+                img::putLe64(p + 24, runs);
+                img::putLe64(p + 32, changedBytes);
+                img::putLe64(p + 40, payloadBytes);
+                img::putLe64(p + 48, id);
+                img::putLe32(p + 60, hash::crc32c(p, 60));
+            }
+
+            bool decode(const BYTE* p)
+            {
+                if (img::le32(p) != _magic || img::le32(p + 4) != _version || img::le32(p + 60) != hash::crc32c(p, 60)) {
+                    return false;
+                }
+                blockSize = img::le32(p + 8);
+                runLimit = img::le32(p + 12);
+                size = img::le64(p + 16);
+                runs = img::le64(p + 24);
+                changedBytes = img::le64(p + 32);
+                payloadBytes = img::le64(p + 40);
+                id = img::le64(p + 48);
+                return blockSize && runLimit && runLimit <= 64 * 1024 * 1024;
+            }
+        };
+
+        struct Run
+        {
+            uint64_t offset = 0;
+            uint32_t length = 0;
+            BYTE encoding = _encodingRaw;
+            uint32_t payloadCrc = 0;
+            uint64_t oldHash = 0;
+            uint64_t newHash = 0;
+            std::vector<BYTE> payload;
+
+            void encode(BYTE* p) const
+            {
+                memset(p, 0, _recordSize);
+                img::putLe64(p, offset);
+                img::putLe32(p + 8, length);
+                img::putLe32(p + 12, (uint32_t)payload.size());
+                p[16] = encoding;
+                img::putLe32(p + 20, payloadCrc);
+                img::putLe64(p + 24, oldHash);
+                img::putLe64(p + 32, newHash);
+            }
+
+            // the payload length, which the payload is then read into
+            uint32_t decode(const BYTE* p)
+            {
+                offset = img::le64(p);
+                length = img::le32(p + 8);
+                encoding = p[16];
+                payloadCrc = img::le32(p + 20);
+                oldHash = img::le64(p + 24);
+                newHash = img::le64(p + 32);
+                return img::le32(p + 12);
+            }
+
+            // the new content into 'out', of 'length' bytes
+            bool expand(BYTE* out) const
+            {
+                if (encoding == _encodingRaw)
+                {
+                    if (payload.size() != length) {
+                        return false;
+                    }
+                    memcpy(out, payload.data(), length);
+                }
+                else if (encoding != _encodingLznt1 || !ntfs::lznt1Decompress(payload.data(), payload.size(), out, length)) {
+                    return false;
+                }
+                return hash::xxh64(out, length) == newHash;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        struct DiffReport
+        {
+            uint64_t size = 0;
+            uint64_t bytesCompared = 0;
+            // unallocated in both images
+            uint64_t bytesSkipped = 0;
+            uint64_t runs = 0;
+            uint64_t changedBytes = 0;
+            uint64_t patchBytes = 0;
+            double seconds = 0;
+        };
+
+        // the patch is written to a temporary and renamed once complete.
+        // throws if the sizes differ or either image cannot be read
+        static DiffReport diff(blk::BlockSource& oldImage, blk::BlockSource& newImage, const std::filesystem::path& patchPath,
+                               const Options& options = Options(),
+                               const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            nv2::throw_if(oldImage.size() != newImage.size(),
+                          nv2::acc("Images differ in size: ") << oldImage.size() << " and " << newImage.size());
+            nv2::throw_if(!options.blockSize || options.runLimit % options.blockSize || options.readSize % options.runLimit,
+                          nv2::acc("Read size ") << options.readSize << " is not a multiple of run limit " << options.runLimit);
+            auto started = std::chrono::steady_clock::now();
+            DiffReport report;
+            report.size = newImage.size();
+            const uint64_t chunks = (report.size + options.readSize - 1) / options.readSize;
+            const unsigned threads = (std::max)(1u, options.threads);
+            // chunks compared ahead of the one being written
+            const uint64_t window = threads * 2;
+
+            std::mutex lock;
+            std::condition_variable ready;
+            std::map<uint64_t, std::vector<Run>> results;
+            uint64_t written = 0;
+            bool stop = false;
+            uint64_t failedAt = UINT64_MAX;
+            std::atomic<uint64_t> next{ 0 };
+            std::atomic<uint64_t> compared{ 0 };
+            std::atomic<uint64_t> skipped{ 0 };
+
+            auto work = [&]() {
+                blk::AlignedBuffer before(options.readSize);
+                blk::AlignedBuffer after(options.readSize);
+                for (uint64_t c = next++; c < chunks; c = next++)
+                {
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        ready.wait(guard, [&]() { return c < written + window || stop; });
+                        if (stop) {
+                            break;
+                        }
+                    }
+                    uint64_t offset = c * options.readSize;
+                    size_t length = (size_t)(std::min)((uint64_t)options.readSize, report.size - offset);
+                    std::vector<Run> runs;
+                    bool ok = true;
+                    if (!img::allocated(oldImage, offset, length) && !img::allocated(newImage, offset, length)) {
+                        skipped += length;
+                    }
+                    else if (!oldImage.read(offset, before.data(), length) || !newImage.read(offset, after.data(), length)) {
+                        ok = false;
+                    }
+                    else
+                    {
+                        compared += length;
+                        // memcmp is the vectorised compare the CRT has for each target
+                        for (size_t b = 0; b < length; )
+                        {
+                            size_t n = (std::min)((size_t)options.blockSize, length - b);
+                            if (memcmp(before.data() + b, after.data() + b, n) == 0)
+                            {
+                                b += n;
+                                continue;
+                            }
+                            Run run;
+                            run.offset = offset + b;
+                            run.length = (uint32_t)n;
+                            b += n;
+                            // extend while changed, within the run limit, which divides the read
+                            while (b < length && (run.offset + run.length) % options.runLimit)
+                            {
+                                n = (std::min)((size_t)options.blockSize, length - b);
+                                if (memcmp(before.data() + b, after.data() + b, n) == 0) {
+                                    break;
+                                }
+                                run.length += (uint32_t)n;
+                                b += n;
+                            }
+                            const BYTE* from = before.data() + (run.offset - offset);
+                            const BYTE* to = after.data() + (run.offset - offset);
+                            run.oldHash = hash::xxh64(from, run.length);
+                            run.newHash = hash::xxh64(to, run.length);
+                            if (options.compress)
+                            {
+                                run.payload.resize(ntfs::lznt1Bound(run.length));
+                                size_t coded = ntfs::lznt1Compress(to, run.length, run.payload.data());
+                                if (coded && coded < run.length)
+                                {
+                                    run.payload.resize(coded);
+                                    run.encoding = _encodingLznt1;
+                                }
+                            }
+                            if (run.encoding == _encodingRaw) {
+                                run.payload.assign(to, to + run.length);
+                            }
+                            run.payloadCrc = hash::crc32c(run.payload.data(), run.payload.size());
+                            runs.push_back(std::move(run));
+                        }
+                    }
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        if (!ok) {
+                            failedAt = (std::min)(failedAt, offset);
+                        }
+                        results[c] = std::move(runs);
+                    }
+                    ready.notify_all();
+                }
+            };
+
+            std::filesystem::path tmp = patchPath;
+            tmp += ".tmp";
+            std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+            nv2::throw_if(!os, nv2::acc("Unable to create ") << tmp.wstring());
+
+            Header header;
+            header.blockSize = options.blockSize;
+            header.runLimit = options.runLimit;
+            header.size = report.size;
+            std::random_device rd;
+            header.id = ((uint64_t)rd() << 32) | rd();
+            BYTE head[_headerSize] = { 0 };
+            os.write((const char*)head, sizeof(head));
+
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; t++) {
+                workers.emplace_back(work);
+            }
+            uint32_t crc = 0;
+            for (uint64_t c = 0; c < chunks && os; c++)
+            {
+                std::vector<Run> runs;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    ready.wait(guard, [&]() { return results.count(c) || failedAt != UINT64_MAX; });
+                    if (failedAt != UINT64_MAX) {
+                        break;
+                    }
+                    runs = std::move(results[c]);
+                    results.erase(c);
+                    written = c + 1;
+                }
+                ready.notify_all();
+                for (const Run& run : runs)
+                {
+                    BYTE record[_recordSize];
+                    run.encode(record);
+                    os.write((const char*)record, sizeof(record));
+                    os.write((const char*)run.payload.data(), (std::streamsize)run.payload.size());
+                    crc = hash::crc32c(record, sizeof(record), crc);
+                    crc = hash::crc32c(run.payload.data(), run.payload.size(), crc);
+                    header.runs++;
+                    header.changedBytes += run.length;
+                    header.payloadBytes += run.payload.size();
+                }
+                if (progress) {
+                    progress((std::min)((c + 1) * options.readSize, report.size), report.size);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stop = true;
+            }
+            ready.notify_all();
+            for (auto& t : workers) {
+                t.join();
+            }
+            if (failedAt != UINT64_MAX || !os)
+            {
+                os.close();
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                nv2::throw_if(failedAt != UINT64_MAX, nv2::acc("Unable to read either image at offset ") << failedAt);
+                nv2::throw_if(true, nv2::acc("Unable to write ") << tmp.wstring());
+            }
+
+            BYTE trailer[_trailerSize] = { 0 };
+            img::putLe32(trailer, _trailerMagic);
+            img::putLe32(trailer + 4, crc);
+            img::putLe64(trailer + 8, header.runs);
+            os.write((const char*)trailer, sizeof(trailer));
+            header.encode(head);
+            os.seekp(0);
+            os.write((const char*)head, sizeof(head));
+            os.close();
+            if (!os)
+            {
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                nv2::throw_if(true, nv2::acc("Unable to write ") << tmp.wstring());
+            }
+            nv2::throw_if(!cache::commitAtomically(tmp, patchPath), nv2::acc("Unable to rename ") << tmp.wstring() << " to " << patchPath.wstring());
+
+            report.bytesCompared = compared;
+            report.bytesSkipped = skipped;
+            report.runs = header.runs;
+            report.changedBytes = header.changedBytes;
+            report.patchBytes = _headerSize + header.runs * _recordSize + header.payloadBytes + _trailerSize;
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            return report;
+        }
+
+        //-----------------------------------------------------------------------------
+        // reads a patch front to back, checking each run as it goes
+        class Reader
+        {
+            std::ifstream m_is;
+            Header m_header;
+            uint64_t m_run = 0;
+            uint32_t m_crc = 0;
+
+        public:
+            // throws unless a patch
+            explicit Reader(const std::filesystem::path& path) : m_is(path, std::ios::binary)
+            {
+                BYTE head[_headerSize];
+                nv2::throw_if(!m_is.read((char*)head, sizeof(head)) || !m_header.decode(head),
+                              nv2::acc("Not a patch: ") << path.wstring());
+            }
+
+            const Header& header() const { return m_header; }
+
+            // false after the last run. throws on a damaged run or trailer
+            bool next(Run& run)
+            {
+                if (m_run == m_header.runs)
+                {
+                    BYTE trailer[_trailerSize];
+                    nv2::throw_if(!m_is.read((char*)trailer, sizeof(trailer)) || img::le32(trailer) != _trailerMagic
+                                  || img::le32(trailer + 4) != m_crc || img::le64(trailer + 8) != m_header.runs,
+                                  nv2::acc("Patch trailer does not match its ") << m_header.runs << " runs");
+                    return false;
+                }
+                BYTE record[_recordSize];
+                nv2::throw_if(!m_is.read((char*)record, sizeof(record)), nv2::acc("Patch ends at run ") << m_run);
+                uint32_t payloadLength = run.decode(record);
+                nv2::throw_if(run.offset % m_header.blockSize || run.length == 0 || run.length > m_header.runLimit
+                              || run.offset > m_header.size || run.length > m_header.size - run.offset
+                              || payloadLength > ntfs::lznt1Bound(run.length),
+                              nv2::acc("Patch run ") << m_run << " is out of range");
+                run.payload.resize(payloadLength);
+                nv2::throw_if(!m_is.read((char*)run.payload.data(), payloadLength)
+                              || hash::crc32c(run.payload.data(), payloadLength) != run.payloadCrc,
+                              nv2::acc("Patch run ") << m_run << " at offset " << run.offset << " is damaged");
+                m_crc = hash::crc32c(record, sizeof(record), m_crc);
+                m_crc = hash::crc32c(run.payload.data(), payloadLength, m_crc);
+                m_run++;
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // which batch of runs an apply was writing, beside the target
+        struct Journal
+        {
+            uint64_t id = 0;
+            // runs before 'done' are written and flushed. [done, end) may be torn
+            uint64_t done = 0;
+            uint64_t end = 0;
+
+            static std::filesystem::path pathFor(const std::filesystem::path& target)
+            {
+                std::filesystem::path p = target;
+                p += ".wdpj";
+                return p;
+            }
+
+            // false if there is none
+            bool load(const std::filesystem::path& path)
+            {
+                std::ifstream is(path, std::ios::binary);
+                BYTE data[32];
+                if (!is.read((char*)data, sizeof(data)) || img::le32(data) != _journalMagic
+                    || img::le32(data + 4) != hash::crc32c(data + 8, 24)) {
+                    return false;
+                }
+                id = img::le64(data + 8);
+                done = img::le64(data + 16);
+                end = img::le64(data + 24);
+                return true;
+            }
+
+            bool save(const std::filesystem::path& path) const
+            {
+                BYTE data[32];
+                img::putLe32(data, _journalMagic);
+                img::putLe64(data + 8, id);
+                img::putLe64(data + 16, done);
+                img::putLe64(data + 24, end);
+                img::putLe32(data + 4, hash::crc32c(data + 8, 24));
+                // on disk before the batch it covers is written
+                return cache::saveAtomically(path, data, sizeof(data));
+            }
+        };
+
+        struct ApplyReport
+        {
+            uint64_t runs = 0;
+            uint64_t written = 0;
+            // already the new content
+            uint64_t skipped = 0;
+            uint64_t bytesWritten = 0;
+            // an interrupted apply was picked up
+            bool resumed = false;
+            double seconds = 0;
+        };
+
+        // patches a raw image or fixed VHD in place. throws, having written
+        // nothing, if the patch is damaged or the target is not its base
+        static ApplyReport apply(const std::filesystem::path& patchPath, const std::filesystem::path& targetPath,
+                                 const std::function<void(uint64_t, uint64_t)>& progress = nullptr,
+                                 uint64_t batchBytes = 64 * 1024 * 1024)
+        {
+            auto started = std::chrono::steady_clock::now();
+            ApplyReport report;
+            Header header;
+            // every run, expanded, and the trailer check out first
+            std::vector<uint32_t> lengths;
+            {
+                Reader reader(patchPath);
+                header = reader.header();
+                std::vector<BYTE> expanded(header.runLimit);
+                Run run;
+                while (reader.next(run))
+                {
+                    nv2::throw_if(!run.expand(expanded.data()), nv2::acc("Patch run at offset ") << run.offset << " does not expand");
+                    lengths.push_back(run.length);
+                }
+            }
+            report.runs = header.runs;
+
+            // only formats written in place. the extension decides what create() writes
+            img::Kind kind = img::Kind::Raw;
+            {
+                std::unique_ptr<blk::BlockSource> image = img::open(targetPath, &kind);
+                nv2::throw_if(!image, nv2::acc("Unable to open ") << targetPath.wstring());
+                nv2::throw_if((kind != img::Kind::Raw && kind != img::Kind::FixedVhd) || kind != img::kindFor(targetPath),
+                              nv2::acc("Only a raw image or fixed .vhd is patched in place, not a ") << img::kindName(kind));
+                // create() would round an odd size up to whole sectors
+                nv2::throw_if(image->size() != header.size || header.size % 512,
+                              nv2::acc("Patch is for ") << header.size << " bytes, not " << image->size());
+            }
+            std::unique_ptr<img::ImageWriter> target = img::create(targetPath, header.size, true);
+            nv2::throw_if(!target, nv2::acc("Unable to open ") << targetPath.wstring() << " for writing");
+
+            std::filesystem::path journalPath = Journal::pathFor(targetPath);
+            Journal journal;
+            if (journal.load(journalPath))
+            {
+                nv2::throw_if(journal.id != header.id, nv2::acc("A different patch was being applied to ") << targetPath.wstring());
+                report.resumed = true;
+            }
+
+            // every run is the old content or the new, or was being written
+            std::vector<bool> pending(header.runs, false);
+            std::vector<BYTE> current(header.runLimit);
+            {
+                Reader reader(patchPath);
+                Run run;
+                for (uint64_t i = 0; reader.next(run); i++)
+                {
+                    if (report.resumed && i >= journal.done && i < journal.end)
+                    {
+                        pending[i] = true;
+                        continue;
+                    }
+                    nv2::throw_if(!target->read(run.offset, current.data(), run.length),
+                                  nv2::acc("Unable to read ") << targetPath.wstring() << " at offset " << run.offset);
+                    uint64_t h = hash::xxh64(current.data(), run.length);
+                    if (h == run.newHash) {
+                        continue;
+                    }
+                    nv2::throw_if(h != run.oldHash || (report.resumed && i < journal.done),
+                                  nv2::acc("Target is not the patch's base image at offset ") << run.offset);
+                    pending[i] = true;
+                }
+            }
+
+            // batches: journal, write, flush
+            Reader reader(patchPath);
+            Run run;
+            uint64_t i = 0;
+            while (i < header.runs)
+            {
+                uint64_t end = i;
+                for (uint64_t bytes = 0; end < header.runs && bytes < batchBytes; end++) {
+                    bytes += lengths[end];
+                }
+                journal.id = header.id;
+                journal.done = i;
+                journal.end = end;
+                nv2::throw_if(!journal.save(journalPath), nv2::acc("Unable to write ") << journalPath.wstring());
+                uint64_t before = report.written;
+                for (; i < end; i++)
+                {
+                    reader.next(run);
+                    if (!pending[i])
+                    {
+                        report.skipped++;
+                        continue;
+                    }
+                    nv2::throw_if(!run.expand(current.data()), nv2::acc("Patch run at offset ") << run.offset << " does not expand");
+                    nv2::throw_if(!target->write(run.offset, current.data(), run.length),
+                                  nv2::acc("Unable to write ") << targetPath.wstring() << " at offset " << run.offset);
+                    report.written++;
+                    report.bytesWritten += run.length;
+                }
+                // a fixed VHD's footer is rewritten too, so only after writing
+                nv2::throw_if(report.written != before && !target->finish(), nv2::acc("Unable to flush ") << targetPath.wstring());
+                if (progress) {
+                    progress(i, header.runs);
+                }
+            }
+            std::error_code ec;
+            std::filesystem::remove(journalPath, ec);
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            return report;
+        }
+    }
+}
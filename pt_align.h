@@ -0,0 +1,613 @@
+/*
+
+    Partition realignment and sector size conversion for cloning.
+
+    RealignedSource presents a disk as it would look with every
+    partition starting on a 1MB boundary, with a different logical
+    sector size, or with a different size. Partition data is read from
+    its original offset; the MBR or GPT, and the boot sectors of NTFS
+    and FAT volumes, are rewritten to match. Cloning from the view
+    rather than the disk gives, for example, a 4K sector VHDX of a 512e
+    disk, or an image whose partitions no longer straddle 4K sectors
+    as an XP-era layout starting at sector 63 does on every I/O.
+
+    Partitions only ever move towards the end of the disk, and one that
+    is aligned already stays where it is unless the one before it has
+    grown into its place. With realignment the view is larger than the
+    disk by at most the alignment for each partition moved.
+
+    A new sector size changes the LBAs of the partition table and the
+    sector based fields of each boot sector. NTFS and FAT volumes whose
+    clusters are smaller than the new sector, or whose layout does not
+    fall on its boundaries, cannot be converted; nor can a partition
+    holding anything else.
+
+    Refused: MBR extended/logical partitions, LDM (dynamic) disks and
+    hybrid MBRs, and a GPT whose primary header is damaged.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "blk_io.h"
+#include "hash_ex.h"
+#include "img_write.h"
+#include "pt_raw.h"
+
+namespace wde2
+{
+    namespace pt
+    {
+        static const uint64_t _alignment = 1024 * 1024;
+        // MBR type of an LDM (dynamic) partition
+        static const BYTE _mbrLdm = 0x42;
+        static const BYTE _mbrProtective = 0xEE;
+
+        //-----------------------------------------------------------------------------
+        // MBR CHS as 255 heads x 63 sectors, or the 'too large' marker
+        static void putChs(BYTE* p, uint64_t lba)
+        {
+            uint64_t c = lba / (255 * 63);
+            if (c > 1023)
+            {
+                p[0] = 0xFE;
+                p[1] = 0xFF;
+                p[2] = 0xFF;
+                return;
+            }
+            p[0] = (BYTE)((lba / 63) % 255);
+            p[1] = (BYTE)(((lba % 63) + 1) | ((c >> 2) & 0xC0));
+            p[2] = (BYTE)c;
+        }
+
+        // BPB sectors per cluster. NTFS writes 2^n above 128 as 256 - n
+        static uint32_t decodeSpc(BYTE v)
+        {
+            return v <= 0x80 ? v : (v < 0xE0 ? 0 : 1u << (256 - v));
+        }
+
+        static BYTE encodeSpc(uint32_t spc)
+        {
+            if (spc <= 0x80) {
+                return (BYTE)spc;
+            }
+            unsigned n = 0;
+            while ((1u << n) < spc) {
+                n++;
+            }
+            return (BYTE)(256 - n);
+        }
+
+        // NTFS record and index block sizes at 0x40 and 0x44. clusters, or
+        // 2^-n bytes when negative
+        static uint64_t decodeNtfsSize(BYTE v, uint64_t cluster)
+        {
+            int8_t n = (int8_t)v;
+            return n < 0 ? (n < -31 ? 0 : 1ull << -n) : (uint64_t)n * cluster;
+        }
+
+        //-----------------------------------------------------------------------------
+        struct LayoutOptions
+        {
+            // partitions start on multiples of this. 0 moves them only as far
+            // as a new sector size requires
+            uint64_t alignment = _alignment;
+            // logical sector size of the view. 0 keeps the disk's
+            DWORD sectorSize = 0;
+            // of the view. 0 fits the disk
+            uint64_t size = 0;
+        };
+
+        //-----------------------------------------------------------------------------
+        class RealignedSource : public blk::BlockSource
+        {
+        public:
+            // one partition, in bytes
+            struct Move
+            {
+                uint32_t number = 0;
+                uint64_t from = 0;
+                uint64_t to = 0;
+                uint64_t length = 0;
+                // "NTFS", "FAT" or "FAT32" where a boot sector was found
+                const char* fileSystem = "";
+                // boot sectors rewritten, primary and backup
+                uint32_t bootSectors = 0;
+            };
+
+        private:
+            blk::BlockSource& m_source;
+            LayoutOptions m_options;
+            uint64_t m_size = 0;
+            // of the disk, of the view
+            DWORD m_diskSs = 512;
+            DWORD m_ss = 512;
+            bool m_gpt = false;
+            // [0, m_head) reads through unchanged: MBR boot code and what follows it
+            uint64_t m_head = 0;
+            std::vector<Move> m_moves;
+            // view offset => bytes replacing what would be read there
+            std::map<uint64_t, std::vector<BYTE>> m_patches;
+            std::string m_error;
+
+            bool readSectors(uint64_t offset, std::vector<BYTE>& out, size_t length)
+            {
+                out.assign((length + m_diskSs - 1) / m_diskSs * m_diskSs, 0);
+                return m_source.read(offset, out.data(), out.size());
+            }
+
+            static uint64_t roundUp(uint64_t v, uint64_t step) { return (v + step - 1) / step * step; }
+
+            bool fail(const std::string& why)
+            {
+                m_error = why;
+                return false;
+            }
+
+            std::string partitionName(const Move& m) const { return "partition " + std::to_string(m.number); }
+
+            // each partition at the next boundary at or after its own start,
+            // the end of the one before and 'first'
+            bool place(uint64_t first)
+            {
+                std::sort(m_moves.begin(), m_moves.end(), [](const Move& a, const Move& b) { return a.from < b.from; });
+                uint64_t step = (std::max)(m_options.alignment, (uint64_t)m_ss);
+                uint64_t end = first;
+                for (Move& m : m_moves)
+                {
+                    if (m.length % m_ss) {
+                        return fail(partitionName(m) + " is not a whole number of " + std::to_string(m_ss) + " byte sectors");
+                    }
+                    m.to = roundUp((std::max)(m.from, end), step);
+                    end = m.to + m.length;
+                }
+                return true;
+            }
+
+            // 'needed' bytes hold the partitions and anything after them
+            bool fit(uint64_t needed)
+            {
+                needed = roundUp(needed, (std::max)(m_options.alignment, (uint64_t)m_ss));
+                if (m_options.size == 0) {
+                    m_size = (std::max)(roundUp(m_source.size(), m_ss), needed);
+                }
+                else if (m_options.size % m_ss) {
+                    return fail("the size is not a whole number of sectors");
+                }
+                else if (m_options.size < needed) {
+                    return fail("the partitions need " + std::to_string(needed) + " bytes");
+                }
+                else {
+                    m_size = m_options.size;
+                }
+                return true;
+            }
+
+            uint64_t endOfMoves() const
+            {
+                uint64_t end = 0;
+                for (const Move& m : m_moves) {
+                    end = (std::max)(end, m.to + m.length);
+                }
+                return end;
+            }
+
+            // a sector based BPB field in the new sector size. false if it does not divide
+            bool convert(uint64_t sectors, uint32_t bps, uint64_t& out) const
+            {
+                uint64_t bytes = sectors * bps;
+                out = bytes / m_ss;
+                return bytes % m_ss == 0;
+            }
+
+            bool convertNtfs(Move& m, std::vector<BYTE>& boot, uint64_t& backup)
+            {
+                BYTE* b = boot.data();
+                uint32_t bps = le16(b + 0x0B);
+                uint64_t cluster = (uint64_t)bps * decodeSpc(b[0x0D]);
+                // the volume, then the backup boot sector in the sector after it
+                uint64_t total = le64(b + 0x28);
+                if (bps != m_ss)
+                {
+                    if (cluster < m_ss || cluster % m_ss) {
+                        return fail(partitionName(m) + ": NTFS clusters of " + std::to_string(cluster) + " bytes are smaller than a sector");
+                    }
+                    // file records and index blocks must still be at least a sector
+                    uint64_t record = decodeNtfsSize(b[0x40], cluster);
+                    uint64_t index = decodeNtfsSize(b[0x44], cluster);
+                    if (record < m_ss) {
+                        return fail(partitionName(m) + ": NTFS file records of " + std::to_string(record) + " bytes are smaller than a sector");
+                    }
+                    if (index < m_ss) {
+                        return fail(partitionName(m) + ": NTFS index blocks of " + std::to_string(index) + " bytes are smaller than a sector");
+                    }
+                    uint64_t volume = (total + 1) * bps / m_ss * m_ss;
+                    if (volume > m.length || (total * bps) / cluster != (volume - m_ss) / cluster) {
+                        return fail(partitionName(m) + ": the NTFS volume does not end on a sector boundary");
+                    }
+                    img::putLe16(b + 0x0B, (uint16_t)m_ss);
+                    b[0x0D] = encodeSpc((uint32_t)(cluster / m_ss));
+                    total = volume / m_ss - 1;
+                    img::putLe64(b + 0x28, total);
+                }
+                backup = total * m_ss;
+                return true;
+            }
+
+            bool convertFat(Move& m, std::vector<BYTE>& boot, bool fat32, uint64_t& backup)
+            {
+                BYTE* b = boot.data();
+                uint32_t bps = le16(b + 0x0B);
+                uint64_t cluster = (uint64_t)bps * b[0x0D];
+                uint64_t reserved = le16(b + 0x0E);
+                uint32_t fats = b[0x10];
+                uint64_t rootBytes = (uint64_t)le16(b + 0x11) * 32;
+                uint64_t total = le16(b + 0x13) ? le16(b + 0x13) : le32(b + 0x20);
+                uint64_t fatSize = le16(b + 0x16) ? le16(b + 0x16) : le32(b + 0x24);
+                uint64_t fsInfo = fat32 ? le16(b + 0x30) : 0;
+                backup = fat32 ? (uint64_t)le16(b + 0x32) * bps : 0;
+                if (bps == m_ss) {
+                    return true;
+                }
+                std::string name = partitionName(m) + ": ";
+                uint64_t reserved2 = 0, fatSize2 = 0;
+                if (cluster < m_ss || cluster % m_ss || cluster / m_ss > 128) {
+                    return fail(name + "FAT clusters of " + std::to_string(cluster) + " bytes are smaller than a sector");
+                }
+                if (!convert(reserved, bps, reserved2) || !convert(fatSize, bps, fatSize2) || rootBytes % m_ss) {
+                    return fail(name + "the FAT layout does not fall on sector boundaries");
+                }
+                uint64_t data = (reserved + fats * fatSize) * bps + rootBytes;
+                uint64_t total2 = total * bps / m_ss;
+                // the cluster count decides FAT12/16/32, so it must not change
+                if (total2 * m_ss < data || (total * bps - data) / cluster != (total2 * m_ss - data) / cluster) {
+                    return fail(name + "the FAT volume does not end on a sector boundary");
+                }
+                if (total2 > 0xFFFFFFFFull) {
+                    return fail(name + "the FAT volume is too large for the sector size");
+                }
+                img::putLe16(b + 0x0B, (uint16_t)m_ss);
+                b[0x0D] = (BYTE)(cluster / m_ss);
+                img::putLe16(b + 0x0E, (uint16_t)reserved2);
+                if (le16(b + 0x13) && total2 <= 0xFFFF) {
+                    img::putLe16(b + 0x13, (uint16_t)total2);
+                }
+                else
+                {
+                    img::putLe16(b + 0x13, 0);
+                    img::putLe32(b + 0x20, (uint32_t)total2);
+                }
+                if (!fat32)
+                {
+                    img::putLe16(b + 0x16, (uint16_t)fatSize2);
+                    return true;
+                }
+                img::putLe32(b + 0x24, (uint32_t)fatSize2);
+                // FSInfo and the backup boot sector usually sit at 512 byte sectors
+                // 1 and 6, which a larger sector cannot address. move them to
+                // sectors 1 and 2; UEFI reads no more than the BPB of either
+                uint64_t fsInfo2 = 0, backup2 = 0;
+                if (!convert(fsInfo, bps, fsInfo2) || !convert(backup / bps, bps, backup2))
+                {
+                    if (reserved2 < 2) {
+                        return fail(name + "no room for FSInfo in the FAT32 reserved area");
+                    }
+                    std::vector<BYTE> info;
+                    if (!readSectors(m.from + fsInfo * bps, info, bps)) {
+                        return fail(name + "unable to read FSInfo");
+                    }
+                    info.resize(m_ss, 0);
+                    fsInfo2 = 1;
+                    backup2 = (reserved2 >= 4) ? 2 : 0;
+                    m_patches[m.to + m_ss] = info;
+                    if (backup2) {
+                        m_patches[m.to + 3 * m_ss] = info;
+                    }
+                }
+                img::putLe16(b + 0x30, (uint16_t)fsInfo2);
+                img::putLe16(b + 0x32, (uint16_t)backup2);
+                backup = backup2 * m_ss;
+                return true;
+            }
+
+            // the first sector of the volume with HiddenSectors, and for a new
+            // sector size the geometry, rewritten. its backup follows suit
+            bool patchBoot(Move& m)
+            {
+                std::vector<BYTE> boot;
+                if (!readSectors(m.from, boot, (std::max)(m_ss, m_diskSs))) {
+                    return fail("unable to read " + partitionName(m));
+                }
+                boot.resize(m_ss);
+                const BYTE* b = boot.data();
+                uint32_t bps = le16(b + 0x0B);
+                bool ntfs = memcmp(b + 3, "NTFS    ", 8) == 0;
+                bool fat32 = !ntfs && memcmp(b + 0x52, "FAT32   ", 8) == 0;
+                bool fat = fat32 || (!ntfs && memcmp(b + 0x36, "FAT", 3) == 0);
+                bool valid = (ntfs || fat) && bps >= 512 && bps <= 4096 && (bps & (bps - 1)) == 0 && b[0x0D] != 0;
+                if (!valid)
+                {
+                    // nothing there, e.g. the Microsoft reserved partition, copies as is
+                    if (m_ss != m_diskSs && !img::isZero(b, m_ss)) {
+                        return fail(partitionName(m) + " holds a file system that cannot be converted");
+                    }
+                    return true;
+                }
+                m.fileSystem = ntfs ? "NTFS" : (fat32 ? "FAT32" : "FAT");
+                // the same disk, or a copy of the source backup that lies where it did
+                bool convert = bps != m_ss;
+                uint64_t backup = 0;
+                if (!(ntfs ? convertNtfs(m, boot, backup) : convertFat(m, boot, fat32, backup))) {
+                    return false;
+                }
+                if (m.to / m_ss <= 0xFFFFFFFFull) {
+                    img::putLe32(boot.data() + 0x1C, (uint32_t)(m.to / m_ss));
+                }
+                m_patches[m.to] = boot;
+                m.bootSectors++;
+                if (backup == 0 || backup + m_ss > m.length) {
+                    return true;
+                }
+                // an unchanged volume keeps its backup only where it had one
+                std::vector<BYTE> old;
+                if (convert || (readSectors(m.from + backup, old, m_ss) && memcmp(old.data() + 3, b + 3, 8) == 0))
+                {
+                    m_patches[m.to + backup] = boot;
+                    m.bootSectors++;
+                }
+                return true;
+            }
+
+            bool layoutMbr(std::vector<BYTE>& mbr)
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    const BYTE* e = mbr.data() + 446 + i * 16;
+                    if (e[4] == PARTITION_ENTRY_UNUSED || le32(e + 12) == 0) {
+                        continue;
+                    }
+                    if (isExtendedMbrType(e[4])) {
+                        return fail("extended partitions cannot be moved");
+                    }
+                    if (e[4] == _mbrLdm) {
+                        return fail("dynamic disks cannot be moved");
+                    }
+                    Move m;
+                    m.number = (uint32_t)i + 1;
+                    m.from = (uint64_t)le32(e + 8) * m_diskSs;
+                    m.length = (uint64_t)le32(e + 12) * m_diskSs;
+                    m_moves.push_back(m);
+                }
+                if (!place(m_ss) || !fit(endOfMoves())) {
+                    return false;
+                }
+                m_head = m_moves.empty() ? 0 : m_moves.front().from;
+                for (Move& m : m_moves)
+                {
+                    BYTE* e = mbr.data() + 446 + (m.number - 1) * 16;
+                    uint64_t lba = m.to / m_ss;
+                    if (lba + m.length / m_ss > 0xFFFFFFFFull) {
+                        return fail(partitionName(m) + " would lie beyond the reach of an MBR");
+                    }
+                    img::putLe32(e + 8, (uint32_t)lba);
+                    img::putLe32(e + 12, (uint32_t)(m.length / m_ss));
+                    putChs(e + 1, lba);
+                    putChs(e + 5, lba + m.length / m_ss - 1);
+                    if (!patchBoot(m)) {
+                        return false;
+                    }
+                }
+                mbr.resize(512);
+                m_patches[0] = mbr;
+                return true;
+            }
+
+            bool layoutGpt(std::vector<BYTE>& mbr)
+            {
+                std::vector<BYTE> header;
+                GptHeader h;
+                if (!readSectors(m_diskSs, header, m_diskSs) || !decodeGptHeader(header.data(), m_diskSs, 1, h)) {
+                    return fail("the primary GPT header is damaged");
+                }
+                std::vector<BYTE> entries;
+                if (!readSectors(h.entryLBA * m_diskSs, entries, (size_t)h.entryBytes())) {
+                    return fail("unable to read the GPT entries");
+                }
+                for (uint32_t i = 0; i < h.entryCount; i++)
+                {
+                    const BYTE* e = entries.data() + (size_t)i * h.entrySize;
+                    if (isNullGUID(guidFromBytes(e))) {
+                        continue;
+                    }
+                    Move m;
+                    m.number = i + 1;
+                    m.from = le64(e + 32) * m_diskSs;
+                    m.length = (le64(e + 40) - le64(e + 32) + 1) * m_diskSs;
+                    m_moves.push_back(m);
+                }
+                // the tables are rebuilt: header in LBA 1, entries from LBA 2,
+                // their backups at the end
+                uint64_t entrySectors = (h.entryBytes() + m_ss - 1) / m_ss;
+                uint64_t first = (std::max)(2 + entrySectors, (h.firstUsable * m_diskSs + m_ss - 1) / m_ss);
+                if (!place(first * m_ss) || !fit(endOfMoves() + (entrySectors + 1) * m_ss)) {
+                    return false;
+                }
+                uint64_t last = m_size / m_ss - 1;
+                for (Move& m : m_moves)
+                {
+                    BYTE* e = entries.data() + (size_t)(m.number - 1) * h.entrySize;
+                    img::putLe64(e + 32, m.to / m_ss);
+                    img::putLe64(e + 40, (m.to + m.length) / m_ss - 1);
+                    if (!patchBoot(m)) {
+                        return false;
+                    }
+                }
+                uint32_t entriesCrc = hash::crc32(entries.data(), (size_t)h.entryBytes());
+                entries.resize((size_t)(entrySectors * m_ss), 0);
+                uint32_t headerSize = le32(header.data() + 0x0C);
+                header.resize(m_ss, 0);
+                auto seal = [&](std::vector<BYTE>& p, uint64_t myLBA, uint64_t alternateLBA, uint64_t entryLBA) {
+                    img::putLe64(p.data() + 0x18, myLBA);
+                    img::putLe64(p.data() + 0x20, alternateLBA);
+                    img::putLe64(p.data() + 0x28, first);
+                    img::putLe64(p.data() + 0x30, last - entrySectors - 1);
+                    img::putLe64(p.data() + 0x48, entryLBA);
+                    img::putLe32(p.data() + 0x58, entriesCrc);
+                    img::putLe32(p.data() + 0x10, 0);
+                    img::putLe32(p.data() + 0x10, hash::crc32(p.data(), headerSize));
+                };
+                std::vector<BYTE> backup = header;
+                seal(header, 1, last, 2);
+                seal(backup, last, 1, last - entrySectors);
+                m_patches[m_ss] = header;
+                m_patches[2 * m_ss] = entries;
+                m_patches[(last - entrySectors) * m_ss] = entries;
+                m_patches[last * m_ss] = backup;
+                // the protective entry covers the whole disk, as far as it can
+                for (int i = 0; i < 4; i++)
+                {
+                    BYTE* e = mbr.data() + 446 + i * 16;
+                    if (e[4] == _mbrProtective) {
+                        img::putLe32(e + 12, (uint32_t)(std::min)(last, (uint64_t)0xFFFFFFFF));
+                    }
+                }
+                mbr.resize(m_ss, 0);
+                m_patches[0] = mbr;
+                return true;
+            }
+
+        public:
+            RealignedSource(blk::BlockSource& source, const LayoutOptions& options = LayoutOptions())
+                : m_source(source), m_options(options), m_diskSs((std::max)(source.sectorSize(), (DWORD)512))
+            {
+                m_ss = options.sectorSize ? options.sectorSize : m_diskSs;
+                std::vector<BYTE> mbr;
+                if (m_ss != 512 && m_ss != 4096) {
+                    fail("sectors must be 512 or 4096 bytes");
+                }
+                else if (!readSectors(0, mbr, m_diskSs) || le16(mbr.data() + 510) != 0xAA55) {
+                    fail("no partition table");
+                }
+                else
+                {
+                    int protective = 0, other = 0;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        BYTE t = mbr[446 + i * 16 + 4];
+                        protective += (t == _mbrProtective) ? 1 : 0;
+                        other += (t != _mbrProtective && t != PARTITION_ENTRY_UNUSED) ? 1 : 0;
+                    }
+                    m_gpt = protective != 0;
+                    if (protective && other) {
+                        fail("hybrid MBRs cannot be moved");
+                    }
+                    else if (m_gpt ? layoutGpt(mbr) : layoutMbr(mbr)) {
+                        return;
+                    }
+                }
+                m_moves.clear();
+                m_patches.clear();
+            }
+
+            explicit operator bool() const { return m_error.empty(); }
+            const std::string& error() const { return m_error; }
+            bool gpt() const { return m_gpt; }
+            const std::vector<Move>& moves() const { return m_moves; }
+            // true if nothing had to move
+            bool unchanged() const
+            {
+                for (const Move& m : m_moves)
+                {
+                    if (m.from != m.to) {
+                        return false;
+                    }
+                }
+                return m_ss == m_diskSs;
+            }
+
+            uint64_t size() const override { return m_size; }
+            DWORD sectorSize() const override { return m_ss; }
+
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                BYTE* p = (BYTE*)buffer;
+                memset(p, 0, length);
+                uint64_t end = offset + length;
+                // the part of [from, from + n) of the disk that lands at 'to'.
+                // the disk is read in whole sectors of its own
+                std::vector<BYTE> edge;
+                auto copy = [&](uint64_t from, uint64_t to, uint64_t n) {
+                    uint64_t a = (std::max)(offset, to);
+                    uint64_t b = (std::min)(end, to + n);
+                    if (a >= b) {
+                        return true;
+                    }
+                    uint64_t src = from + (a - to);
+                    if (src % m_diskSs == 0 && (b - a) % m_diskSs == 0) {
+                        return m_source.read(src, p + (a - offset), (size_t)(b - a));
+                    }
+                    uint64_t first = src / m_diskSs * m_diskSs;
+                    if (!readSectors(first, edge, (size_t)(src + (b - a) - first))) {
+                        return false;
+                    }
+                    memcpy(p + (a - offset), edge.data() + (src - first), (size_t)(b - a));
+                    return true;
+                };
+                if (!copy(0, 0, m_head)) {
+                    return false;
+                }
+                for (const Move& m : m_moves)
+                {
+                    if (!copy(m.from, m.to, m.length)) {
+                        return false;
+                    }
+                }
+                for (auto it = m_patches.begin(); it != m_patches.end() && it->first < end; ++it)
+                {
+                    uint64_t a = (std::max)(offset, it->first);
+                    uint64_t b = (std::min)(end, it->first + it->second.size());
+                    if (a < b) {
+                        memcpy(p + (a - offset), it->second.data() + (a - it->first), (size_t)(b - a));
+                    }
+                }
+                return true;
+            }
+        };
+    }
+}
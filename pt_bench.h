@@ -0,0 +1,252 @@
+/*
+
+    Partition table parser throughput benchmark.
+
+    Parses a set of images repeatedly through pt::parse() and
+    reports parses/second, bytes and I/Os per image. Images are
+    either files (raw or fixed VHD) or synthesized in memory: MBR
+    with long EBR chains and GPT with standard and oversized entry
+    arrays, so thousands of layouts cost only their metadata.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "blk_io.h"
+#include "hash_ex.h"
+#include "pt_raw.h"
+
+namespace wde2
+{
+    namespace pt
+    {
+        namespace bench
+        {
+            static inline void put16(BYTE* p, uint16_t v) { p[0] = (BYTE)v; p[1] = (BYTE)(v >> 8); }
+            static inline void put32(BYTE* p, uint32_t v) { put16(p, (uint16_t)v); put16(p + 2, (uint16_t)(v >> 16)); }
+            static inline void put64(BYTE* p, uint64_t v) { put32(p, (uint32_t)v); put32(p + 4, (uint32_t)(v >> 32)); }
+
+            static void putMbrEntry(BYTE* e, BYTE type, uint32_t startLBA, uint32_t sectors, bool boot = false)
+            {
+                e[0] = boot ? 0x80 : 0;
+                e[4] = type;
+                put32(e + 8, startLBA);
+                put32(e + 12, sectors);
+            }
+
+            //-----------------------------------------------------------------------------
+            // primary NTFS, then an extended container of 'logicals' x 1MB partitions
+            static void synthesizeMbr(blk::SparseSource& disk, std::mt19937_64& rng, uint32_t logicals)
+            {
+                DWORD bps = disk.sectorSize();
+                uint32_t step = (1024 * 1024) / bps;
+                std::vector<BYTE> sector(bps, 0);
+                put32(sector.data() + 440, (uint32_t)rng());
+                putMbrEntry(sector.data() + 446, PARTITION_IFS, step, step, true);
+                uint32_t base = 2 * step;
+                if (logicals) {
+                    putMbrEntry(sector.data() + 462, PARTITION_EXTENDED, base, (logicals + 1) * step);
+                }
+                sector[510] = 0x55;
+                sector[511] = 0xAA;
+                disk.write(0, sector.data(), bps);
+                for (uint32_t i = 0; i < logicals; i++)
+                {
+                    std::fill(sector.begin(), sector.end(), 0);
+                    uint32_t ebr = base + i * step;
+                    putMbrEntry(sector.data() + 446, PARTITION_IFS, 1, step - 1);
+                    if (i + 1 < logicals) {
+                        putMbrEntry(sector.data() + 462, PARTITION_EXTENDED, (i + 1) * step, step);
+                    }
+                    sector[510] = 0x55;
+                    sector[511] = 0xAA;
+                    disk.write((uint64_t)ebr * bps, sector.data(), bps);
+                }
+            }
+
+            //-----------------------------------------------------------------------------
+            // protective MBR, primary and backup GPT with 'entryCount' slots of which 'used' are in use
+            static void synthesizeGpt(blk::SparseSource& disk, std::mt19937_64& rng, uint32_t entryCount, uint32_t used)
+            {
+                DWORD bps = disk.sectorSize();
+                uint64_t lastLBA = disk.size() / bps - 1;
+                uint64_t entrySectors = ((uint64_t)entryCount * 128 + bps - 1) / bps;
+                std::vector<BYTE> entries((size_t)(entrySectors * bps), 0);
+                uint64_t firstUsable = 2 + entrySectors;
+                uint64_t lastUsable = lastLBA - 1 - entrySectors;
+                static const BYTE basicData[16] = { 0xA2, 0xA0, 0xD0, 0xEB, 0xE5, 0xB9, 0x33, 0x44,
+                                                    0x87, 0xC0, 0x68, 0xB6, 0xB7, 0x26, 0x99, 0xC7 };
+                uint64_t lba = 2048;
+                for (uint32_t i = 0; i < used && i < entryCount; i++)
+                {
+                    BYTE* e = entries.data() + (size_t)i * 128;
+                    memcpy(e, basicData, 16);
+                    put64(e + 16, rng());
+                    put64(e + 24, rng());
+                    put64(e + 32, lba);
+                    put64(e + 40, lba + 2047);
+                    const char* name = "data";
+                    for (int c = 0; name[c]; c++) {
+                        put16(e + 56 + c * 2, (uint16_t)name[c]);
+                    }
+                    lba += 2048;
+                }
+                uint32_t entriesCrc = hash::crc32(entries.data(), (size_t)entryCount * 128);
+
+                std::vector<BYTE> sector(bps, 0);
+                putMbrEntry(sector.data() + 446, PARTITION_GPT, 1, (uint32_t)(std::min)(lastLBA, (uint64_t)0xFFFFFFFF));
+                sector[510] = 0x55;
+                sector[511] = 0xAA;
+                disk.write(0, sector.data(), bps);
+
+                uint64_t diskGuid[2] = { rng(), rng() };
+                auto header = [&](uint64_t myLBA, uint64_t altLBA, uint64_t entryLBA) {
+                    std::fill(sector.begin(), sector.end(), 0);
+                    BYTE* h = sector.data();
+                    memcpy(h, "EFI PART", 8);
+                    put32(h + 0x08, 0x00010000);
+                    put32(h + 0x0C, 92);
+                    put64(h + 0x18, myLBA);
+                    put64(h + 0x20, altLBA);
+                    put64(h + 0x28, firstUsable);
+                    put64(h + 0x30, lastUsable);
+                    put64(h + 0x38, diskGuid[0]);
+                    put64(h + 0x40, diskGuid[1]);
+                    put64(h + 0x48, entryLBA);
+                    put32(h + 0x50, entryCount);
+                    put32(h + 0x54, 128);
+                    put32(h + 0x58, entriesCrc);
+                    put32(h + 0x10, hash::crc32(h, 92));
+                    disk.write(myLBA * bps, h, bps);
+                };
+                header(1, lastLBA, 2);
+                disk.write(2ull * bps, entries.data(), entries.size());
+                header(lastLBA, 1, lastLBA - entrySectors);
+                disk.write((lastLBA - entrySectors) * bps, entries.data(), entries.size());
+            }
+
+            //-----------------------------------------------------------------------------
+            // a mix close to a real fleet: mostly standard GPT, some MBR with
+            // logical drives, a few GPT with oversized entry arrays
+            static std::vector<std::unique_ptr<blk::BlockSource>> synthesize(size_t count, uint64_t seed = 40)
+            {
+                std::mt19937_64 rng(seed);
+                std::vector<std::unique_ptr<blk::BlockSource>> images;
+                images.reserve(count);
+                for (size_t i = 0; i < count; i++)
+                {
+                    DWORD bps = (i % 8 == 7) ? 4096 : 512;
+                    uint64_t size = (64ull << 30) + (rng() % 1024) * (1024 * 1024);
+                    std::unique_ptr<blk::SparseSource> disk(new blk::SparseSource(size, bps));
+                    switch (i % 4)
+                    {
+                    case 0:
+                        synthesizeMbr(*disk, rng, (uint32_t)(rng() % 64));
+                        break;
+                    case 3:
+                        synthesizeGpt(*disk, rng, 1024 + (uint32_t)(rng() % 4) * 1024, 1 + (uint32_t)(rng() % 256));
+                        break;
+                    default:
+                        synthesizeGpt(*disk, rng, 128, 1 + (uint32_t)(rng() % 16));
+                        break;
+                    }
+                    images.push_back(std::move(disk));
+                }
+                return images;
+            }
+
+            //-----------------------------------------------------------------------------
+            struct Result
+            {
+                uint64_t images = 0;
+                uint64_t parses = 0;
+                uint64_t failures = 0;
+                uint64_t reads = 0;
+                uint64_t bytes = 0;
+                uint64_t partitions = 0;
+                double seconds = 0;
+            };
+
+            // 'checkBackup' as per pt::parse()
+            static Result run(std::vector<std::unique_ptr<blk::BlockSource>>& images, int iterations, bool checkBackup = true)
+            {
+                Result result;
+                result.images = images.size();
+                wde2::DiskInfo di;
+                ParseReport report;
+                auto start = std::chrono::steady_clock::now();
+                for (int it = 0; it < iterations; it++)
+                {
+                    for (auto& image : images)
+                    {
+                        bool ok = parseAnySectorSize(*image, di, &report, checkBackup);
+                        result.reads += report.reads;
+                        result.bytes += report.bytesRead;
+                        result.parses++;
+                        result.partitions += di.partitions.size();
+                        if (!ok || di.DriveLayout.PartitionStyle == PARTITION_STYLE_RAW) {
+                            result.failures++;
+                        }
+                    }
+                }
+                result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                return result;
+            }
+
+            //-----------------------------------------------------------------------------
+            // files, or every regular file in a directory
+            static void addImages(const std::filesystem::path& path, std::vector<std::unique_ptr<blk::BlockSource>>& images)
+            {
+                std::error_code ec;
+                if (std::filesystem::is_directory(path, ec))
+                {
+                    for (auto& entry : std::filesystem::directory_iterator(path, ec))
+                    {
+                        if (entry.is_regular_file(ec)) {
+                            addImages(entry.path(), images);
+                        }
+                    }
+                    return;
+                }
+                std::unique_ptr<ImageSource> image(new ImageSource(path));
+                if (*image) {
+                    images.push_back(std::move(image));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,569 @@
+/*
+
+    Raw MBR/GPT decoding into the wde2 disk model.
+
+    Used where IOCTL_DISK_GET_DRIVE_LAYOUT_EX is not available,
+    i.e. on Linux or for an image file, by reading sectors from
+    a blk::BlockSource and decoding them directly.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+#include "structs.h"
+#include "blk_io.h"
+#include "hash_ex.h"
+
+namespace wde2
+{
+    namespace pt
+    {
+        // on-disk values are little endian
+        static inline uint16_t le16(const BYTE* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+        static inline uint32_t le32(const BYTE* p) { return (uint32_t)le16(p) | ((uint32_t)le16(p + 2) << 16); }
+        static inline uint64_t le64(const BYTE* p) { return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32); }
+
+        // GPT stores GUIDs in the same mixed endian form as the Win32 GUID struct
+        static GUID guidFromBytes(const BYTE* p)
+        {
+            GUID g{};
+            g.Data1 = le32(p);
+            g.Data2 = le16(p + 4);
+            g.Data3 = le16(p + 6);
+            memcpy(g.Data4, p + 8, 8);
+            return g;
+        }
+
+        // same form as StringFromGUID2(), i.e. {C8D15F5D-8396-4FEC-B60C-777074654498}
+        static std::string guidToString(const GUID& g)
+        {
+            char buffer[40];
+            snprintf(buffer, sizeof(buffer), "{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+                (unsigned)g.Data1, g.Data2, g.Data3,
+                g.Data4[0], g.Data4[1], g.Data4[2], g.Data4[3],
+                g.Data4[4], g.Data4[5], g.Data4[6], g.Data4[7]);
+            return buffer;
+        }
+
+        static bool isNullGUID(const GUID& g)
+        {
+            static const GUID z{};
+            return memcmp(&g, &z, sizeof(GUID)) == 0;
+        }
+
+        //-----------------------------------------------------------------------------
+        // MBR types Windows reports with RecognizedPartition == TRUE
+        static bool isRecognizedMbrType(BYTE t)
+        {
+            switch (t)
+            {
+            case PARTITION_FAT_12:
+            case PARTITION_FAT_16:
+            case PARTITION_HUGE:
+            case PARTITION_IFS:
+            case PARTITION_FAT32:
+            case PARTITION_FAT32_XINT13:
+            case PARTITION_XINT13:
+                return true;
+            }
+            return false;
+        }
+
+        static bool isExtendedMbrType(BYTE t)
+        {
+            return (t == PARTITION_EXTENDED || t == PARTITION_XINT13_EXTENDED);
+        }
+
+        //-----------------------------------------------------------------------------
+        // same algorithm disk.sys uses for DRIVE_LAYOUT_INFORMATION_MBR::CheckSum
+        static DWORD mbrCheckSum(const BYTE* sector0)
+        {
+            DWORD sum = 0;
+            for (int i = 0; i < 128; i++) {
+                sum += le32(sector0 + i * 4);
+            }
+            return (~sum) + 1;
+        }
+
+        //-----------------------------------------------------------------------------
+        // what parse() found besides the layout itself
+        struct ParseReport
+        {
+            // MBR holds a 0xEE entry
+            bool protectiveMbr = false;
+            // ... alongside other MBR entries
+            bool hybridMbr = false;
+            bool gptPrimaryValid = false;
+            bool gptBackupChecked = false;
+            bool gptBackupValid = false;
+            // primary damaged, layout decoded from the backup
+            bool usedBackup = false;
+            uint32_t ebrCount = 0;
+            // EBR chain stopped early: loop, out of range or unreadable
+            bool ebrChainTruncated = false;
+            uint32_t reads = 0;
+            uint64_t bytesRead = 0;
+            uint32_t readErrors = 0;
+        };
+
+        // chains longer than this are corrupt or hostile
+        static const uint32_t _maxEbrCount = 4096;
+        // 16MB of GPT entries, i.e. 131072 x 128 bytes
+        static const uint64_t _maxGptEntryBytes = 16 * 1024 * 1024;
+
+        //-----------------------------------------------------------------------------
+        // decoded and validated GPT header
+        struct GptHeader
+        {
+            uint64_t myLBA = 0;
+            uint64_t alternateLBA = 0;
+            uint64_t firstUsable = 0;
+            uint64_t lastUsable = 0;
+            GUID diskId{};
+            uint64_t entryLBA = 0;
+            uint32_t entryCount = 0;
+            uint32_t entrySize = 0;
+            uint32_t entriesCrc = 0;
+
+            uint64_t entryBytes() const { return (uint64_t)entryCount * entrySize; }
+        };
+
+        // signature, header CRC and the fields we rely on
+        static bool decodeGptHeader(const BYTE* p, DWORD bytesPerSector, uint64_t expectedLBA, GptHeader& h)
+        {
+            if (memcmp(p, "EFI PART", 8) != 0) {
+                return false;
+            }
+            uint32_t headerSize = le32(p + 0x0C);
+            if (headerSize < 92 || headerSize > bytesPerSector) {
+                return false;
+            }
+            // CRC is over the header with its own CRC field zeroed
+            BYTE copy[4096];
+            memcpy(copy, p, headerSize);
+            memset(copy + 0x10, 0, 4);
+            if (hash::crc32(copy, headerSize) != le32(p + 0x10)) {
+                return false;
+            }
+            h.myLBA = le64(p + 0x18);
+            h.alternateLBA = le64(p + 0x20);
+            h.firstUsable = le64(p + 0x28);
+            h.lastUsable = le64(p + 0x30);
+            h.diskId = guidFromBytes(p + 0x38);
+            h.entryLBA = le64(p + 0x48);
+            h.entryCount = le32(p + 0x50);
+            h.entrySize = le32(p + 0x54);
+            h.entriesCrc = le32(p + 0x58);
+            return h.myLBA == expectedLBA
+                && h.entrySize >= 128 && (h.entrySize % 8) == 0
+                && h.entryBytes() <= _maxGptEntryBytes
+                && h.lastUsable >= h.firstUsable;
+        }
+
+        //-----------------------------------------------------------------------------
+        // reads through the source, reusing the leading sectors read up front
+        class SectorReader
+        {
+            blk::BlockSource& m_source;
+            ParseReport& m_report;
+            std::vector<BYTE> m_head;
+
+        public:
+            DWORD bytesPerSector;
+            uint64_t sectorCount;
+
+            SectorReader(blk::BlockSource& source, DWORD bps, ParseReport& report)
+                : m_source(source), m_report(report),
+                  bytesPerSector(bps), sectorCount(source.size() / bps)
+            {
+            }
+
+            bool read(uint64_t offset, BYTE* buffer, size_t length)
+            {
+                m_report.reads++;
+                m_report.bytesRead += length;
+                if (!m_source.read(offset, buffer, length))
+                {
+                    m_report.readErrors++;
+                    return false;
+                }
+                return true;
+            }
+
+            // one I/O for LBA 0 .. 'sectors'
+            bool readHead(uint64_t sectors)
+            {
+                sectors = (std::min)(sectors, sectorCount);
+                m_head.assign((size_t)(sectors * bytesPerSector), 0);
+                return m_head.size() && read(0, m_head.data(), m_head.size());
+            }
+
+            const BYTE* head() const { return m_head.data(); }
+            uint64_t headBytes() const { return m_head.size(); }
+
+            // [offset, offset + length) into 'out', only reading what the head lacks
+            bool fetch(uint64_t offset, uint64_t length, std::vector<BYTE>& out)
+            {
+                if (offset + length > m_source.size()) {
+                    return false;
+                }
+                out.resize((size_t)length);
+                uint64_t have = 0;
+                if (offset < m_head.size())
+                {
+                    have = (std::min)(length, m_head.size() - offset);
+                    memcpy(out.data(), m_head.data() + offset, (size_t)have);
+                }
+                if (have == length) {
+                    return true;
+                }
+                // whole sectors, as devices require
+                uint64_t from = offset + have;
+                uint64_t alignedFrom = from - (from % bytesPerSector);
+                uint64_t to = offset + length;
+                uint64_t alignedTo = ((to + bytesPerSector - 1) / bytesPerSector) * bytesPerSector;
+                std::vector<BYTE> tmp((size_t)(alignedTo - alignedFrom));
+                if (!read(alignedFrom, tmp.data(), tmp.size())) {
+                    return false;
+                }
+                memcpy(out.data() + have, tmp.data() + (from - alignedFrom), (size_t)(to - from));
+                return true;
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        static void addMbrEntry(wde2::DiskInfo& di, DWORD key, const BYTE* e,
+                                uint64_t startLBA, DWORD bytesPerSector, DWORD& partitionNumber)
+        {
+            PARTITION_INFORMATION_EX piex;
+            memset(&piex, 0, sizeof(piex));
+            piex.PartitionStyle = PARTITION_STYLE_MBR;
+            piex.StartingOffset.QuadPart = (LONGLONG)(startLBA * bytesPerSector);
+            piex.PartitionLength.QuadPart = (LONGLONG)le32(e + 12) * bytesPerSector;
+            piex.Mbr.PartitionType = e[4];
+            piex.Mbr.BootIndicator = (e[0] == 0x80);
+            piex.Mbr.RecognizedPartition = isRecognizedMbrType(e[4]);
+            // relative to the table holding the entry, as per Windows
+            piex.Mbr.HiddenSectors = le32(e + 8);
+            // containers are not numbered, as per Windows
+            if (e[4] != PARTITION_ENTRY_UNUSED && !isExtendedMbrType(e[4])) {
+                piex.PartitionNumber = ++partitionNumber;
+            }
+            if (key == 0) {
+                di.DriveLayout.PartitionEntry[0] = piex;
+            }
+            if (piex.PartitionLength.QuadPart > 0)
+            {
+                wde2::PartitionInfo partitionInfo;
+                partitionInfo.piex = piex;
+                di.partitions[key] = partitionInfo;
+            }
+        }
+
+        // Windows reports 4 entries per table: the primaries, then for each
+        // EBR its logical partition and link, padded to 4
+        static void decodeMbr(SectorReader& reader, const BYTE* sector0, wde2::DiskInfo& di, ParseReport& report)
+        {
+            DWORD bps = reader.bytesPerSector;
+            di.DriveLayout.PartitionStyle = PARTITION_STYLE_MBR;
+            di.DriveLayout.Mbr.Signature = le32(sector0 + 440);
+            di.DriveLayout.Mbr.CheckSum = mbrCheckSum(sector0);
+            DWORD partitionNumber = 0;
+            uint64_t extendedBase = 0;
+            for (DWORD i = 0; i < 4; i++)
+            {
+                const BYTE* e = sector0 + 446 + i * 16;
+                addMbrEntry(di, i, e, le32(e + 8), bps, partitionNumber);
+                if (isExtendedMbrType(e[4]) && extendedBase == 0) {
+                    extendedBase = le32(e + 8);
+                }
+            }
+            DWORD key = 4;
+            uint64_t ebr = extendedBase;
+            std::vector<BYTE> sector;
+            std::set<uint64_t> visited;
+            while (ebr)
+            {
+                if (ebr >= reader.sectorCount || report.ebrCount >= _maxEbrCount || !visited.insert(ebr).second
+                    || !reader.fetch(ebr * bps, bps, sector)
+                    || sector[510] != 0x55 || sector[511] != 0xAA)
+                {
+                    report.ebrChainTruncated = true;
+                    break;
+                }
+                report.ebrCount++;
+                const BYTE* logical = sector.data() + 446;
+                const BYTE* link = logical + 16;
+                // logical start is relative to this EBR, the link to the container
+                addMbrEntry(di, key, logical, ebr + le32(logical + 8), bps, partitionNumber);
+                addMbrEntry(di, key + 1, link, extendedBase + le32(link + 8), bps, partitionNumber);
+                key += 4;
+                ebr = (isExtendedMbrType(link[4]) && le32(link + 8)) ? extendedBase + le32(link + 8) : 0;
+            }
+            di.DriveLayout.PartitionCount = key;
+        }
+
+        //-----------------------------------------------------------------------------
+        static bool loadGptEntries(SectorReader& reader, const GptHeader& h, std::vector<BYTE>& entries)
+        {
+            return reader.fetch(h.entryLBA * reader.bytesPerSector, h.entryBytes(), entries)
+                && hash::crc32(entries.data(), entries.size()) == h.entriesCrc;
+        }
+
+        static void decodeGpt(SectorReader& reader, bool checkBackup, wde2::DiskInfo& di, ParseReport& report)
+        {
+            DWORD bps = reader.bytesPerSector;
+            uint64_t lastLBA = reader.sectorCount - 1;
+            GptHeader primary;
+            std::vector<BYTE> entries;
+            bool primaryHeader = reader.headBytes() >= 2ull * bps
+                && decodeGptHeader(reader.head() + bps, bps, 1, primary);
+            report.gptPrimaryValid = primaryHeader && loadGptEntries(reader, primary, entries);
+
+            GptHeader backup;
+            if (!report.gptPrimaryValid || checkBackup)
+            {
+                report.gptBackupChecked = true;
+                uint64_t backupLBA = (primaryHeader && primary.alternateLBA <= lastLBA) ? primary.alternateLBA : lastLBA;
+                std::vector<BYTE> sector;
+                if (report.gptPrimaryValid)
+                {
+                    // header only. matching entry CRC means matching entries
+                    report.gptBackupValid = reader.fetch(backupLBA * bps, bps, sector)
+                        && decodeGptHeader(sector.data(), bps, backupLBA, backup)
+                        && backup.entriesCrc == primary.entriesCrc
+                        && backup.entryBytes() == primary.entryBytes();
+                }
+                else if (backupLBA > 1)
+                {
+                    // usual layout: entries directly below the header. one I/O for both
+                    uint64_t tail = (std::min)(backupLBA, (uint64_t)(1 + (16384 + bps - 1) / bps));
+                    std::vector<BYTE> region;
+                    if (reader.fetch((backupLBA - tail + 1) * bps, tail * bps, region)
+                        && decodeGptHeader(region.data() + (tail - 1) * bps, bps, backupLBA, backup))
+                    {
+                        uint64_t regionLBA = backupLBA - tail + 1;
+                        if (backup.entryLBA >= regionLBA
+                            && (backup.entryLBA - regionLBA) * bps + backup.entryBytes() <= region.size())
+                        {
+                            const BYTE* p = region.data() + (backup.entryLBA - regionLBA) * bps;
+                            entries.assign(p, p + backup.entryBytes());
+                            report.gptBackupValid = hash::crc32(entries.data(), entries.size()) == backup.entriesCrc;
+                        }
+                        else {
+                            report.gptBackupValid = loadGptEntries(reader, backup, entries);
+                        }
+                    }
+                }
+            }
+
+            if (!report.gptPrimaryValid && !report.gptBackupValid) {
+                // protective MBR but no usable GPT. report as RAW
+                return;
+            }
+            report.usedBackup = !report.gptPrimaryValid;
+            const GptHeader& h = report.gptPrimaryValid ? primary : backup;
+
+            di.DriveLayout.PartitionStyle = PARTITION_STYLE_GPT;
+            di.DriveLayout.Gpt.DiskId = h.diskId;
+            di.DriveLayout.Gpt.StartingUsableOffset.QuadPart = (LONGLONG)(h.firstUsable * bps);
+            di.DriveLayout.Gpt.UsableLength.QuadPart = (LONGLONG)((h.lastUsable - h.firstUsable + 1) * bps);
+            di.DriveLayout.Gpt.MaxPartitionCount = h.entryCount;
+
+            DWORD index = 0;
+            for (uint32_t i = 0; i < h.entryCount; i++)
+            {
+                const BYTE* e = entries.data() + (uint64_t)i * h.entrySize;
+                GUID type = guidFromBytes(e);
+                if (isNullGUID(type)) {
+                    continue;
+                }
+                uint64_t first = le64(e + 32);
+                uint64_t last = le64(e + 40);
+                if (last < first || last > lastLBA) {
+                    continue;
+                }
+                PARTITION_INFORMATION_EX piex;
+                memset(&piex, 0, sizeof(piex));
+                piex.PartitionStyle = PARTITION_STYLE_GPT;
+                piex.StartingOffset.QuadPart = (LONGLONG)(first * bps);
+                piex.PartitionLength.QuadPart = (LONGLONG)((last - first + 1) * bps);
+                piex.PartitionNumber = index + 1;
+                piex.Gpt.PartitionType = type;
+                piex.Gpt.PartitionId = guidFromBytes(e + 16);
+                piex.Gpt.Attributes = le64(e + 48);
+                // UTF-16LE, 36 code units
+                for (int c = 0; c < 36; c++) {
+                    piex.Gpt.Name[c] = (WCHAR)le16(e + 56 + c * 2);
+                }
+                if (index == 0) {
+                    di.DriveLayout.PartitionEntry[0] = piex;
+                }
+                wde2::PartitionInfo partitionInfo;
+                partitionInfo.piex = piex;
+                di.partitions[index] = partitionInfo;
+                index++;
+            }
+            di.DriveLayout.PartitionCount = index;
+        }
+
+        //-----------------------------------------------------------------------------
+        // Decode the partition table(s) of 'source' into the same model
+        // IOCTL_DISK_GET_DRIVE_LAYOUT_EX produces: protective/hybrid MBR,
+        // the EBR chain, GPT primary and backup with CRC checks, and any
+        // number of entries.
+        //
+        // I/O: one read for LBA 0 to the end of a standard GPT entry array,
+        // one more only if the entries go further, one sector for the backup
+        // header (checkBackup), and one sector per EBR outside the first read.
+        //
+        // Returns false if nothing could be decoded because reads failed.
+        static bool parse(blk::BlockSource& source, DWORD bytesPerSector,
+                          wde2::DiskInfo& di,
+                          ParseReport* report = nullptr,
+                          bool checkBackup = true)
+        {
+            ParseReport local;
+            ParseReport& r = report ? *report : local;
+            r = ParseReport();
+            memset(&di.DriveLayout, 0, sizeof(di.DriveLayout));
+            di.partitions.clear();
+            di.DriveLayout.PartitionStyle = PARTITION_STYLE_RAW;
+            if (bytesPerSector < 512 || bytesPerSector > 4096 || source.size() < bytesPerSector) {
+                return false;
+            }
+
+            SectorReader reader(source, bytesPerSector, r);
+            // MBR, GPT header and 128 x 128 byte entries
+            if (!reader.readHead(2 + (16384 + bytesPerSector - 1) / bytesPerSector)) {
+                return false;
+            }
+            const BYTE* sector0 = reader.head();
+            // no boot signature => RAW
+            if (sector0[510] != 0x55 || sector0[511] != 0xAA) {
+                return true;
+            }
+            int used = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                BYTE type = sector0[446 + i * 16 + 4];
+                if (type == PARTITION_GPT) {
+                    r.protectiveMbr = true;
+                }
+                else if (type != PARTITION_ENTRY_UNUSED) {
+                    used++;
+                }
+            }
+            r.hybridMbr = r.protectiveMbr && used > 0;
+            if (r.protectiveMbr) {
+                decodeGpt(reader, checkBackup, di, r);
+            }
+            else {
+                decodeMbr(reader, sector0, di, r);
+            }
+            return di.DriveLayout.PartitionStyle != PARTITION_STYLE_RAW || r.readErrors == 0;
+        }
+
+        //-----------------------------------------------------------------------------
+        // images do not say what sector size they were written with. try the
+        // source's own first, then the other one in use.
+        static bool parseAnySectorSize(blk::BlockSource& source, wde2::DiskInfo& di,
+                                       ParseReport* report = nullptr,
+                                       bool checkBackup = true)
+        {
+            DWORD first = source.sectorSize();
+            bool ok = false;
+            for (DWORD bps : { first, (first == 512) ? 4096u : 512u })
+            {
+                ok = parse(source, bps, di, report, checkBackup);
+                di.Geometry.BytesPerSector = bps;
+                if (ok && di.DriveLayout.PartitionStyle != PARTITION_STYLE_RAW) {
+                    return true;
+                }
+            }
+            // nothing decoded at either size
+            di.Geometry.BytesPerSector = first;
+            return ok;
+        }
+
+        //-----------------------------------------------------------------------------
+        // raw or fixed VHD image file. the fixed VHD footer is not disk data.
+        class ImageSource : public blk::BlockSource
+        {
+            blk::FileSource m_file;
+            uint64_t m_size = 0;
+
+        public:
+            explicit ImageSource(const std::filesystem::path& path) : m_file(path)
+            {
+                m_size = m_file.size();
+                BYTE footer[512];
+                if (m_size >= 1024 && m_file.read(m_size - 512, footer, sizeof(footer))
+                    && memcmp(footer, "conectix", 8) == 0) {
+                    m_size -= 512;
+                }
+            }
+            explicit operator bool() const { return (bool)m_file && m_size; }
+            uint64_t size() const override { return m_size; }
+            DWORD sectorSize() const override { return m_file.sectorSize(); }
+            bool read(uint64_t offset, void* buffer, size_t length) override
+            {
+                if (offset > m_size || length > m_size - offset) {
+                    return false;
+                }
+                return m_file.read(offset, buffer, length);
+            }
+        };
+
+        static bool readImage(const std::filesystem::path& path, wde2::DiskInfo& di, ParseReport* report = nullptr)
+        {
+            ImageSource source(path);
+            if (!source) {
+                return false;
+            }
+            di.DeviceName = path.wstring();
+            di.DevicePath = path.wstring();
+            di.DiskSize.QuadPart = (LONGLONG)source.size();
+            bool ok = parseAnySectorSize(source, di, report);
+            di.Geometry.MediaType = FixedMedia;
+            di.Geometry.TracksPerCylinder = 255;
+            di.Geometry.SectorsPerTrack = 63;
+            di.Geometry.Cylinders.QuadPart = (LONGLONG)(source.size() / (255ull * 63 * di.Geometry.BytesPerSector));
+            return ok;
+        }
+    }
+}
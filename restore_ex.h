@@ -0,0 +1,244 @@
+/*
+
+    Restore an image onto a disk or a raw image file.
+
+    The image is read on its own thread and written through an
+    AsyncTarget with several requests in flight. Blocks that are zero,
+    or unallocated in a dynamic VHD/VHDX, are not written: runs of them
+    are unmapped, TRIM on a disk and a punched hole in a file, and a
+    new file needs nothing at all. Where the target cannot unmap, the
+    zeros are written after all.
+
+    Compare mode reads each block of the target first and leaves it
+    alone if it already matches, which saves flash wear and write time
+    when restoring over an earlier copy of the same disk.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blk_aio.h"
+#include "blk_io.h"
+#include "clone_ex.h"
+#include "img_io.h"
+#include "img_write.h"
+#include "metrics_ex.h"
+#include "trace_ex.h"
+
+namespace wde2
+{
+    namespace restore
+    {
+        //-----------------------------------------------------------------------------
+        struct Options
+        {
+            // read the target first, write only blocks that differ
+            bool compare = false;
+            // unmap zero ranges rather than writing zeros
+            bool unmap = true;
+        };
+
+        struct Report
+        {
+            uint64_t size = 0;
+            uint64_t blocks = 0;
+            uint64_t bytesRead = 0;
+            uint64_t bytesWritten = 0;
+            // blocks compare mode found already in place
+            uint64_t identical = 0;
+            uint64_t bytesUnmapped = 0;
+            // zeros written where the target could not unmap
+            uint64_t bytesZeroed = 0;
+            double seconds = 0;
+        };
+
+        //-----------------------------------------------------------------------------
+        // 'target' open and at least as large as 'image'. throws on a read or
+        // write error; the target is then partly restored
+        static Report run(blk::BlockSource& image, blk::AsyncTarget& target, const Options& options = Options(),
+                          const std::function<void(uint64_t, uint64_t)>& progress = nullptr)
+        {
+            Report report;
+            report.size = image.size();
+            auto started = std::chrono::steady_clock::now();
+            size_t blockSize = target.blockSize();
+            nv2::throw_if(target.size() < report.size,
+                          nv2::acc("Target holds ") << target.size() << " bytes, the image " << report.size);
+            nv2::throw_if(target.isDevice() && target.sectorSize() != image.sectorSize(),
+                          nv2::acc("Target has ") << target.sectorSize() << " byte sectors, the image " << image.sectorSize());
+            nv2::throw_if(blockSize % target.sectorSize() != 0, nv2::acc("Block size is not a multiple of the sector size"));
+
+            struct Block
+            {
+                uint64_t offset = 0;
+                size_t length = 0;
+                bool zero = false;
+                std::vector<BYTE> data;
+            };
+            clone::BoundedQueue<Block> blocks(16);
+            std::string readError;
+            std::thread reader([&]() {
+                trace::nameThread("restore reader");
+                for (uint64_t offset = 0; offset < report.size; offset += blockSize)
+                {
+                    trace::Stage stage("read", "offset", offset);
+                    Block b;
+                    b.offset = offset;
+                    b.length = (size_t)(std::min)((uint64_t)blockSize, report.size - offset);
+                    if (img::allocated(image, offset, b.length))
+                    {
+                        b.data.resize(b.length);
+                        metrics::Timer timer(metrics::job().readLatency);
+                        if (!image.read(offset, b.data.data(), b.length))
+                        {
+                            readError = "Image read failed at " + std::to_string(offset);
+                            metrics::job().readErrors.add();
+                            break;
+                        }
+                        timer.end();
+                        report.bytesRead += b.length;
+                        metrics::job().bytesRead.add(b.length);
+                        b.zero = img::isZero(b.data.data(), b.length);
+                        if (b.zero) {
+                            b.data = std::vector<BYTE>();
+                        }
+                    }
+                    else {
+                        b.zero = true;
+                    }
+                    stage.end();
+                    if (!blocks.push(std::move(b))) {
+                        break;
+                    }
+                }
+                blocks.close();
+            });
+
+            blk::AlignedBuffer current(blockSize);
+            // zero blocks the target could not unmap, or may not read back as zero
+            auto writeZeros = [&](uint64_t start, uint64_t end, bool check) {
+                for (uint64_t offset = start; offset < end; offset += blockSize)
+                {
+                    size_t n = (size_t)(std::min)((uint64_t)blockSize, end - offset);
+                    if (check && target.read(offset, current.data(), n) && img::isZero(current.data(), n)) {
+                        continue;
+                    }
+                    blk::AsyncTarget::Slot& slot = target.next();
+                    memset(slot.buffer.data(), 0, n);
+                    target.submit(slot, offset, n);
+                    report.bytesZeroed += n;
+                    metrics::job().bytesWritten.add(n);
+                }
+            };
+            // a run of zero blocks
+            uint64_t zeroStart = 0, zeroEnd = 0;
+            // a new file reads as zero already
+            auto flushZeros = [&]() {
+                if (zeroEnd != zeroStart && !target.created())
+                {
+                    if (options.unmap && target.unmap(zeroStart, zeroEnd - zeroStart))
+                    {
+                        report.bytesUnmapped += zeroEnd - zeroStart;
+                        if (!target.unmapReadsZero()) {
+                            writeZeros(zeroStart, zeroEnd, true);
+                        }
+                    }
+                    else {
+                        writeZeros(zeroStart, zeroEnd, options.compare);
+                    }
+                }
+                zeroStart = zeroEnd;
+            };
+
+            Block b;
+            auto reported = started;
+            while (target.ok() && blocks.pop(b))
+            {
+                report.blocks++;
+                metrics::job().queueDepth.set((int64_t)blocks.size());
+                if (b.zero)
+                {
+                    metrics::job().zeroBlocks.add();
+                    if (b.offset != zeroEnd) {
+                        flushZeros();
+                        zeroStart = b.offset;
+                    }
+                    zeroEnd = b.offset + b.length;
+                }
+                else
+                {
+                    flushZeros();
+                    trace::Stage stage("write", "offset", b.offset);
+                    if (options.compare && target.read(b.offset, current.data(), b.length)
+                        && memcmp(current.data(), b.data.data(), b.length) == 0) {
+                        report.identical++;
+                        metrics::job().identicalBlocks.add();
+                    }
+                    else
+                    {
+                        // includes the wait for a free slot: the target's pace
+                        metrics::Timer timer(metrics::job().writeLatency);
+                        blk::AsyncTarget::Slot& slot = target.next();
+                        memcpy(slot.buffer.data(), b.data.data(), b.length);
+                        target.submit(slot, b.offset, b.length);
+                        timer.end();
+                        report.bytesWritten += b.length;
+                        metrics::job().bytesWritten.add(b.length);
+                    }
+                }
+                if (progress && std::chrono::steady_clock::now() - reported >= std::chrono::milliseconds(500))
+                {
+                    progress(b.offset + b.length, report.size);
+                    reported = std::chrono::steady_clock::now();
+                }
+            }
+            // stops the reader if a write failed
+            blocks.close();
+            reader.join();
+            nv2::throw_if(!readError.empty(), nv2::acc(readError.c_str()));
+            if (target.ok()) {
+                flushZeros();
+            }
+            nv2::throw_if(!target.flush(), nv2::acc("Target write failed"));
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            if (progress) {
+                progress(report.size, report.size);
+            }
+            return report;
+        }
+    }
+}
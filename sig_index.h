@@ -0,0 +1,526 @@
+/*
+
+    Fleet-wide disk identity collision index.
+
+    Ingests inventory exports (enumeration cache files written with
+    -ec) and raw/fixed VHD images from any number of machines into
+    an on-disk open addressing hash table keyed by
+
+        MBR disk signature
+        GPT disk GUID
+        GPT partition GUID
+
+    Every insert is O(1) amortized so ingesting N identities is
+    linear in N. A duplicate key is a collision and is recorded,
+    whether it comes from another source or the same disk. The allocator hands out signatures
+    and GUIDs not present in the index and reserves them.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "structs.h"
+#include "pt_raw.h"
+#include "enum_cache.h"
+
+namespace wde2
+{
+    namespace sig
+    {
+        //-----------------------------------------------------------------------------
+        enum KeyKind : uint8_t
+        {
+            kEmpty = 0,
+            kMbrSignature = 1,
+            kGptDiskId = 2,
+            kGptPartitionId = 3,
+        };
+
+        static const char* kindName(uint8_t kind)
+        {
+            switch (kind)
+            {
+            case kMbrSignature: return "MBR signature";
+            case kGptDiskId: return "GPT disk GUID";
+            case kGptPartitionId: return "GPT partition GUID";
+            }
+            return "?";
+        }
+
+        // 16 byte key. MBR signatures use the first 4 bytes
+        struct Key
+        {
+            uint8_t kind = kEmpty;
+            uint8_t id[16] = { 0 };
+
+            static Key fromSignature(DWORD signature)
+            {
+                Key k;
+                k.kind = kMbrSignature;
+                for (int i = 0; i < 4; i++) {
+                    k.id[i] = (uint8_t)(signature >> (i * 8));
+                }
+                return k;
+            }
+            static Key fromGUID(uint8_t kind, const GUID& g)
+            {
+                Key k;
+                k.kind = kind;
+                cache::ByteWriter w;
+                w.guid(g);
+                memcpy(k.id, w.buffer().data(), 16);
+                return k;
+            }
+            DWORD signature() const { return pt::le32(id); }
+            GUID guid() const { return pt::guidFromBytes(id); }
+            bool operator==(const Key& rhs) const { return kind == rhs.kind && memcmp(id, rhs.id, 16) == 0; }
+
+            std::string toString() const
+            {
+                if (kind == kMbrSignature)
+                {
+                    char buffer[16];
+                    snprintf(buffer, sizeof(buffer), "0x%08X", (unsigned)signature());
+                    return buffer;
+                }
+                return pt::guidToString(guid());
+            }
+        };
+
+        // splitmix64 finalizer over the key words
+        static uint64_t hashKey(const Key& k)
+        {
+            uint64_t a = 0, b = 0;
+            memcpy(&a, k.id, 8);
+            memcpy(&b, k.id + 8, 8);
+            uint64_t h = a ^ (b * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)k.kind << 56);
+            h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+            h ^= h >> 27; h *= 0x94d049bb133111ebull;
+            h ^= h >> 31;
+            return h;
+        }
+
+        //-----------------------------------------------------------------------------
+        // On disk:
+        //
+        //  header   64 bytes
+        //  slots    (1 << slotBits) * 32 bytes. { kind, pad[3], count, firstSource, pad, id[16] }
+        //  sources  u32 count, then { u32 length, UTF-8 bytes }
+        //  dups     u32 count, then { kind, id[16], u32 source }
+        class SigIndex
+        {
+            // 'WDSX'
+            static const uint32_t _magic = 0x58534457;
+            static const uint32_t _version = 1;
+            static const size_t _headerSize = 64;
+            static const size_t _slotSize = 32;
+
+            struct Slot
+            {
+                Key key;
+                uint32_t count = 0;
+                uint32_t firstSource = 0;
+            };
+
+            struct Dup
+            {
+                Key key;
+                uint32_t source = 0;
+            };
+
+            std::filesystem::path m_path;
+            uint32_t m_slotBits = 12;
+            uint32_t m_used = 0;
+            std::vector<Slot> m_slots;
+            std::vector<std::string> m_sources;
+            std::unordered_map<std::string, uint32_t> m_sourceIndex;
+            std::vector<Dup> m_dups;
+            std::mt19937_64 m_rng;
+
+            size_t mask() const { return ((size_t)1 << m_slotBits) - 1; }
+
+            // linear probing. returns the slot holding 'k' or the empty slot it would go in
+            size_t probe(const Key& k) const
+            {
+                size_t i = (size_t)hashKey(k) & mask();
+                while (m_slots[i].key.kind != kEmpty && !(m_slots[i].key == k)) {
+                    i = (i + 1) & mask();
+                }
+                return i;
+            }
+
+            void grow()
+            {
+                std::vector<Slot> old;
+                old.swap(m_slots);
+                m_slotBits++;
+                m_slots.assign((size_t)1 << m_slotBits, Slot());
+                for (auto& s : old)
+                {
+                    if (s.key.kind != kEmpty) {
+                        m_slots[probe(s.key)] = s;
+                    }
+                }
+            }
+
+            uint32_t addSource(const std::string& name)
+            {
+                auto it = m_sourceIndex.find(name);
+                if (it != m_sourceIndex.end()) {
+                    return it->second;
+                }
+                uint32_t id = (uint32_t)m_sources.size();
+                m_sources.push_back(name);
+                m_sourceIndex[name] = id;
+                return id;
+            }
+
+            static void writeKey(cache::ByteWriter& w, const Key& k)
+            {
+                w.u8(k.kind);
+                w.bytes(k.id, 16);
+            }
+
+            static Key readKey(cache::ByteReader& r)
+            {
+                Key k;
+                k.kind = r.u8();
+                r.bytes(k.id, 16);
+                return k;
+            }
+
+        public:
+
+            // collision found while inserting
+            struct Collision
+            {
+                Key key;
+                std::string first;
+                std::string other;
+            };
+
+            //-----------------------------------------------------------------------------
+            // empty path => in-memory only, i.e. for the local -cs check
+            explicit SigIndex(const std::filesystem::path& path = std::filesystem::path())
+                : m_path(path)
+            {
+                std::random_device rd;
+                m_rng.seed(((uint64_t)rd() << 32) ^ rd() ^
+                    (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count());
+                m_slots.assign((size_t)1 << m_slotBits, Slot());
+                if (!m_path.empty() && std::filesystem::exists(m_path)) {
+                    nv2::throw_if(!load(), nv2::acc("Invalid signature index: ") << m_path.wstring());
+                }
+            }
+
+            size_t size() const { return m_used; }
+            size_t sourceCount() const { return m_sources.size(); }
+            bool hasSource(const std::string& name) const { return m_sourceIndex.count(name) != 0; }
+
+            //-----------------------------------------------------------------------------
+            // returns true if the key was already present. two partitions of one
+            // disk with the same GUID are as much a collision as two disks
+            bool insert(const Key& k, const std::string& source, Collision* pc = nullptr)
+            {
+                if ((m_used + 1) * 10 > m_slots.size() * 7) {
+                    grow();
+                }
+                uint32_t src = addSource(source);
+                size_t i = probe(k);
+                Slot& s = m_slots[i];
+                if (s.key.kind == kEmpty)
+                {
+                    s.key = k;
+                    s.count = 1;
+                    s.firstSource = src;
+                    m_used++;
+                    return false;
+                }
+                s.count++;
+                Dup d;
+                d.key = k;
+                d.source = src;
+                m_dups.push_back(d);
+                if (pc)
+                {
+                    pc->key = k;
+                    pc->first = m_sources[s.firstSource];
+                    pc->other = source;
+                }
+                return true;
+            }
+
+            bool contains(const Key& k) const
+            {
+                return m_slots[probe(k)].key.kind != kEmpty;
+            }
+
+            //-----------------------------------------------------------------------------
+            // every identity a disk exposes
+            static std::vector<Key> keysOf(const wde2::DiskInfo& di)
+            {
+                std::vector<Key> keys;
+                if (di.DriveLayout.PartitionStyle == PARTITION_STYLE_MBR)
+                {
+                    // zero means 'no signature'. Windows writes one on first online
+                    if (di.DriveLayout.Mbr.Signature) {
+                        keys.push_back(Key::fromSignature(di.DriveLayout.Mbr.Signature));
+                    }
+                }
+                else if (di.DriveLayout.PartitionStyle == PARTITION_STYLE_GPT)
+                {
+                    keys.push_back(Key::fromGUID(kGptDiskId, di.DriveLayout.Gpt.DiskId));
+                    for (auto& p : di.partitions) {
+                        keys.push_back(Key::fromGUID(kGptPartitionId, p.second.piex.Gpt.PartitionId));
+                    }
+                }
+                return keys;
+            }
+
+            std::vector<Collision> insertDisk(const wde2::DiskInfo& di, const std::string& source)
+            {
+                std::vector<Collision> ret;
+                for (const Key& k : keysOf(di))
+                {
+                    Collision c;
+                    if (insert(k, source, &c)) {
+                        ret.push_back(c);
+                    }
+                }
+                return ret;
+            }
+
+            //-----------------------------------------------------------------------------
+            // all recorded collisions
+            std::vector<Collision> collisions() const
+            {
+                std::vector<Collision> ret;
+                for (auto& d : m_dups)
+                {
+                    const Slot& s = m_slots[probe(d.key)];
+                    Collision c;
+                    c.key = d.key;
+                    c.first = m_sources[s.firstSource];
+                    c.other = m_sources[d.source];
+                    ret.push_back(c);
+                }
+                return ret;
+            }
+
+            //-----------------------------------------------------------------------------
+            // Allocate identities guaranteed unique against the index. Each one
+            // is reserved under 'owner' so the next allocation cannot return it.
+            DWORD allocateSignature(const std::string& owner)
+            {
+                for (;;)
+                {
+                    DWORD candidate = (DWORD)m_rng();
+                    Key k = Key::fromSignature(candidate);
+                    if (candidate && !contains(k))
+                    {
+                        insert(k, owner);
+                        return candidate;
+                    }
+                }
+            }
+
+            GUID allocateGUID(const std::string& owner, uint8_t kind = kGptPartitionId)
+            {
+                for (;;)
+                {
+                    uint8_t bytes[16];
+                    uint64_t a = m_rng(), b = m_rng();
+                    memcpy(bytes, &a, 8);
+                    memcpy(bytes + 8, &b, 8);
+                    // RFC 4122 version 4, variant 1
+                    bytes[7] = (uint8_t)((bytes[7] & 0x0F) | 0x40);
+                    bytes[8] = (uint8_t)((bytes[8] & 0x3F) | 0x80);
+                    GUID g = pt::guidFromBytes(bytes);
+                    // disk and partition GUIDs share a namespace as far as Windows cares
+                    Key kd = Key::fromGUID(kGptDiskId, g);
+                    Key kp = Key::fromGUID(kGptPartitionId, g);
+                    if (!contains(kd) && !contains(kp))
+                    {
+                        insert(kind == kGptDiskId ? kd : kp, owner);
+                        return g;
+                    }
+                }
+            }
+
+            // a slot table of 2^slotBits entries that the file holds in full
+            static bool tableFits(uint32_t slotBits, uint64_t fileSize)
+            {
+                return slotBits >= 4 && slotBits <= 31 && fileSize >= _headerSize + ((uint64_t)_slotSize << slotBits);
+            }
+
+            //-----------------------------------------------------------------------------
+            bool load()
+            {
+                std::ifstream is(m_path, std::ios::binary);
+                if (!is) {
+                    return false;
+                }
+                std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+                cache::ByteReader r(data.data(), data.size());
+                if (r.u32() != _magic || r.u32() != _version) {
+                    return false;
+                }
+                m_slotBits = r.u32();
+                uint32_t used = r.u32();
+                if (!tableFits(m_slotBits, data.size()) || used >= ((size_t)1 << m_slotBits)) {
+                    return false;
+                }
+                r = cache::ByteReader(data.data() + _headerSize, data.size() - _headerSize);
+                m_slots.assign((size_t)1 << m_slotBits, Slot());
+                m_used = 0;
+                for (auto& s : m_slots)
+                {
+                    s.key.kind = r.u8();
+                    r.u8(); r.u8(); r.u8();
+                    s.count = r.u32();
+                    s.firstSource = r.u32();
+                    r.u32();
+                    r.bytes(s.key.id, 16);
+                    if (s.key.kind != kEmpty) {
+                        m_used++;
+                    }
+                }
+                uint32_t sources = r.u32();
+                m_sources.clear();
+                m_sourceIndex.clear();
+                for (uint32_t i = 0; i < sources && r.ok(); i++)
+                {
+                    uint32_t n = r.u32();
+                    if (n > data.size()) {
+                        return false;
+                    }
+                    std::string s(n, '\0');
+                    r.bytes(&s[0], n);
+                    addSource(s);
+                }
+                uint32_t dups = r.u32();
+                m_dups.clear();
+                for (uint32_t i = 0; i < dups && r.ok(); i++)
+                {
+                    Dup d;
+                    d.key = readKey(r);
+                    d.source = r.u32();
+                    if (d.source >= m_sources.size()) {
+                        return false;
+                    }
+                    m_dups.push_back(d);
+                }
+                // every source referenced must have been read
+                for (auto& s : m_slots)
+                {
+                    if (s.key.kind != kEmpty && s.firstSource >= m_sources.size()) {
+                        return false;
+                    }
+                }
+                return r.ok() && used == m_used;
+            }
+
+            bool save() const
+            {
+                if (m_path.empty()) {
+                    return true;
+                }
+                cache::ByteWriter w;
+                w.u32(_magic);
+                w.u32(_version);
+                w.u32(m_slotBits);
+                w.u32(m_used);
+                while (w.buffer().size() < _headerSize) {
+                    w.u8(0);
+                }
+                for (auto& s : m_slots)
+                {
+                    w.u8(s.key.kind);
+                    w.u8(0); w.u8(0); w.u8(0);
+                    w.u32(s.count);
+                    w.u32(s.firstSource);
+                    w.u32(0);
+                    w.bytes(s.key.id, 16);
+                }
+                w.u32((uint32_t)m_sources.size());
+                for (auto& s : m_sources)
+                {
+                    w.u32((uint32_t)s.size());
+                    w.bytes(s.data(), s.size());
+                }
+                w.u32((uint32_t)m_dups.size());
+                for (auto& d : m_dups)
+                {
+                    writeKey(w, d.key);
+                    w.u32(d.source);
+                }
+                return cache::saveAtomically(m_path, w.buffer());
+            }
+        };
+
+        //-----------------------------------------------------------------------------
+        // An export is either an enumeration cache (-ec) or a raw/fixed VHD
+        // disk image, decoded by pt::readImage().
+        static std::map<int, wde2::DiskInfo> readExport(const std::filesystem::path& path)
+        {
+            std::map<int, wde2::DiskInfo> vdi;
+            cache::CacheMap entries;
+            if (cache::load(path, entries))
+            {
+                for (auto& e : entries) {
+                    vdi[e.first] = e.second.diskInfo;
+                }
+                return vdi;
+            }
+            wde2::DiskInfo di;
+            nv2::throw_if(!pt::readImage(path, di), nv2::acc("Cannot read ") << path.wstring());
+            vdi[0] = di;
+            return vdi;
+        }
+
+        static std::string narrow(const std::wstring& s)
+        {
+            std::string ret;
+            for (wchar_t c : s) {
+                ret.push_back((c > 0 && c < 0x80) ? (char)c : '?');
+            }
+            return ret;
+        }
+    }
+}
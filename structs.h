@@ -32,6 +32,16 @@
 
 */
 
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+#ifndef _WIN32
+#include "lnx_compat.h"
+#endif
+
 namespace wde2
 {
 
@@ -47,6 +57,22 @@ namespace wde2
 		PARTITION_INFORMATION_EX piex;
 	};
 
+	// what a device says about itself. each query can fail on its own,
+	// i.e. behind a USB bridge, hence the 'has' flags
+	struct StorageClass
+	{
+		STORAGE_BUS_TYPE BusType{ BusTypeUnknown };
+		bool hasSeekPenalty{ false };
+		bool IncursSeekPenalty{ false };
+		bool hasTrim{ false };
+		bool TrimEnabled{ false };
+		// largest single unmap, Linux only. 0 => not known
+		uint64_t MaxUnmapBytes{ 0 };
+		// 0 => not known
+		DWORD BytesPerPhysicalSector{ 0 };
+		DWORD BytesOffsetForSectorAlignment{ 0 };
+	};
+
 	// disk contains 0+ partitions
 	struct DiskInfo
 	{
@@ -69,9 +95,28 @@ namespace wde2
 		DISK_GEOMETRY Geometry; // Standard disk geometry: may be faked by driver.
 		LARGE_INTEGER DiskSize; // Must always be correct
 		DRIVE_LAYOUT_INFORMATION_EX DriveLayout;
+		//
+		StorageClass Storage;
 		// partitions indexed by 1-relative key
 		std::map<DWORD,PartitionInfo> partitions;
 	};
 
+	// cheap per-device summary. if this is unchanged a cached DiskInfo is still good
+	struct ChangeToken
+	{
+		uint64_t DiskSize{ 0 };
+		// hash of the decoded layout (style, signature/GUID, entry offsets and types)
+		uint64_t LayoutHash{ 0 };
+		std::wstring SerialNumber;
+
+		bool operator==(const ChangeToken& rhs) const
+		{
+			return DiskSize == rhs.DiskSize
+				&& LayoutHash == rhs.LayoutHash
+				&& SerialNumber == rhs.SerialNumber;
+		}
+		bool operator!=(const ChangeToken& rhs) const { return !(*this == rhs); }
+	};
+
 }	// vde2
 
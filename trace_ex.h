@@ -0,0 +1,347 @@
+/*
+
+    Timeline tracing, written as Chrome trace-event JSON.
+
+    Off unless start() is called, and then a Span costs a clock read
+    at each end and an append to a buffer that belongs to the calling
+    thread. Phase spans, the VSS steps and enumeration IOCTLs, are
+    always kept. Pipeline spans, one per buffer read, hashed or
+    written, are sampled: when a thread's buffer reaches its limit
+    every other sampled span is dropped and the thread keeps one in
+    twice as many from then on, so a run of hours stays bounded and
+    still covers its whole length evenly.
+
+    stop() writes everything to a file that chrome://tracing and
+    https://ui.perfetto.dev open as they are.
+
+    Span names and categories must be string literals: only the
+    pointers are kept.
+
+    Visit https://github.com/g40
+
+    Copyright (c) Jerry Evans, 2026
+
+    All rights reserved.
+
+    The MIT License (MIT)
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace wde2
+{
+    namespace trace
+    {
+        //-----------------------------------------------------------------------------
+        // spans a thread keeps before it thins its sampled ones
+        static const size_t _perThread = 64 * 1024;
+
+        struct Event
+        {
+            const char* name = nullptr;
+            const char* category = nullptr;
+            // microseconds from start()
+            int64_t begin = 0;
+            int64_t duration = 0;
+            // an offset or byte count. shown when 'argName' is set
+            const char* argName = nullptr;
+            uint64_t arg = 0;
+            bool sampled = false;
+        };
+
+        //-----------------------------------------------------------------------------
+        class ThreadBuffer
+        {
+            std::mutex m_lock;
+            std::vector<Event> m_events;
+            // 1 in 'm_interval' sampled spans is kept
+            uint64_t m_interval = 1;
+            uint64_t m_seen = 0;
+            unsigned m_id = 0;
+            std::string m_name;
+
+        public:
+            explicit ThreadBuffer(unsigned id) : m_id(id) {}
+
+            unsigned id() const { return m_id; }
+
+            void name(const char* name)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_name = name;
+            }
+
+            // decided when the span starts, so a dropped one costs no clock read
+            bool keep()
+            {
+                return (m_seen++ % m_interval) == 0;
+            }
+
+            void add(const Event& e)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_events.size() >= _perThread)
+                {
+                    // halve the sampled spans, keep every phase span
+                    size_t n = 0;
+                    bool odd = false;
+                    for (const Event& x : m_events)
+                    {
+                        if (x.sampled && (odd = !odd) == false) {
+                            continue;
+                        }
+                        m_events[n++] = x;
+                    }
+                    m_events.resize(n);
+                    m_interval *= 2;
+                    // nothing left to thin: a runaway phase span
+                    if (m_events.size() >= _perThread) {
+                        return;
+                    }
+                }
+                m_events.push_back(e);
+            }
+
+            template <typename F>
+            void each(F&& f)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                for (const Event& e : m_events) {
+                    f(e);
+                }
+            }
+
+            std::string threadName()
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                return m_name;
+            }
+
+            uint64_t interval() const { return m_interval; }
+        };
+
+        //-----------------------------------------------------------------------------
+        class Tracer
+        {
+            std::mutex m_lock;
+            std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+            std::chrono::steady_clock::time_point m_start;
+            // bumped by start() so threads drop buffers from an earlier trace
+            std::atomic<uint64_t> m_generation{ 0 };
+
+        public:
+            std::atomic<bool> enabled{ false };
+
+            void start()
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_buffers.clear();
+                m_generation++;
+                m_start = std::chrono::steady_clock::now();
+                enabled.store(true, std::memory_order_release);
+            }
+
+            int64_t now() const
+            {
+                return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+            }
+
+            uint64_t generation() const
+            {
+                return m_generation.load(std::memory_order_relaxed);
+            }
+
+            std::shared_ptr<ThreadBuffer> attach(uint64_t& generation)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_buffers.push_back(std::make_shared<ThreadBuffer>((unsigned)m_buffers.size() + 1));
+                generation = m_generation;
+                return m_buffers.back();
+            }
+
+            std::vector<std::shared_ptr<ThreadBuffer>> buffers()
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                return m_buffers;
+            }
+        };
+
+        static Tracer& tracer()
+        {
+            static Tracer instance;
+            return instance;
+        }
+
+        static bool enabled()
+        {
+            return tracer().enabled.load(std::memory_order_relaxed);
+        }
+
+        static ThreadBuffer& buffer()
+        {
+            thread_local std::shared_ptr<ThreadBuffer> local;
+            thread_local uint64_t generation = 0;
+            if (!local || generation != tracer().generation()) {
+                local = tracer().attach(generation);
+            }
+            return *local;
+        }
+
+        // shown as the thread's name in the viewer
+        static void nameThread(const char* name)
+        {
+            if (enabled()) {
+                buffer().name(name);
+            }
+        }
+
+        //-----------------------------------------------------------------------------
+        // one span from construction to destruction
+        class Span
+        {
+            ThreadBuffer* m_buffer = nullptr;
+            Event m_event;
+
+        public:
+            Span(const char* name, const char* category, const char* argName = nullptr, uint64_t arg = 0, bool sampled = false)
+            {
+                if (!enabled()) {
+                    return;
+                }
+                ThreadBuffer& b = buffer();
+                if (sampled && !b.keep()) {
+                    return;
+                }
+                m_buffer = &b;
+                m_event.name = name;
+                m_event.category = category;
+                m_event.argName = argName;
+                m_event.arg = arg;
+                m_event.sampled = sampled;
+                m_event.begin = tracer().now();
+            }
+
+            ~Span()
+            {
+                end();
+            }
+
+            // before the end of the scope
+            void end()
+            {
+                if (m_buffer)
+                {
+                    m_event.duration = tracer().now() - m_event.begin;
+                    m_buffer->add(m_event);
+                    m_buffer = nullptr;
+                }
+            }
+
+            Span(const Span&) = delete;
+            Span& operator=(const Span&) = delete;
+        };
+
+        // a pipeline span: one per buffer, sampled
+        class Stage : public Span
+        {
+        public:
+            Stage(const char* name, const char* argName = nullptr, uint64_t arg = 0)
+                : Span(name, "pipeline", argName, arg, true) {}
+        };
+
+        //-----------------------------------------------------------------------------
+        static void start()
+        {
+            tracer().start();
+        }
+
+        static void escape(std::string& out, const std::string& s)
+        {
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\') {
+                    out += '\\';
+                }
+                if ((unsigned char)c < 0x20) {
+                    continue;
+                }
+                out += c;
+            }
+        }
+
+        // stop recording and return the trace as JSON. threads should have
+        // finished their spans; one still open is left out
+        static std::string stop()
+        {
+            tracer().enabled.store(false, std::memory_order_release);
+            std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            bool first = true;
+            char line[512];
+            auto put = [&](const std::string& s) {
+                out += first ? "" : ",\n";
+                out += s;
+                first = false;
+            };
+            for (auto& b : tracer().buffers())
+            {
+                std::string name = b->threadName();
+                if (name.empty()) {
+                    name = "thread " + std::to_string(b->id());
+                }
+                if (b->interval() > 1) {
+                    name += " (1 in " + std::to_string(b->interval()) + " sampled)";
+                }
+                std::string meta = "{\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(b->id()) + ",\"name\":\"thread_name\",\"args\":{\"name\":\"";
+                escape(meta, name);
+                put(meta + "\"}}");
+                b->each([&](const Event& e) {
+                    std::string s = "{\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(b->id()) + ",\"name\":\"";
+                    escape(s, e.name);
+                    s += "\",\"cat\":\"";
+                    escape(s, e.category);
+                    snprintf(line, sizeof(line), "\",\"ts\":%lld,\"dur\":%lld", (long long)e.begin, (long long)e.duration);
+                    s += line;
+                    if (e.argName)
+                    {
+                        s += ",\"args\":{\"";
+                        escape(s, e.argName);
+                        snprintf(line, sizeof(line), "\":%llu}", (unsigned long long)e.arg);
+                        s += line;
+                    }
+                    put(s + "}");
+                });
+            }
+            out += "\n]}\n";
+            return out;
+        }
+    }
+}
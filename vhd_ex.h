@@ -38,6 +38,8 @@
 #include <rpc.h>
 #include <sddl.h>
 
+#include <functional>
+
 // autolink
 #pragma comment( lib, "virtdisk.lib")
 #pragma comment( lib, "rpcrt4.lib")
@@ -72,7 +74,9 @@ namespace vhdc
         CloneVHDFromDisk(LPCWSTR DiskNumber,    // L"\\\\.\\PhysicalDrive6"
                          LPCWSTR VHDPath,      // L"u:\\test\\disk6.vhd"
                           DWORD* pdwError = nullptr,
-                          OVERLAPPED* pov = nullptr)  // handle must exist at start to monitor
+                          OVERLAPPED* pov = nullptr,  // handle must exist at start to monitor
+                          // called every ~500ms with (completed, total) when set
+                          const std::function<void(ULONGLONG, ULONGLONG)>& progress = nullptr)
     {
         GUID uniqueId{ 0 };
         if (RPC_S_OK != UuidCreate((UUID*)&uniqueId))
@@ -109,6 +113,13 @@ namespace vhdc
         SECURITY_DESCRIPTOR* lpsd = nullptr;
         // 
         HANDLE vhdHandle = INVALID_HANDLE_VALUE;
+        // progress needs an asynchronous create. use our own OVERLAPPED if none given
+        OVERLAPPED ov{ 0 };
+        if (progress && pov == nullptr)
+        {
+            ov.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+            pov = &ov;
+        }
         // slow if creating large disk
         DWORD opStatus = CreateVirtualDisk(
             &storageType,
@@ -121,6 +132,30 @@ namespace vhdc
             pov,            // must be shared too?
             &vhdHandle);
         //
+        if (opStatus == ERROR_IO_PENDING && progress && pov->hEvent)
+        {
+            VIRTUAL_DISK_PROGRESS vdp{ 0 };
+            for (;;)
+            {
+                DWORD wait = ::WaitForSingleObject(pov->hEvent, 500);
+                opStatus = GetVirtualDiskOperationProgress(vhdHandle, pov, &vdp);
+                if (opStatus != ERROR_SUCCESS) {
+                    break;
+                }
+                progress(vdp.CurrentValue, vdp.CompletionValue);
+                opStatus = vdp.OperationStatus;
+                if (wait == WAIT_OBJECT_0 || opStatus != ERROR_IO_PENDING) {
+                    break;
+                }
+            }
+            if (opStatus != ERROR_SUCCESS) {
+                ::SetLastError(opStatus);
+            }
+        }
+        if (ov.hEvent) {
+            ::CloseHandle(ov.hEvent);
+        }
+        //
         if (opStatus != ERROR_SUCCESS)
         {
             if (pdwError) {
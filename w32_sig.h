@@ -63,52 +63,18 @@ namespace wde2
             return 1;
         }
 
-        // Step 1: Retrieve the current drive layout using IOCTL_DISK_GET_DRIVE_LAYOUT_EX
+        // Step 1: Retrieve the current drive layout using IOCTL_DISK_GET_DRIVE_LAYOUT_EX.
+        // grown to fit, so MBR disks with long EBR chains are written back whole
         BOOL result = FALSE;
         DWORD bytesReturned = 0;
-    #if 0
-        // not working as expected.
-        // First call to get the required buffer size
-        result = DeviceIoControl(hDisk,
-            IOCTL_DISK_GET_DRIVE_LAYOUT_EX,
-            NULL,
-            0,
-            NULL,
-            0,
-            &bytesReturned,
-            NULL);
-        if (!result)
-        {
-            DWORD dwError = ::GetLastError();
-            std::string s = nv2::s_error(dwError);
-            DBMSG("Failed: " << s);
-        }
-    #endif
-        // Start with minimal buffer size
-        DWORD outBufferSize = sizeof(DRIVE_LAYOUT_INFORMATION_EX);
-        // GPT can hold up to 128 partitions
-        outBufferSize += (128*sizeof(PARTITION_INFORMATION_EX));
-        //
-        std::vector<byte> buffer(outBufferSize,0);
-        //
-        DRIVE_LAYOUT_INFORMATION_EX* driveLayoutEx = (DRIVE_LAYOUT_INFORMATION_EX*)&buffer[0];
-
-        // First call to get the required buffer size
-        result = DeviceIoControl(hDisk,
-            IOCTL_DISK_GET_DRIVE_LAYOUT_EX,
-            NULL,
-            0,
-            driveLayoutEx,
-            outBufferSize,
-            &bytesReturned,
-            NULL);
-
-        if (!result) {
-            // Some other error occurred
+        std::vector<BYTE> buffer;
+        if (!GetDriveLayoutEx(hDisk, buffer)) {
             printf("Failed to get drive layout. Error: %lu\n", GetLastError());
             CloseHandle(hDisk);
             return 1;
         }
+        DRIVE_LAYOUT_INFORMATION_EX* driveLayoutEx = (DRIVE_LAYOUT_INFORMATION_EX*)&buffer[0];
+        DWORD outBufferSize = (DWORD)buffer.size();
         // bail if signature == 0
         if (dwMBRSignature == 0) {
             return -1;
@@ -38,6 +38,13 @@
 #include <atlstr.h>
 // --std=c++17
 #include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+
+#include "blk_io.h"
+#include "fl_backup.h"
+#include "trace_ex.h"
 
 #pragma comment(lib, "vssapi.lib")
 
@@ -134,6 +141,7 @@ namespace vss
         void
             VerifyWriterStatus(CComPtr<IVssBackupComponents>& pBackupComponents)
         {
+            wde2::trace::Span span("VerifyWriterStatus", "vss");
             DBMSG("--------> VerifyWriterStatus()\n");
 
             // verify writer status
@@ -242,6 +250,18 @@ namespace vss
             uw32::throw_on_fail(LFL "::CopyFile failure", !ok);
         }
 
+        //-----------------------------------------------------------------------------
+        // every volume of the set and its shadow copy device, in the same order.
+        // one volume unless doSnapshotSet() was given more
+        virtual
+        void
+        doCopySet(const std::vector<std::wstring>& volumes,
+            const std::vector<std::wstring>& devices,
+            const std::wstring& opPath)
+        {
+            doCopy(devices[0], opPath);
+        }
+
 	public:
 		
         //-----------------------------------------------------------------------------
@@ -257,17 +277,25 @@ namespace vss
         // \\?\GLOBALROOT\Device\HarddiskVolumeShadowCopy130
 		void 
             doSnapshotCopy(const std::wstring& ipVolume,
-							const std::wstring& opPath) throw()
+							const std::wstring& opPath)
 		{
+            doSnapshotSet(std::vector<std::wstring>{ ipVolume }, opPath);
+        }
+
+        //-----------------------------------------------------------------------------
+        // one snapshot of several volumes at the same instant. with more than
+        // one, volumes VSS does not support are left out; none at all throws
+        void
+            doSnapshotSet(const std::vector<std::wstring>& ipVolumes,
+                            const std::wstring& opPath)
+        {
+            wde2::trace::Span snapshot("doSnapshotCopy", "vss");
             //
-            DBMSG("IP: " << ipVolume << " OP: " << opPath);
+            DBMSG("IP: " << ipVolumes.size() << " volumes OP: " << opPath);
 
             /// The backup components VSS object.
             CComPtr<IVssBackupComponents> pBackupComponents;
 
-            // \\?\GLOBALROOT\Device\HarddiskVolumeShadowCopy117
-            std::wstring snapshotDeviceObject;
-            
             // [1 Initialize COM
             vss::ComInit comInit;
 
@@ -277,12 +305,15 @@ namespace vss
             uw32::throw_on_fail(LFL "CreateVssBackupComponents", result != S_OK);
 
             // [3] InitializeForBackup
+            wde2::trace::Span initialize("InitializeForBackup", "vss");
             result = pBackupComponents->InitializeForBackup();
+            initialize.end();
             uw32::trace_hresult(LFL "COM error: ", result);
             uw32::throw_on_fail(LFL "InitializeForBackup", result != S_OK);
 
             // [4] gather writer metadata
             {
+                wde2::trace::Span span("GatherWriterMetadata", "vss");
                 CComPtr<IVssAsync> pVssAsync;
                 result = pBackupComponents->GatherWriterMetadata(&pVssAsync);
                 uw32::throw_on_fail(LFL "GatherWriterMetadata", result != S_OK);
@@ -301,19 +332,34 @@ namespace vss
             result = pBackupComponents->StartSnapshotSet(snapshotSetId);
             uw32::throw_on_fail(LFL "StartSnapshotSet", result != S_OK);
 
-            std::vector<byte> vSnapshotId(sizeof(VSS_ID),0);
-            VSS_ID* snapshotId = (VSS_ID*)&vSnapshotId[0];
+            std::vector<VSS_ID> snapshotIds;
+            std::vector<std::wstring> volumes;
 
+            for (const std::wstring& ipVolume : ipVolumes)
             {
                 // [7]
-                // add volumes to snapshot set AddToSnapshotSet -- we will only add the first drive spec -- all source files must be on the same volume
+                // add volumes to snapshot set AddToSnapshotSet. all source files of a copy must be on the same volume
                 LPWSTR lpwstr = (LPWSTR)ipVolume.c_str();
-                result = pBackupComponents->AddToSnapshotSet(lpwstr, GUID_NULL, snapshotId);
+                if (ipVolumes.size() > 1)
+                {
+                    // i.e. an EFI system partition
+                    BOOL supported = FALSE;
+                    if (pBackupComponents->IsVolumeSupported(GUID_NULL, lpwstr, &supported) != S_OK || !supported) {
+                        DBMSG("Not supported by VSS: " << ipVolume);
+                        continue;
+                    }
+                }
+                VSS_ID snapshotId = {};
+                result = pBackupComponents->AddToSnapshotSet(lpwstr, GUID_NULL, &snapshotId);
                 uw32::throw_on_fail(LFL "AddToSnapshotSet", result != S_OK);
+                snapshotIds.push_back(snapshotId);
+                volumes.push_back(ipVolume);
             }
+            uw32::throw_on_fail(LFL "No volume supports shadow copies", volumes.empty());
 
             // [8] notify writers of impending backup
             {
+                wde2::trace::Span span("PrepareForBackup", "vss");
                 // 
                 CComPtr<IVssAsync> pPrepareForBackupResults;
                 result = pBackupComponents->PrepareForBackup(&pPrepareForBackupResults);
@@ -331,6 +377,7 @@ namespace vss
             {
                 // request shadow copy
                 OutputDebugStringA(LFL "DoSnapshotSet()\n");
+                wde2::trace::Span span("DoSnapshotSet", "vss");
 
                 CComPtr<IVssAsync> pDoSnapshotSetResults;
                 result = pBackupComponents->DoSnapshotSet(&pDoSnapshotSetResults);
@@ -344,32 +391,38 @@ namespace vss
             VerifyWriterStatus(pBackupComponents);
 
             // [10]
+            // \\?\GLOBALROOT\Device\HarddiskVolumeShadowCopy117
+            std::vector<std::wstring> snapshotDeviceObjects;
             {
                 // GetSnapshotProperties to get device to copy from
-                VSS_SNAPSHOT_PROP snapshotProp{};
-                result = pBackupComponents->GetSnapshotProperties(*snapshotId, &snapshotProp);
-                uw32::throw_on_fail(LFL "GetSnapshotProperties", result != S_OK);
-
-                OutputDebugStringA(LFL "** Snapshot ID: ");
-                OutputDebugString(snapshotProp.m_pwszSnapshotDeviceObject);
-                OutputDebugStringA("\n");
-                
-                //
-                snapshotDeviceObject = snapshotProp.m_pwszSnapshotDeviceObject;
+                wde2::trace::Span span("GetSnapshotProperties", "vss");
+                for (const VSS_ID& snapshotId : snapshotIds)
+                {
+                    VSS_SNAPSHOT_PROP snapshotProp{};
+                    result = pBackupComponents->GetSnapshotProperties(snapshotId, &snapshotProp);
+                    uw32::throw_on_fail(LFL "GetSnapshotProperties", result != S_OK);
+
+                    OutputDebugStringA(LFL "** Snapshot ID: ");
+                    OutputDebugString(snapshotProp.m_pwszSnapshotDeviceObject);
+                    OutputDebugStringA("\n");
+
+                    //
+                    snapshotDeviceObjects.push_back(snapshotProp.m_pwszSnapshotDeviceObject);
+                    VssFreeSnapshotProperties(&snapshotProp);
+                }
 
                 // free writer metadata
                 result = pBackupComponents->FreeWriterMetadata();
                 uw32::throw_on_fail(LFL "FreeWriterMetadata", result != S_OK);
 
-                VssFreeSnapshotProperties(&snapshotProp);
-
                 OutputDebugStringA(LFL "GetSnapshotProperties OK\n");
             }
 
             // [11]
             {
                 // actually do the copy
-                doCopy(snapshotDeviceObject,opPath);
+                wde2::trace::Span span("copy", "vss");
+                doCopySet(volumes, snapshotDeviceObjects, opPath);
             }
 
             printf("Completed all copy operations successfully.\n\n");
@@ -378,6 +431,7 @@ namespace vss
             // [12]
             // set backup succeeded
             {
+                wde2::trace::Span span("BackupComplete", "vss");
                 CComPtr<IVssAsync> pBackupCompleteResults;
                 result = pBackupComponents->BackupComplete(&pBackupCompleteResults);
                 uw32::throw_on_fail(LFL "BackupComplete", result != S_OK);
@@ -392,4 +446,112 @@ namespace vss
             std::cout << "VSS copy completed" << std::endl;
 		}
 	};
+
+    //-------------------------------------------------------------------------
+    // file level backup of one directory of the snapshot. see fl_backup.h
+    class FileBackup : public VSSWrapper
+    {
+        std::wstring m_directory;
+        std::wstring m_manifest;
+        wde2::backup::Options m_options;
+
+        //-----------------------------------------------------------------------------
+        // per-file failures are collected in the report, the rest throws
+        void
+        doCopy(const std::wstring& ipVolume,
+            const std::wstring& opPath) override
+        {
+            std::wstring source = ipVolume;
+            if (source.back() != _T('\\'))
+                source += _T('\\');
+            source += m_directory;
+            DBMSG("IP: " << source << " OP: " << opPath);
+            wde2::backup::run(source, opPath, m_manifest, report, m_options);
+        }
+
+    public:
+
+        wde2::backup::Report report;
+
+        //-----------------------------------------------------------------------------
+        // directory is relative to the volume root, i.e. Users\jerry
+        FileBackup(const std::wstring& directory,
+            const std::wstring& manifest,
+            const wde2::backup::Options& options = wde2::backup::Options())
+            : m_manifest(manifest), m_options(options)
+        {
+            size_t p = directory.find_first_not_of(_T("\\/"));
+            // drop any drive prefix, the snapshot device replaces it
+            if (directory.size() >= 2 && directory[1] == _T(':'))
+                p = directory.find_first_not_of(_T("\\/"), 2);
+            m_directory = (p == std::wstring::npos) ? std::wstring() : directory.substr(p);
+        }
+    };
+
+    //-------------------------------------------------------------------------
+    // a whole disk as it was at one instant. each volume on it that VSS
+    // supports is read from its shadow copy; partition tables, gaps and
+    // other volumes are read from the disk itself. see clone::converge()
+    class DiskSnapshot : public VSSWrapper
+    {
+        wde2::blk::BlockSource& m_disk;
+        // volume => start and length on the disk
+        std::map<std::wstring, std::pair<uint64_t, uint64_t>> m_extents;
+        std::function<void(wde2::blk::BlockSource&)> m_pass;
+
+        //-----------------------------------------------------------------------------
+        // the pass runs while the snapshots are held
+        void
+        doCopySet(const std::vector<std::wstring>& volumes,
+            const std::vector<std::wstring>& devices,
+            const std::wstring& opPath) override
+        {
+            std::vector<std::unique_ptr<wde2::blk::FileSource>> shadows;
+            wde2::blk::OverlaySource view(m_disk);
+            for (size_t i = 0; i < volumes.size(); i++)
+            {
+                const std::pair<uint64_t, uint64_t>& extent = m_extents[volumes[i]];
+                shadows.emplace_back(new wde2::blk::FileSource(devices[i]));
+                nv2::throw_if(!*shadows.back(), nv2::acc("Unable to read ") << devices[i]);
+                // anything past the end of the shadow copy comes from the disk
+                nv2::throw_if(!view.add(extent.first, (std::min)(extent.second, shadows.back()->size()), *shadows.back()),
+                              nv2::acc("Volume outside the disk: ") << volumes[i]);
+                DBMSG("Snapshot: " << volumes[i] << " at " << extent.first << " => " << devices[i]);
+            }
+            m_pass(view);
+        }
+
+    public:
+
+        //-----------------------------------------------------------------------------
+        //
+        DiskSnapshot(wde2::blk::BlockSource& disk, const wde2::DiskInfo& info)
+            : m_disk(disk)
+        {
+            for (auto& p : info.partitions)
+            {
+                if (!p.second.volumeID.empty()) {
+                    m_extents[p.second.volumeID] = { (uint64_t)p.second.piex.StartingOffset.QuadPart,
+                                                     (uint64_t)p.second.piex.PartitionLength.QuadPart };
+                }
+            }
+        }
+
+        //-----------------------------------------------------------------------------
+        // false if the disk has no volumes to snapshot
+        bool
+        run(const std::function<void(wde2::blk::BlockSource&)>& pass)
+        {
+            std::vector<std::wstring> volumes;
+            for (auto& e : m_extents) {
+                volumes.push_back(e.first);
+            }
+            if (volumes.empty()) {
+                return false;
+            }
+            m_pass = pass;
+            doSnapshotSet(volumes, std::wstring());
+            return true;
+        }
+    };
 }
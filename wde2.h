@@ -113,6 +113,7 @@ This value can be set for basic and dynamic disks.
 
 #include <map>
 #include "structs.h"
+#include "trace_ex.h"
 
 namespace wde2
 {
@@ -200,6 +201,28 @@ namespace wde2
         return val;
     }
 
+    //----------------------------------------------------------------------------
+    // byte count with an optional K, M, G or T suffix, in powers of 1024
+    static uint64_t xstosize(const string_t& arg)
+    {
+        std::size_t pos = 0;
+        uint64_t val = std::stoull(arg, &pos, 10);
+        string_t suffix = arg.substr(pos);
+        if (suffix.empty()) {
+            return val;
+        }
+        string_t units = _T("KMGT");
+        std::size_t unit = units.find((char_t)std::toupper(suffix[0]));
+        if (unit == string_t::npos || suffix.size() > 2 || (suffix.size() == 2 && std::toupper(suffix[1]) != 'B')) {
+            throw std::invalid_argument("Expecting a size such as '500G'");
+        }
+        unsigned shift = 10 * (unsigned)(unit + 1);
+        if (val > (UINT64_MAX >> shift)) {
+            throw std::out_of_range("Size is too large");
+        }
+        return val << shift;
+    }
+
     //----------------------------------------------------------------------------
     // https://learn.microsoft.com/en-us/windows/win32/fileio/disk-partition-types
     static
@@ -295,6 +318,246 @@ namespace wde2
         return v;
     }
 
+    //-----------------------------------------------------------------------------
+    // IOCTL_DISK_GET_DRIVE_LAYOUT_EX into a buffer grown until the whole layout fits
+    static
+        bool GetDriveLayoutEx(HANDLE hDevice, std::vector<BYTE>& buffer)
+    {
+        // GPT default. enough for nearly everything first time round
+        DWORD entries = 128;
+        for (;;)
+        {
+            buffer.assign(sizeof(DRIVE_LAYOUT_INFORMATION_EX) + entries * sizeof(PARTITION_INFORMATION_EX), 0);
+            DWORD bytesReturned = 0;
+            wde2::trace::Span ioctl("IOCTL_DISK_GET_DRIVE_LAYOUT_EX", "ioctl", "entries", entries);
+            BOOL ok = DeviceIoControl(hDevice,
+                                IOCTL_DISK_GET_DRIVE_LAYOUT_EX,
+                                NULL, 0,
+                                buffer.data(), (DWORD)buffer.size(),
+                                &bytesReturned,
+                                NULL);
+            ioctl.end();
+            if (ok) {
+                return true;
+            }
+            DWORD dwError = ::GetLastError();
+            if ((dwError != ERROR_INSUFFICIENT_BUFFER && dwError != ERROR_MORE_DATA) || entries >= 0x10000) {
+                return false;
+            }
+            entries *= 2;
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+    // bus, seek penalty, TRIM and alignment of an open disk handle. a handle
+    // opened with no access is enough
+    static
+        void QueryStorageClass(HANDLE hDevice, wde2::StorageClass& storage)
+    {
+        storage = wde2::StorageClass();
+        auto query = [&](const char* name, STORAGE_PROPERTY_ID id, void* out, DWORD size) {
+            wde2::trace::Span ioctl(name, "ioctl");
+            STORAGE_PROPERTY_QUERY storagePropertyQuery;
+            ZeroMemory(&storagePropertyQuery, sizeof(STORAGE_PROPERTY_QUERY));
+            storagePropertyQuery.PropertyId = id;
+            storagePropertyQuery.QueryType = PropertyStandardQuery;
+            DWORD bytesReturned = 0;
+            return DeviceIoControl(hDevice, IOCTL_STORAGE_QUERY_PROPERTY,
+                                   &storagePropertyQuery, sizeof(storagePropertyQuery),
+                                   out, size, &bytesReturned, NULL) && bytesReturned >= size;
+        };
+        STORAGE_DEVICE_DESCRIPTOR device{ 0 };
+        if (query("StorageDeviceProperty", StorageDeviceProperty, &device, sizeof(device))) {
+            storage.BusType = device.BusType;
+        }
+        DEVICE_SEEK_PENALTY_DESCRIPTOR seek{ 0 };
+        if (query("StorageDeviceSeekPenaltyProperty", StorageDeviceSeekPenaltyProperty, &seek, sizeof(seek)))
+        {
+            storage.hasSeekPenalty = true;
+            storage.IncursSeekPenalty = seek.IncursSeekPenalty != FALSE;
+        }
+        DEVICE_TRIM_DESCRIPTOR trim{ 0 };
+        if (query("StorageDeviceTrimProperty", StorageDeviceTrimProperty, &trim, sizeof(trim)))
+        {
+            storage.hasTrim = true;
+            storage.TrimEnabled = trim.TrimEnabled != FALSE;
+        }
+        STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment{ 0 };
+        if (query("StorageAccessAlignmentProperty", StorageAccessAlignmentProperty, &alignment, sizeof(alignment)))
+        {
+            storage.BytesPerPhysicalSector = alignment.BytesPerPhysicalSector;
+            storage.BytesOffsetForSectorAlignment = alignment.BytesOffsetForSectorAlignment;
+        }
+        DBMSG2("BusType: " << storage.BusType << " seek penalty: " << storage.IncursSeekPenalty
+               << " TRIM: " << storage.TrimEnabled << " physical sector: " << storage.BytesPerPhysicalSector);
+    }
+
+    //-----------------------------------------------------------------------------
+    // query properties, geometry and layout of an open disk handle
+    static
+        void QueryDiskProperties(HANDLE hDevice, wde2::DiskInfo& diskInfo)
+    {
+        BOOL ok = FALSE;
+        DWORD bytesReturned = 0;
+        LPOVERLAPPED lpov = nullptr;
+        // may be a refresh of an existing entry
+        diskInfo.partitions.clear();
+
+        STORAGE_PROPERTY_QUERY storagePropertyQuery;
+        ZeroMemory(&storagePropertyQuery, sizeof(STORAGE_PROPERTY_QUERY));
+        storagePropertyQuery.PropertyId = StorageDeviceProperty;
+        storagePropertyQuery.QueryType = PropertyStandardQuery;
+
+        char propQueryOut[_8KB] = { 0 };
+        wde2::trace::Span ioctl("IOCTL_STORAGE_QUERY_PROPERTY", "ioctl");
+        ok = DeviceIoControl(hDevice, 
+                            IOCTL_STORAGE_QUERY_PROPERTY,
+                            &storagePropertyQuery, sizeof(storagePropertyQuery),
+                            &propQueryOut, sizeof(propQueryOut), 
+                            &bytesReturned, 
+                            lpov);
+        ioctl.end();
+
+        STORAGE_DEVICE_DESCRIPTOR* pDevDesc = (STORAGE_DEVICE_DESCRIPTOR*)&propQueryOut[0];
+        if (pDevDesc)
+        {   
+            DBMSG2("pDevDesc->RemovableMedia: " << (bool)pDevDesc->RemovableMedia);
+
+            // Vendor ID string
+            const char* p = &propQueryOut[pDevDesc->VendorIdOffset];
+            if (p && pDevDesc->VendorIdOffset)
+            {
+                // strcpy_s(rawDevEntry->DiskInfo.szVendorId, MAX_PATH, p);
+                DBMSG2("VendorId: " << p);
+                diskInfo.VendorId = nv2::n2w(p);
+            }
+            p = &propQueryOut[pDevDesc->ProductIdOffset];
+            if (p && pDevDesc->ProductIdOffset)
+            {
+                // strcpy_s(rawDevEntry->DiskInfo.szModelNumber, MAX_PATH, p);
+                DBMSG2("ProductId: " << p);
+                diskInfo.ProductId = nv2::n2w(p);
+            }
+            p = &propQueryOut[pDevDesc->ProductRevisionOffset];
+            if (p && pDevDesc->ProductRevisionOffset)
+            {
+                // strcpy_s(rawDevEntry->DiskInfo.szProductRevision, MAX_PATH, p);
+                DBMSG2("ProductRevision: " << p);
+                diskInfo.ProductRevision = nv2::n2w(p);
+            }
+            p = &propQueryOut[pDevDesc->SerialNumberOffset];
+            if (p && pDevDesc->SerialNumberOffset)
+            {
+                // strcpy_s(rawDevEntry->DiskInfo.szSerialNumber, MAX_PATH, p);
+                DBMSG2("SerialNumber: " << p);
+                diskInfo.SerialNumber = nv2::n2w(p);
+            }
+        }
+
+        char propQueryOut2[sizeof(DISK_GEOMETRY_EX)];
+        wde2::trace::Span geometry("IOCTL_DISK_GET_DRIVE_GEOMETRY_EX", "ioctl");
+        ok = DeviceIoControl(hDevice, 
+                            IOCTL_DISK_GET_DRIVE_GEOMETRY_EX,
+                            NULL, 0,
+                            &propQueryOut2, sizeof(DISK_GEOMETRY_EX), 
+                            &bytesReturned, 
+                            lpov);
+        geometry.end();
+
+        DISK_GEOMETRY_EX* geom = (PDISK_GEOMETRY_EX)&propQueryOut2[0];
+        DBMSG2("geom->Geometry.BytesPerSector: " << geom->Geometry.BytesPerSector);
+        diskInfo.Geometry = geom->Geometry;
+        diskInfo.DiskSize = geom->DiskSize;
+
+        QueryStorageClass(hDevice, diskInfo.Storage);
+
+        // memcpy(&(rawDevEntry->DiskInfo.diskGeometry), geom, sizeof(DISK_GEOMETRY_EX));
+        // DWORD BytesPerSector = rawDevEntry->DiskInfo.diskGeometry.Geometry.BytesPerSector;
+
+        // no fixed cap on the number of entries
+        std::vector<BYTE> layout;
+        if (!GetDriveLayoutEx(hDevice, layout)) {
+            DBMSG2("IOCTL_DISK_GET_DRIVE_LAYOUT_EX failed: " << ::GetLastError());
+        }
+
+        DRIVE_LAYOUT_INFORMATION_EX* pDriveLayout = (DRIVE_LAYOUT_INFORMATION_EX*)layout.data();
+        diskInfo.DriveLayout = *pDriveLayout;
+
+        if (pDriveLayout->PartitionStyle == PARTITION_STYLE_MBR)
+        {
+            DBMSG2("Mbr.CheckSum: " << nv2::to_hex(pDriveLayout->Mbr.CheckSum));
+            DBMSG2("Mbr.Signature (Disk ID): " << nv2::to_hex(pDriveLayout->Mbr.Signature));
+        }
+        else if (pDriveLayout->PartitionStyle == PARTITION_STYLE_GPT)
+        {
+            DBMSG2("Gpt.DiskId: " << pDriveLayout->Gpt.DiskId);
+        }
+
+        //
+        DWORD maxPart = pDriveLayout->PartitionCount;
+        DBMSG2("Disk has " << maxPart << " partitions");
+        if (1)
+        {
+            for (DWORD iPart = 0; iPart < maxPart; iPart++)
+            {
+                PARTITION_INFORMATION_EX piex = pDriveLayout->PartitionEntry[iPart];
+                if (piex.PartitionLength.QuadPart > 0)
+                {
+                    wde2::PartitionInfo partitionInfo;
+                    partitionInfo.piex = piex;
+                    DBMSG2("------");
+                    DBMSG2("\tpartInfoEx.PartitionNumber: " << piex.PartitionNumber);
+                    DBMSG2("\tpartInfoEx.PartitionStyle: " << pps[piex.PartitionStyle]);
+                    //DBMSG2("\tpartInfoEx.StartingOffset: " << partInfoEx.StartingOffset.QuadPart);
+                    //DBMSG2("\tpartInfoEx.PartitionLength: " << partInfoEx.PartitionLength.QuadPart);
+                    //DBMSG2("\tpartInfoEx.RewritePartition: " << partInfoEx.RewritePartition);
+                    GUID guidVolume = {};
+                    if (pDriveLayout->PartitionStyle == PARTITION_STYLE_MBR) {
+                        // the critical link ...
+                        guidVolume = piex.Mbr.PartitionId;
+                        DBMSG2("\tpartInfoEx.Mbr.PartitionId: " << piex.Mbr.PartitionId);
+                        DBMSG2("\tpartInfoEx.Mbr.BootIndicator: " << piex.Mbr.BootIndicator);
+                        DBMSG2("\tpartInfoEx.Mbr.PartitionType: " << piex.Mbr.PartitionType);
+                        DBMSG2("\tpartInfoEx.Mbr.PartitionType: " << partitionIDToString(piex.Mbr.PartitionType));
+                        DBMSG2("\tpartInfoEx.Mbr.RecognizedPartition: " << piex.Mbr.RecognizedPartition);
+                        DBMSG2("\tpartInfoEx.Mbr.HiddenSectors: " << piex.Mbr.HiddenSectors);
+                    }
+                    else if (pDriveLayout->PartitionStyle == PARTITION_STYLE_GPT) {
+                        // see [1]
+                        // std::map<std::string, string_t, pm::GUIDComparer>::iterator it = pm::mapper.find(partInfoEx.Gpt.PartitionId);
+                        guidVolume = piex.Gpt.PartitionId;
+                        DBMSG2("\tpartInfoEx.Gpt.PartitionId: " << piex.Gpt.PartitionId);
+
+                        DBMSG2("\tpartInfoEx.Gpt.PartitionType: " << piex.Gpt.PartitionType);
+                        DBMSG2("\tpartInfoEx.Gpt.PartitionType: " << w32::GUIDToPartitionTypeString(piex.Gpt.PartitionType));
+                        DBMSG2("\tpartInfoEx.Gpt.Attributes: " << piex.Gpt.Attributes);
+                        DBMSG2("\tpartInfoEx.Gpt.Name: " << piex.Gpt.Name);
+
+                        GUID guidPartitionId{};
+                        // BOOL bg = GUIDFromString(_T("{ebd0a0a2-b9e5-4433-87c0-68b6b72699c7}"),&guidPartitionId);
+                        //
+                    }
+
+                    DBMSG2("\tpartInfoEx.RewritePartition: " << piex.RewritePartition);
+                    DBMSG2("\tpartInfoEx.PartitionLength: " << piex.PartitionLength.QuadPart);
+                    DBMSG2("\tpartInfoEx.PartitionLength (MB): " << piex.PartitionLength.QuadPart / _1MB);
+                    DBMSG2("\tpartInfoEx.PartitionLength (GB): " << piex.PartitionLength.QuadPart / _1GB);
+                    DBMSG2("\tpartInfoEx.StartingOffset: " << piex.StartingOffset.QuadPart);
+                    DBMSG2("\tpartInfoEx.EndingOffset: " << piex.StartingOffset.QuadPart + piex.PartitionLength.QuadPart);
+
+                    //
+                    nv2::acc key;
+                    // essential! must have  trailing slash
+                    key << _T("\\\\?\\Volume") << guidVolume << _T("\\");
+                    partitionInfo.volumeID = key.wstr();
+                    std::vector<std::wstring> names = getDOSNamesFromVolumeGUID(guidVolume);
+
+                    diskInfo.partitions[iPart] = partitionInfo;
+                }
+            }
+        }
+    }
+
     //-----------------------------------------------------------------------------
     static 
         std::map<int, wde2::DiskInfo> BuildDeviceList(void)
@@ -309,6 +572,7 @@ namespace wde2
         // present in the system and have an enabled disk device
         // interface.
         //
+        wde2::trace::Span span("BuildDeviceList", "enumerate");
         GUID diskClassDeviceInterfaceGuid = GUID_DEVINTERFACE_DISK;
         HDEVINFO diskClassDevices = SetupDiGetClassDevs(&diskClassDeviceInterfaceGuid,
             NULL,
@@ -369,6 +633,7 @@ namespace wde2
 
             DWORD bytesReturned = 0;
             STORAGE_DEVICE_NUMBER StorageDeviceNumber{ 0 };
+            wde2::trace::Span ioctl("IOCTL_STORAGE_GET_DEVICE_NUMBER", "ioctl");
             ok = DeviceIoControl(hDevice,
                 IOCTL_STORAGE_GET_DEVICE_NUMBER,
                 NULL,
@@ -377,6 +642,7 @@ namespace wde2
                 sizeof(STORAGE_DEVICE_NUMBER),
                 &bytesReturned,
                 NULL);
+            ioctl.end();
             //
             nv2::throw_if(!ok,nv2::acc("DeviceIoControl:") << nv2::s_error(::GetLastError()));
             //
@@ -391,7 +657,6 @@ namespace wde2
                 diskInfo.StorageDeviceNumber = StorageDeviceNumber;
 
                     
-                LPOVERLAPPED lpov = nullptr;
                 // If we are here it means everything was ok with this drive => get info
                 // DBMSG2("diskNumber.DeviceNumber: " << diskNumber.DeviceNumber);
                 DBMSG2("Drive " << StorageDeviceNumber.DeviceNumber << ":" << deviceIndex);
@@ -411,155 +676,9 @@ namespace wde2
                 //DBMSG2("canBePartitioned: " << (diskNumber.PartitionNumber == 0));
 
 
-                STORAGE_PROPERTY_QUERY storagePropertyQuery;
-                ZeroMemory(&storagePropertyQuery, sizeof(STORAGE_PROPERTY_QUERY));
-                storagePropertyQuery.PropertyId = StorageDeviceProperty;
-                storagePropertyQuery.QueryType = PropertyStandardQuery;
-
-                char propQueryOut[_8KB] = { 0 };
-                ok = DeviceIoControl(hDevice, 
-                                    IOCTL_STORAGE_QUERY_PROPERTY,
-                                    &storagePropertyQuery, sizeof(storagePropertyQuery),
-                                    &propQueryOut, sizeof(propQueryOut), 
-                                    &bytesReturned, 
-                                    lpov);
-
-                STORAGE_DEVICE_DESCRIPTOR* pDevDesc = (STORAGE_DEVICE_DESCRIPTOR*)&propQueryOut[0];
-                if (pDevDesc)
-                {   
-                    DBMSG2("pDevDesc->RemovableMedia: " << (bool)pDevDesc->RemovableMedia);
-
-                    // Vendor ID string
-                    const char* p = &propQueryOut[pDevDesc->VendorIdOffset];
-                    if (p && pDevDesc->VendorIdOffset)
-                    {
-                        // strcpy_s(rawDevEntry->DiskInfo.szVendorId, MAX_PATH, p);
-                        DBMSG2("VendorId: " << p);
-                        diskInfo.VendorId = nv2::n2w(p);
-                    }
-                    p = &propQueryOut[pDevDesc->ProductIdOffset];
-                    if (p && pDevDesc->ProductIdOffset)
-                    {
-                        // strcpy_s(rawDevEntry->DiskInfo.szModelNumber, MAX_PATH, p);
-                        DBMSG2("ProductId: " << p);
-                        diskInfo.ProductId = nv2::n2w(p);
-                    }
-                    p = &propQueryOut[pDevDesc->ProductRevisionOffset];
-                    if (p && pDevDesc->ProductRevisionOffset)
-                    {
-                        // strcpy_s(rawDevEntry->DiskInfo.szProductRevision, MAX_PATH, p);
-                        DBMSG2("ProductRevision: " << p);
-                        diskInfo.ProductRevision = nv2::n2w(p);
-                    }
-                    p = &propQueryOut[pDevDesc->SerialNumberOffset];
-                    if (p && pDevDesc->SerialNumberOffset)
-                    {
-                        // strcpy_s(rawDevEntry->DiskInfo.szSerialNumber, MAX_PATH, p);
-                        DBMSG2("SerialNumber: " << p);
-                        diskInfo.SerialNumber = nv2::n2w(p);
-                    }
-                }
-
-                char propQueryOut2[sizeof(DISK_GEOMETRY_EX)];
-                ok = DeviceIoControl(hDevice, 
-                                    IOCTL_DISK_GET_DRIVE_GEOMETRY_EX,
-                                    NULL, 0,
-                                    &propQueryOut2, sizeof(DISK_GEOMETRY_EX), 
-                                    &bytesReturned, 
-                                    lpov);
-
-                DISK_GEOMETRY_EX* geom = (PDISK_GEOMETRY_EX)&propQueryOut2[0];
-                DBMSG2("geom->Geometry.BytesPerSector: " << geom->Geometry.BytesPerSector);
-                diskInfo.Geometry = geom->Geometry;
-                diskInfo.DiskSize = geom->DiskSize;
-
-                // memcpy(&(rawDevEntry->DiskInfo.diskGeometry), geom, sizeof(DISK_GEOMETRY_EX));
-                // DWORD BytesPerSector = rawDevEntry->DiskInfo.diskGeometry.Geometry.BytesPerSector;
-
-                char propQueryOut3[sizeof(DRIVE_LAYOUT_INFORMATION_EX) + (128 - 1) * sizeof(PARTITION_INFORMATION_EX)];
-                ok = DeviceIoControl(hDevice, 
-                                    IOCTL_DISK_GET_DRIVE_LAYOUT_EX,
-                                    NULL, 0, 
-                                    &propQueryOut3, sizeof(propQueryOut3), 
-                                    &bytesReturned, 
-                                    lpov);
-
-                DRIVE_LAYOUT_INFORMATION_EX* pDriveLayout = (DRIVE_LAYOUT_INFORMATION_EX*)&propQueryOut3[0];
-                diskInfo.DriveLayout = *pDriveLayout;
-
-                if (pDriveLayout->PartitionStyle == PARTITION_STYLE_MBR)
-                {
-                    DBMSG2("Mbr.CheckSum: " << nv2::to_hex(pDriveLayout->Mbr.CheckSum));
-                    DBMSG2("Mbr.Signature (Disk ID): " << nv2::to_hex(pDriveLayout->Mbr.Signature));
-                }
-                else if (pDriveLayout->PartitionStyle == PARTITION_STYLE_GPT)
-                {
-                    DBMSG2("Gpt.DiskId: " << pDriveLayout->Gpt.DiskId);
-                }
-
-                //
-                DWORD maxPart = min(pDriveLayout->PartitionCount, 128);
-                DBMSG2("Disk has " << maxPart << " partitions");
-                if (1)
-                {
-                    for (DWORD iPart = 0; iPart < maxPart; iPart++)
-                    {
-                        PARTITION_INFORMATION_EX piex = pDriveLayout->PartitionEntry[iPart];
-                        if (piex.PartitionLength.QuadPart > 0)
-                        {
-                            wde2::PartitionInfo partitionInfo;
-                            partitionInfo.piex = piex;
-                            DBMSG2("------");
-                            DBMSG2("\tpartInfoEx.PartitionNumber: " << piex.PartitionNumber);
-                            DBMSG2("\tpartInfoEx.PartitionStyle: " << pps[piex.PartitionStyle]);
-                            //DBMSG2("\tpartInfoEx.StartingOffset: " << partInfoEx.StartingOffset.QuadPart);
-                            //DBMSG2("\tpartInfoEx.PartitionLength: " << partInfoEx.PartitionLength.QuadPart);
-                            //DBMSG2("\tpartInfoEx.RewritePartition: " << partInfoEx.RewritePartition);
-                            GUID guidVolume = { 0 };
-                            if (pDriveLayout->PartitionStyle == PARTITION_STYLE_MBR) {
-                                // the critical link ...
-                                guidVolume = piex.Mbr.PartitionId;
-                                DBMSG2("\tpartInfoEx.Mbr.PartitionId: " << piex.Mbr.PartitionId);
-                                DBMSG2("\tpartInfoEx.Mbr.BootIndicator: " << piex.Mbr.BootIndicator);
-                                DBMSG2("\tpartInfoEx.Mbr.PartitionType: " << piex.Mbr.PartitionType);
-                                DBMSG2("\tpartInfoEx.Mbr.PartitionType: " << partitionIDToString(piex.Mbr.PartitionType));
-                                DBMSG2("\tpartInfoEx.Mbr.RecognizedPartition: " << piex.Mbr.RecognizedPartition);
-                                DBMSG2("\tpartInfoEx.Mbr.HiddenSectors: " << piex.Mbr.HiddenSectors);
-                            }
-                            else if (pDriveLayout->PartitionStyle == PARTITION_STYLE_GPT) {
-                                // see [1]
-                                // std::map<std::string, string_t, pm::GUIDComparer>::iterator it = pm::mapper.find(partInfoEx.Gpt.PartitionId);
-                                guidVolume = piex.Gpt.PartitionId;
-                                DBMSG2("\tpartInfoEx.Gpt.PartitionId: " << piex.Gpt.PartitionId);
-
-                                DBMSG2("\tpartInfoEx.Gpt.PartitionType: " << piex.Gpt.PartitionType);
-                                DBMSG2("\tpartInfoEx.Gpt.PartitionType: " << w32::GUIDToPartitionTypeString(piex.Gpt.PartitionType));
-                                DBMSG2("\tpartInfoEx.Gpt.Attributes: " << piex.Gpt.Attributes);
-                                DBMSG2("\tpartInfoEx.Gpt.Name: " << piex.Gpt.Name);
-
-                                GUID guidPartitionId{ 0 };
-                                // BOOL bg = GUIDFromString(_T("{ebd0a0a2-b9e5-4433-87c0-68b6b72699c7}"),&guidPartitionId);
-                                //
-                            }
-
-                            DBMSG2("\tpartInfoEx.RewritePartition: " << piex.RewritePartition);
-                            DBMSG2("\tpartInfoEx.PartitionLength: " << piex.PartitionLength.QuadPart);
-                            DBMSG2("\tpartInfoEx.PartitionLength (MB): " << piex.PartitionLength.QuadPart / _1MB);
-                            DBMSG2("\tpartInfoEx.PartitionLength (GB): " << piex.PartitionLength.QuadPart / _1GB);
-                            DBMSG2("\tpartInfoEx.StartingOffset: " << piex.StartingOffset.QuadPart);
-                            DBMSG2("\tpartInfoEx.EndingOffset: " << piex.StartingOffset.QuadPart + piex.PartitionLength.QuadPart);
-
-                            //
-                            nv2::acc key;
-                            // essential! must have  trailing slash
-                            key << _T("\\\\?\\Volume") << guidVolume << _T("\\");
-                            partitionInfo.volumeID = key.wstr();
-                            std::vector<std::wstring> names = getDOSNamesFromVolumeGUID(guidVolume);
-
-                            diskInfo.partitions[iPart] = partitionInfo;
-                        }
-                    }
-                }
+                wde2::trace::Span query("QueryDiskProperties", "enumerate", "disk", StorageDeviceNumber.DeviceNumber);
+                QueryDiskProperties(hDevice, diskInfo);
+                query.end();
 
                 // should have a verbose mode.
                 DBMSG2("diskInfo.StorageDeviceNumber.DeviceNumber " << diskInfo.StorageDeviceNumber.DeviceNumber << " => " << diskInfo.DevicePath << " (" << deviceIndex << ")");